@@ -55,11 +55,32 @@ Neon::Allocator::CreateBuffer(const vk::DeviceSize& size, const vk::BufferUsageF
 	return std::unique_ptr<BufferAllocation>(bufferAllocation);
 }
 
+std::unique_ptr<Neon::BufferAllocation>
+Neon::Allocator::CreateMappedBuffer(const vk::DeviceSize& size, const vk::BufferUsageFlags& usage,
+									const VmaMemoryUsage& memoryUsage)
+{
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = memoryUsage;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+	bufferInfo.size = size;
+	bufferInfo.usage = static_cast<VkBufferUsageFlags>(usage);
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	auto* bufferAllocation = new BufferAllocation();
+	VmaAllocationInfo allocationInfo{};
+	vmaCreateBuffer(s_Allocator.m_Allocator, &bufferInfo, &allocInfo, &bufferAllocation->m_Buffer,
+					&bufferAllocation->m_Allocation, &allocationInfo);
+	bufferAllocation->m_MappedData = allocationInfo.pMappedData;
+	assert(bufferAllocation->m_MappedData);
+	return std::unique_ptr<BufferAllocation>(bufferAllocation);
+}
+
 std::unique_ptr<Neon::ImageAllocation>
 Neon::Allocator::CreateImage(const uint32_t width, const uint32_t height,
 							 const vk::SampleCountFlagBits& sampleCount, const vk::Format& format,
 							 const vk::ImageTiling& tiling, const vk::ImageUsageFlags& usage,
-							 const VmaMemoryUsage& memoryUsage)
+							 const VmaMemoryUsage& memoryUsage, uint32_t mipLevels,
+							 uint32_t arrayLayers)
 {
 	VmaAllocationCreateInfo allocInfo = {};
 	allocInfo.usage = memoryUsage;
@@ -67,8 +88,8 @@ Neon::Allocator::CreateImage(const uint32_t width, const uint32_t height,
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
 	imageInfo.format = static_cast<VkFormat>(format);
 	imageInfo.extent = {width, height, 1};
-	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
+	imageInfo.mipLevels = mipLevels;
+	imageInfo.arrayLayers = arrayLayers;
 	imageInfo.samples = static_cast<VkSampleCountFlagBits>(sampleCount);
 	imageInfo.tiling = static_cast<VkImageTiling>(tiling);
 	imageInfo.usage = static_cast<VkImageUsageFlags>(usage);
@@ -82,9 +103,10 @@ Neon::Allocator::CreateImage(const uint32_t width, const uint32_t height,
 }
 
 void Neon::Allocator::TransitionImageLayout(vk::Image image, vk::ImageAspectFlagBits aspect,
-											vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
+											vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+											uint32_t levelCount, uint32_t layerCount)
 {
-	vk::ImageSubresourceRange imgSubresourceRange{aspect, 0, 1, 0, 1};
+	vk::ImageSubresourceRange imgSubresourceRange{aspect, 0, levelCount, 0, layerCount};
 	vk::ImageMemoryBarrier barrier{{},
 								   {},
 								   oldLayout,
@@ -273,11 +295,61 @@ Neon::Allocator::CreateHdrTextureImage(const std::string& filename)
 	return std::move(imageAllocation);
 }
 
+std::unique_ptr<Neon::ImageAllocation>
+Neon::Allocator::CreateFloatTextureImage(const std::vector<glm::vec4>& texels, uint32_t width,
+										 uint32_t height)
+{
+	assert(texels.size() == static_cast<size_t>(width) * height);
+	return CreateTextureImage(texels.data(), texels.size() * sizeof(glm::vec4), width, height,
+							  vk::Format::eR32G32B32A32Sfloat);
+}
+
+std::unique_ptr<Neon::ImageAllocation>
+Neon::Allocator::CreateTextureImage(const void* texels, vk::DeviceSize size, uint32_t width,
+									uint32_t height, vk::Format format)
+{
+	std::unique_ptr<BufferAllocation> stagingBufferAllocation =
+		CreateBuffer(size, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_TO_CPU);
+	void* mappedData;
+	vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation->m_Allocation, &mappedData);
+	memcpy(mappedData, texels, static_cast<size_t>(size));
+	vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation->m_Allocation);
+
+	std::unique_ptr<ImageAllocation> imageAllocation = CreateImage(
+		width, height, vk::SampleCountFlagBits::e1, format, vk::ImageTiling::eOptimal,
+		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	TransitionImageLayout(imageAllocation->m_Image, vk::ImageAspectFlagBits::eColor,
+						  vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+
+	vk::ImageSubresourceLayers imgSubresourceLayers{vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+	vk::BufferImageCopy region{
+		0, 0, 0, imgSubresourceLayers, {0, 0, 0}, vk::Extent3D{width, height, 1}};
+
+	auto commandBuffer = VulkanRenderer::BeginSingleTimeCommands();
+	commandBuffer.copyBufferToImage(stagingBufferAllocation->m_Buffer, imageAllocation->m_Image,
+									vk::ImageLayout::eTransferDstOptimal, {region});
+	VulkanRenderer::EndSingleTimeCommands(commandBuffer);
+
+	TransitionImageLayout(imageAllocation->m_Image, vk::ImageAspectFlagBits::eColor,
+						  vk::ImageLayout::eTransferDstOptimal,
+						  vk::ImageLayout::eShaderReadOnlyOptimal);
+
+	s_Allocator.m_StagingBuffers.push_back(std::move(stagingBufferAllocation));
+	return imageAllocation;
+}
+
 void Neon::Allocator::FreeMemory(VmaAllocation allocation)
 {
 	vmaFreeMemory(s_Allocator.m_Allocator, allocation);
 }
 
+void Neon::Allocator::InvalidateAllocation(VmaAllocation allocation)
+{
+	vmaInvalidateAllocation(s_Allocator.m_Allocator, allocation, 0, VK_WHOLE_SIZE);
+}
+
 void Neon::Allocator::DestroyImageAllocation(Neon::ImageAllocation& imageAllocation)
 {
 	s_Allocator.m_LogicalDevice.destroyImage(imageAllocation.m_Image);
@@ -14,6 +14,7 @@ struct BufferAllocation
 	~BufferAllocation();
 	VkBuffer m_Buffer{};
 	VmaAllocation m_Allocation{};
+	void* m_MappedData = nullptr;
 };
 struct ImageAllocation
 {
@@ -58,20 +59,32 @@ public:
 	static std::unique_ptr<BufferAllocation> CreateBuffer(const vk::DeviceSize& size,
 														  const vk::BufferUsageFlags& usage,
 														  const VmaMemoryUsage& memoryUsage);
+	static std::unique_ptr<BufferAllocation> CreateMappedBuffer(const vk::DeviceSize& size,
+																const vk::BufferUsageFlags& usage,
+																const VmaMemoryUsage& memoryUsage);
 
 	static std::unique_ptr<ImageAllocation>
 	CreateImage(uint32_t width, uint32_t height, const vk::SampleCountFlagBits& sampleCount,
 				const vk::Format& format, const vk::ImageTiling& tiling,
-				const vk::ImageUsageFlags& usage, const VmaMemoryUsage& memoryUsage);
+				const vk::ImageUsageFlags& usage, const VmaMemoryUsage& memoryUsage,
+				uint32_t mipLevels = 1, uint32_t arrayLayers = 1);
 
 	static void TransitionImageLayout(vk::Image image, vk::ImageAspectFlagBits aspect,
-									  vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+									  vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+									  uint32_t levelCount = 1, uint32_t layerCount = 1);
 
 	static std::unique_ptr<ImageAllocation> CreateTextureImage(const std::string& filename);
 	static std::unique_ptr<ImageAllocation> CreateTextureImage(stbi_uc* pixels, int texWidth,
 															   int texHeight);
 
 	static std::unique_ptr<ImageAllocation> CreateHdrTextureImage(const std::string& filename);
+	// RGBA32F image holding texels row after row, for data sampled with texelFetch
+	static std::unique_ptr<ImageAllocation>
+	CreateFloatTextureImage(const std::vector<glm::vec4>& texels, uint32_t width, uint32_t height);
+	// Single mip image of format holding size bytes of tightly packed texels row after row
+	static std::unique_ptr<ImageAllocation> CreateTextureImage(const void* texels,
+															   vk::DeviceSize size, uint32_t width,
+															   uint32_t height, vk::Format format);
 
 	template<typename T>
 	static void UpdateAllocation(const VmaAllocation& allocation, const T& data)
@@ -117,7 +130,30 @@ public:
 		return std::move(resultBufferAllocation);
 	}
 
+	// Copies data into a region of an existing device local buffer through a staging buffer
+	template<typename T>
+	static void UploadToBuffer(const vk::CommandBuffer& commandBuffer, const std::vector<T>& data,
+							   vk::Buffer buffer, vk::DeviceSize offset)
+	{
+		vk::DeviceSize dataSize = sizeof(T) * data.size();
+		if (dataSize == 0) { return; }
+
+		std::unique_ptr<BufferAllocation> stagingBufferAllocation = CreateBuffer(
+			dataSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+		void* mappedData;
+		vmaMapMemory(s_Allocator.m_Allocator, stagingBufferAllocation->m_Allocation, &mappedData);
+		memcpy(mappedData, data.data(), (size_t)dataSize);
+		vmaUnmapMemory(s_Allocator.m_Allocator, stagingBufferAllocation->m_Allocation);
+
+		vk::BufferCopy copyRegion{0, offset, dataSize};
+		commandBuffer.copyBuffer(stagingBufferAllocation->m_Buffer, buffer, 1, &copyRegion);
+		s_Allocator.m_StagingBuffers.push_back(std::move(stagingBufferAllocation));
+	}
+
 	static void FreeMemory(VmaAllocation allocation);
+	// Makes device writes to a mapped host visible allocation visible to the host
+	static void InvalidateAllocation(VmaAllocation allocation);
 	static void DestroyImageAllocation(ImageAllocation& imageAllocation);
 	static void DestroyBufferAllocation(BufferAllocation& bufferAllocation);
 	static void DestroyTextureImage(TextureImage& textureImage);
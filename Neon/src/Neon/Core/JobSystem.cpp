@@ -0,0 +1,109 @@
+#include "neopch.h"
+
+#include "JobSystem.h"
+
+Neon::JobSystem Neon::JobSystem::s_Instance;
+
+Neon::JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_JobCondition.notify_all();
+	for (auto& worker : m_Workers) { worker.join(); }
+}
+
+void Neon::JobSystem::Start()
+{
+	// The calling thread takes part in every loop
+	const uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	m_Workers.reserve(hardwareThreads - 1);
+	for (uint32_t i = 0; i + 1 < hardwareThreads; i++)
+	{ m_Workers.emplace_back(&JobSystem::WorkerLoop, this); }
+	m_Started = true;
+}
+
+void Neon::JobSystem::Run(uint32_t count, uint32_t batchSize, JobFunction function,
+						  const void* context)
+{
+	auto& instance = s_Instance;
+	if (!instance.m_Started) { instance.Start(); }
+
+	batchSize = std::max(batchSize, 1u);
+	const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount == 1 || instance.m_Workers.empty())
+	{
+		function(context, 0, count);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(instance.m_Mutex);
+		// Workers that picked up the previous job must be done reading its description
+		instance.m_DoneCondition.wait(lock, [&] { return instance.m_ActiveWorkers == 0; });
+		instance.m_Function = function;
+		instance.m_Context = context;
+		instance.m_Count = count;
+		instance.m_BatchSize = batchSize;
+		instance.m_BatchCount = batchCount;
+		instance.m_NextBatch = 0;
+		instance.m_CompletedBatches = 0;
+		instance.m_Generation++;
+	}
+	instance.m_JobCondition.notify_all();
+
+	instance.ExecuteBatches(function, context, count, batchSize, batchCount);
+
+	std::unique_lock<std::mutex> lock(instance.m_Mutex);
+	instance.m_DoneCondition.wait(
+		lock, [&] { return instance.m_CompletedBatches.load() == batchCount; });
+}
+
+void Neon::JobSystem::WorkerLoop()
+{
+	uint64_t generation = 0;
+	while (true)
+	{
+		JobFunction function;
+		const void* context;
+		uint32_t count, batchSize, batchCount;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobCondition.wait(lock, [&] { return m_Stop || m_Generation != generation; });
+			if (m_Stop) { return; }
+			generation = m_Generation;
+			function = m_Function;
+			context = m_Context;
+			count = m_Count;
+			batchSize = m_BatchSize;
+			batchCount = m_BatchCount;
+			m_ActiveWorkers++;
+		}
+
+		ExecuteBatches(function, context, count, batchSize, batchCount);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_ActiveWorkers--;
+		}
+		m_DoneCondition.notify_all();
+	}
+}
+
+void Neon::JobSystem::ExecuteBatches(JobFunction function, const void* context, uint32_t count,
+									 uint32_t batchSize, uint32_t batchCount)
+{
+	uint32_t batch;
+	while ((batch = m_NextBatch.fetch_add(1)) < batchCount)
+	{
+		const uint32_t begin = batch * batchSize;
+		function(context, begin, std::min(begin + batchSize, count));
+		if (m_CompletedBatches.fetch_add(1) + 1 == batchCount)
+		{
+			// Taking the lock orders the notification after the waiter checked the predicate
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_DoneCondition.notify_all();
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Neon
+{
+// Fixed pool of worker threads, started on first use, that runs data parallel loops together
+// with the calling thread. Loops are dispatched through a function pointer and a context so
+// that running one does not allocate.
+class JobSystem
+{
+public:
+	JobSystem(const JobSystem& other) = delete;
+	JobSystem(JobSystem&& other) = delete;
+	JobSystem& operator=(const JobSystem& other) = delete;
+	JobSystem& operator=(JobSystem&& other) = delete;
+
+	// Calls function(begin, end) for consecutive ranges of at most batchSize indices covering
+	// [0, count) and returns once all of them finished. Ranges run concurrently, so function
+	// must only write state owned by its range. Must not be called from a job.
+	template<typename F>
+	static void ParallelFor(uint32_t count, uint32_t batchSize, const F& function)
+	{
+		if (count == 0) { return; }
+		Run(count, batchSize,
+			[](const void* context, uint32_t begin, uint32_t end) {
+				(*static_cast<const F*>(context))(begin, end);
+			},
+			&function);
+	}
+
+	static uint32_t GetWorkerCount()
+	{
+		return static_cast<uint32_t>(s_Instance.m_Workers.size());
+	}
+
+private:
+	using JobFunction = void (*)(const void* context, uint32_t begin, uint32_t end);
+
+	JobSystem() noexcept = default;
+	~JobSystem();
+
+	static void Run(uint32_t count, uint32_t batchSize, JobFunction function, const void* context);
+	void Start();
+	void WorkerLoop();
+	// Executes batches of the current job until none are left
+	void ExecuteBatches(JobFunction function, const void* context, uint32_t count,
+						uint32_t batchSize, uint32_t batchCount);
+
+private:
+	static JobSystem s_Instance;
+
+	std::vector<std::thread> m_Workers;
+	bool m_Started = false;
+	bool m_Stop = false;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_JobCondition;
+	std::condition_variable m_DoneCondition;
+	uint64_t m_Generation = 0;
+	uint32_t m_ActiveWorkers = 0;
+
+	JobFunction m_Function = nullptr;
+	const void* m_Context = nullptr;
+	uint32_t m_Count = 0;
+	uint32_t m_BatchSize = 1;
+	uint32_t m_BatchCount = 0;
+	std::atomic<uint32_t> m_NextBatch{0};
+	std::atomic<uint32_t> m_CompletedBatches{0};
+};
+} // namespace Neon
@@ -0,0 +1,35 @@
+#include "neopch.h"
+
+#include "ComputePipeline.h"
+
+void Neon::ComputePipeline::Init(vk::Device device)
+{
+	m_Device = device;
+}
+
+void Neon::ComputePipeline::LoadComputeShader(const std::string& file)
+{
+	m_Shader = std::make_unique<VulkanShader>(m_Device, vk::ShaderStageFlagBits::eCompute);
+	m_Shader->LoadFromFile(file);
+}
+
+void Neon::ComputePipeline::CreatePipelineLayout(
+	std::vector<vk::DescriptorSetLayout> descLayouts,
+	std::vector<vk::PushConstantRange> pushConstRanges)
+{
+	vk::PipelineLayoutCreateInfo pipelineLayoutInfo{{},
+													static_cast<uint32_t>(descLayouts.size()),
+													descLayouts.data(),
+													static_cast<uint32_t>(pushConstRanges.size()),
+													pushConstRanges.data()};
+	m_Layout = m_Device.createPipelineLayoutUnique(pipelineLayoutInfo);
+}
+
+void Neon::ComputePipeline::CreatePipeline()
+{
+	assert(m_Shader && m_Layout);
+	vk::ComputePipelineCreateInfo pipelineInfo{
+		{}, m_Shader->GetShaderStageCreateInfo(), m_Layout.get()};
+	m_Pipeline = m_Device.createComputePipelineUnique(nullptr, pipelineInfo);
+	m_Shader.reset();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Renderer/VulkanShader.h"
+#include "VulkanShader.h"
+
+#include <vulkan/vulkan.hpp>
+
+namespace Neon
+{
+class ComputePipeline
+{
+public:
+	ComputePipeline() = default;
+	explicit operator vk::Pipeline() const
+	{
+		return m_Pipeline.get();
+	}
+	void Init(vk::Device device);
+	void LoadComputeShader(const std::string& file);
+	void CreatePipelineLayout(std::vector<vk::DescriptorSetLayout> descLayouts,
+							  std::vector<vk::PushConstantRange> pushConstRanges);
+	void CreatePipeline();
+
+	[[nodiscard]] inline vk::PipelineLayout GetLayout() const
+	{
+		return m_Layout.get();
+	}
+
+private:
+	vk::Device m_Device;
+	std::unique_ptr<VulkanShader> m_Shader;
+	vk::UniquePipelineLayout m_Layout;
+	vk::UniquePipeline m_Pipeline;
+};
+} // namespace Neon
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace Neon
+{
+// View frustum planes (xyz normal pointing inwards, w distance) extracted from a
+// projection * view matrix with Vulkan's [0, 1] depth range
+struct Frustum
+{
+	glm::vec4 m_Planes[6];
+	// Multiview passes also draw the view mirrored across the plane y = m_MirrorHeight, which
+	// sees a sphere where the planes see its mirror image
+	bool m_Mirrored = false;
+	float m_MirrorHeight = 0.0f;
+
+	Frustum() = default;
+	explicit Frustum(const glm::mat4& viewProjection)
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+		{
+			rows[i] = {viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+					   viewProjection[3][i]};
+		}
+		m_Planes[0] = rows[3] + rows[0];
+		m_Planes[1] = rows[3] - rows[0];
+		m_Planes[2] = rows[3] + rows[1];
+		m_Planes[3] = rows[3] - rows[1];
+		m_Planes[4] = rows[2];
+		m_Planes[5] = rows[3] - rows[2];
+		for (auto& plane : m_Planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+	}
+
+	[[nodiscard]] bool IsSphereVisible(const glm::vec3& center, float radius) const
+	{
+		if (IsSphereInside(center, radius)) { return true; }
+		return m_Mirrored &&
+			   IsSphereInside({center.x, 2.0f * m_MirrorHeight - center.y, center.z}, radius);
+	}
+
+	[[nodiscard]] bool IsSphereInside(const glm::vec3& center, float radius) const
+	{
+		for (const auto& plane : m_Planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) { return false; }
+		}
+		return true;
+	}
+};
+} // namespace Neon
@@ -5,6 +5,8 @@
 void Neon::GraphicsPipeline::Init(vk::Device device)
 {
 	m_Device = device;
+	m_Shaders.clear();
+	m_MultiviewShaders.clear();
 }
 
 void Neon::GraphicsPipeline::LoadVertexShader(const std::string& file)
@@ -19,6 +21,16 @@ void Neon::GraphicsPipeline::LoadFragmentShader(const std::string& file)
 	m_Shaders[m_Shaders.size() - 1].LoadFromFile(file);
 }
 
+void Neon::GraphicsPipeline::LoadMultiviewShaders(const std::string& vertexFile,
+												 const std::string& fragmentFile)
+{
+	m_MultiviewShaders.clear();
+	m_MultiviewShaders.emplace_back(m_Device, vk::ShaderStageFlagBits::eVertex);
+	m_MultiviewShaders[0].LoadFromFile(vertexFile);
+	m_MultiviewShaders.emplace_back(m_Device, vk::ShaderStageFlagBits::eFragment);
+	m_MultiviewShaders[1].LoadFromFile(fragmentFile);
+}
+
 void Neon::GraphicsPipeline::CreatePipelineLayout(
 	std::vector<vk::DescriptorSetLayout> descLayouts,
 	std::vector<vk::PushConstantRange> pushConstRanges)
@@ -35,30 +47,61 @@ void Neon::GraphicsPipeline::CreatePipeline(
 	vk::RenderPass renderPass, vk::SampleCountFlagBits samples, vk::Extent2D extent,
 	std::vector<vk::VertexInputBindingDescription> bindingDesc,
 	std::vector<vk::VertexInputAttributeDescription> attributeDesc, vk::CullModeFlagBits cullMode)
+{
+	m_Extent = extent;
+	m_BindingDescriptions = std::move(bindingDesc);
+	m_AttributeDescriptions = std::move(attributeDesc);
+	m_CullMode = cullMode;
+	m_RenderPass = renderPass;
+	m_Pipeline = Build(renderPass, samples, false);
+	m_Variants.clear();
+}
+
+vk::Pipeline Neon::GraphicsPipeline::GetVariant(vk::RenderPass renderPass,
+												vk::SampleCountFlagBits samples,
+												bool multiview) const
+{
+	if (renderPass == m_RenderPass) { return m_Pipeline.get(); }
+	for (const auto& variant : m_Variants)
+	{
+		if (variant.m_RenderPass == renderPass) { return variant.m_Pipeline.get(); }
+	}
+	m_Variants.push_back({renderPass, Build(renderPass, samples, multiview)});
+	return m_Variants.back().m_Pipeline.get();
+}
+
+vk::UniquePipeline Neon::GraphicsPipeline::Build(vk::RenderPass renderPass,
+												 vk::SampleCountFlagBits samples,
+												 bool multiview) const
 {
 	vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
 		{},
-		static_cast<uint32_t>(bindingDesc.size()),
-		bindingDesc.data(),
-		static_cast<uint32_t>(attributeDesc.size()),
-		attributeDesc.data()};
+		static_cast<uint32_t>(m_BindingDescriptions.size()),
+		m_BindingDescriptions.data(),
+		static_cast<uint32_t>(m_AttributeDescriptions.size()),
+		m_AttributeDescriptions.data()};
 
 	vk::PipelineInputAssemblyStateCreateInfo inputAssembly{
 		{}, vk::PrimitiveTopology::eTriangleList, VK_FALSE};
 
 	vk::Viewport viewport{
-		0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height),
+		0.0f, 0.0f, static_cast<float>(m_Extent.width), static_cast<float>(m_Extent.height),
 		0.0f, 1.0f};
 
-	vk::Rect2D scissor{{0, 0}, extent};
+	vk::Rect2D scissor{{0, 0}, m_Extent};
 
 	vk::PipelineViewportStateCreateInfo viewportState{{}, 1, &viewport, 1, &scissor};
 
-	vk::PipelineRasterizationStateCreateInfo rasterizer{{},		  VK_FALSE,
-														VK_FALSE, vk::PolygonMode::eFill,
-														cullMode, vk::FrontFace::eCounterClockwise,
-														VK_FALSE, 0.0f,
-														0.0f,	  0.0f,
+	vk::PipelineRasterizationStateCreateInfo rasterizer{{},
+														VK_FALSE,
+														VK_FALSE,
+														vk::PolygonMode::eFill,
+														m_CullMode,
+														vk::FrontFace::eCounterClockwise,
+														VK_FALSE,
+														0.0f,
+														0.0f,
+														0.0f,
 														1.0f};
 
 	vk::PipelineMultisampleStateCreateInfo multisampling{{},	  samples,	VK_FALSE, 1.0f,
@@ -81,8 +124,9 @@ void Neon::GraphicsPipeline::CreatePipeline(
 	vk::PipelineDepthStencilStateCreateInfo depthStencil{
 		{}, VK_TRUE, VK_TRUE, vk::CompareOp::eLess, VK_FALSE, VK_FALSE, {}, {}, 0.0f, 1.0f};
 
+	assert(!multiview || !m_MultiviewShaders.empty());
 	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
-	for (const auto& shader : m_Shaders)
+	for (const auto& shader : multiview ? m_MultiviewShaders : m_Shaders)
 	{
 		shaderStages.push_back(shader.GetShaderStageCreateInfo());
 	}
@@ -108,6 +152,5 @@ void Neon::GraphicsPipeline::CreatePipeline(
 												renderPass,
 												0};
 
-	m_Pipeline = m_Device.createGraphicsPipelineUnique(nullptr, pipelineInfo);
-	m_Shaders.clear();
+	return m_Device.createGraphicsPipelineUnique(nullptr, pipelineInfo);
 }
@@ -18,6 +18,9 @@ public:
 	void Init(vk::Device device);
 	void LoadVertexShader(const std::string& file);
 	void LoadFragmentShader(const std::string& file);
+	// Shaders of the variants drawing into multiview render passes, which select the view they
+	// draw with gl_ViewIndex
+	void LoadMultiviewShaders(const std::string& vertexFile, const std::string& fragmentFile);
 	void CreatePipelineLayout(std::vector<vk::DescriptorSetLayout> descLayouts,
 							  std::vector<vk::PushConstantRange> pushConstRanges);
 	void CreatePipeline(vk::RenderPass renderPass, vk::SampleCountFlagBits samples,
@@ -25,16 +28,40 @@ public:
 						std::vector<vk::VertexInputBindingDescription> bindingDesc,
 						std::vector<vk::VertexInputAttributeDescription> attributeDesc,
 						vk::CullModeFlagBits cullMode);
+	// Pipeline drawing into renderPass, which may differ from the one of CreatePipeline in the
+	// format and sample count of its attachments or in being multiview. Variants are created the
+	// first time they are requested.
+	[[nodiscard]] vk::Pipeline GetVariant(vk::RenderPass renderPass,
+										  vk::SampleCountFlagBits samples,
+										  bool multiview = false) const;
 
 	[[nodiscard]] inline vk::PipelineLayout GetLayout() const
 	{
 		return m_Layout.get();
 	}
 
+private:
+	struct Variant
+	{
+		vk::RenderPass m_RenderPass;
+		vk::UniquePipeline m_Pipeline;
+	};
+
+	[[nodiscard]] vk::UniquePipeline Build(vk::RenderPass renderPass,
+										   vk::SampleCountFlagBits samples, bool multiview) const;
+
 private:
 	vk::Device m_Device;
+	// Shaders and fixed function state are kept to build variants
 	std::vector<VulkanShader> m_Shaders;
+	std::vector<VulkanShader> m_MultiviewShaders;
+	vk::Extent2D m_Extent;
+	std::vector<vk::VertexInputBindingDescription> m_BindingDescriptions;
+	std::vector<vk::VertexInputAttributeDescription> m_AttributeDescriptions;
+	vk::CullModeFlagBits m_CullMode = vk::CullModeFlagBits::eNone;
 	vk::UniquePipelineLayout m_Layout;
+	vk::RenderPass m_RenderPass;
 	vk::UniquePipeline m_Pipeline;
+	mutable std::vector<Variant> m_Variants;
 };
 } // namespace Neon
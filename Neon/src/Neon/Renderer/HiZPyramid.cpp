@@ -0,0 +1,145 @@
+#include "neopch.h"
+
+#include "HiZPyramid.h"
+#include "VulkanRenderer.h"
+
+void Neon::HiZPyramid::Init(vk::Device device, vk::DescriptorPool descriptorPool)
+{
+	m_Device = device;
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(1, vk::DescriptorType::eStorageImage, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+
+	// One set per level, created once and only rewritten when the source depth is recreated
+	m_LevelDescriptorSets.resize(HIZ_MAX_LEVELS);
+	for (auto& descriptorSet : m_LevelDescriptorSets)
+	{
+		descriptorSet.Init(device);
+		descriptorSet.Create(descriptorPool, bindings);
+	}
+
+	m_ReducePipeline.Init(device);
+	m_ReducePipeline.LoadComputeShader("src/Shaders/build/comp_hiz.spv");
+	vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0,
+											sizeof(ReducePushConstant)};
+	m_ReducePipeline.CreatePipelineLayout({m_LevelDescriptorSets[0].GetLayout()},
+										  {pushConstantRange});
+	m_ReducePipeline.CreatePipeline();
+
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eNearest;
+	samplerInfo.minFilter = vk::Filter::eNearest;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.maxLod = static_cast<float>(HIZ_MAX_LEVELS);
+	m_Sampler = m_Device.createSamplerUnique(samplerInfo);
+}
+
+void Neon::HiZPyramid::Create(vk::Extent2D depthExtent, const TextureImage& depthTextureImage)
+{
+	m_SourceExtent = depthExtent;
+	m_LevelExtents.clear();
+	vk::Extent2D extent = depthExtent;
+	do
+	{
+		extent = {std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u)};
+		m_LevelExtents.push_back(extent);
+	} while ((extent.width > 1 || extent.height > 1) && m_LevelExtents.size() < HIZ_MAX_LEVELS);
+	const auto levelCount = static_cast<uint32_t>(m_LevelExtents.size());
+
+	m_LevelImageViews.clear();
+	m_ImageView.reset();
+	// Two channels would do, but two channel storage images need the
+	// shaderStorageImageExtendedFormats feature, four are supported by every device
+	m_Image = Allocator::CreateImage(
+		m_LevelExtents[0].width, m_LevelExtents[0].height, vk::SampleCountFlagBits::e1,
+		vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal,
+		vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+		VMA_MEMORY_USAGE_GPU_ONLY, levelCount);
+	Allocator::TransitionImageLayout(m_Image->m_Image, vk::ImageAspectFlagBits::eColor,
+									 vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+									 levelCount);
+
+	vk::ImageViewCreateInfo viewInfo{{},
+									 m_Image->m_Image,
+									 vk::ImageViewType::e2D,
+									 vk::Format::eR32G32B32A32Sfloat,
+									 {},
+									 {vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, 1}};
+	m_ImageView = m_Device.createImageViewUnique(viewInfo);
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		m_LevelImageViews.push_back(m_Device.createImageViewUnique(viewInfo));
+	}
+	m_Descriptor = {m_Sampler.get(), m_ImageView.get(), vk::ImageLayout::eGeneral};
+
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		vk::DescriptorImageInfo sourceInfo =
+			level == 0 ? vk::DescriptorImageInfo{m_Sampler.get(),
+												 depthTextureImage.m_Descriptor.imageView,
+												 vk::ImageLayout::eDepthStencilReadOnlyOptimal}
+					   : vk::DescriptorImageInfo{m_Sampler.get(), m_LevelImageViews[level - 1].get(),
+												 vk::ImageLayout::eGeneral};
+		vk::DescriptorImageInfo destinationInfo{nullptr, m_LevelImageViews[level].get(),
+												vk::ImageLayout::eGeneral};
+
+		auto& descriptorSet = m_LevelDescriptorSets[level];
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(0, &sourceInfo, 0),
+			descriptorSet.CreateWrite(1, &destinationInfo, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
+}
+
+void Neon::HiZPyramid::Build(vk::CommandBuffer commandBuffer)
+{
+	assert(m_Image);
+
+	// Wait for the depth resolve of the scene pass and for earlier culling and shading reads of
+	// the pyramid
+	vk::MemoryBarrier barrier{vk::AccessFlagBits::eColorAttachmentWrite |
+								  vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+								  vk::AccessFlagBits::eShaderRead,
+							  vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput |
+									  vk::PipelineStageFlagBits::eLateFragmentTests |
+									  vk::PipelineStageFlagBits::eFragmentShader |
+									  vk::PipelineStageFlagBits::eComputeShader,
+								  vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr,
+								  nullptr);
+
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_ReducePipeline));
+	vk::Extent2D sourceExtent = m_SourceExtent;
+	for (size_t level = 0; level < m_LevelExtents.size(); level++)
+	{
+		const auto& extent = m_LevelExtents[level];
+		ReducePushConstant pushConstant{
+			{static_cast<int>(sourceExtent.width), static_cast<int>(sourceExtent.height)},
+			{static_cast<int>(extent.width), static_cast<int>(extent.height)},
+			level == 0 ? 1 : 0};
+		const vk::DescriptorSet descriptorSet = m_LevelDescriptorSets[level].Get();
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+										 m_ReducePipeline.GetLayout(), 0, 1, &descriptorSet, 0,
+										 nullptr);
+		commandBuffer.pushConstants(m_ReducePipeline.GetLayout(), vk::ShaderStageFlagBits::eCompute,
+									0, sizeof(ReducePushConstant), &pushConstant);
+		commandBuffer.dispatch((extent.width + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE,
+							   (extent.height + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, 1);
+
+		vk::MemoryBarrier levelBarrier{vk::AccessFlagBits::eShaderWrite,
+									   vk::AccessFlagBits::eShaderRead};
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+									  vk::PipelineStageFlagBits::eComputeShader, {}, levelBarrier,
+									  nullptr, nullptr);
+		sourceExtent = extent;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Allocator.h"
+#include "ComputePipeline.h"
+#include "DescriptorSet.h"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#define HIZ_MAX_LEVELS 16
+#define HIZ_WORKGROUP_SIZE 8
+
+namespace Neon
+{
+// Mip chain of the farthest (r) and closest (g) depth covered by every texel, built by compute
+// from a resolved depth image. Level 0 has half the resolution of the source depth.
+class HiZPyramid
+{
+public:
+	HiZPyramid() = default;
+
+	void Init(vk::Device device, vk::DescriptorPool descriptorPool);
+	void Create(vk::Extent2D depthExtent, const TextureImage& depthTextureImage);
+	void Build(vk::CommandBuffer commandBuffer);
+
+	[[nodiscard]] const vk::DescriptorImageInfo& GetDescriptor() const
+	{
+		return m_Descriptor;
+	}
+
+private:
+	struct ReducePushConstant
+	{
+		glm::ivec2 sourceExtent;
+		glm::ivec2 destinationExtent;
+		// The source is the depth image, which has no closest depth of its own
+		int32_t sourceIsDepth;
+	};
+
+	vk::Device m_Device;
+	ComputePipeline m_ReducePipeline;
+	std::vector<DescriptorSet> m_LevelDescriptorSets;
+
+	std::unique_ptr<ImageAllocation> m_Image;
+	vk::UniqueImageView m_ImageView;
+	std::vector<vk::UniqueImageView> m_LevelImageViews;
+	vk::UniqueSampler m_Sampler;
+	vk::Extent2D m_SourceExtent;
+	std::vector<vk::Extent2D> m_LevelExtents;
+	vk::DescriptorImageInfo m_Descriptor;
+};
+} // namespace Neon
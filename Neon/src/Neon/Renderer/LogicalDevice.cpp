@@ -21,14 +21,19 @@ Neon::LogicalDevice::LogicalDevice(const PhysicalDevice& physicalDevice)
 	{
 		queueCreateInfos.push_back({{}, queueFamilyIndex, 1, &queuePriority});
 	}
+	vk::PhysicalDeviceMultiviewFeatures multiviewFeatures;
+	multiviewFeatures.multiview = VK_TRUE;
 	vk::PhysicalDeviceScalarBlockLayoutFeatures scalarLayoutFeatures;
 	scalarLayoutFeatures.scalarBlockLayout = VK_TRUE;
+	scalarLayoutFeatures.pNext = &multiviewFeatures;
 	vk::PhysicalDeviceDescriptorIndexingFeatures descriptorFeatures;
 	descriptorFeatures.runtimeDescriptorArray = VK_TRUE;
 	descriptorFeatures.pNext = &scalarLayoutFeatures;
 	vk::PhysicalDeviceFeatures deviceFeatures;
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.shaderClipDistance = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 	vk::PhysicalDeviceFeatures2 deviceFeatures2;
 	deviceFeatures2.pNext = &descriptorFeatures;
 	deviceFeatures2.features = deviceFeatures;
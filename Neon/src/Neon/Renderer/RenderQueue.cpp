@@ -0,0 +1,114 @@
+#include "neopch.h"
+
+#include "RenderQueue.h"
+
+#define SORT_KEY_LAYER_SHIFT 60
+#define SORT_KEY_PIPELINE_BITS 16
+#define SORT_KEY_MATERIAL_BITS 20
+#define SORT_KEY_DEPTH_BITS 24
+
+void Neon::RenderQueue::Begin(const glm::vec3& cameraPosition, const glm::vec3& cameraFront)
+{
+	m_CameraPosition = cameraPosition;
+	m_CameraFront = cameraFront;
+	m_Packets.clear();
+	m_SortItems.clear();
+	// IDs only order the packets of one pass, so they are handed out again every pass. Destroyed
+	// pipelines and materials never keep an ID and the IDs stay within their key bits.
+	m_PipelineIDs.clear();
+	m_MaterialIDs.clear();
+}
+
+void Neon::RenderQueue::Submit(RenderLayer layer, const DrawPacket& packet)
+{
+	m_SortItems.push_back({CreateSortKey(layer, packet), static_cast<uint32_t>(m_Packets.size())});
+	m_Packets.push_back(packet);
+	m_Packets.back().m_Layer = layer;
+}
+
+void Neon::RenderQueue::Sort()
+{
+	// LSD radix sort over the 8 key bytes. All histograms are built in a single pass and
+	// bytes that are equal for every packet (e.g. layer bits within one pass) are skipped.
+	const size_t count = m_SortItems.size();
+	if (count < 2) { return; }
+	m_SortScratch.resize(count);
+
+	std::array<std::array<uint32_t, 256>, sizeof(uint64_t)> histograms{};
+	for (const auto& item : m_SortItems)
+	{
+		for (size_t byte = 0; byte < sizeof(uint64_t); byte++)
+		{
+			histograms[byte][(item.m_Key >> (byte * 8)) & 0xFF]++;
+		}
+	}
+
+	SortItem* source = m_SortItems.data();
+	SortItem* destination = m_SortScratch.data();
+	for (size_t byte = 0; byte < sizeof(uint64_t); byte++)
+	{
+		auto& histogram = histograms[byte];
+		if (histogram[(source[0].m_Key >> (byte * 8)) & 0xFF] == count) { continue; }
+
+		uint32_t offset = 0;
+		for (auto& bucket : histogram)
+		{
+			uint32_t bucketSize = bucket;
+			bucket = offset;
+			offset += bucketSize;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			destination[histogram[(source[i].m_Key >> (byte * 8)) & 0xFF]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	if (source != m_SortItems.data()) { m_SortItems.swap(m_SortScratch); }
+}
+
+uint64_t Neon::RenderQueue::CreateSortKey(RenderLayer layer, const DrawPacket& packet)
+{
+	constexpr uint64_t depthMax = (1ull << SORT_KEY_DEPTH_BITS) - 1;
+	float viewDepth = glm::dot(glm::vec3(packet.m_Model[3]) - m_CameraPosition, m_CameraFront);
+	float normalizedDepth = glm::clamp(viewDepth / RENDER_QUEUE_MAX_DEPTH, 0.0f, 1.0f);
+	auto depth = static_cast<uint64_t>(normalizedDepth * static_cast<float>(depthMax));
+
+	uint64_t pipeline = GetPipelineID(packet.m_Pipeline);
+	uint64_t material = GetMaterialID(packet.m_DescriptorSet);
+	uint64_t key = static_cast<uint64_t>(layer) << SORT_KEY_LAYER_SHIFT;
+	if (layer == RenderLayer::Transparent)
+	{
+		// Blended geometry has to be drawn back to front, so depth outranks state
+		key |= (depthMax - depth) << (SORT_KEY_PIPELINE_BITS + SORT_KEY_MATERIAL_BITS);
+		key |= pipeline << SORT_KEY_MATERIAL_BITS;
+		key |= material;
+	}
+	else
+	{
+		key |= pipeline << (SORT_KEY_MATERIAL_BITS + SORT_KEY_DEPTH_BITS);
+		key |= material << SORT_KEY_DEPTH_BITS;
+		key |= depth;
+	}
+	return key;
+}
+
+uint32_t Neon::RenderQueue::GetPipelineID(vk::Pipeline pipeline)
+{
+	auto it = m_PipelineIDs.find(static_cast<VkPipeline>(pipeline));
+	if (it != m_PipelineIDs.end()) { return it->second; }
+	auto id = static_cast<uint32_t>(m_PipelineIDs.size());
+	assert(id < (1u << SORT_KEY_PIPELINE_BITS));
+	m_PipelineIDs[static_cast<VkPipeline>(pipeline)] = id;
+	return id;
+}
+
+uint32_t Neon::RenderQueue::GetMaterialID(vk::DescriptorSet descriptorSet)
+{
+	auto it = m_MaterialIDs.find(static_cast<VkDescriptorSet>(descriptorSet));
+	if (it != m_MaterialIDs.end()) { return it->second; }
+	auto id = static_cast<uint32_t>(m_MaterialIDs.size());
+	assert(id < (1u << SORT_KEY_MATERIAL_BITS));
+	m_MaterialIDs[static_cast<VkDescriptorSet>(descriptorSet)] = id;
+	return id;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+
+#define RENDER_QUEUE_MAX_DEPTH 10000.0f
+#define DRAW_PACKET_NO_QUERY UINT32_MAX
+
+namespace Neon
+{
+enum class RenderLayer : uint8_t
+{
+	Background = 0,
+	Opaque = 1,
+	Transparent = 2
+};
+
+struct DrawPacket
+{
+	vk::Pipeline m_Pipeline;
+	vk::PipelineLayout m_PipelineLayout;
+	vk::DescriptorSet m_DescriptorSet;
+	vk::Buffer m_VertexBuffer;
+	vk::Buffer m_IndexBuffer;
+	uint32_t m_IndexCount = 0;
+	uint32_t m_FirstIndex = 0;
+	int32_t m_VertexOffset = 0;
+	glm::mat4 m_Model{1.0f};
+	// Object space bounding sphere (xyz center, w radius), negative radius disables culling
+	glm::vec4 m_BoundingSphere{0.0f, 0.0f, 0.0f, -1.0f};
+	float m_MoveFactor = 0;
+	RenderLayer m_Layer = RenderLayer::Opaque;
+	// Visibility query answered by the draw of the packet, see VulkanRenderer::IsVisible
+	uint32_t m_VisibilityQuery = DRAW_PACKET_NO_QUERY;
+
+	// Packets sharing pipeline, material, buffers and push constants can be drawn without rebinding
+	[[nodiscard]] bool IsBindCompatible(const DrawPacket& other) const
+	{
+		return m_Pipeline == other.m_Pipeline && m_DescriptorSet == other.m_DescriptorSet &&
+			   m_VertexBuffer == other.m_VertexBuffer && m_IndexBuffer == other.m_IndexBuffer &&
+			   m_MoveFactor == other.m_MoveFactor;
+	}
+
+	// Packets that only differ in their transform can be drawn as instances of one draw
+	[[nodiscard]] bool IsInstanceCompatible(const DrawPacket& other) const
+	{
+		return IsBindCompatible(other) && m_IndexCount == other.m_IndexCount &&
+			   m_FirstIndex == other.m_FirstIndex && m_VertexOffset == other.m_VertexOffset &&
+			   m_VisibilityQuery == other.m_VisibilityQuery;
+	}
+};
+
+// Collects draw packets for one scene pass and orders them by a 64-bit key
+// (layer, pipeline, material, depth) so that submission can skip redundant binds.
+class RenderQueue
+{
+public:
+	RenderQueue() = default;
+
+	void Begin(const glm::vec3& cameraPosition, const glm::vec3& cameraFront);
+	void Submit(RenderLayer layer, const DrawPacket& packet);
+	void Sort();
+
+	[[nodiscard]] size_t Size() const
+	{
+		return m_SortItems.size();
+	}
+
+	[[nodiscard]] const DrawPacket& operator[](size_t index) const
+	{
+		return m_Packets[m_SortItems[index].m_PacketIndex];
+	}
+
+private:
+	struct SortItem
+	{
+		uint64_t m_Key;
+		uint32_t m_PacketIndex;
+	};
+
+	uint64_t CreateSortKey(RenderLayer layer, const DrawPacket& packet);
+	uint32_t GetPipelineID(vk::Pipeline pipeline);
+	uint32_t GetMaterialID(vk::DescriptorSet descriptorSet);
+
+private:
+	glm::vec3 m_CameraPosition{};
+	glm::vec3 m_CameraFront{0.0f, 0.0f, 1.0f};
+
+	std::vector<DrawPacket> m_Packets;
+	std::vector<SortItem> m_SortItems;
+	std::vector<SortItem> m_SortScratch;
+
+	std::unordered_map<VkPipeline, uint32_t> m_PipelineIDs;
+	std::unordered_map<VkDescriptorSet, uint32_t> m_MaterialIDs;
+};
+} // namespace Neon
@@ -0,0 +1,31 @@
+#include "neopch.h"
+
+#include "StaticGeometryArena.h"
+
+Neon::StaticGeometryArena::Page& Neon::StaticGeometryArena::GetPage(uint32_t vertexCount,
+																	 uint32_t indexCount)
+{
+	for (auto& page : m_Pages)
+	{
+		if (page.m_VertexCount + vertexCount <= page.m_VertexCapacity &&
+			page.m_IndexCount + indexCount <= page.m_IndexCapacity)
+		{ return page; }
+	}
+
+	// Meshes larger than a page get a page of their own
+	Page page;
+	page.m_VertexCapacity = std::max(vertexCount, STATIC_GEOMETRY_PAGE_VERTICES);
+	page.m_IndexCapacity = std::max(indexCount, STATIC_GEOMETRY_PAGE_INDICES);
+	page.m_VertexBuffer = Allocator::CreateBuffer(
+		static_cast<vk::DeviceSize>(page.m_VertexCapacity) * m_VertexStride,
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer |
+			vk::BufferUsageFlagBits::eStorageBuffer,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+	page.m_IndexBuffer = Allocator::CreateBuffer(
+		static_cast<vk::DeviceSize>(page.m_IndexCapacity) * sizeof(uint32_t),
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer |
+			vk::BufferUsageFlagBits::eStorageBuffer,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+	m_Pages.push_back(std::move(page));
+	return m_Pages.back();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <vulkan/vulkan.hpp>
+
+#define STATIC_GEOMETRY_PAGE_VERTICES (1u << 18)
+#define STATIC_GEOMETRY_PAGE_INDICES (1u << 20)
+
+namespace Neon
+{
+// Location of one mesh inside the shared buffers of a StaticGeometryArena
+struct StaticGeometryRange
+{
+	vk::Buffer m_VertexBuffer;
+	vk::Buffer m_IndexBuffer;
+	uint32_t m_BaseVertex = 0;
+	uint32_t m_BaseIndex = 0;
+};
+
+// Packs immutable meshes sharing one vertex layout into a few large vertex and index buffers,
+// so they are drawn with base vertex/index offsets instead of binding buffers per mesh. Ranges
+// are never freed individually, the arena releases everything together with its owner.
+class StaticGeometryArena
+{
+public:
+	explicit StaticGeometryArena(uint32_t vertexStride)
+		: m_VertexStride(vertexStride)
+	{
+	}
+
+	template<typename T>
+	StaticGeometryRange Add(const vk::CommandBuffer& commandBuffer, const std::vector<T>& vertices,
+							const std::vector<uint32_t>& indices)
+	{
+		assert(sizeof(T) == m_VertexStride);
+		auto& page = GetPage(static_cast<uint32_t>(vertices.size()),
+							 static_cast<uint32_t>(indices.size()));
+		StaticGeometryRange range{page.m_VertexBuffer->m_Buffer, page.m_IndexBuffer->m_Buffer,
+								  page.m_VertexCount, page.m_IndexCount};
+		Allocator::UploadToBuffer(commandBuffer, vertices, page.m_VertexBuffer->m_Buffer,
+								  static_cast<vk::DeviceSize>(page.m_VertexCount) * m_VertexStride);
+		Allocator::UploadToBuffer(commandBuffer, indices, page.m_IndexBuffer->m_Buffer,
+								  static_cast<vk::DeviceSize>(page.m_IndexCount) * sizeof(uint32_t));
+		page.m_VertexCount += static_cast<uint32_t>(vertices.size());
+		page.m_IndexCount += static_cast<uint32_t>(indices.size());
+		return range;
+	}
+
+	[[nodiscard]] size_t GetPageCount() const
+	{
+		return m_Pages.size();
+	}
+
+private:
+	struct Page
+	{
+		std::unique_ptr<BufferAllocation> m_VertexBuffer;
+		std::unique_ptr<BufferAllocation> m_IndexBuffer;
+		uint32_t m_VertexCapacity = 0;
+		uint32_t m_IndexCapacity = 0;
+		uint32_t m_VertexCount = 0;
+		uint32_t m_IndexCount = 0;
+	};
+
+	Page& GetPage(uint32_t vertexCount, uint32_t indexCount);
+
+private:
+	uint32_t m_VertexStride;
+	std::vector<Page> m_Pages;
+};
+} // namespace Neon
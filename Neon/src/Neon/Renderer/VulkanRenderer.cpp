@@ -4,6 +4,7 @@
 
 #include "Allocator.h"
 #include "Context.h"
+#include "Frustum.h"
 #include "RenderPass.h"
 #include "Window.h"
 
@@ -16,6 +17,125 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
 Neon::VulkanRenderer Neon::VulkanRenderer::s_Instance;
 
+// Scene pass drawing into multisampled color and depth attachments followed by their resolve
+// targets, or directly into single sampled ones. The occlusion culled scene pass stores the
+// multisampled attachments, so a second instance loading them can add the disoccluded geometry.
+// Multiview passes broadcast every draw to both layers of the attachments. Attachments match the
+// framebuffers of CreateFrameBuffers.
+static vk::UniqueRenderPass CreateSceneRenderPass(vk::Device device, vk::Format colorFormat,
+												  vk::SampleCountFlagBits samples,
+												  vk::AttachmentLoadOp loadOp,
+												  vk::AttachmentStoreOp multisampledStoreOp,
+												  bool multiview = false)
+{
+	const bool resolve = samples != vk::SampleCountFlagBits::e1;
+	const vk::AttachmentStoreOp storeOp =
+		resolve ? multisampledStoreOp : vk::AttachmentStoreOp::eStore;
+	std::vector<vk::AttachmentDescription2> attachments = {
+		vk::AttachmentDescription2{{},
+								   colorFormat,
+								   samples,
+								   loadOp,
+								   storeOp,
+								   vk::AttachmentLoadOp::eDontCare,
+								   vk::AttachmentStoreOp::eDontCare,
+								   vk::ImageLayout::eGeneral,
+								   vk::ImageLayout::eGeneral},
+		vk::AttachmentDescription2{{},
+								   vk::Format::eD32Sfloat,
+								   samples,
+								   loadOp,
+								   storeOp,
+								   vk::AttachmentLoadOp::eDontCare,
+								   vk::AttachmentStoreOp::eDontCare,
+								   vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+								   vk::ImageLayout::eDepthStencilReadOnlyOptimal}};
+	if (resolve)
+	{
+		attachments.push_back(vk::AttachmentDescription2{{},
+														 colorFormat,
+														 vk::SampleCountFlagBits::e1,
+														 vk::AttachmentLoadOp::eDontCare,
+														 vk::AttachmentStoreOp::eStore,
+														 vk::AttachmentLoadOp::eDontCare,
+														 vk::AttachmentStoreOp::eDontCare,
+														 vk::ImageLayout::eGeneral,
+														 vk::ImageLayout::eGeneral});
+		attachments.push_back(
+			vk::AttachmentDescription2{{},
+									   vk::Format::eD32Sfloat,
+									   vk::SampleCountFlagBits::e1,
+									   vk::AttachmentLoadOp::eDontCare,
+									   vk::AttachmentStoreOp::eStore,
+									   vk::AttachmentLoadOp::eDontCare,
+									   vk::AttachmentStoreOp::eDontCare,
+									   vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+									   vk::ImageLayout::eDepthStencilReadOnlyOptimal});
+	}
+
+	vk::AttachmentReference2 colorReference{0, vk::ImageLayout::eColorAttachmentOptimal,
+											vk::ImageAspectFlagBits::eColor};
+	vk::AttachmentReference2 depthReference{1, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+											vk::ImageAspectFlagBits::eDepth};
+	vk::AttachmentReference2 colorResolveReference{2, vk::ImageLayout::eColorAttachmentOptimal,
+												   vk::ImageAspectFlagBits::eColor};
+	vk::AttachmentReference2 depthResolveReference{
+		3, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth};
+	vk::SubpassDescriptionDepthStencilResolve depthResolve{
+		vk::ResolveModeFlagBits::eSampleZero, vk::ResolveModeFlagBits::eNone,
+		&depthResolveReference};
+
+	vk::SubpassDescription2 subpass{{},
+									vk::PipelineBindPoint::eGraphics,
+									0,
+									0,
+									nullptr,
+									1,
+									&colorReference,
+									resolve ? &colorResolveReference : nullptr,
+									&depthReference};
+	if (resolve) { subpass.pNext = &depthResolve; }
+	// The views are rendered together and see mostly the same geometry
+	const uint32_t viewMask = 0b11;
+	if (multiview) { subpass.viewMask = viewMask; }
+
+	std::array<vk::SubpassDependency2, 2> dependencies = {
+		vk::SubpassDependency2{VK_SUBPASS_EXTERNAL, 0,
+							   vk::PipelineStageFlagBits::eComputeShader |
+								   vk::PipelineStageFlagBits::eColorAttachmentOutput |
+								   vk::PipelineStageFlagBits::eLateFragmentTests,
+							   vk::PipelineStageFlagBits::eEarlyFragmentTests |
+								   vk::PipelineStageFlagBits::eColorAttachmentOutput,
+							   vk::AccessFlagBits::eColorAttachmentWrite |
+								   vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+							   vk::AccessFlagBits::eColorAttachmentRead |
+								   vk::AccessFlagBits::eColorAttachmentWrite |
+								   vk::AccessFlagBits::eDepthStencilAttachmentRead |
+								   vk::AccessFlagBits::eDepthStencilAttachmentWrite},
+		vk::SubpassDependency2{0, VK_SUBPASS_EXTERNAL,
+							   vk::PipelineStageFlagBits::eColorAttachmentOutput |
+								   vk::PipelineStageFlagBits::eLateFragmentTests,
+							   vk::PipelineStageFlagBits::eFragmentShader |
+								   vk::PipelineStageFlagBits::eComputeShader,
+							   vk::AccessFlagBits::eColorAttachmentWrite |
+								   vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+							   vk::AccessFlagBits::eShaderRead}};
+
+	vk::RenderPassCreateInfo2 createInfo{{},
+										 static_cast<uint32_t>(attachments.size()),
+										 attachments.data(),
+										 1,
+										 &subpass,
+										 static_cast<uint32_t>(dependencies.size()),
+										 dependencies.data()};
+	if (multiview)
+	{
+		createInfo.correlatedViewMaskCount = 1;
+		createInfo.pCorrelatedViewMasks = &viewMask;
+	}
+	return device.createRenderPass2KHRUnique(createInfo);
+}
+
 Neon::VulkanRenderer::VulkanRenderer() noexcept { }
 
 void Neon::VulkanRenderer::Init(Window* window)
@@ -37,6 +157,10 @@ void Neon::VulkanRenderer::Begin()
 		assert(result == vk::Result::eSuccess || result == vk::Result::eSuboptimalKHR);
 		vk::CommandBufferBeginInfo beginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit};
 		s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get().begin(beginInfo);
+		s_Instance.ReadVisibility();
+		s_Instance.m_InstanceCount = 0;
+		s_Instance.m_DrawCount = 0;
+		s_Instance.m_GpuDriven = s_Instance.m_RequestedGpuDriven;
 	}
 }
 
@@ -44,6 +168,7 @@ void Neon::VulkanRenderer::End()
 {
 	auto& commandBuffer =
 		s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
+	s_Instance.CopyVisibility(commandBuffer);
 	commandBuffer.end();
 	auto result = s_Instance.m_SwapChain->Present(commandBuffer);
 
@@ -60,7 +185,9 @@ void Neon::VulkanRenderer::BeginScene(const std::vector<vk::UniqueFramebuffer>&
 									  const Neon::PerspectiveCamera& camera,
 									  const glm::vec4& clippingPlane, bool pointLight,
 									  float lightIntensity, glm::vec3 lightDirection,
-									  const glm::vec3& lightPosition)
+									  const glm::vec3& lightPosition, bool occlusionCulling,
+									  vk::Format colorFormat, vk::SampleCountFlagBits samples,
+									  bool multiview, float mirrorHeight)
 {
 	s_Instance.m_PushConstant.cameraPos = camera.GetPosition();
 	s_Instance.m_PushConstant.view = camera.GetViewMatrix();
@@ -70,24 +197,36 @@ void Neon::VulkanRenderer::BeginScene(const std::vector<vk::UniqueFramebuffer>&
 	s_Instance.m_PushConstant.lightIntensity = lightIntensity;
 	s_Instance.m_PushConstant.lightDirection = lightDirection;
 	s_Instance.m_PushConstant.lightPosition = lightPosition;
+	s_Instance.m_PushConstant.mirrorHeight = mirrorHeight;
 
-	auto& commandBuffer =
-		s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
-	std::array<vk::ClearValue, 2> clearValues = {};
-	memcpy(&clearValues[0].color.float32, &clearColor, sizeof(clearValues[0].color.float32));
-	clearValues[1].depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
-	vk::RenderPassBeginInfo renderPassInfo{
-		s_Instance.m_OffscreenRenderPass.get(),
-		frameBuffers[s_Instance.m_SwapChain->GetImageIndex()].get(),
-		{{0, 0}, extent},
-		static_cast<uint32_t>(clearValues.size()),
-		clearValues.data()};
-	commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+	auto& scenePass = s_Instance.m_ScenePass;
+	scenePass.m_RenderPass = GetSceneRenderPass(colorFormat, samples, multiview);
+	scenePass.m_Samples = samples;
+	scenePass.m_Framebuffer = frameBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
+	scenePass.m_Extent = extent;
+	memcpy(&scenePass.m_ClearValues[0].color.float32, &clearColor,
+		   sizeof(scenePass.m_ClearValues[0].color.float32));
+	scenePass.m_ClearValues[1].depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
+	scenePass.m_ViewProjection = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+	// The depth pyramid is built from the offscreen depth, so only the main pass can use it
+	assert(!occlusionCulling || &frameBuffers == &s_Instance.m_OffscreenFrameBuffers);
+	scenePass.m_OcclusionCulling = occlusionCulling && s_Instance.m_GpuDriven;
+	scenePass.m_Multiview = multiview;
+	scenePass.m_MirrorHeight = mirrorHeight;
+	// The opaque scene textures are taken from the offscreen targets, so only by the main pass
+	scenePass.m_CaptureOpaque = s_Instance.m_OpaqueSceneRequested &&
+								&frameBuffers == &s_Instance.m_OffscreenFrameBuffers;
+	if (scenePass.m_CaptureOpaque) { s_Instance.m_OpaqueSceneRequested = false; }
+
+	s_Instance.m_RenderQueue.Begin(camera.GetPosition(), camera.GetFront());
 }
 
 void Neon::VulkanRenderer::EndScene()
 {
-	s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get().endRenderPass();
+	auto& commandBuffer =
+		s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
+	s_Instance.FlushRenderQueue(commandBuffer);
+	commandBuffer.endRenderPass();
 }
 
 void Neon::VulkanRenderer::DrawImGui()
@@ -128,12 +267,13 @@ void Neon::VulkanRenderer::EndSingleTimeCommands(vk::CommandBuffer commandBuffer
 }
 
 vk::ImageView Neon::VulkanRenderer::CreateImageView(vk::Image image, vk::Format format,
-													const vk::ImageAspectFlags& aspectFlags)
+													const vk::ImageAspectFlags& aspectFlags,
+													vk::ImageViewType viewType,
+													uint32_t baseArrayLayer, uint32_t layerCount)
 {
 	auto& logicalDevice = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
-	vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, 1, 0, 1);
-	vk::ImageViewCreateInfo imageViewCreateInfo{{},		image, vk::ImageViewType::e2D,
-												format, {},	   subResourceRange};
+	vk::ImageSubresourceRange subResourceRange(aspectFlags, 0, 1, baseArrayLayer, layerCount);
+	vk::ImageViewCreateInfo imageViewCreateInfo{{}, image, viewType, format, {}, subResourceRange};
 	return logicalDevice.createImageView(imageViewCreateInfo);
 }
 
@@ -186,10 +326,18 @@ void Neon::VulkanRenderer::InitRenderer(Window* window)
 					   1 * MAX_SWAP_CHAIN_IMAGES * MAX_DESCRIPTOR_SETS_PER_POOL);
 	sizes.emplace_back(vk::DescriptorType::eCombinedImageSampler,
 					   10 * MAX_SWAP_CHAIN_IMAGES * MAX_DESCRIPTOR_SETS_PER_POOL);
+	// Levels of the HiZ pyramid and the images written by the compute passes of the scene
+	sizes.emplace_back(vk::DescriptorType::eStorageImage,
+					   HIZ_MAX_LEVELS + MAX_DESCRIPTOR_SETS_PER_POOL);
+	sizes.emplace_back(vk::DescriptorType::eStorageBufferDynamic, MAX_DESCRIPTOR_SETS_PER_POOL);
 	m_DescriptorPools.push_back(DescriptorPool::Create(
 		logicalDevice.GetHandle(), sizes, MAX_SWAP_CHAIN_IMAGES * MAX_DESCRIPTOR_SETS_PER_POOL));
 	////////////////////////
 
+	CreateInstanceBuffers();
+	CreateCullPipeline();
+	CreateSkinningPipeline();
+
 	Neon::Context::GetInstance().GetLogicalDevice().GetHandle().waitIdle();
 }
 
@@ -199,6 +347,7 @@ void Neon::VulkanRenderer::WindowResized()
 	device.waitIdle();
 	CreateOffscreenRenderer();
 	CreateImGuiRenderer();
+	CreateOpaqueSceneTextures();
 	device.waitIdle();
 }
 
@@ -299,51 +448,717 @@ void Neon::VulkanRenderer::CreateCommandBuffers()
 	m_CommandBuffers = device.allocateCommandBuffersUnique(allocInfo);
 }
 
+void Neon::VulkanRenderer::CreateInstanceBuffers()
+{
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+
+	m_EmptyDescriptorSetLayout = device.createDescriptorSetLayoutUnique({});
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eVertex);
+
+	m_InstanceBuffers.clear();
+	m_InstanceDescriptorSets.clear();
+	m_InstanceDescriptorSets.resize(m_SwapChain->GetImageViewSize());
+	m_CulledInstanceBuffers.clear();
+	m_CulledInstanceDescriptorSets.clear();
+	m_CulledInstanceDescriptorSets.resize(m_SwapChain->GetImageViewSize());
+	m_DrawCommandBuffers.clear();
+	m_RetestBuffers.clear();
+	m_VisibilityDraws.clear();
+	m_VisibilityDraws.resize(m_SwapChain->GetImageViewSize());
+	m_VisibilityBuffers.clear();
+	for (size_t i = 0; i < m_SwapChain->GetImageViewSize(); i++)
+	{
+		// Large enough for either path, the CPU path stores bare transforms, the GPU driven
+		// path stores GpuInstance records
+		m_InstanceBuffers.push_back(Allocator::CreateMappedBuffer(
+			sizeof(GpuInstance) * MAX_INSTANCES_PER_FRAME, vk::BufferUsageFlagBits::eStorageBuffer,
+			VMA_MEMORY_USAGE_CPU_TO_GPU));
+		m_CulledInstanceBuffers.push_back(Allocator::CreateBuffer(
+			sizeof(glm::mat4) * MAX_INSTANCES_PER_FRAME, vk::BufferUsageFlagBits::eStorageBuffer,
+			VMA_MEMORY_USAGE_GPU_ONLY));
+		// Second half holds the commands of the disocclusion phase
+		m_DrawCommandBuffers.push_back(Allocator::CreateMappedBuffer(
+			sizeof(vk::DrawIndexedIndirectCommand) * MAX_DRAWS_PER_FRAME * 2,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+				vk::BufferUsageFlagBits::eTransferSrc,
+			VMA_MEMORY_USAGE_CPU_TO_GPU));
+		m_VisibilityBuffers.push_back(Allocator::CreateMappedBuffer(
+			sizeof(uint32_t) * MAX_DRAWS_PER_FRAME * 2, vk::BufferUsageFlagBits::eTransferDst,
+			VMA_MEMORY_USAGE_GPU_TO_CPU));
+		m_RetestBuffers.push_back(Allocator::CreateBuffer(sizeof(uint32_t) * MAX_INSTANCES_PER_FRAME,
+														  vk::BufferUsageFlagBits::eStorageBuffer,
+														  VMA_MEMORY_USAGE_GPU_ONLY));
+
+		vk::DescriptorBufferInfo instanceBufferInfo{m_InstanceBuffers[i]->m_Buffer, 0,
+													VK_WHOLE_SIZE};
+		auto& descriptorSet = m_InstanceDescriptorSets[i];
+		descriptorSet.Init(device);
+		descriptorSet.Create(GetDescriptorPool(), bindings);
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(0, &instanceBufferInfo, 0)};
+		descriptorSet.Update(descriptorWrites);
+
+		vk::DescriptorBufferInfo culledInstanceBufferInfo{m_CulledInstanceBuffers[i]->m_Buffer, 0,
+														  VK_WHOLE_SIZE};
+		auto& culledDescriptorSet = m_CulledInstanceDescriptorSets[i];
+		culledDescriptorSet.Init(device);
+		culledDescriptorSet.Create(GetDescriptorPool(), bindings);
+		std::vector<vk::WriteDescriptorSet> culledDescriptorWrites = {
+			culledDescriptorSet.CreateWrite(0, &culledInstanceBufferInfo, 0)};
+		culledDescriptorSet.Update(culledDescriptorWrites);
+	}
+}
+
+void Neon::VulkanRenderer::CreateCullPipeline()
+{
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(1, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(3, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(4, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+
+	m_OcclusionRenderPass =
+		CreateSceneRenderPass(device, vk::Format::eR32G32B32A32Sfloat, s_MsaaSamples,
+							  vk::AttachmentLoadOp::eClear, vk::AttachmentStoreOp::eStore);
+	m_OcclusionLoadRenderPass =
+		CreateSceneRenderPass(device, vk::Format::eR32G32B32A32Sfloat, s_MsaaSamples,
+							  vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore);
+	m_HiZPyramid.Init(device, GetDescriptorPool());
+
+	m_CullDescriptorSets.clear();
+	m_CullDescriptorSets.resize(m_SwapChain->GetImageViewSize());
+	for (size_t i = 0; i < m_SwapChain->GetImageViewSize(); i++)
+	{
+		vk::DescriptorBufferInfo instanceBufferInfo{m_InstanceBuffers[i]->m_Buffer, 0,
+													VK_WHOLE_SIZE};
+		vk::DescriptorBufferInfo drawCommandBufferInfo{m_DrawCommandBuffers[i]->m_Buffer, 0,
+													   VK_WHOLE_SIZE};
+		vk::DescriptorBufferInfo culledInstanceBufferInfo{m_CulledInstanceBuffers[i]->m_Buffer, 0,
+														  VK_WHOLE_SIZE};
+		vk::DescriptorBufferInfo retestBufferInfo{m_RetestBuffers[i]->m_Buffer, 0, VK_WHOLE_SIZE};
+
+		auto& descriptorSet = m_CullDescriptorSets[i];
+		descriptorSet.Init(device);
+		descriptorSet.Create(GetDescriptorPool(), bindings);
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(0, &instanceBufferInfo, 0),
+			descriptorSet.CreateWrite(1, &drawCommandBufferInfo, 0),
+			descriptorSet.CreateWrite(2, &culledInstanceBufferInfo, 0),
+			descriptorSet.CreateWrite(4, &retestBufferInfo, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
+	CreateOpaqueSceneTextures();
+
+	m_CullPipeline.Init(device);
+	m_CullPipeline.LoadComputeShader("src/Shaders/build/comp_cull.spv");
+	vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0,
+											sizeof(CullPushConstant)};
+	m_CullPipeline.CreatePipelineLayout({m_CullDescriptorSets[0].GetLayout()}, {pushConstantRange});
+	m_CullPipeline.CreatePipeline();
+}
+
+void Neon::VulkanRenderer::CreateOpaqueSceneTextures()
+{
+	const vk::Extent2D extent = m_SwapChain->GetExtent();
+	m_HiZPyramid.Create(extent, m_OffscreenDepthTextureImage);
+	for (auto& descriptorSet : m_CullDescriptorSets)
+	{
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(3, &m_HiZPyramid.GetDescriptor(), 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
+	m_HiZValid = false;
+
+	// The copy of the previous size is released first, its view and sampler are not owned
+	Allocator::DestroyTextureImage(m_OpaqueColorTextureImage);
+	m_OpaqueColorTextureImage.m_Descriptor = vk::DescriptorImageInfo{};
+	m_OpaqueColorTextureImage.m_TextureAllocation.reset();
+	m_OpaqueColorTextureImage.m_TextureAllocation = Allocator::CreateImage(
+		extent.width, extent.height, vk::SampleCountFlagBits::e1,
+		vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal,
+		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+	Allocator::TransitionImageLayout(m_OpaqueColorTextureImage.m_TextureAllocation->m_Image,
+									 vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
+									 vk::ImageLayout::eGeneral);
+	m_OpaqueColorTextureImage.m_Descriptor.imageView =
+		CreateImageView(m_OpaqueColorTextureImage.m_TextureAllocation->m_Image,
+						vk::Format::eR32G32B32A32Sfloat, vk::ImageAspectFlagBits::eColor);
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear;
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+	m_OpaqueColorTextureImage.m_Descriptor.sampler = CreateSampler(samplerInfo);
+	m_OpaqueColorTextureImage.m_Descriptor.imageLayout = vk::ImageLayout::eGeneral;
+}
+
+void Neon::VulkanRenderer::CreateSkinningPipeline()
+{
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+
+	const auto bindings = GetSkinningDescriptorSetBindings();
+	m_SkinningDescriptorSetLayout = device.createDescriptorSetLayoutUnique(
+		{{}, static_cast<uint32_t>(bindings.size()), bindings.data()});
+
+	m_SkinningPipeline.Init(device);
+	m_SkinningPipeline.LoadComputeShader("src/Shaders/build/comp_skinning.spv");
+	vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0,
+											sizeof(SkinningPushConstant)};
+	m_SkinningPipeline.CreatePipelineLayout({m_SkinningDescriptorSetLayout.get()},
+											{pushConstantRange});
+	m_SkinningPipeline.CreatePipeline();
+
+	// Dynamic offsets must be multiples of the storage buffer offset alignment
+	const vk::DeviceSize alignment = Neon::Context::GetInstance()
+										 .GetPhysicalDevice()
+										 .GetProperties()
+										 .limits.minStorageBufferOffsetAlignment;
+	m_BoneSliceSize = (sizeof(glm::mat4) * MAX_BONE_MATRICES_PER_FRAME + alignment - 1) /
+					  alignment * alignment;
+	m_BoneBuffer = Allocator::CreateMappedBuffer(m_BoneSliceSize * m_SwapChain->GetImageViewSize(),
+												 vk::BufferUsageFlagBits::eStorageBuffer,
+												 VMA_MEMORY_USAGE_CPU_TO_GPU);
+}
+
+uint32_t Neon::VulkanRenderer::CreateVisibilityQuery()
+{
+	s_Instance.m_Visibility.push_back(1);
+	return static_cast<uint32_t>(s_Instance.m_Visibility.size() - 1);
+}
+
+// Copies the instance counts the cull shader wrote into the draw commands answering visibility
+// queries, in the order of the queries, into the readback buffer of the image
+void Neon::VulkanRenderer::CopyVisibility(vk::CommandBuffer commandBuffer)
+{
+	const uint32_t imageIndex = m_SwapChain->GetImageIndex();
+	const auto& visibilityDraws = m_VisibilityDraws[imageIndex];
+	if (visibilityDraws.empty()) { return; }
+
+	vk::MemoryBarrier cullBarrier{vk::AccessFlagBits::eShaderWrite,
+								  vk::AccessFlagBits::eTransferRead};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+								  vk::PipelineStageFlagBits::eTransfer, {}, cullBarrier, nullptr,
+								  nullptr);
+	std::vector<vk::BufferCopy> regions;
+	regions.reserve(visibilityDraws.size());
+	for (size_t i = 0; i < visibilityDraws.size(); i++)
+	{
+		regions.emplace_back(sizeof(vk::DrawIndexedIndirectCommand) * visibilityDraws[i].second +
+								 offsetof(VkDrawIndexedIndirectCommand, instanceCount),
+							 sizeof(uint32_t) * i, sizeof(uint32_t));
+	}
+	commandBuffer.copyBuffer(m_DrawCommandBuffers[imageIndex]->m_Buffer,
+							 m_VisibilityBuffers[imageIndex]->m_Buffer, regions);
+	vk::MemoryBarrier readbackBarrier{vk::AccessFlagBits::eTransferWrite,
+									  vk::AccessFlagBits::eHostRead};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+								  vk::PipelineStageFlagBits::eHost, {}, readbackBarrier, nullptr,
+								  nullptr);
+}
+
+// The frame that last rendered to the acquired image is complete, so the instance counts it copied
+// for its visibility queries can be read before this frame records new ones
+void Neon::VulkanRenderer::ReadVisibility()
+{
+	const uint32_t imageIndex = m_SwapChain->GetImageIndex();
+	auto& visibilityDraws = m_VisibilityDraws[imageIndex];
+	if (visibilityDraws.empty()) { return; }
+	Allocator::InvalidateAllocation(m_VisibilityBuffers[imageIndex]->m_Allocation);
+	const auto* instanceCounts =
+		static_cast<const uint32_t*>(m_VisibilityBuffers[imageIndex]->m_MappedData);
+	for (size_t i = 0; i < visibilityDraws.size(); i++)
+	{ m_Visibility[visibilityDraws[i].first] = instanceCounts[i] > 0 ? 1 : 0; }
+	visibilityDraws.clear();
+}
+
+vk::RenderPass Neon::VulkanRenderer::GetSceneRenderPass(vk::Format colorFormat,
+														vk::SampleCountFlagBits samples,
+														bool multiview)
+{
+	if (colorFormat == vk::Format::eR32G32B32A32Sfloat && samples == s_MsaaSamples && !multiview)
+	{ return GetOffscreenRenderPass(); }
+	auto& renderPasses = s_Instance.m_SceneRenderPasses;
+	for (const auto& renderPass : renderPasses)
+	{
+		if (renderPass.m_ColorFormat == colorFormat && renderPass.m_Samples == samples &&
+			renderPass.m_Multiview == multiview)
+		{ return renderPass.m_RenderPass.get(); }
+	}
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	renderPasses.push_back({colorFormat, samples, multiview,
+							CreateSceneRenderPass(device, colorFormat, samples,
+												  vk::AttachmentLoadOp::eClear,
+												  vk::AttachmentStoreOp::eDontCare, multiview)});
+	return renderPasses.back().m_RenderPass.get();
+}
+
+void Neon::VulkanRenderer::UploadBoneMatrices(const std::vector<glm::mat4>& matrices,
+											  uint32_t count)
+{
+	assert(count <= matrices.size() && count <= MAX_BONE_MATRICES_PER_FRAME);
+	const uint32_t imageIndex = s_Instance.m_SwapChain->GetImageIndex();
+	auto* slice = static_cast<uint8_t*>(s_Instance.m_BoneBuffer->m_MappedData) +
+				  imageIndex * s_Instance.m_BoneSliceSize;
+	memcpy(slice, matrices.data(), sizeof(glm::mat4) * count);
+}
+
+std::vector<vk::DescriptorSetLayoutBinding>
+Neon::VulkanRenderer::GetSkinningDescriptorSetBindings()
+{
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(1, vk::DescriptorType::eStorageBufferDynamic, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	return bindings;
+}
+
+void Neon::VulkanRenderer::DispatchSkinning(SkinnedMeshRenderer& renderer)
+{
+	assert(renderer.m_SkinnedVertexBuffer);
+	const uint32_t imageIndex = s_Instance.m_SwapChain->GetImageIndex();
+	auto& commandBuffer = s_Instance.m_CommandBuffers[imageIndex].get();
+	const auto& pipeline = s_Instance.m_SkinningPipeline;
+
+	SkinningPushConstant pushConstant{renderer.m_Mesh.m_VerticesCount,
+									  imageIndex * renderer.m_Mesh.m_VerticesCount,
+									  renderer.m_BoneOffset};
+	const vk::DescriptorSet descriptorSet = renderer.m_SkinningDescriptorSet.Get();
+	const auto boneSliceOffset = static_cast<uint32_t>(imageIndex * s_Instance.m_BoneSliceSize);
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(pipeline));
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.GetLayout(), 0, 1,
+									 &descriptorSet, 1, &boneSliceOffset);
+	commandBuffer.pushConstants(pipeline.GetLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+								sizeof(SkinningPushConstant), &pushConstant);
+	commandBuffer.dispatch(
+		(pushConstant.vertexCount + SKINNING_WORKGROUP_SIZE - 1) / SKINNING_WORKGROUP_SIZE, 1, 1);
+
+	renderer.m_Mesh.m_StaticGeometry.m_VertexBuffer = renderer.m_SkinnedVertexBuffer->m_Buffer;
+	renderer.m_Mesh.m_StaticGeometry.m_BaseVertex = pushConstant.outputOffset;
+	s_Instance.m_SkinningPending = true;
+}
+
+void Neon::VulkanRenderer::BeginRenderPass(vk::CommandBuffer commandBuffer,
+										   vk::RenderPass renderPass)
+{
+	vk::RenderPassBeginInfo renderPassInfo{
+		renderPass, m_ScenePass.m_Framebuffer, {{0, 0}, m_ScenePass.m_Extent},
+		static_cast<uint32_t>(m_ScenePass.m_ClearValues.size()), m_ScenePass.m_ClearValues.data()};
+	commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+	vk::Viewport viewport{0.0f,
+						  0.0f,
+						  static_cast<float>(m_ScenePass.m_Extent.width),
+						  static_cast<float>(m_ScenePass.m_Extent.height),
+						  0.0f,
+						  1.0f};
+	commandBuffer.setViewport(0, 1, &viewport);
+	vk::Rect2D scissor{{0, 0}, m_ScenePass.m_Extent};
+	commandBuffer.setScissor(0, 1, &scissor);
+}
+
+void Neon::VulkanRenderer::FlushRenderQueue(vk::CommandBuffer commandBuffer)
+{
+	if (m_SkinningPending)
+	{
+		vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite,
+								  vk::AccessFlagBits::eVertexAttributeRead};
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+									  vk::PipelineStageFlagBits::eVertexInput, {}, barrier, nullptr,
+									  nullptr);
+		m_SkinningPending = false;
+	}
+
+	m_RenderQueue.Sort();
+	if (m_GpuDriven) { SubmitGpuDriven(commandBuffer); }
+	else
+	{
+		SubmitDirect(commandBuffer);
+	}
+}
+
+void Neon::VulkanRenderer::SubmitDirect(vk::CommandBuffer commandBuffer)
+{
+	const uint32_t imageIndex = m_SwapChain->GetImageIndex();
+	auto* instanceTransforms = static_cast<glm::mat4*>(m_InstanceBuffers[imageIndex]->m_MappedData);
+	const vk::DescriptorSet instanceDescriptorSet = m_InstanceDescriptorSets[imageIndex].Get();
+	// Packets past the instances left for the frame are dropped
+	const size_t packetEnd =
+		std::min(m_RenderQueue.Size(), size_t{MAX_INSTANCES_PER_FRAME - m_InstanceCount});
+	if (packetEnd < m_RenderQueue.Size())
+	{ NEO_CORE_WARN("Instance buffer full, {0} draws dropped", m_RenderQueue.Size() - packetEnd); }
+
+	// The opaque scene is captured before the first blended packet, the render pass drawing the
+	// opaque ones stores its targets for it
+	bool captureOpaque = m_ScenePass.m_CaptureOpaque;
+	BeginRenderPass(commandBuffer,
+					captureOpaque ? m_OcclusionRenderPass.get() : m_ScenePass.m_RenderPass);
+
+	BoundState boundState;
+	size_t i = 0;
+	while (i < packetEnd)
+	{
+		const auto& packet = m_RenderQueue[i];
+		if (captureOpaque && packet.m_Layer == RenderLayer::Transparent)
+		{
+			commandBuffer.endRenderPass();
+			CaptureOpaqueScene(commandBuffer);
+			BeginRenderPass(commandBuffer, m_OcclusionLoadRenderPass.get());
+			captureOpaque = false;
+		}
+
+		// Sorting placed packets sharing pipeline, material and mesh next to each other, so the
+		// whole run is drawn as instances reading their transforms from the instance buffer
+		const uint32_t firstInstance = m_InstanceCount;
+		size_t runEnd = i;
+		do
+		{
+			instanceTransforms[m_InstanceCount++] = m_RenderQueue[runEnd].m_Model;
+			runEnd++;
+		} while (runEnd < packetEnd && packet.IsInstanceCompatible(m_RenderQueue[runEnd]));
+
+		// Nothing is culled on this path
+		if (packet.m_VisibilityQuery != DRAW_PACKET_NO_QUERY)
+		{ m_Visibility[packet.m_VisibilityQuery] = 1; }
+		BindDrawState(commandBuffer, packet, instanceDescriptorSet, boundState);
+		commandBuffer.drawIndexed(packet.m_IndexCount, static_cast<uint32_t>(runEnd - i),
+								  packet.m_FirstIndex, packet.m_VertexOffset, firstInstance);
+		i = runEnd;
+	}
+}
+
+void Neon::VulkanRenderer::SubmitGpuDriven(vk::CommandBuffer commandBuffer)
+{
+	const uint32_t imageIndex = m_SwapChain->GetImageIndex();
+	auto* instances = static_cast<GpuInstance*>(m_InstanceBuffers[imageIndex]->m_MappedData);
+	auto* drawCommands = static_cast<vk::DrawIndexedIndirectCommand*>(
+		m_DrawCommandBuffers[imageIndex]->m_MappedData);
+	const bool occlusionCulling = m_ScenePass.m_OcclusionCulling;
+	// Packets past the instances or draw commands left for the frame are dropped
+	const size_t packetEnd =
+		std::min(m_RenderQueue.Size(), size_t{MAX_INSTANCES_PER_FRAME - m_InstanceCount});
+
+	// One indirect command per run of instance compatible packets, its instance count is
+	// filled by the cull shader. Commands that can share binds form one multi draw bucket.
+	const uint32_t firstInstance = m_InstanceCount;
+	m_DrawBuckets.clear();
+	size_t i = 0;
+	while (i < packetEnd && m_DrawCount < MAX_DRAWS_PER_FRAME)
+	{
+		const size_t runStart = i;
+		const auto& packet = m_RenderQueue[runStart];
+		const uint32_t drawIndex = m_DrawCount++;
+		drawCommands[drawIndex] = vk::DrawIndexedIndirectCommand{
+			packet.m_IndexCount, 0, packet.m_FirstIndex, packet.m_VertexOffset, m_InstanceCount};
+		drawCommands[MAX_DRAWS_PER_FRAME + drawIndex] = drawCommands[drawIndex];
+		// Deferred instances are only counted by the disocclusion phase
+		if (packet.m_VisibilityQuery != DRAW_PACKET_NO_QUERY)
+		{
+			const bool deferred =
+				occlusionCulling && packet.m_Layer == RenderLayer::Transparent;
+			m_VisibilityDraws[imageIndex].emplace_back(
+				packet.m_VisibilityQuery, deferred ? MAX_DRAWS_PER_FRAME + drawIndex : drawIndex);
+		}
+		do
+		{
+			auto& instance = instances[m_InstanceCount++];
+			instance.model = m_RenderQueue[i].m_Model;
+			instance.boundingSphere = m_RenderQueue[i].m_BoundingSphere;
+			instance.drawIndex = drawIndex;
+			// Blended geometry has to come after everything the disocclusion phase adds
+			instance.flags = occlusionCulling && m_RenderQueue[i].m_Layer == RenderLayer::Transparent
+								 ? GPU_INSTANCE_FLAG_DEFERRED
+								 : 0;
+			i++;
+		} while (i < packetEnd && packet.IsInstanceCompatible(m_RenderQueue[i]));
+
+		if (m_DrawBuckets.empty() ||
+			!m_RenderQueue[m_DrawBuckets.back().m_PacketIndex].IsBindCompatible(packet) ||
+			m_RenderQueue[m_DrawBuckets.back().m_PacketIndex].m_Layer != packet.m_Layer)
+		{ m_DrawBuckets.push_back({runStart, drawIndex, 0}); }
+		m_DrawBuckets.back().m_DrawCount++;
+	}
+	const uint32_t instanceCount = m_InstanceCount - firstInstance;
+	if (i < m_RenderQueue.Size())
+	{ NEO_CORE_WARN("Instance or draw buffer full, {0} draws dropped", m_RenderQueue.Size() - i); }
+
+	size_t deferredBucket = 0;
+	while (deferredBucket < m_DrawBuckets.size() &&
+		   m_RenderQueue[m_DrawBuckets[deferredBucket].m_PacketIndex].m_Layer !=
+			   RenderLayer::Transparent)
+	{ deferredBucket++; }
+
+	if (!occlusionCulling)
+	{
+		DispatchCull(commandBuffer, CullPhase::Frustum, firstInstance, instanceCount,
+					 m_ScenePass.m_ViewProjection);
+		if (!m_ScenePass.m_CaptureOpaque)
+		{
+			BeginRenderPass(commandBuffer, m_ScenePass.m_RenderPass);
+			DrawBuckets(commandBuffer, 0, m_DrawBuckets.size(), 0);
+			return;
+		}
+		BeginRenderPass(commandBuffer, m_OcclusionRenderPass.get());
+		DrawBuckets(commandBuffer, 0, deferredBucket, 0);
+		commandBuffer.endRenderPass();
+		CaptureOpaqueScene(commandBuffer);
+		BeginRenderPass(commandBuffer, m_OcclusionLoadRenderPass.get());
+		DrawBuckets(commandBuffer, deferredBucket, m_DrawBuckets.size(), 0);
+		return;
+	}
+
+	// Draw what was visible against the previous frame's depth, reprojected with its matrices
+	DispatchCull(commandBuffer, CullPhase::Occlusion, firstInstance, instanceCount,
+				 m_PreviousViewProjection);
+	BeginRenderPass(commandBuffer, m_OcclusionRenderPass.get());
+	DrawBuckets(commandBuffer, 0, deferredBucket, 0);
+	commandBuffer.endRenderPass();
+
+	// Retest the rejected instances against the depth drawn so far and add the disoccluded ones
+	// together with the deferred blended geometry
+	m_HiZPyramid.Build(commandBuffer);
+	DispatchCull(commandBuffer, CullPhase::Disocclusion, firstInstance, instanceCount,
+				 m_ScenePass.m_ViewProjection);
+	BeginRenderPass(commandBuffer, m_OcclusionLoadRenderPass.get());
+	if (!m_ScenePass.m_CaptureOpaque)
+	{ DrawBuckets(commandBuffer, 0, m_DrawBuckets.size(), MAX_DRAWS_PER_FRAME); }
+	else
+	{
+		// The pyramid is rebuilt to include the disoccluded instances
+		DrawBuckets(commandBuffer, 0, deferredBucket, MAX_DRAWS_PER_FRAME);
+		commandBuffer.endRenderPass();
+		CaptureOpaqueScene(commandBuffer);
+		BeginRenderPass(commandBuffer, m_OcclusionLoadRenderPass.get());
+		DrawBuckets(commandBuffer, deferredBucket, m_DrawBuckets.size(), MAX_DRAWS_PER_FRAME);
+	}
+
+	m_PreviousViewProjection = m_ScenePass.m_ViewProjection;
+	m_HiZValid = true;
+}
+
+void Neon::VulkanRenderer::CaptureOpaqueScene(vk::CommandBuffer commandBuffer)
+{
+	m_HiZPyramid.Build(commandBuffer);
+	m_PreviousViewProjection = m_ScenePass.m_ViewProjection;
+	m_HiZValid = true;
+
+	// Wait for the color resolve and for the blended geometry of earlier frames reading the copy
+	vk::MemoryBarrier copyBarrier{vk::AccessFlagBits::eColorAttachmentWrite |
+									  vk::AccessFlagBits::eShaderRead,
+								  vk::AccessFlagBits::eTransferRead |
+									  vk::AccessFlagBits::eTransferWrite};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput |
+									  vk::PipelineStageFlagBits::eFragmentShader,
+								  vk::PipelineStageFlagBits::eTransfer, {}, copyBarrier, nullptr,
+								  nullptr);
+	vk::ImageCopy region{{vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+						 {0, 0, 0},
+						 {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+						 {0, 0, 0},
+						 {m_ScenePass.m_Extent.width, m_ScenePass.m_Extent.height, 1}};
+	commandBuffer.copyImage(m_OffscreenColorTextureImage.m_TextureAllocation->m_Image,
+							vk::ImageLayout::eGeneral,
+							m_OpaqueColorTextureImage.m_TextureAllocation->m_Image,
+							vk::ImageLayout::eGeneral, region);
+
+	vk::MemoryBarrier readBarrier{vk::AccessFlagBits::eTransferWrite |
+									  vk::AccessFlagBits::eShaderWrite,
+								  vk::AccessFlagBits::eShaderRead};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer |
+									  vk::PipelineStageFlagBits::eComputeShader,
+								  vk::PipelineStageFlagBits::eFragmentShader, {}, readBarrier,
+								  nullptr, nullptr);
+}
+
+void Neon::VulkanRenderer::DispatchCull(vk::CommandBuffer commandBuffer, CullPhase phase,
+										uint32_t firstInstance, uint32_t instanceCount,
+										const glm::mat4& occlusionViewProjection)
+{
+	if (instanceCount == 0) { return; }
+
+	CullPushConstant cullPushConstant{};
+	Frustum frustum(m_ScenePass.m_ViewProjection);
+	std::copy(std::begin(frustum.m_Planes), std::end(frustum.m_Planes),
+			  cullPushConstant.frustumPlanes);
+	cullPushConstant.occlusionViewProjection = occlusionViewProjection;
+	cullPushConstant.depthExtent = {static_cast<int>(m_ScenePass.m_Extent.width),
+									static_cast<int>(m_ScenePass.m_Extent.height)};
+	cullPushConstant.firstInstance = firstInstance;
+	cullPushConstant.instanceCount = instanceCount;
+	cullPushConstant.phase = phase;
+	cullPushConstant.hiZValid = m_HiZValid ? 1 : 0;
+	cullPushConstant.disocclusionDrawOffset = MAX_DRAWS_PER_FRAME;
+	cullPushConstant.mirrored = m_ScenePass.m_Multiview ? 1 : 0;
+	cullPushConstant.mirrorHeight = m_ScenePass.m_MirrorHeight;
+
+	const vk::DescriptorSet cullDescriptorSet =
+		m_CullDescriptorSets[m_SwapChain->GetImageIndex()].Get();
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_CullPipeline));
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_CullPipeline.GetLayout(), 0,
+									 1, &cullDescriptorSet, 0, nullptr);
+	commandBuffer.pushConstants(m_CullPipeline.GetLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+								sizeof(CullPushConstant), &cullPushConstant);
+	commandBuffer.dispatch((instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	// Also orders the depth pyramid reads before the next depth writes
+	vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite,
+							  vk::AccessFlagBits::eIndirectCommandRead |
+								  vk::AccessFlagBits::eShaderRead};
+	commandBuffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eComputeShader,
+		vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader |
+			vk::PipelineStageFlagBits::eComputeShader |
+			vk::PipelineStageFlagBits::eEarlyFragmentTests |
+			vk::PipelineStageFlagBits::eLateFragmentTests |
+			vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		{}, barrier, nullptr, nullptr);
+}
+
+void Neon::VulkanRenderer::DrawBuckets(vk::CommandBuffer commandBuffer, size_t firstBucket,
+									   size_t bucketEnd, uint32_t drawOffset)
+{
+	const uint32_t imageIndex = m_SwapChain->GetImageIndex();
+	const vk::Buffer drawCommandBuffer = m_DrawCommandBuffers[imageIndex]->m_Buffer;
+	const vk::DescriptorSet culledDescriptorSet = m_CulledInstanceDescriptorSets[imageIndex].Get();
+
+	BoundState boundState;
+	for (size_t bucketIndex = firstBucket; bucketIndex < bucketEnd; bucketIndex++)
+	{
+		const auto& bucket = m_DrawBuckets[bucketIndex];
+		BindDrawState(commandBuffer, m_RenderQueue[bucket.m_PacketIndex], culledDescriptorSet,
+					  boundState);
+		commandBuffer.drawIndexedIndirect(
+			drawCommandBuffer,
+			(drawOffset + bucket.m_FirstDraw) * sizeof(vk::DrawIndexedIndirectCommand),
+			bucket.m_DrawCount, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+}
+
+void Neon::VulkanRenderer::BindDrawState(vk::CommandBuffer commandBuffer,
+										 const DrawPacket& packet,
+										 vk::DescriptorSet instanceDescriptorSet,
+										 BoundState& boundState)
+{
+	if (packet.m_Pipeline != boundState.m_Pipeline)
+	{
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, packet.m_Pipeline);
+		boundState.m_Pipeline = packet.m_Pipeline;
+	}
+	if (packet.m_PipelineLayout != boundState.m_Layout)
+	{
+		// Every layout declares the same push constant range, the whole block is only
+		// pushed again (and sets rebound) when the layout itself changes
+		m_PushConstant.moveFactor = packet.m_MoveFactor;
+		commandBuffer.pushConstants(packet.m_PipelineLayout,
+									vk::ShaderStageFlagBits::eVertex |
+										vk::ShaderStageFlagBits::eFragment,
+									0, sizeof(PushConstant), &m_PushConstant);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, packet.m_PipelineLayout,
+										 1, 1, &instanceDescriptorSet, 0, nullptr);
+		boundState.m_Layout = packet.m_PipelineLayout;
+		boundState.m_DescriptorSet = nullptr;
+		boundState.m_MoveFactor = packet.m_MoveFactor;
+	}
+	else if (packet.m_MoveFactor != boundState.m_MoveFactor)
+	{
+		commandBuffer.pushConstants(packet.m_PipelineLayout,
+									vk::ShaderStageFlagBits::eVertex |
+										vk::ShaderStageFlagBits::eFragment,
+									offsetof(PushConstant, moveFactor), sizeof(float),
+									&packet.m_MoveFactor);
+		boundState.m_MoveFactor = packet.m_MoveFactor;
+	}
+	if (packet.m_DescriptorSet && packet.m_DescriptorSet != boundState.m_DescriptorSet)
+	{
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, packet.m_PipelineLayout,
+										 0, 1, &packet.m_DescriptorSet, 0, nullptr);
+		boundState.m_DescriptorSet = packet.m_DescriptorSet;
+	}
+	if (packet.m_VertexBuffer != boundState.m_VertexBuffer)
+	{
+		commandBuffer.bindVertexBuffers(0, {packet.m_VertexBuffer}, {0});
+		boundState.m_VertexBuffer = packet.m_VertexBuffer;
+	}
+	if (packet.m_IndexBuffer != boundState.m_IndexBuffer)
+	{
+		commandBuffer.bindIndexBuffer(packet.m_IndexBuffer, 0, vk::IndexType::eUint32);
+		boundState.m_IndexBuffer = packet.m_IndexBuffer;
+	}
+}
+
 void Neon::VulkanRenderer::CreateFrameBuffers(vk::Extent2D extent,
 											  Neon::TextureImage& sampledColorTextureImage,
 											  Neon::TextureImage& sampledDepthTextureImage,
 											  Neon::TextureImage& colorTextureImage,
 											  Neon::TextureImage& depthTextureImage,
-											  std::vector<vk::UniqueFramebuffer>& frameBuffers)
+											  std::vector<vk::UniqueFramebuffer>& frameBuffers,
+											  vk::Format colorFormat,
+											  vk::SampleCountFlagBits samples, bool multiview)
 {
 	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	const bool resolve = samples != vk::SampleCountFlagBits::e1;
+	const uint32_t layerCount = multiview ? 2 : 1;
+	const vk::ImageViewType viewType =
+		multiview ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
 
-	sampledColorTextureImage.m_TextureAllocation = Allocator::CreateImage(
-		extent.width, extent.height, VulkanRenderer::GetMsaaSamples(),
-		vk::Format::eR32G32B32A32Sfloat, vk::ImageTiling::eOptimal,
-		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
-		VMA_MEMORY_USAGE_GPU_ONLY);
-	Neon::Allocator::TransitionImageLayout(sampledColorTextureImage.m_TextureAllocation->m_Image,
-										   vk::ImageAspectFlagBits::eColor,
-										   vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
-	sampledColorTextureImage.m_Descriptor.imageView = VulkanRenderer::CreateImageView(
-		sampledColorTextureImage.m_TextureAllocation->m_Image, vk::Format::eR32G32B32A32Sfloat,
-		vk::ImageAspectFlagBits::eColor);
-
-	sampledDepthTextureImage.m_TextureAllocation =
-		Neon::Allocator::CreateImage(extent.width, extent.height, VulkanRenderer::GetMsaaSamples(),
-									 vk::Format::eD32Sfloat, vk::ImageTiling::eOptimal,
-									 vk::ImageUsageFlagBits::eDepthStencilAttachment |
-										 vk::ImageUsageFlagBits::eTransientAttachment,
-									 VMA_MEMORY_USAGE_GPU_ONLY);
-	Neon::Allocator::TransitionImageLayout(
-		sampledDepthTextureImage.m_TextureAllocation->m_Image, vk::ImageAspectFlagBits::eDepth,
-		vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal);
-	sampledDepthTextureImage.m_Descriptor.imageView =
-		VulkanRenderer::CreateImageView(sampledDepthTextureImage.m_TextureAllocation->m_Image,
-										vk::Format::eD32Sfloat, vk::ImageAspectFlagBits::eDepth);
+	if (resolve)
+	{
+		sampledColorTextureImage.m_TextureAllocation = Allocator::CreateImage(
+			extent.width, extent.height, samples, colorFormat, vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eColorAttachment |
+				vk::ImageUsageFlagBits::eTransientAttachment,
+			VMA_MEMORY_USAGE_GPU_ONLY, 1, layerCount);
+		Neon::Allocator::TransitionImageLayout(
+			sampledColorTextureImage.m_TextureAllocation->m_Image, vk::ImageAspectFlagBits::eColor,
+			vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1, layerCount);
+		sampledColorTextureImage.m_Descriptor.imageView = VulkanRenderer::CreateImageView(
+			sampledColorTextureImage.m_TextureAllocation->m_Image, colorFormat,
+			vk::ImageAspectFlagBits::eColor, viewType, 0, layerCount);
+
+		sampledDepthTextureImage.m_TextureAllocation = Neon::Allocator::CreateImage(
+			extent.width, extent.height, samples, vk::Format::eD32Sfloat,
+			vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eDepthStencilAttachment |
+				vk::ImageUsageFlagBits::eTransientAttachment,
+			VMA_MEMORY_USAGE_GPU_ONLY, 1, layerCount);
+		Neon::Allocator::TransitionImageLayout(
+			sampledDepthTextureImage.m_TextureAllocation->m_Image, vk::ImageAspectFlagBits::eDepth,
+			vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal, 1,
+			layerCount);
+		sampledDepthTextureImage.m_Descriptor.imageView = VulkanRenderer::CreateImageView(
+			sampledDepthTextureImage.m_TextureAllocation->m_Image, vk::Format::eD32Sfloat,
+			vk::ImageAspectFlagBits::eDepth, viewType, 0, layerCount);
+	}
 
 	colorTextureImage.m_TextureAllocation = Neon::Allocator::CreateImage(
-		extent.width, extent.height, vk::SampleCountFlagBits::e1, vk::Format::eR32G32B32A32Sfloat,
+		extent.width, extent.height, vk::SampleCountFlagBits::e1, colorFormat,
 		vk::ImageTiling::eOptimal,
-		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled |
+			vk::ImageUsageFlagBits::eTransferSrc,
+		VMA_MEMORY_USAGE_GPU_ONLY, 1, layerCount);
 	Neon::Allocator::TransitionImageLayout(colorTextureImage.m_TextureAllocation->m_Image,
 										   vk::ImageAspectFlagBits::eColor,
-										   vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+										   vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+										   1, layerCount);
 	colorTextureImage.m_Descriptor.imageView = VulkanRenderer::CreateImageView(
-		colorTextureImage.m_TextureAllocation->m_Image, vk::Format::eR32G32B32A32Sfloat,
-		vk::ImageAspectFlagBits::eColor);
+		colorTextureImage.m_TextureAllocation->m_Image, colorFormat,
+		vk::ImageAspectFlagBits::eColor, viewType, 0, layerCount);
 	colorTextureImage.m_Descriptor.sampler = VulkanRenderer::CreateSampler(vk::SamplerCreateInfo());
 	colorTextureImage.m_Descriptor.imageLayout = vk::ImageLayout::eGeneral;
 
@@ -351,31 +1166,43 @@ void Neon::VulkanRenderer::CreateFrameBuffers(vk::Extent2D extent,
 		extent.width, extent.height, vk::SampleCountFlagBits::e1, vk::Format::eD32Sfloat,
 		vk::ImageTiling::eOptimal,
 		vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
-		VMA_MEMORY_USAGE_GPU_ONLY);
+		VMA_MEMORY_USAGE_GPU_ONLY, 1, layerCount);
 	Neon::Allocator::TransitionImageLayout(
 		depthTextureImage.m_TextureAllocation->m_Image, vk::ImageAspectFlagBits::eDepth,
-		vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal);
-	depthTextureImage.m_Descriptor.imageView =
-		VulkanRenderer::CreateImageView(depthTextureImage.m_TextureAllocation->m_Image,
-										vk::Format::eD32Sfloat, vk::ImageAspectFlagBits::eDepth);
+		vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal, 1,
+		layerCount);
+	depthTextureImage.m_Descriptor.imageView = VulkanRenderer::CreateImageView(
+		depthTextureImage.m_TextureAllocation->m_Image, vk::Format::eD32Sfloat,
+		vk::ImageAspectFlagBits::eDepth, viewType, 0, layerCount);
 	depthTextureImage.m_Descriptor.sampler = VulkanRenderer::CreateSampler(vk::SamplerCreateInfo());
 	depthTextureImage.m_Descriptor.imageLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
 
+	std::vector<vk::ImageView> attachments;
+	if (resolve)
+	{
+		attachments = {sampledColorTextureImage.m_Descriptor.imageView,
+					   sampledDepthTextureImage.m_Descriptor.imageView,
+					   colorTextureImage.m_Descriptor.imageView,
+					   depthTextureImage.m_Descriptor.imageView};
+	}
+	else
+	{
+		attachments = {colorTextureImage.m_Descriptor.imageView,
+					   depthTextureImage.m_Descriptor.imageView};
+	}
+
 	frameBuffers.clear();
 	frameBuffers.reserve(MAX_SWAP_CHAIN_IMAGES);
 	for (size_t i = 0; i < MAX_SWAP_CHAIN_IMAGES; i++)
 	{
-		std::vector<vk::ImageView> attachments = {sampledColorTextureImage.m_Descriptor.imageView,
-												  sampledDepthTextureImage.m_Descriptor.imageView,
-												  colorTextureImage.m_Descriptor.imageView,
-												  depthTextureImage.m_Descriptor.imageView};
-
 		vk::FramebufferCreateInfo framebufferInfo;
-		framebufferInfo.setRenderPass(VulkanRenderer::GetOffscreenRenderPass());
+		framebufferInfo.setRenderPass(
+			VulkanRenderer::GetSceneRenderPass(colorFormat, samples, multiview));
 		framebufferInfo.setAttachmentCount(static_cast<uint32_t>(attachments.size()));
 		framebufferInfo.setPAttachments(attachments.data());
 		framebufferInfo.setWidth(extent.width);
 		framebufferInfo.setHeight(extent.height);
+		// Multiview framebuffers have a single layer, the views select the image layers
 		framebufferInfo.setLayers(1);
 
 		frameBuffers.push_back(device.createFramebufferUnique(framebufferInfo));
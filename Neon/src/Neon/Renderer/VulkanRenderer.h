@@ -6,8 +6,10 @@
 #include <Scene/Components.h>
 #include <Scene/Entity.h>
 
+#include "ComputePipeline.h"
 #include "DescriptorSet.h"
 #include "GraphicsPipeline.h"
+#include "HiZPyramid.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include "Window/Window.h"
@@ -15,10 +17,18 @@
 #include "Allocator.h"
 #include "DescriptorPool.h"
 #include "PhysicalDevice.h"
+#include "RenderQueue.h"
 #include "SwapChain.h"
 #include "Window.h"
 
 #define MAX_SWAP_CHAIN_IMAGES 8
+#define MAX_INSTANCES_PER_FRAME 65536
+#define MAX_DRAWS_PER_FRAME 8192
+#define CULL_WORKGROUP_SIZE 64
+#define SKINNING_WORKGROUP_SIZE 64
+#define MAX_BONE_MATRICES_PER_FRAME 65536
+
+#define GPU_INSTANCE_FLAG_DEFERRED 1
 
 namespace Neon
 {
@@ -30,14 +40,54 @@ struct PushConstant
 
 	glm::vec4 clippingPlane;
 
-	glm::mat4 model;
-
 	int pointLight;
 	float lightIntensity;
 	glm::vec3 lightDirection;
 	glm::vec3 lightPosition;
 
 	float moveFactor;
+	// Multiview passes draw a second view mirroring the camera across the plane y = mirrorHeight
+	float mirrorHeight;
+	// Sphere of the sky dome (xyz center, w radius) for shaders that trace rays to it
+	glm::vec4 skyDome;
+};
+
+// Per instance record read by shader_comp_cull.comp
+struct GpuInstance
+{
+	glm::mat4 model;
+	glm::vec4 boundingSphere;
+	uint32_t drawIndex;
+	uint32_t flags;
+	uint32_t padding[2];
+};
+
+enum class CullPhase : uint32_t
+{
+	Frustum = 0,
+	Occlusion = 1,
+	Disocclusion = 2
+};
+
+struct CullPushConstant
+{
+	glm::vec4 frustumPlanes[6];
+	glm::mat4 occlusionViewProjection;
+	glm::ivec2 depthExtent;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+	CullPhase phase;
+	uint32_t hiZValid;
+	uint32_t disocclusionDrawOffset;
+	uint32_t mirrored;
+	float mirrorHeight;
+};
+
+struct SkinningPushConstant
+{
+	uint32_t vertexCount;
+	uint32_t outputOffset;
+	uint32_t boneOffset;
 };
 
 class VulkanRenderer
@@ -55,13 +105,18 @@ public:
 						   const vk::Extent2D& extent, const glm::vec4& clearColor,
 						   const Neon::PerspectiveCamera& camera, const glm::vec4& clippingPlane,
 						   bool pointLight, float lightIntensity, glm::vec3 lightDirection,
-						   const glm::vec3& lightPosition);
+						   const glm::vec3& lightPosition, bool occlusionCulling = false,
+						   vk::Format colorFormat = vk::Format::eR32G32B32A32Sfloat,
+						   vk::SampleCountFlagBits samples = s_MsaaSamples,
+						   bool multiview = false, float mirrorHeight = 0.0f);
 	static void EndScene();
 	static void DrawImGui();
 	static vk::CommandBuffer BeginSingleTimeCommands();
 	static void EndSingleTimeCommands(vk::CommandBuffer commandBuffer);
 	static vk::ImageView CreateImageView(vk::Image image, vk::Format format,
-										 const vk::ImageAspectFlags& aspectFlags);
+										 const vk::ImageAspectFlags& aspectFlags,
+										 vk::ImageViewType viewType = vk::ImageViewType::e2D,
+										 uint32_t baseArrayLayer = 0, uint32_t layerCount = 1);
 	static vk::UniqueImageView CreateImageViewUnique(vk::Image image, vk::Format format,
 													 const vk::ImageAspectFlags& aspectFlags);
 	static vk::Sampler CreateSampler(const vk::SamplerCreateInfo& createInfo);
@@ -80,6 +135,12 @@ public:
 		assert(s_Instance.m_OffscreenRenderPass.get());
 		return s_Instance.m_OffscreenRenderPass.get();
 	}
+	// Scene pass drawing into framebuffers of CreateFrameBuffers with colorFormat and samples,
+	// the offscreen render pass for its own format and sample count. Multiview passes draw both
+	// layers of two layer targets.
+	static vk::RenderPass GetSceneRenderPass(vk::Format colorFormat,
+											 vk::SampleCountFlagBits samples,
+											 bool multiview = false);
 	static vk::DescriptorPool GetDescriptorPool()
 	{
 		assert(!s_Instance.m_DescriptorPools.empty());
@@ -93,48 +154,170 @@ public:
 	{
 		return s_Instance.m_OffscreenFrameBuffers;
 	}
+	static vk::DescriptorSetLayout GetInstanceDescriptorSetLayout()
+	{
+		assert(!s_Instance.m_InstanceDescriptorSets.empty());
+		return s_Instance.m_InstanceDescriptorSets[0].GetLayout();
+	}
+	static vk::DescriptorSetLayout GetEmptyDescriptorSetLayout()
+	{
+		assert(s_Instance.m_EmptyDescriptorSetLayout);
+		return s_Instance.m_EmptyDescriptorSetLayout.get();
+	}
+	// Switches between GPU culled indirect draws and CPU recorded draws, applied from the next frame
+	static void SetGpuDriven(bool gpuDriven)
+	{
+		s_Instance.m_RequestedGpuDriven = gpuDriven;
+	}
+	static bool IsGpuDriven()
+	{
+		return s_Instance.m_RequestedGpuDriven;
+	}
+	// Sky dome of the scene, kept by the push constant of the following scene passes
+	static void SetSkyDome(const glm::vec4& sphere)
+	{
+		s_Instance.m_PushConstant.skyDome = sphere;
+	}
+	static uint32_t GetImageIndex()
+	{
+		return s_Instance.m_SwapChain->GetImageIndex();
+	}
+	// Splits the next main scene pass after its opaque geometry to build the depth pyramid and
+	// copy the color, so that the blended geometry drawn after the split can sample them
+	static void RequestOpaqueScene()
+	{
+		s_Instance.m_OpaqueSceneRequested = true;
+	}
+	// Resolved color of the opaque main pass, recreated with the window
+	static const vk::DescriptorImageInfo& GetOpaqueColorDescriptor()
+	{
+		return s_Instance.m_OpaqueColorTextureImage.m_Descriptor;
+	}
+	// Depth pyramid of the opaque main pass, recreated with the window
+	static const vk::DescriptorImageInfo& GetHiZDescriptor()
+	{
+		return s_Instance.m_HiZPyramid.GetDescriptor();
+	}
+	// Command buffer of the current swap chain image, compute work recorded into it outside of
+	// BeginScene/EndScene runs before the scene passes of the frame
+	static vk::CommandBuffer GetCommandBuffer()
+	{
+		return s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
+	}
+	// Query answered by GPU culling: tells whether any instance of the draws submitted with it
+	// survived frustum and occlusion culling. Results are read back when the swap chain image that
+	// drew them is acquired again, so they lag a few frames behind and are visible until then.
+	static uint32_t CreateVisibilityQuery();
+	static bool IsVisible(uint32_t query)
+	{
+		return s_Instance.m_Visibility[query] != 0;
+	}
+	// Source vertices, bone transforms and skinned output read by shader_comp_skinning.comp
+	static std::vector<vk::DescriptorSetLayoutBinding> GetSkinningDescriptorSetBindings();
+	// Skins the bind pose of renderer into the region of the current swap chain image, must be
+	// called outside of BeginScene/EndScene before the mesh is rendered this frame
+	static void DispatchSkinning(SkinnedMeshRenderer& renderer);
+	// Persistently mapped ring holding one slice of bone matrices per swap chain image, bound as
+	// a dynamic storage buffer of GetBoneSliceSize() bytes offset to the current image's slice.
+	// Each instance reads its palette at its bone offset within the slice.
+	static vk::Buffer GetBoneBuffer()
+	{
+		assert(s_Instance.m_BoneBuffer);
+		return s_Instance.m_BoneBuffer->m_Buffer;
+	}
+	static vk::DeviceSize GetBoneSliceSize()
+	{
+		return s_Instance.m_BoneSliceSize;
+	}
+	// Copies the first count matrices of the frame's bone palettes into the slice of the current
+	// swap chain image with a single write. The slice was last read by the frame that rendered
+	// to the image, whose fence was waited when the image was acquired.
+	static void UploadBoneMatrices(const std::vector<glm::mat4>& matrices, uint32_t count);
+
+	template<typename T>
+	static void Render(const Transform& transformComponent, const T& renderer, float moveFactor,
+					   RenderLayer layer = RenderLayer::Opaque,
+					   uint32_t visibilityQuery = DRAW_PACKET_NO_QUERY)
+	{
+		Render(transformComponent, renderer, renderer.m_Mesh, moveFactor, layer, visibilityQuery);
+	}
 
+	// Draws mesh with the pipeline and descriptor sets of renderer, for instances that share
+	// their material but not their geometry
 	template<typename T>
-	static void Render(const Transform& transformComponent, const T& renderer, vk::Extent2D extent,
-					   float moveFactor)
-	{
-		auto& commandBuffer =
-			s_Instance.m_CommandBuffers[s_Instance.m_SwapChain->GetImageIndex()].get();
-		vk::Viewport viewport{
-			0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height),
-			0.0f, 1.0f};
-		commandBuffer.setViewport(0, 1, &viewport);
-		vk::Rect2D scissor{{0, 0}, extent};
-		commandBuffer.setScissor(0, 1, &scissor);
-
-		commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics,
-								   static_cast<vk::Pipeline>(renderer.m_GraphicsPipeline));
-
-		if (renderer.m_DescriptorSets.size() > 0)
+	static void Render(const Transform& transformComponent, const T& renderer, const Mesh& mesh,
+					   float moveFactor, RenderLayer layer = RenderLayer::Opaque,
+					   uint32_t visibilityQuery = DRAW_PACKET_NO_QUERY)
+	{
+		Render(transformComponent, renderer.m_GraphicsPipeline, renderer.m_DescriptorSets, mesh,
+			   moveFactor, layer, visibilityQuery);
+	}
+
+	// Draws mesh with pipeline and the descriptor set of the current swap chain image, for
+	// renderers whose descriptor sets do not live next to their pipeline
+	static void Render(const Transform& transformComponent, const GraphicsPipeline& pipeline,
+					   const std::vector<DescriptorSet>& descriptorSets, const Mesh& mesh,
+					   float moveFactor, RenderLayer layer = RenderLayer::Opaque,
+					   uint32_t visibilityQuery = DRAW_PACKET_NO_QUERY)
+	{
+		const auto& scenePass = s_Instance.m_ScenePass;
+		DrawPacket packet{};
+		packet.m_Pipeline = pipeline.GetVariant(scenePass.m_RenderPass, scenePass.m_Samples,
+												scenePass.m_Multiview);
+		packet.m_PipelineLayout = pipeline.GetLayout();
+		if (descriptorSets.size() > 0)
 		{
-			assert(s_Instance.m_SwapChain->GetImageIndex() < renderer.m_DescriptorSets.size());
-			commandBuffer.bindDescriptorSets(
-				vk::PipelineBindPoint::eGraphics, renderer.m_GraphicsPipeline.GetLayout(), 0, 1,
-				&renderer.m_DescriptorSets[s_Instance.m_SwapChain->GetImageIndex()].Get(), 0,
-				nullptr);
+			assert(s_Instance.m_SwapChain->GetImageIndex() < descriptorSets.size());
+			packet.m_DescriptorSet = descriptorSets[s_Instance.m_SwapChain->GetImageIndex()].Get();
 		}
+		packet.m_VertexBuffer = mesh.GetVertexBuffer();
+		packet.m_IndexBuffer = mesh.GetIndexBuffer();
+		packet.m_IndexCount = static_cast<uint32_t>(mesh.m_IndicesCount);
+		packet.m_FirstIndex = mesh.m_StaticGeometry.m_BaseIndex;
+		packet.m_VertexOffset = static_cast<int32_t>(mesh.m_StaticGeometry.m_BaseVertex);
+		packet.m_Model = transformComponent.m_Global;
+		packet.m_BoundingSphere = mesh.m_BoundingSphere;
+		packet.m_MoveFactor = moveFactor;
+		packet.m_VisibilityQuery = visibilityQuery;
+		s_Instance.m_RenderQueue.Submit(layer, packet);
+	}
 
-		s_Instance.m_PushConstant.model = transformComponent.m_Global;
-		s_Instance.m_PushConstant.moveFactor = moveFactor;
-		commandBuffer.pushConstants(renderer.m_GraphicsPipeline.GetLayout(),
-									vk::ShaderStageFlagBits::eVertex |
-										vk::ShaderStageFlagBits::eFragment,
-									0, sizeof(PushConstant), &s_Instance.m_PushConstant);
+private:
+	// Scene passes are recorded at EndScene, since culling has to be dispatched outside of the
+	// render pass
+	struct ScenePass
+	{
+		vk::RenderPass m_RenderPass;
+		vk::SampleCountFlagBits m_Samples{};
+		vk::Framebuffer m_Framebuffer;
+		vk::Extent2D m_Extent;
+		std::array<vk::ClearValue, 2> m_ClearValues;
+		glm::mat4 m_ViewProjection{1.0f};
+		bool m_OcclusionCulling = false;
+		bool m_Multiview = false;
+		float m_MirrorHeight = 0.0f;
+		bool m_CaptureOpaque = false;
+	};
 
-		commandBuffer.bindVertexBuffers(0, {renderer.m_Mesh.m_VertexBuffer->m_Buffer}, {0});
-		commandBuffer.bindIndexBuffer(renderer.m_Mesh.m_IndexBuffer->m_Buffer, 0,
-									  vk::IndexType::eUint32);
+	// Redundant state tracking while recording the sorted queue
+	struct BoundState
+	{
+		vk::Pipeline m_Pipeline;
+		vk::PipelineLayout m_Layout;
+		vk::DescriptorSet m_DescriptorSet;
+		vk::Buffer m_VertexBuffer;
+		vk::Buffer m_IndexBuffer;
+		float m_MoveFactor = 0;
+	};
 
-		commandBuffer.drawIndexed(static_cast<uint32_t>(renderer.m_Mesh.m_IndicesCount), 1, 0, 0,
-								  0);
-	}
+	// Consecutive indirect commands that are submitted with a single multi draw
+	struct DrawBucket
+	{
+		size_t m_PacketIndex;
+		uint32_t m_FirstDraw;
+		uint32_t m_DrawCount;
+	};
 
-private:
 	VulkanRenderer() noexcept;
 	void InitRenderer(Window* window);
 	void WindowResized();
@@ -143,14 +326,39 @@ private:
 	void CreateImGuiRenderer();
 	void CreateCommandPool();
 	void CreateCommandBuffers();
+	void CreateInstanceBuffers();
+	void CreateCullPipeline();
+	void CreateOpaqueSceneTextures();
+	void CreateSkinningPipeline();
+	void BeginRenderPass(vk::CommandBuffer commandBuffer, vk::RenderPass renderPass);
+	void FlushRenderQueue(vk::CommandBuffer commandBuffer);
+	void SubmitDirect(vk::CommandBuffer commandBuffer);
+	void SubmitGpuDriven(vk::CommandBuffer commandBuffer);
+	// Builds the depth pyramid from and copies the color of the opaque geometry drawn so far by
+	// the main pass, whose render pass has to be ended
+	void CaptureOpaqueScene(vk::CommandBuffer commandBuffer);
+	void DispatchCull(vk::CommandBuffer commandBuffer, CullPhase phase, uint32_t firstInstance,
+					  uint32_t instanceCount, const glm::mat4& occlusionViewProjection);
+	void DrawBuckets(vk::CommandBuffer commandBuffer, size_t firstBucket, size_t bucketEnd,
+					 uint32_t drawOffset);
+	void BindDrawState(vk::CommandBuffer commandBuffer, const DrawPacket& packet,
+					   vk::DescriptorSet instanceDescriptorSet, BoundState& boundState);
+	void CopyVisibility(vk::CommandBuffer commandBuffer);
+	void ReadVisibility();
 
 public:
+	// Targets of a scene pass. The multisampled images are only created when samples is above
+	// one, colorTextureImage and depthTextureImage hold the resolved or directly drawn result.
+	// Multiview targets are two layer arrays, the image views cover both layers.
 	static void CreateFrameBuffers(vk::Extent2D extent,
 								   Neon::TextureImage& sampledColorTextureImage,
 								   Neon::TextureImage& sampledDepthTextureImage,
 								   Neon::TextureImage& colorTextureImage,
 								   Neon::TextureImage& depthTextureImage,
-								   std::vector<vk::UniqueFramebuffer>& frameBuffers);
+								   std::vector<vk::UniqueFramebuffer>& frameBuffers,
+								   vk::Format colorFormat = vk::Format::eR32G32B32A32Sfloat,
+								   vk::SampleCountFlagBits samples = s_MsaaSamples,
+								   bool multiview = false);
 
 private:
 	static VulkanRenderer s_Instance;
@@ -160,6 +368,15 @@ private:
 	std::unique_ptr<SwapChain> m_SwapChain;
 
 	vk::UniqueRenderPass m_OffscreenRenderPass;
+	// Scene passes of the other color formats, sample counts and multiview, created on first use
+	struct SceneRenderPass
+	{
+		vk::Format m_ColorFormat;
+		vk::SampleCountFlagBits m_Samples;
+		bool m_Multiview;
+		vk::UniqueRenderPass m_RenderPass;
+	};
+	std::vector<SceneRenderPass> m_SceneRenderPasses;
 	TextureImage m_SampledOffscreenColorTextureImage;
 	TextureImage m_SampledOffscreenDepthTextureImage;
 	TextureImage m_OffscreenColorTextureImage;
@@ -179,6 +396,56 @@ private:
 	std::vector<vk::UniqueCommandBuffer> m_CommandBuffers;
 
 	PushConstant m_PushConstant{};
+
+	RenderQueue m_RenderQueue;
+
+	ScenePass m_ScenePass;
+	std::vector<DrawBucket> m_DrawBuckets;
+
+	// Per swap chain image storage buffers holding the model matrix of every drawn instance,
+	// indexed by gl_InstanceIndex in the vertex shaders (descriptor set 1)
+	std::vector<std::unique_ptr<BufferAllocation>> m_InstanceBuffers;
+	std::vector<DescriptorSet> m_InstanceDescriptorSets;
+	vk::UniqueDescriptorSetLayout m_EmptyDescriptorSetLayout;
+	uint32_t m_InstanceCount = 0;
+
+	// GPU driven path: the instance buffers hold GpuInstance records which the cull shader
+	// compacts into the culled instance buffers, filling instance counts of the indirect commands
+	bool m_GpuDriven = true;
+	bool m_RequestedGpuDriven = true;
+	ComputePipeline m_CullPipeline;
+	std::vector<DescriptorSet> m_CullDescriptorSets;
+	std::vector<std::unique_ptr<BufferAllocation>> m_DrawCommandBuffers;
+	std::vector<std::unique_ptr<BufferAllocation>> m_CulledInstanceBuffers;
+	std::vector<DescriptorSet> m_CulledInstanceDescriptorSets;
+	uint32_t m_DrawCount = 0;
+
+	// Occlusion culling of the main scene pass. Instances are tested against the depth pyramid
+	// of the previous frame first, the rejected ones again against the pyramid built from what
+	// was drawn, the survivors are drawn by a second instance of the render pass
+	vk::UniqueRenderPass m_OcclusionRenderPass;
+	vk::UniqueRenderPass m_OcclusionLoadRenderPass;
+	HiZPyramid m_HiZPyramid;
+	std::vector<std::unique_ptr<BufferAllocation>> m_RetestBuffers;
+	glm::mat4 m_PreviousViewProjection{1.0f};
+	bool m_HiZValid = false;
+	// Copy of the offscreen color taken by CaptureOpaqueScene for the blended geometry
+	TextureImage m_OpaqueColorTextureImage;
+	bool m_OpaqueSceneRequested = false;
+
+	// Draw command index answering each visibility query submitted by the frames of every swap
+	// chain image, and the last answers read back from the draw commands
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> m_VisibilityDraws;
+	// Instance counts of those draws, copied at the end of the frame of every swap chain image
+	std::vector<std::unique_ptr<BufferAllocation>> m_VisibilityBuffers;
+	std::vector<uint8_t> m_Visibility;
+
+	// Compute skinning of all skinned meshes, made visible to vertex input by the next scene pass
+	ComputePipeline m_SkinningPipeline;
+	vk::UniqueDescriptorSetLayout m_SkinningDescriptorSetLayout;
+	std::unique_ptr<BufferAllocation> m_BoneBuffer;
+	vk::DeviceSize m_BoneSliceSize = 0;
+	bool m_SkinningPending = false;
 };
 } // namespace Neon
 
@@ -3,23 +3,55 @@
 #include "Animation.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-Neon::Animation::Animation(const aiScene* scene, int index,
-						   std::unordered_map<std::string, uint32_t>& boneMap, uint32_t bonesCount)
+// Rotation key before quantization
+struct KeyFrameRotation
+{
+	float time;
+	glm::vec4 value;
+};
+
+// Normalized lerp along the shorter arc, the same interpolation LocalPose::Interpolate uses
+static glm::vec4 InterpolateRotation(const glm::vec4& from, const glm::vec4& to, float factor)
+{
+	const glm::vec4 target = glm::dot(from, to) < 0.0f ? -to : to;
+	return glm::normalize(from + factor * (target - from));
+}
+
+static float VectorError(const Neon::KeyFrameVector& from, const Neon::KeyFrameVector& to,
+						 const Neon::KeyFrameVector& key, float factor)
+{
+	return glm::length(from.value + factor * (to.value - from.value) - key.value);
+}
+
+static float RotationError(const KeyFrameRotation& from, const KeyFrameRotation& to,
+						   const KeyFrameRotation& key, float factor)
+{
+	return 1.0f - std::abs(glm::dot(InterpolateRotation(from.value, to.value, factor), key.value));
+}
+
+Neon::AnimationClip::AnimationClip(const aiScene* scene, int index,
+								   const std::unordered_map<std::string, uint32_t>& boneMap,
+								   uint32_t bonesCount, float bakedSampleRate)
+	: m_BonesCount(bonesCount)
 {
 	assert(scene->HasAnimations());
 	assert(index < scene->mNumAnimations);
+	m_Name = scene->mAnimations[index]->mName.C_Str();
 	m_Duration = static_cast<float>(scene->mAnimations[index]->mDuration);
 	m_TicksPerSecond = scene->mAnimations[index]->mTicksPerSecond != 0
-						   ? static_cast<float>(scene->mAnimations[0]->mTicksPerSecond)
+						   ? static_cast<float>(scene->mAnimations[index]->mTicksPerSecond)
 						   : 25.0f;
+	m_AnimatedBones.resize(bonesCount, 0);
 	m_ScalingKeyFrames.resize(bonesCount);
 	m_PositionKeyFrames.resize(bonesCount);
 	m_RotationKeyFrames.resize(bonesCount);
 	LoadAnimation(scene, scene->mRootNode, index, boneMap);
+	if (bakedSampleRate > 0.0f) { Bake(bakedSampleRate); }
 }
 
-void Neon::Animation::LoadAnimation(const aiScene* scene, const aiNode* node, int animationIndex,
-									std::unordered_map<std::string, uint32_t>& boneMap)
+void Neon::AnimationClip::LoadAnimation(const aiScene* scene, const aiNode* node,
+										int animationIndex,
+										const std::unordered_map<std::string, uint32_t>& boneMap)
 {
 	std::string nodeName = node->mName.data;
 
@@ -39,7 +71,8 @@ void Neon::Animation::LoadAnimation(const aiScene* scene, const aiNode* node, in
 	if (nodeAnim)
 	{
 		assert(boneMap.find(nodeName) != boneMap.end());
-		uint32_t id = boneMap[nodeName];
+		uint32_t id = boneMap.at(nodeName);
+		m_AnimatedBones[id] = 1;
 		for (int i = 0; i < nodeAnim->mNumScalingKeys; i++)
 		{
 			const auto& scalingKey = nodeAnim->mScalingKeys[i];
@@ -52,11 +85,30 @@ void Neon::Animation::LoadAnimation(const aiScene* scene, const aiNode* node, in
 			m_PositionKeyFrames[id].push_back(
 				{static_cast<float>(positionKey.mTime), *(glm::vec3*)&positionKey.mValue});
 		}
+		std::vector<KeyFrameRotation> rotationKeyFrames;
 		for (int i = 0; i < nodeAnim->mNumRotationKeys; i++)
 		{
 			const auto& rotationKey = nodeAnim->mRotationKeys[i];
+			const auto& value = rotationKey.mValue;
+			rotationKeyFrames.push_back(
+				{static_cast<float>(rotationKey.mTime),
+				 glm::normalize(glm::vec4(value.x, value.y, value.z, value.w))});
+		}
+
+		// Drop keys interpolation reproduces, constant channels end up with a single key and
+		// are evaluated without any keyframe search
+		ReduceKeyFrames(m_ScalingKeyFrames[id], ANIMATION_VECTOR_TOLERANCE, VectorError);
+		ReduceKeyFrames(m_PositionKeyFrames[id], ANIMATION_VECTOR_TOLERANCE, VectorError);
+		ReduceKeyFrames(rotationKeyFrames, ANIMATION_ROTATION_TOLERANCE, RotationError);
+		m_ScalingKeyFrames[id].shrink_to_fit();
+		m_PositionKeyFrames[id].shrink_to_fit();
+		m_RotationKeyFrames[id].reserve(rotationKeyFrames.size());
+		for (const auto& keyFrame : rotationKeyFrames)
+		{
+			const auto& value = keyFrame.value;
 			m_RotationKeyFrames[id].push_back(
-				{static_cast<float>(rotationKey.mTime), rotationKey.mValue});
+				{keyFrame.time,
+				 PackedQuaternion::Pack(aiQuaternion(value.w, value.x, value.y, value.z))});
 		}
 	}
 
@@ -66,44 +118,435 @@ void Neon::Animation::LoadAnimation(const aiScene* scene, const aiNode* node, in
 	}
 }
 
-void Neon::Animation::Update(float seconds, std::vector<glm::mat4>& transforms, Bone& rootBone)
+Neon::Animation::Animation(std::shared_ptr<const AnimationClip> clip)
+{
+	m_Layers.reserve(ANIMATION_MAX_LAYERS);
+	m_Layers.emplace_back();
+	Play(0, std::move(clip));
+}
+
+uint32_t Neon::Animation::AddLayer(AnimationBlendMode mode, std::vector<float> mask, float weight)
+{
+	assert(m_Layers.size() < ANIMATION_MAX_LAYERS);
+	auto& layer = m_Layers.emplace_back();
+	layer.m_Mode = mode;
+	layer.m_Mask = std::move(mask);
+	layer.m_Weight = weight;
+	return static_cast<uint32_t>(m_Layers.size() - 1);
+}
+
+void Neon::Animation::SetLayerWeight(uint32_t layer, float weight)
+{
+	// The base layer is what the others blend over
+	assert(layer > 0 && layer < m_Layers.size());
+	m_Layers[layer].m_Weight = weight;
+	m_TargetValid = false;
+}
+
+void Neon::Animation::Play(uint32_t layer, std::shared_ptr<const AnimationClip> clip,
+						   float fadeSeconds, float speed)
+{
+	assert(layer < m_Layers.size() && clip && speed >= 0.0f);
+	auto& animationLayer = m_Layers[layer];
+	auto& clips = animationLayer.m_Clips;
+	// Swapping keeps the cursor and reference buffers of both slots, so switching clips only
+	// allocates while a slot grows to a larger skeleton
+	if (fadeSeconds > 0.0f && clips[0].m_Clip) { std::swap(clips[0], clips[1]); }
+	else
+	{
+		clips[1].m_Clip = nullptr;
+	}
+
+	auto& playback = clips[0];
+	playback.m_Clip = std::move(clip);
+	playback.m_Time = 0;
+	playback.m_Speed = speed;
+	playback.m_Cursors.assign(playback.m_Clip->GetBonesCount(), ChannelCursors{});
+	playback.m_ReferenceValid = false;
+	animationLayer.m_FadeDuration = fadeSeconds;
+	animationLayer.m_FadeTime = 0;
+	m_TargetValid = false;
+}
+
+void Neon::Animation::Update(float seconds, glm::mat4* transforms, const Skeleton& skeleton,
+							 uint32_t lod)
+{
+	if (m_LocalTransforms.size() < skeleton.GetPaddedJointCount())
+	{
+		m_Sample.Resize(skeleton.GetJointCount());
+		m_Pose.Resize(skeleton.GetJointCount());
+		m_ClipPose.Resize(skeleton.GetJointCount());
+		m_LayerPose.Resize(skeleton.GetJointCount());
+		m_PreviousPose.Resize(skeleton.GetJointCount());
+		m_TargetPose.Resize(skeleton.GetJointCount());
+		m_LocalTransforms.resize(skeleton.GetPaddedJointCount());
+		m_ModelTransforms.resize(skeleton.GetPaddedJointCount());
+	}
+
+	assert(lod < ANIMATION_LOD_COUNT);
+	const uint32_t jointCount = skeleton.GetLodJointCount(lod);
+	const uint32_t interval = ANIMATION_LODS[lod].m_UpdateInterval;
+	if (interval == 1)
+	{
+		EvaluatePose(0.0f, skeleton, jointCount, m_Pose);
+		m_TargetValid = false;
+	}
+	else
+	{
+		if (!m_TargetValid || m_TargetLod != lod || m_FramesUntilTarget == 0)
+		{
+			// The previous target is the pose of the current time unless the LOD changed
+			if (m_TargetValid && m_TargetLod == lod) { std::swap(m_PreviousPose, m_TargetPose); }
+			else
+			{
+				EvaluatePose(0.0f, skeleton, jointCount, m_PreviousPose);
+			}
+			EvaluatePose(static_cast<float>(interval) * seconds, skeleton, jointCount,
+						 m_TargetPose);
+			m_TargetLod = lod;
+			m_FramesUntilTarget = interval;
+			m_TargetValid = true;
+		}
+		const float factor = static_cast<float>(interval - m_FramesUntilTarget) / interval;
+		m_FramesUntilTarget--;
+		m_Pose.Interpolate(m_PreviousPose, m_TargetPose, factor, jointCount);
+	}
+	skeleton.ComputeSkinningMatrices(m_Pose, m_LocalTransforms, m_ModelTransforms, transforms,
+									 jointCount);
+
+	Step(seconds);
+}
+
+void Neon::Animation::Advance(float seconds)
+{
+	Step(seconds);
+	m_TargetValid = false;
+}
+
+void Neon::Animation::Step(float seconds)
+{
+	for (auto& layer : m_Layers)
+	{
+		for (auto& playback : layer.m_Clips)
+		{
+			if (playback.m_Clip) { playback.m_Time = playback.GetTime(seconds); }
+		}
+		layer.m_FadeTime += seconds;
+		// A finished fade releases the clip faded out
+		if (layer.GetFade(0.0f) >= 1.0f) { layer.m_Clips[1].m_Clip = nullptr; }
+	}
+}
+
+void Neon::Animation::EvaluatePose(float seconds, const Skeleton& skeleton, uint32_t jointCount,
+								   LocalPose& pose)
+{
+	for (size_t i = 0; i < m_Layers.size(); i++)
+	{
+		auto& layer = m_Layers[i];
+		auto& current = layer.m_Clips[0];
+		auto& previous = layer.m_Clips[1];
+		if (!current.m_Clip || (i > 0 && layer.m_Weight <= 0.0f)) { continue; }
+		const float fade = layer.GetFade(seconds);
+		const bool fading = fade < 1.0f;
+
+		if (layer.m_Mode == AnimationBlendMode::Additive)
+		{
+			AddClip(current, seconds, layer.m_Weight * fade, layer.m_Mask, skeleton, jointCount,
+					pose);
+			if (fading)
+			{
+				AddClip(previous, seconds, layer.m_Weight * (1.0f - fade), layer.m_Mask, skeleton,
+						jointCount, pose);
+			}
+			continue;
+		}
+
+		// The base layer is evaluated in place, the ones above blend over it
+		assert(i > 0 || (layer.m_Weight == 1.0f && layer.m_Mask.empty()));
+		LocalPose& layerPose = i == 0 ? pose : m_LayerPose;
+		if (fading)
+		{
+			SampleClip(previous, seconds, skeleton, jointCount, layerPose);
+			SampleClip(current, seconds, skeleton, jointCount, m_ClipPose);
+			layerPose.Blend(m_ClipPose, fade, {}, jointCount);
+		}
+		else
+		{
+			SampleClip(current, seconds, skeleton, jointCount, layerPose);
+		}
+		if (i > 0) { pose.Blend(m_LayerPose, layer.m_Weight, layer.m_Mask, jointCount); }
+	}
+}
+
+void Neon::Animation::SampleClip(ClipPlayback& playback, float seconds, const Skeleton& skeleton,
+								 uint32_t jointCount, LocalPose& pose)
+{
+	playback.m_Clip->Sample(playback.GetTime(seconds), skeleton, playback.m_Cursors, m_Sample,
+							jointCount);
+	pose.Interpolate(m_Sample.m_From, m_Sample.m_To, m_Sample.m_Factors, jointCount);
+}
+
+void Neon::Animation::AddClip(ClipPlayback& playback, float seconds, float weight,
+							  const std::vector<float>& mask, const Skeleton& skeleton,
+							  uint32_t jointCount, LocalPose& pose)
 {
-	CalculateBoneTransforms(rootBone, glm::mat4(1.0f), transforms);
-	m_CurrentAnimationTime += seconds * m_TicksPerSecond;
-	m_CurrentAnimationTime = fmod(m_CurrentAnimationTime, m_Duration);
+	if (!playback.m_ReferenceValid)
+	{
+		// Sampled for every joint once, so the reference stays valid across LOD changes
+		playback.m_Reference.Resize(skeleton.GetJointCount());
+		playback.m_Clip->Sample(0.0f, skeleton, playback.m_Cursors, m_Sample,
+								skeleton.GetJointCount());
+		playback.m_Reference.Interpolate(m_Sample.m_From, m_Sample.m_To, m_Sample.m_Factors,
+										 skeleton.GetJointCount());
+		playback.m_ReferenceValid = true;
+	}
+	SampleClip(playback, seconds, skeleton, jointCount, m_ClipPose);
+	pose.Add(m_ClipPose, playback.m_Reference, weight, mask, jointCount);
 }
 
 void Neon::Animation::Reset()
 {
-	m_CurrentAnimationTime = 0;
+	for (auto& layer : m_Layers)
+	{
+		for (auto& playback : layer.m_Clips)
+		{
+			playback.m_Time = 0;
+			std::fill(playback.m_Cursors.begin(), playback.m_Cursors.end(), ChannelCursors{});
+		}
+		layer.m_Clips[1].m_Clip = nullptr;
+		layer.m_FadeTime = 0;
+	}
+	m_TargetValid = false;
 }
 
-void Neon::Animation::CalculateBoneTransforms(Bone& bone, glm::mat4 parentTransform,
-											  std::vector<glm::mat4>& transforms)
+uint32_t Neon::AnimationClip::BakeSkinningMatrices(const Skeleton& skeleton, float sampleRate,
+												   std::vector<glm::vec4>& rows) const
 {
-	glm::mat4 nodeTransform = bone.GetLocalTransform();
-	if (bone.m_Animated)
+	const float framesPerTick = sampleRate / m_TicksPerSecond;
+	const uint32_t frameCount =
+		std::max(1u, static_cast<uint32_t>(std::ceil(m_Duration * framesPerTick)));
+
+	std::vector<ChannelCursors> cursors(m_BonesCount);
+	PoseSample sample;
+	sample.Resize(skeleton.GetJointCount());
+	LocalPose pose;
+	pose.Resize(skeleton.GetJointCount());
+	std::vector<glm::mat4> localTransforms(skeleton.GetPaddedJointCount());
+	std::vector<glm::mat4> modelTransforms(skeleton.GetPaddedJointCount());
+	std::vector<glm::mat4> transforms(m_BonesCount, glm::mat4(1.0f));
+
+	rows.resize(static_cast<size_t>(frameCount) * m_BonesCount * 3);
+	for (uint32_t frame = 0; frame < frameCount; frame++)
 	{
-		glm::mat4 scaling = glm::scale(
-			glm::mat4(1.0), Interpolate<KeyFrameVector, glm::vec3>(
-								m_CurrentAnimationTime, m_ScalingKeyFrames[bone.GetID()]));
-		glm::mat4 translation = glm::translate(
-			glm::mat4(1.0), Interpolate<KeyFrameVector, glm::vec3>(
-								m_CurrentAnimationTime, m_PositionKeyFrames[bone.GetID()]));
+		const float time = std::min(static_cast<float>(frame) / framesPerTick, m_Duration);
+		Sample(time, skeleton, cursors, sample, skeleton.GetJointCount());
+		pose.Interpolate(sample.m_From, sample.m_To, sample.m_Factors, skeleton.GetJointCount());
+		skeleton.ComputeSkinningMatrices(pose, localTransforms, modelTransforms, transforms.data(),
+										 skeleton.GetJointCount());
+		for (uint32_t id = 0; id < m_BonesCount; id++)
+		{
+			const glm::mat4 transposed = glm::transpose(transforms[id]);
+			const size_t first = (static_cast<size_t>(frame) * m_BonesCount + id) * 3;
+			rows[first] = transposed[0];
+			rows[first + 1] = transposed[1];
+			rows[first + 2] = transposed[2];
+		}
+	}
+	return frameCount;
+}
+
+void Neon::AnimationClip::Bake(float sampleRate)
+{
+	m_BakedFramesPerTick = sampleRate / m_TicksPerSecond;
+	m_BakedFrameCount = static_cast<uint32_t>(std::ceil(m_Duration * m_BakedFramesPerTick)) + 1;
+	m_BakedKeys.resize(static_cast<size_t>(m_BakedFrameCount) * m_BonesCount);
+
+	std::vector<ChannelCursors> cursors(m_BonesCount);
+	const KeyFrameVector* fromVector;
+	const KeyFrameVector* toVector;
+	const KeyFrameQuaternion* fromQuaternion;
+	const KeyFrameQuaternion* toQuaternion;
+	for (uint32_t frame = 0; frame < m_BakedFrameCount; frame++)
+	{
+		const float time = std::min(static_cast<float>(frame) / m_BakedFramesPerTick, m_Duration);
+		for (uint32_t id = 0; id < m_BonesCount; id++)
+		{
+			auto& boneCursors = cursors[id];
+			auto& key = m_BakedKeys[static_cast<size_t>(frame) * m_BonesCount + id];
+			key.m_Translation = glm::vec3(0.0f);
+			key.m_Scale = glm::vec3(1.0f);
+			key.m_Rotation = PackedQuaternion::Pack(aiQuaternion());
+			if (!m_PositionKeyFrames[id].empty())
+			{
+				float factor = SampleChannel(time, m_PositionKeyFrames[id], boneCursors.m_Position,
+											 fromVector, toVector);
+				key.m_Translation = fromVector->Interpolate(toVector->value, factor);
+			}
+			if (!m_ScalingKeyFrames[id].empty())
+			{
+				float factor = SampleChannel(time, m_ScalingKeyFrames[id], boneCursors.m_Scaling,
+											 fromVector, toVector);
+				key.m_Scale = fromVector->Interpolate(toVector->value, factor);
+			}
+			if (!m_RotationKeyFrames[id].empty())
+			{
+				float factor = SampleChannel(time, m_RotationKeyFrames[id], boneCursors.m_Rotation,
+											 fromQuaternion, toQuaternion);
+				glm::vec4 rotation = InterpolateRotation(fromQuaternion->value.Unpack(),
+														 toQuaternion->value.Unpack(), factor);
+				key.m_Rotation = PackedQuaternion::Pack(
+					aiQuaternion(rotation.w, rotation.x, rotation.y, rotation.z));
+			}
+		}
+	}
+
+	// The baked rows replace the keyframes
+	m_ScalingKeyFrames = {};
+	m_PositionKeyFrames = {};
+	m_RotationKeyFrames = {};
+}
+
+// Holds components channels of joint at the bind pose
+static void SampleBindChannel(const std::vector<float>* bind, int components, uint32_t joint,
+							  std::vector<float>* from, std::vector<float>* to,
+							  std::vector<float>& factors)
+{
+	for (int c = 0; c < components; c++) { from[c][joint] = to[c][joint] = bind[c][joint]; }
+	factors[joint] = 0.0f;
+}
+
+static void SampleBindPose(const Neon::Skeleton& skeleton, uint32_t joint,
+						   Neon::PoseSample& sample)
+{
+	const Neon::LocalPose& bindPose = skeleton.GetBindPose();
+	SampleBindChannel(bindPose.m_Translation, 3, joint, sample.m_From.m_Translation,
+					  sample.m_To.m_Translation, sample.m_Factors[0]);
+	SampleBindChannel(bindPose.m_Rotation, 4, joint, sample.m_From.m_Rotation,
+					  sample.m_To.m_Rotation, sample.m_Factors[1]);
+	SampleBindChannel(bindPose.m_Scale, 3, joint, sample.m_From.m_Scale, sample.m_To.m_Scale,
+					  sample.m_Factors[2]);
+}
+
+void Neon::AnimationClip::SampleBaked(float animationTime, const Skeleton& skeleton,
+									  PoseSample& sample, uint32_t jointCount) const
+{
+	const float frame = animationTime * m_BakedFramesPerTick;
+	const uint32_t first = std::min(static_cast<uint32_t>(frame), m_BakedFrameCount - 1);
+	const uint32_t next = std::min(first + 1, m_BakedFrameCount - 1);
+	const float factor = std::clamp(frame - static_cast<float>(first), 0.0f, 1.0f);
+	const BakedKey* fromRow = &m_BakedKeys[static_cast<size_t>(first) * m_BonesCount];
+	const BakedKey* toRow = &m_BakedKeys[static_cast<size_t>(next) * m_BonesCount];
 
-		auto mat = Interpolate<KeyFrameQuaternion, aiQuaternion>(m_CurrentAnimationTime,
-																 m_RotationKeyFrames[bone.GetID()])
-					   .GetMatrix();
-		auto rotation = glm::mat4(glm::transpose(*(glm::mat3*)&mat));
-		nodeTransform = translation * rotation * scaling;
+	for (uint32_t joint = 0; joint < jointCount; joint++)
+	{
+		if (!skeleton.IsAnimated(joint)) { continue; }
+		const uint32_t id = skeleton.GetBoneID(joint);
+		if (!m_AnimatedBones[id])
+		{
+			SampleBindPose(skeleton, joint, sample);
+			continue;
+		}
+		const BakedKey& from = fromRow[id];
+		const BakedKey& to = toRow[id];
+		const glm::vec4 fromRotation = from.m_Rotation.Unpack();
+		const glm::vec4 toRotation = to.m_Rotation.Unpack();
+		for (int c = 0; c < 3; c++)
+		{
+			sample.m_From.m_Translation[c][joint] = from.m_Translation[c];
+			sample.m_To.m_Translation[c][joint] = to.m_Translation[c];
+			sample.m_From.m_Scale[c][joint] = from.m_Scale[c];
+			sample.m_To.m_Scale[c][joint] = to.m_Scale[c];
+			sample.m_Factors[c][joint] = factor;
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			sample.m_From.m_Rotation[c][joint] = fromRotation[c];
+			sample.m_To.m_Rotation[c][joint] = toRotation[c];
+		}
 	}
+}
 
-	auto newParentTransform = parentTransform * bone.GetParentTransform() * nodeTransform;
-	transforms[bone.GetID()] = newParentTransform * bone.GetOffsetMatrix();
-	bone.SetAnimatedTransform(transforms[bone.GetID()]);
+void Neon::AnimationClip::Sample(float animationTime, const Skeleton& skeleton,
+								 std::vector<ChannelCursors>& cursors, PoseSample& sample,
+								 uint32_t jointCount) const
+{
+	jointCount = std::min(jointCount, skeleton.GetJointCount());
+	if (!m_BakedKeys.empty())
+	{
+		SampleBaked(animationTime, skeleton, sample, jointCount);
+		return;
+	}
 
-	for (auto& child : bone.GetChildren())
+	// Only the key lookup is scalar, interpolation runs over all joints in Interpolate. The
+	// sample is shared by every clip of an instance, so channels without keys are overwritten
+	// with the bind pose.
+	const LocalPose& bindPose = skeleton.GetBindPose();
+	for (uint32_t joint = 0; joint < jointCount; joint++)
 	{
-		CalculateBoneTransforms(child, newParentTransform, transforms);
+		if (!skeleton.IsAnimated(joint)) { continue; }
+		const uint32_t id = skeleton.GetBoneID(joint);
+		auto& boneCursors = cursors[id];
+
+		const KeyFrameVector* fromVector;
+		const KeyFrameVector* toVector;
+		if (!m_PositionKeyFrames[id].empty())
+		{
+			sample.m_Factors[0][joint] =
+				SampleChannel(animationTime, m_PositionKeyFrames[id], boneCursors.m_Position,
+							  fromVector, toVector);
+			for (int c = 0; c < 3; c++)
+			{
+				sample.m_From.m_Translation[c][joint] = fromVector->value[c];
+				sample.m_To.m_Translation[c][joint] = toVector->value[c];
+			}
+		}
+		else
+		{
+			SampleBindChannel(bindPose.m_Translation, 3, joint, sample.m_From.m_Translation,
+							  sample.m_To.m_Translation, sample.m_Factors[0]);
+		}
+		if (!m_ScalingKeyFrames[id].empty())
+		{
+			sample.m_Factors[2][joint] =
+				SampleChannel(animationTime, m_ScalingKeyFrames[id], boneCursors.m_Scaling,
+							  fromVector, toVector);
+			for (int c = 0; c < 3; c++)
+			{
+				sample.m_From.m_Scale[c][joint] = fromVector->value[c];
+				sample.m_To.m_Scale[c][joint] = toVector->value[c];
+			}
+		}
+		else
+		{
+			SampleBindChannel(bindPose.m_Scale, 3, joint, sample.m_From.m_Scale,
+							  sample.m_To.m_Scale, sample.m_Factors[2]);
+		}
+		if (!m_RotationKeyFrames[id].empty())
+		{
+			const KeyFrameQuaternion* fromQuaternion;
+			const KeyFrameQuaternion* toQuaternion;
+			sample.m_Factors[1][joint] =
+				SampleChannel(animationTime, m_RotationKeyFrames[id], boneCursors.m_Rotation,
+							  fromQuaternion, toQuaternion);
+			const glm::vec4 from = fromQuaternion->value.Unpack();
+			const glm::vec4 to = toQuaternion->value.Unpack();
+			for (int c = 0; c < 4; c++)
+			{
+				sample.m_From.m_Rotation[c][joint] = from[c];
+				sample.m_To.m_Rotation[c][joint] = to[c];
+			}
+		}
+		else
+		{
+			SampleBindChannel(bindPose.m_Rotation, 4, joint, sample.m_From.m_Rotation,
+							  sample.m_To.m_Rotation, sample.m_Factors[1]);
+		}
 	}
 }
+
+void Neon::PoseSample::Resize(uint32_t jointCount)
+{
+	m_From.Resize(jointCount);
+	m_To.Resize(jointCount);
+	for (auto& factors : m_Factors) { factors.assign(m_From.m_Rotation[0].size(), 0.0f); }
+}
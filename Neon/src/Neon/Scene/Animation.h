@@ -5,11 +5,36 @@
 #ifndef NEON_ANIMATION_H
 #define NEON_ANIMATION_H
 
-#include "Bone.h"
+#include "AnimationCompression.h"
+#include "Skeleton.h"
 #include <assimp/scene.h>
 
 namespace Neon
 {
+// Minimum projected size of the bounding sphere (radius relative to half the viewport height)
+// for each animation LOD and the number of frames between two evaluations of its pose
+struct AnimationLod
+{
+	float m_MinScreenSize;
+	uint32_t m_UpdateInterval;
+};
+
+constexpr AnimationLod ANIMATION_LODS[ANIMATION_LOD_COUNT] = {
+	{0.5f, 1}, {0.25f, 2}, {0.12f, 4}, {0.0f, 8}};
+
+// Layers of one Animation, including the base layer
+#define ANIMATION_MAX_LAYERS 4
+// Clips blended within a layer, the one playing and the one it crossfades from
+#define ANIMATION_LAYER_CLIPS 2
+
+enum class AnimationBlendMode
+{
+	// Blends the layer pose over the layers below by the layer weight
+	Override,
+	// Adds the difference between the clip and its first frame to the layers below
+	Additive
+};
+
 struct KeyFrameVector
 {
 	float time{};
@@ -24,68 +49,251 @@ struct KeyFrameVector
 struct KeyFrameQuaternion
 {
 	float time{};
-	// TODO: write own quaternion class
-	aiQuaternion value{};
+	PackedQuaternion value{};
+};
 
-	[[nodiscard]] aiQuaternion Interpolate(aiQuaternion nextValue, float factor) const
-	{
-		aiQuaternion result;
-		aiQuaternion::Interpolate(result, value, nextValue, factor);
-		return result;
-	}
+// Index of the keyframe segment each channel of a bone was last evaluated in
+struct ChannelCursors
+{
+	uint32_t m_Scaling = 0;
+	uint32_t m_Position = 0;
+	uint32_t m_Rotation = 0;
 };
 
-class Animation
+// Keys surrounding the sampled time and the blend factor per channel (translation, rotation,
+// scale), in skeleton joint order
+struct PoseSample
+{
+	LocalPose m_From;
+	LocalPose m_To;
+	std::vector<float> m_Factors[3];
+
+	void Resize(uint32_t jointCount);
+};
+
+// Immutable keyframes of one clip, shared by every instance playing it
+class AnimationClip
 {
 public:
-	Animation(const aiScene* scene, int index, std::unordered_map<std::string, uint32_t>& boneMap,
-			  uint32_t bonesCount);
-	void Update(float seconds, std::vector<glm::mat4>& transforms, Bone& rootBone);
-	void Reset();
+	// A non zero bakedSampleRate resamples the clip at that many frames per second, trading
+	// memory for sampling without any key search
+	AnimationClip(const aiScene* scene, int index,
+				  const std::unordered_map<std::string, uint32_t>& boneMap, uint32_t bonesCount,
+				  float bakedSampleRate = 0.0f);
+
+	// Fills sample with the keys around animationTime for the animated joints among the first
+	// jointCount, cursors hold the playback position of the caller and have one entry per bone
+	void Sample(float animationTime, const Skeleton& skeleton, std::vector<ChannelCursors>& cursors,
+				PoseSample& sample, uint32_t jointCount) const;
+
+	// Evaluates the skinning matrices of skeleton sampleRate times per second of the clip and
+	// stores each as the three rows of its affine part, bone after bone and frame after frame.
+	// Returns the number of frames, the last one is followed by the first when looping.
+	uint32_t BakeSkinningMatrices(const Skeleton& skeleton, float sampleRate,
+								  std::vector<glm::vec4>& rows) const;
+
+	[[nodiscard]] const std::string& GetName() const
+	{
+		return m_Name;
+	}
+	[[nodiscard]] float GetDuration() const
+	{
+		return m_Duration;
+	}
+	[[nodiscard]] float GetTicksPerSecond() const
+	{
+		return m_TicksPerSecond;
+	}
+	[[nodiscard]] uint32_t GetBonesCount() const
+	{
+		return m_BonesCount;
+	}
 
 private:
 	void LoadAnimation(const aiScene* scene, const aiNode* node, int animationIndex,
-					   std::unordered_map<std::string, uint32_t>& boneMap);
-	void CalculateBoneTransforms(Bone& bone, glm::mat4 parentTransform,
-								 std::vector<glm::mat4>& transforms);
+					   const std::unordered_map<std::string, uint32_t>& boneMap);
+	void Bake(float sampleRate);
+	void SampleBaked(float animationTime, const Skeleton& skeleton, PoseSample& sample,
+					 uint32_t jointCount) const;
 
 private:
 	std::vector<std::vector<KeyFrameVector>> m_ScalingKeyFrames;
 	std::vector<std::vector<KeyFrameVector>> m_PositionKeyFrames;
 	std::vector<std::vector<KeyFrameQuaternion>> m_RotationKeyFrames;
+	// Bones with a channel in this clip, the others hold the bind pose
+	std::vector<uint8_t> m_AnimatedBones;
 
+	// Uniformly resampled clip stored frame after frame with one key per bone, so sampling reads
+	// two contiguous rows. Replaces the keyframes when baking was requested.
+	struct BakedKey
+	{
+		glm::vec3 m_Translation;
+		glm::vec3 m_Scale;
+		PackedQuaternion m_Rotation;
+	};
+	std::vector<BakedKey> m_BakedKeys;
+	uint32_t m_BakedFrameCount = 0;
+	float m_BakedFramesPerTick = 0;
+	uint32_t m_BonesCount;
+
+	std::string m_Name;
 	float m_Duration;
 	float m_TicksPerSecond;
-	float m_CurrentAnimationTime = 0;
 
+	// Returns the segment [i, i + 1] containing animationTime. Playback moves forward by at most
+	// a few keys per frame, so the cursor is first advanced in place; wraparound and seeks fall
+	// back to a binary search.
 	template<typename T>
-	int FindIndex(float animationTime, const std::vector<T>& keyFrames)
+	static uint32_t FindIndex(float animationTime, const std::vector<T>& keyFrames,
+							  uint32_t& cursor)
 	{
 		assert(keyFrames.size() > 1);
-		int i = 0;
-		for (const auto& keyFrame : keyFrames)
+		const auto lastSegment = static_cast<uint32_t>(keyFrames.size() - 2);
+		if (cursor > lastSegment || animationTime < keyFrames[cursor].time)
+		{ cursor = animationTime < keyFrames[1].time ? 0 : cursor; }
+
+		for (int step = 0; step < 4 && cursor <= lastSegment; step++)
 		{
-			if (animationTime < keyFrame.time) { return i - 1; }
-			i++;
+			if (animationTime < keyFrames[cursor].time) { break; }
+			if (cursor == lastSegment || animationTime < keyFrames[cursor + 1].time)
+			{ return cursor; }
+			cursor++;
 		}
-		return -1;
+
+		auto next = std::upper_bound(
+			keyFrames.begin() + 1, keyFrames.end(), animationTime,
+			[](float time, const T& keyFrame) { return time < keyFrame.time; });
+		cursor = std::min(static_cast<uint32_t>(next - keyFrames.begin() - 1), lastSegment);
+		return cursor;
 	}
 
-	template<typename T, typename V>
-	V Interpolate(float animationTime, const std::vector<T>& keyFrames)
+	// Finds the two keys around animationTime and the factor between them. Constant channels
+	// return the same key twice without searching.
+	template<typename T>
+	static float SampleChannel(float animationTime, const std::vector<T>& keyFrames,
+							   uint32_t& cursor, const T*& from, const T*& to)
 	{
 		assert(!keyFrames.empty());
-		if (keyFrames.size() == 1) { return {keyFrames[0].value}; }
-		int firstIndex = FindIndex(animationTime, keyFrames);
-		assert(firstIndex >= 0);
-		int nextIndex = firstIndex + 1;
-		assert(nextIndex < keyFrames.size());
-		auto deltaTime = static_cast<float>(keyFrames[nextIndex].time - keyFrames[firstIndex].time);
-		float factor = (animationTime - (float)keyFrames[firstIndex].time) / deltaTime;
-		assert(factor >= 0.0f && factor <= 1.0f);
-		return keyFrames[firstIndex].Interpolate(keyFrames[nextIndex].value, factor);
+		if (keyFrames.size() == 1)
+		{
+			from = to = &keyFrames[0];
+			return 0.0f;
+		}
+		uint32_t firstIndex = FindIndex(animationTime, keyFrames, cursor);
+		from = &keyFrames[firstIndex];
+		to = &keyFrames[firstIndex + 1];
+		auto deltaTime = to->time - from->time;
+		float factor = deltaTime > 0.0f ? (animationTime - from->time) / deltaTime : 0.0f;
+		return std::clamp(factor, 0.0f, 1.0f);
+	}
+};
+
+// Playback position of one clip within a layer
+struct ClipPlayback
+{
+	std::shared_ptr<const AnimationClip> m_Clip;
+	// Ticks of the clip
+	float m_Time = 0;
+	float m_Speed = 1.0f;
+	std::vector<ChannelCursors> m_Cursors;
+	// Pose at the start of the clip, additive layers add the difference to it
+	LocalPose m_Reference;
+	bool m_ReferenceValid = false;
+
+	// Time seconds after the current one, wrapped to the clip
+	[[nodiscard]] float GetTime(float seconds) const
+	{
+		return fmod(m_Time + seconds * m_Speed * m_Clip->GetTicksPerSecond(),
+					m_Clip->GetDuration());
 	}
 };
+
+struct AnimationLayer
+{
+	AnimationBlendMode m_Mode = AnimationBlendMode::Override;
+	float m_Weight = 1.0f;
+	// Per joint weights from Skeleton::CreateMask, empty applies the layer to every joint
+	std::vector<float> m_Mask;
+	// The clip playing followed by the clip it fades from over m_FadeDuration seconds
+	std::array<ClipPlayback, ANIMATION_LAYER_CLIPS> m_Clips;
+	float m_FadeDuration = 0;
+	float m_FadeTime = 0;
+
+	// Weight of the clip playing seconds after the current time, the faded clip has the rest
+	[[nodiscard]] float GetFade(float seconds) const
+	{
+		if (!m_Clips[1].m_Clip || m_FadeDuration <= 0.0f) { return 1.0f; }
+		return std::min((m_FadeTime + seconds) / m_FadeDuration, 1.0f);
+	}
+};
+
+// Playback state of one animated instance: layers of clips blended bottom to top, keyframe
+// cursors and pose buffers. Scratch poses are allocated once for the skeleton and reused, so
+// updating never allocates; each instance owns its buffers so instances need no locking.
+class Animation
+{
+public:
+	// Loops clip on the base layer, which overrides every joint at full weight
+	explicit Animation(std::shared_ptr<const AnimationClip> clip);
+
+	// Adds a layer on top of the existing ones and returns its index, it stays silent until a
+	// clip is played on it
+	uint32_t AddLayer(AnimationBlendMode mode, std::vector<float> mask = {},
+					  float weight = 1.0f);
+	void SetLayerWeight(uint32_t layer, float weight);
+	// Switches layer to clip, crossfading from the clip playing over fadeSeconds. Switching
+	// during a fade drops the clip being faded out.
+	void Play(uint32_t layer, std::shared_ptr<const AnimationClip> clip, float fadeSeconds = 0.0f,
+			  float speed = 1.0f);
+
+	// Writes the skinning matrices of the current time to transforms, one per bone, and advances
+	// by seconds. Instances share no mutable state and can be updated concurrently. Above LOD 0
+	// fewer joints are posed and the pose is only evaluated every update interval frames, the
+	// frames in between blend towards it.
+	void Update(float seconds, glm::mat4* transforms, const Skeleton& skeleton, uint32_t lod = 0);
+	// Moves the playback time without evaluating the pose, for instances animated on the GPU
+	void Advance(float seconds);
+	void Reset();
+
+	// Playback position in ticks of the clip on the base layer
+	[[nodiscard]] float GetTime() const
+	{
+		return m_Layers[0].m_Clips[0].m_Time;
+	}
+	// Clip playing on the base layer
+	[[nodiscard]] const std::shared_ptr<const AnimationClip>& GetClip() const
+	{
+		return m_Layers[0].m_Clips[0].m_Clip;
+	}
+
+private:
+	void Step(float seconds);
+	// Evaluates every layer seconds after the current time
+	void EvaluatePose(float seconds, const Skeleton& skeleton, uint32_t jointCount,
+					  LocalPose& pose);
+	void SampleClip(ClipPlayback& playback, float seconds, const Skeleton& skeleton,
+					uint32_t jointCount, LocalPose& pose);
+	void AddClip(ClipPlayback& playback, float seconds, float weight,
+				 const std::vector<float>& mask, const Skeleton& skeleton, uint32_t jointCount,
+				 LocalPose& pose);
+
+private:
+	std::vector<AnimationLayer> m_Layers;
+
+	PoseSample m_Sample;
+	LocalPose m_Pose;
+	LocalPose m_ClipPose;
+	LocalPose m_LayerPose;
+	// Throttled LODs blend from the pose at the last evaluation to the one evaluated for update
+	// interval frames later, assuming a steady frame time
+	LocalPose m_PreviousPose;
+	LocalPose m_TargetPose;
+	uint32_t m_TargetLod = 0;
+	uint32_t m_FramesUntilTarget = 0;
+	bool m_TargetValid = false;
+	std::vector<glm::mat4> m_LocalTransforms;
+	std::vector<glm::mat4> m_ModelTransforms;
+};
 } // namespace Neon
 
 #endif //NEON_ANIMATION_H
@@ -0,0 +1,57 @@
+#include "neopch.h"
+
+#include "AnimationCompression.h"
+
+#define PACKED_QUATERNION_BITS 15
+#define PACKED_QUATERNION_MAX ((1u << PACKED_QUATERNION_BITS) - 1)
+// Components other than the largest one lie in [-1 / sqrt(2), 1 / sqrt(2)]
+#define PACKED_QUATERNION_RANGE 0.70710678f
+
+Neon::PackedQuaternion Neon::PackedQuaternion::Pack(const aiQuaternion& quaternion)
+{
+	const float components[4] = {quaternion.x, quaternion.y, quaternion.z, quaternion.w};
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (std::abs(components[i]) > std::abs(components[largest])) { largest = i; }
+	}
+	// q and -q are the same rotation, flip so that the dropped component is positive
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint64_t bits = largest;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest) { continue; }
+		float normalized = (components[i] * sign / PACKED_QUATERNION_RANGE) * 0.5f + 0.5f;
+		auto quantized = static_cast<uint64_t>(
+			std::round(std::clamp(normalized, 0.0f, 1.0f) * PACKED_QUATERNION_MAX));
+		bits = (bits << PACKED_QUATERNION_BITS) | quantized;
+	}
+
+	PackedQuaternion result;
+	result.m_Data[0] = static_cast<uint16_t>(bits >> 32);
+	result.m_Data[1] = static_cast<uint16_t>(bits >> 16);
+	result.m_Data[2] = static_cast<uint16_t>(bits);
+	return result;
+}
+
+glm::vec4 Neon::PackedQuaternion::Unpack() const
+{
+	uint64_t bits = (static_cast<uint64_t>(m_Data[0]) << 32) |
+					(static_cast<uint64_t>(m_Data[1]) << 16) | static_cast<uint64_t>(m_Data[2]);
+	const auto largest = static_cast<uint32_t>(bits >> (3 * PACKED_QUATERNION_BITS));
+
+	glm::vec4 result;
+	float lengthSquared = 0.0f;
+	for (int i = 3; i >= 0; i--)
+	{
+		if (static_cast<uint32_t>(i) == largest) { continue; }
+		const float normalized =
+			static_cast<float>(bits & PACKED_QUATERNION_MAX) / PACKED_QUATERNION_MAX;
+		result[i] = (normalized * 2.0f - 1.0f) * PACKED_QUATERNION_RANGE;
+		lengthSquared += result[i] * result[i];
+		bits >>= PACKED_QUATERNION_BITS;
+	}
+	result[largest] = std::sqrt(std::max(0.0f, 1.0f - lengthSquared));
+	return result;
+}
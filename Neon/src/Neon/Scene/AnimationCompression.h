@@ -0,0 +1,63 @@
+#ifndef NEON_ANIMATIONCOMPRESSION_H
+#define NEON_ANIMATIONCOMPRESSION_H
+
+#include <assimp/scene.h>
+#include <glm/glm.hpp>
+
+// Largest error key reduction may introduce, in model units for translation and scale and as
+// 1 - |dot| between the exact and the interpolated rotation
+#define ANIMATION_VECTOR_TOLERANCE 0.0005f
+#define ANIMATION_ROTATION_TOLERANCE 0.00001f
+
+namespace Neon
+{
+// Unit quaternion in 48 bits using the smallest three encoding: the index of the largest
+// component in 2 bits followed by the remaining three components in 15 bits each. The largest
+// component is made positive and rebuilt from the unit length.
+struct PackedQuaternion
+{
+	uint16_t m_Data[3]{};
+
+	static PackedQuaternion Pack(const aiQuaternion& quaternion);
+	// Returns the quaternion as (x, y, z, w)
+	[[nodiscard]] glm::vec4 Unpack() const;
+
+	bool operator==(const PackedQuaternion& other) const
+	{
+		return m_Data[0] == other.m_Data[0] && m_Data[1] == other.m_Data[1] &&
+			   m_Data[2] == other.m_Data[2];
+	}
+};
+
+// Removes every key that linear interpolation between the kept neighbours reproduces within
+// tolerance, collapsing constant channels to a single key. error(from, to, key, factor) returns
+// the deviation of key from the interpolation between from and to.
+template<typename T, typename E>
+void ReduceKeyFrames(std::vector<T>& keyFrames, float tolerance, E error)
+{
+	if (keyFrames.size() < 2) { return; }
+	std::vector<T> reduced{keyFrames.front()};
+	size_t anchor = 0;
+	for (size_t end = 2; end < keyFrames.size(); end++)
+	{
+		const float duration = keyFrames[end].time - keyFrames[anchor].time;
+		for (size_t i = anchor + 1; i < end; i++)
+		{
+			float factor = duration > 0.0f ? (keyFrames[i].time - keyFrames[anchor].time) / duration
+											: 0.0f;
+			if (error(keyFrames[anchor], keyFrames[end], keyFrames[i], factor) > tolerance)
+			{
+				anchor = end - 1;
+				reduced.push_back(keyFrames[anchor]);
+				break;
+			}
+		}
+	}
+	reduced.push_back(keyFrames.back());
+	if (reduced.size() == 2 && error(reduced[0], reduced[0], reduced[1], 0.0f) <= tolerance)
+	{ reduced.pop_back(); }
+	keyFrames = std::move(reduced);
+}
+} // namespace Neon
+
+#endif //NEON_ANIMATIONCOMPRESSION_H
@@ -24,6 +24,7 @@ public:
 	{
 	}
 	bool m_Animated = true;
+	std::string m_Name;
 	[[nodiscard]] uint32_t GetID() const
 	{
 		return m_ID;
@@ -1,16 +1,557 @@
 #include "neopch.h"
 
 #include "Components.h"
+#include "Scene.h"
+#include "TerrainTileLoader.h"
+#include <Renderer/Context.h>
+#include <Renderer/Frustum.h>
 #include <Renderer/VulkanRenderer.h>
 
-Neon::WaterRenderer::WaterRenderer()
+Neon::WaterRenderer::WaterRenderer(const WaterRenderingSettings& settings) : m_Settings(settings)
 {
+	CreateTargets();
+	m_CaptureBuffers.resize(MAX_SWAP_CHAIN_IMAGES);
+	for (auto& captureBuffer : m_CaptureBuffers)
+	{
+		captureBuffer = Allocator::CreateMappedBuffer(sizeof(WaterCapture),
+													  vk::BufferUsageFlagBits::eStorageBuffer,
+													  VMA_MEMORY_USAGE_CPU_TO_GPU);
+	}
+	m_VisibilityQuery = VulkanRenderer::CreateVisibilityQuery();
+}
+
+vk::Extent2D Neon::WaterRenderer::GetTargetExtent() const
+{
+	const vk::Extent2D extent = VulkanRenderer::GetExtent2D();
+	if (m_Settings.m_ReflectionMode == WaterReflectionMode::ScreenSpace) { return extent; }
+	const float resolutionScale = m_Settings.m_ResolutionScale;
+	return {std::max(static_cast<uint32_t>(static_cast<float>(extent.width) * resolutionScale), 1u),
+			std::max(static_cast<uint32_t>(static_cast<float>(extent.height) * resolutionScale),
+					 1u)};
+}
+
+// Destroys the view, sampler and image of a target, which may be empty
+static void ReleaseTexture(Neon::TextureImage& texture)
+{
+	Neon::Allocator::DestroyTextureImage(texture);
+	texture.m_Descriptor = vk::DescriptorImageInfo{};
+	texture.m_TextureAllocation.reset();
+}
+
+// Sampled view of one layer of a multiview target, texture does not own the image
+static void CreateLayerTexture(const Neon::TextureImage& target, vk::Format format,
+							   vk::ImageAspectFlagBits aspect, uint32_t layer,
+							   Neon::TextureImage& texture)
+{
+	ReleaseTexture(texture);
+	texture.m_Descriptor.imageView = Neon::VulkanRenderer::CreateImageView(
+		target.m_TextureAllocation->m_Image, format, aspect, vk::ImageViewType::e2D, layer, 1);
+	texture.m_Descriptor.sampler = Neon::VulkanRenderer::CreateSampler(vk::SamplerCreateInfo());
+	texture.m_Descriptor.imageLayout = target.m_Descriptor.imageLayout;
+}
+
+void Neon::WaterRenderer::CreateTargets()
+{
+	// The targets of the previous settings are released, whichever mode they were made for
+	TextureImage* targets[] = {&m_RefractionSampledColorTextureImage,
+							   &m_RefractionSampledDepthTextureImage,
+							   &m_RefractionColorTextureImage,
+							   &m_RefractionDepthTextureImage,
+							   &m_ReflectionSampledColorTextureImage,
+							   &m_ReflectionSampledDepthTextureImage,
+							   &m_ReflectionColorTextureImage,
+							   &m_ReflectionDepthTextureImage,
+							   &m_MultiviewSampledColorTextureImage,
+							   &m_MultiviewSampledDepthTextureImage,
+							   &m_MultiviewColorTextureImage,
+							   &m_MultiviewDepthTextureImage};
+	for (auto* target : targets) { ReleaseTexture(*target); }
+	m_RefractionFrameBuffers.clear();
+	m_ReflectionFrameBuffers.clear();
+	m_MultiviewFrameBuffers.clear();
+
+	m_TargetExtent = GetTargetExtent();
+	m_Captured = false;
+	// Nothing is rendered for the water of its own
+	if (m_Settings.m_ReflectionMode == WaterReflectionMode::ScreenSpace) { return; }
+	if (m_Settings.m_Multiview)
+	{
+		VulkanRenderer::CreateFrameBuffers(
+			m_TargetExtent, m_MultiviewSampledColorTextureImage,
+			m_MultiviewSampledDepthTextureImage, m_MultiviewColorTextureImage,
+			m_MultiviewDepthTextureImage, m_MultiviewFrameBuffers, m_Settings.m_ColorFormat,
+			m_Settings.m_Samples, true);
+		CreateLayerTexture(m_MultiviewColorTextureImage, m_Settings.m_ColorFormat,
+						   vk::ImageAspectFlagBits::eColor, 0, m_RefractionColorTextureImage);
+		CreateLayerTexture(m_MultiviewColorTextureImage, m_Settings.m_ColorFormat,
+						   vk::ImageAspectFlagBits::eColor, 1, m_ReflectionColorTextureImage);
+		CreateLayerTexture(m_MultiviewDepthTextureImage, vk::Format::eD32Sfloat,
+						   vk::ImageAspectFlagBits::eDepth, 0, m_RefractionDepthTextureImage);
+		return;
+	}
 	VulkanRenderer::CreateFrameBuffers(
-		refractionReflectionResolution, m_RefractionSampledColorTextureImage,
-		m_RefractionSampledDepthTextureImage, m_RefractionColorTextureImage,
-		m_RefractionDepthTextureImage, m_RefractionFrameBuffers);
+		m_TargetExtent, m_RefractionSampledColorTextureImage, m_RefractionSampledDepthTextureImage,
+		m_RefractionColorTextureImage, m_RefractionDepthTextureImage, m_RefractionFrameBuffers,
+		m_Settings.m_ColorFormat, m_Settings.m_Samples);
 	VulkanRenderer::CreateFrameBuffers(
-		refractionReflectionResolution, m_ReflectionSampledColorTextureImage,
-		m_ReflectionSampledDepthTextureImage, m_ReflectionColorTextureImage,
-		m_ReflectionDepthTextureImage, m_ReflectionFrameBuffers);
+		m_TargetExtent, m_ReflectionSampledColorTextureImage, m_ReflectionSampledDepthTextureImage,
+		m_ReflectionColorTextureImage, m_ReflectionDepthTextureImage, m_ReflectionFrameBuffers,
+		m_Settings.m_ColorFormat, m_Settings.m_Samples);
+}
+
+void Neon::WaterRenderer::SetSettings(const WaterRenderingSettings& settings)
+{
+	Context::GetInstance().GetLogicalDevice().GetHandle().waitIdle();
+	m_Settings = settings;
+	CreateTargets();
+	WriteDescriptors();
+}
+
+bool Neon::WaterRenderer::UpdateCapture(bool cameraAbove, bool inView)
+{
+	m_FramesInView = inView ? m_FramesInView + 1 : 0;
+	m_FramesSinceCapture++;
+	bool render = m_FramesSinceCapture >= std::max(m_Settings.m_UpdateInterval, 1u);
+	if (m_Settings.m_SkipHidden && !inView) { render = false; }
+	if (m_Settings.m_SkipHidden && m_FramesInView > MAX_SWAP_CHAIN_IMAGES &&
+		!VulkanRenderer::IsVisible(m_VisibilityQuery))
+	{ render = false; }
+	// Targets from the other side of the water cannot be reprojected
+	if (!m_Captured || cameraAbove != m_CapturedAbove) { render = true; }
+	if (!render) { return false; }
+
+	m_Captured = true;
+	m_CapturedAbove = cameraAbove;
+	m_FramesSinceCapture = 0;
+	return true;
+}
+
+void Neon::WaterRenderer::WriteDescriptors()
+{
+	for (size_t i = 0; i < m_DescriptorSets.size(); i++)
+	{
+		auto& descriptorSet = m_DescriptorSets[i];
+		vk::DescriptorBufferInfo captureBufferInfo{m_CaptureBuffers[i]->m_Buffer, 0,
+												   VK_WHOLE_SIZE};
+		if (m_Settings.m_ReflectionMode == WaterReflectionMode::ScreenSpace)
+		{
+			std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+				descriptorSet.CreateWrite(1, &VulkanRenderer::GetOpaqueColorDescriptor(), 0),
+				descriptorSet.CreateWrite(2, &VulkanRenderer::GetOpaqueColorDescriptor(), 0),
+				descriptorSet.CreateWrite(5, &VulkanRenderer::GetHiZDescriptor(), 0),
+				descriptorSet.CreateWrite(6, &captureBufferInfo, 0)};
+			descriptorSet.Update(descriptorWrites);
+			continue;
+		}
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(1, &m_RefractionColorTextureImage.m_Descriptor, 0),
+			descriptorSet.CreateWrite(2, &m_ReflectionColorTextureImage.m_Descriptor, 0),
+			descriptorSet.CreateWrite(5, &m_RefractionDepthTextureImage.m_Descriptor, 0),
+			descriptorSet.CreateWrite(6, &captureBufferInfo, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
+}
+
+void Neon::WaterRenderer::UploadCapture(uint32_t imageIndex) const
+{
+	memcpy(m_CaptureBuffers[imageIndex]->m_MappedData, &m_Capture, sizeof(m_Capture));
+}
+
+Neon::SkinnedMeshRenderer::SkinnedMeshRenderer(std::shared_ptr<SkinnedMesh> skinnedMesh)
+	: m_SkinnedMesh(std::move(skinnedMesh))
+{
+	m_Animation = std::make_unique<Animation>(m_SkinnedMesh->m_Clips[0]);
+
+	m_Mesh.m_VerticesCount = m_SkinnedMesh->m_VerticesCount;
+	m_Mesh.m_IndicesCount = m_SkinnedMesh->m_IndicesCount;
+	m_Mesh.m_BoundingSphere = m_SkinnedMesh->m_BoundingSphere;
+	m_Mesh.m_StaticGeometry.m_IndexBuffer = m_SkinnedMesh->m_IndexBuffer->m_Buffer;
+	m_SkinnedVertexBuffer = Allocator::CreateBuffer(
+		sizeof(SkinnedVertex) * m_Mesh.m_VerticesCount * MAX_SWAP_CHAIN_IMAGES,
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+		VMA_MEMORY_USAGE_GPU_ONLY);
+
+	vk::DescriptorBufferInfo bindPoseBufferInfo{m_SkinnedMesh->m_BindPoseVertexBuffer->m_Buffer, 0,
+												VK_WHOLE_SIZE};
+	vk::DescriptorBufferInfo boneBufferInfo{VulkanRenderer::GetBoneBuffer(), 0,
+											VulkanRenderer::GetBoneSliceSize()};
+	vk::DescriptorBufferInfo skinnedBufferInfo{m_SkinnedVertexBuffer->m_Buffer, 0, VK_WHOLE_SIZE};
+	m_SkinningDescriptorSet.Init(Context::GetInstance().GetLogicalDevice().GetHandle());
+	m_SkinningDescriptorSet.Create(VulkanRenderer::GetDescriptorPool(),
+								   VulkanRenderer::GetSkinningDescriptorSetBindings());
+	std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+		m_SkinningDescriptorSet.CreateWrite(0, &bindPoseBufferInfo, 0),
+		m_SkinningDescriptorSet.CreateWrite(1, &boneBufferInfo, 0),
+		m_SkinningDescriptorSet.CreateWrite(2, &skinnedBufferInfo, 0)};
+	m_SkinningDescriptorSet.Update(descriptorWrites);
+}
+
+void Neon::SkinnedMeshRenderer::UpdateLod(const glm::mat4& model, const glm::vec3& cameraPosition,
+										  const Frustum& frustum, float projectionScale)
+{
+	const glm::vec4& boundingSphere = m_SkinnedMesh->m_BoundingSphere;
+	const glm::vec3 center = model * glm::vec4(glm::vec3(boundingSphere), 1.0f);
+	const float maxScale = std::max(glm::length(glm::vec3(model[0])),
+									std::max(glm::length(glm::vec3(model[1])),
+											 glm::length(glm::vec3(model[2]))));
+	const float radius = boundingSphere.w * maxScale;
+	m_Culled = boundingSphere.w >= 0.0f && !frustum.IsSphereVisible(center, radius);
+
+	const float distance = std::max(glm::distance(cameraPosition, center), 0.001f);
+	const float screenSize = radius * projectionScale / distance;
+	m_Crowd = screenSize < CROWD_SCREEN_SIZE;
+	m_Lod = 0;
+	while (m_Lod + 1 < ANIMATION_LOD_COUNT && screenSize < ANIMATION_LODS[m_Lod].m_MinScreenSize)
+	{ m_Lod++; }
+}
+
+static float GetTerrainHeight(uint16_t value, float maxHeight)
+{
+	return static_cast<float>(value) / UINT16_MAX * (maxHeight * 2) - maxHeight;
+}
+
+// Heightmap shared by the nodes of a displaced terrain being built
+struct DisplacedTerrainSource
+{
+	const std::vector<uint16_t>& m_Heights;
+	int m_TexWidth;
+	int m_TexHeight;
+	glm::vec2 m_Origin;
+	glm::vec2 m_TexelSize;
+	float m_MaxHeight;
+};
+
+// Appends the node at level whose grid starts at texel (originX, originY) and its subtree,
+// returns its index or 0 when it lies outside of the heightmap. The height range of the texels
+// the node covers bounds it and is also returned through lowest and highest.
+static uint32_t CreateDisplacedTerrainNode(const DisplacedTerrainSource& source, uint32_t level,
+										   int originX, int originY,
+										   std::vector<Neon::TerrainNode>& nodes,
+										   uint16_t& lowest, uint16_t& highest)
+{
+	if (originX >= source.m_TexWidth - 1 || originY >= source.m_TexHeight - 1) { return 0; }
+
+	const auto index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	const int size = TERRAIN_CHUNK_SIZE << level;
+	lowest = UINT16_MAX;
+	highest = 0;
+	if (level > 0)
+	{
+		// Children cover the node, so their ranges make up its range
+		for (uint32_t child = 0; child < 4; child++)
+		{
+			uint16_t childLowest, childHighest;
+			const uint32_t childIndex = CreateDisplacedTerrainNode(
+				source, level - 1, originX + static_cast<int>(child & 1) * size / 2,
+				originY + static_cast<int>(child >> 1) * size / 2, nodes, childLowest,
+				childHighest);
+			nodes[index].m_Children[child] = childIndex;
+			if (childIndex == 0) { continue; }
+			lowest = std::min(lowest, childLowest);
+			highest = std::max(highest, childHighest);
+		}
+	}
+
+	// Grids reaching past the heightmap are clamped to its border
+	const int endX = std::min(originX + size, source.m_TexWidth - 1);
+	const int endY = std::min(originY + size, source.m_TexHeight - 1);
+	if (level == 0)
+	{
+		for (int texY = originY; texY <= endY; texY++)
+		{
+			for (int texX = originX; texX <= endX; texX++)
+			{
+				const uint16_t value = source.m_Heights[texY * source.m_TexWidth + texX];
+				lowest = std::min(lowest, value);
+				highest = std::max(highest, value);
+			}
+		}
+	}
+
+	const glm::vec2 low = source.m_Origin + glm::vec2(originX, originY) * source.m_TexelSize;
+	const glm::vec2 high = source.m_Origin + glm::vec2(endX, endY) * source.m_TexelSize;
+	const glm::vec3 min = {low.x, GetTerrainHeight(lowest, source.m_MaxHeight), low.y};
+	const glm::vec3 max = {high.x, GetTerrainHeight(highest, source.m_MaxHeight), high.y};
+
+	auto& node = nodes[index];
+	node.m_Level = level;
+	node.m_Origin = {originX, originY};
+	node.m_Mesh.m_VerticesCount = (TERRAIN_CHUNK_SIZE + 1) * (TERRAIN_CHUNK_SIZE + 1);
+	node.m_Mesh.m_IndicesCount = TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * 6;
+	node.m_Mesh.m_BoundingSphere = {(min + max) * 0.5f, glm::length(max - min) * 0.5f};
+	return index;
+}
+
+std::vector<Neon::TerrainNode>
+Neon::CreateDisplacedTerrainNodes(const std::vector<uint16_t>& heights, int texWidth,
+								  int texHeight, const glm::vec2& origin,
+								  const glm::vec2& texelSize, float maxHeight)
+{
+	assert(heights.size() == static_cast<size_t>(texWidth) * texHeight);
+	// Levels until the root chunk covers the whole heightmap
+	uint32_t levelCount = 1;
+	while ((TERRAIN_CHUNK_SIZE << (levelCount - 1)) < std::max(texWidth, texHeight) - 1)
+	{ levelCount++; }
+
+	const DisplacedTerrainSource source{heights, texWidth, texHeight, origin, texelSize, maxHeight};
+	std::vector<TerrainNode> nodes;
+	uint16_t lowest, highest;
+	CreateDisplacedTerrainNode(source, levelCount - 1, 0, 0, nodes, lowest, highest);
+	return nodes;
+}
+
+// Draws nodes entirely beyond the range of the next finer level, and refines the others
+static void SelectTerrainNode(const std::vector<Neon::TerrainNode>& nodes, float lodRange,
+							  uint32_t index, const glm::mat4& model, float maxScale,
+							  const glm::vec3& cameraPosition, const Neon::Frustum& frustum,
+							  std::vector<const Neon::TerrainNode*>& chunks)
+{
+	const auto& node = nodes[index];
+	const glm::vec4& boundingSphere = node.m_Mesh.m_BoundingSphere;
+	const glm::vec3 center = model * glm::vec4(glm::vec3(boundingSphere), 1.0f);
+	const float radius = boundingSphere.w * maxScale;
+	if (!frustum.IsSphereVisible(center, radius)) { return; }
+
+	if (node.m_Level == 0 || glm::distance(cameraPosition, center) - radius >
+								 lodRange * static_cast<float>(1u << (node.m_Level - 1)))
+	{
+		chunks.push_back(&node);
+		return;
+	}
+	for (uint32_t child : node.m_Children)
+	{
+		if (child != 0)
+		{
+			SelectTerrainNode(nodes, lodRange, child, model, maxScale, cameraPosition, frustum,
+							  chunks);
+		}
+	}
+}
+
+void Neon::SelectTerrainChunks(const std::vector<TerrainNode>& nodes, float lodRange,
+							   const glm::mat4& model, const glm::vec3& cameraPosition,
+							   const Frustum& frustum, std::vector<const TerrainNode*>& chunks)
+{
+	if (nodes.empty()) { return; }
+	const float maxScale = std::max(glm::length(glm::vec3(model[0])),
+									std::max(glm::length(glm::vec3(model[1])),
+											 glm::length(glm::vec3(model[2]))));
+	SelectTerrainNode(nodes, lodRange, 0, model, maxScale, cameraPosition, frustum, chunks);
+}
+
+void Neon::TerrainRenderer::SelectChunks(const glm::mat4& model, const glm::vec3& cameraPosition,
+										 const Frustum& frustum,
+										 std::vector<const TerrainNode*>& chunks) const
+{
+	SelectTerrainChunks(m_Nodes, m_LodRange, model, cameraPosition, frustum, chunks);
+}
+
+void Neon::CreateTerrainHeightMap(const std::vector<uint16_t>& heights, uint32_t width,
+								  uint32_t height, TextureImage& heightMap)
+{
+	heightMap.m_TextureAllocation = Allocator::CreateTextureImage(
+		heights.data(), heights.size() * sizeof(uint16_t), width, height, vk::Format::eR16Unorm);
+	vk::ImageView heightMapImageView =
+		VulkanRenderer::CreateImageView(heightMap.m_TextureAllocation->m_Image,
+										vk::Format::eR16Unorm, vk::ImageAspectFlagBits::eColor);
+	// Clamped so that normals at the border reuse the border texels
+	vk::SamplerCreateInfo samplerInfo = {
+		{}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eNearest,
+		vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+		vk::SamplerAddressMode::eClampToEdge};
+	heightMap.m_Descriptor = {VulkanRenderer::CreateSampler(samplerInfo), heightMapImageView,
+							  vk::ImageLayout::eShaderReadOnlyOptimal};
+}
+
+Neon::StreamedTerrainRenderer::StreamedTerrainRenderer() = default;
+Neon::StreamedTerrainRenderer::~StreamedTerrainRenderer() = default;
+Neon::StreamedTerrainRenderer::StreamedTerrainRenderer(StreamedTerrainRenderer&& other) noexcept =
+	default;
+Neon::StreamedTerrainRenderer&
+Neon::StreamedTerrainRenderer::operator=(StreamedTerrainRenderer&& other) noexcept = default;
+
+void Neon::StreamedTerrainRenderer::Update(const glm::mat4& model, const glm::vec3& cameraPosition)
+{
+	m_Frame++;
+	const glm::vec3 localCamera = glm::inverse(model) * glm::vec4(cameraPosition, 1.0f);
+	const glm::vec2 camera = {localCamera.x, localCamera.z};
+	const float tileSize = GetTileSize();
+	const float loadDistance = m_Settings.m_LoadDistance;
+	const glm::ivec2 first(glm::floor((camera - loadDistance) / tileSize));
+	const glm::ivec2 last(glm::floor((camera + loadDistance) / tileSize));
+
+	m_WantedTiles.clear();
+	m_Requests.clear();
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			const glm::vec2 low = glm::vec2(x, y) * tileSize;
+			const glm::vec2 nearest = glm::clamp(camera, low, low + tileSize);
+			const float distance = glm::distance(camera, nearest);
+			if (distance > loadDistance) { continue; }
+
+			const uint64_t key = GetTileKey({x, y});
+			m_WantedTiles.insert(key);
+			auto tile = std::find_if(m_Tiles.begin(), m_Tiles.end(), [&](const TerrainTile& t) {
+				return t.m_Resident && GetTileKey(t.m_Coordinate) == key;
+			});
+			if (tile != m_Tiles.end())
+			{
+				tile->m_LastUsedFrame = m_Frame;
+				continue;
+			}
+			if (m_PendingTiles.count(key) == 0)
+			{ m_Requests.emplace_back(distance, glm::ivec2(x, y)); }
+		}
+	}
+
+	std::sort(m_Requests.begin(), m_Requests.end(),
+			  [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+	for (const auto& request : m_Requests)
+	{
+		m_Loader->Request(request.second);
+		m_PendingTiles.insert(GetTileKey(request.second));
+	}
+	// Tiles without a heightmap hold no memory and are forgotten once out of range
+	for (auto& tile : m_Tiles)
+	{
+		if (tile.m_Resident && tile.m_Size == 0 &&
+			m_WantedTiles.count(GetTileKey(tile.m_Coordinate)) == 0)
+		{ tile.m_Resident = false; }
+	}
+	// Tiles already being decoded are discarded once finished
+	for (auto it = m_PendingTiles.begin(); it != m_PendingTiles.end();)
+	{
+		const glm::ivec2 coordinate = {static_cast<int32_t>(*it >> 32), static_cast<int32_t>(*it)};
+		if (m_WantedTiles.count(*it) == 0 && m_Loader->Cancel(coordinate))
+		{
+			it = m_PendingTiles.erase(it);
+			continue;
+		}
+		++it;
+	}
+
+	// Finished tiles wait for a slot while the budget is held by tiles still in use, instead of
+	// being decoded again
+	TerrainTileData data;
+	while (m_Loader->Poll(data)) { m_DecodedTiles.push_back(std::move(data)); }
+	auto unwanted = std::remove_if(
+		m_DecodedTiles.begin(), m_DecodedTiles.end(), [&](const TerrainTileData& decoded) {
+			const uint64_t key = GetTileKey(decoded.m_Coordinate);
+			if (m_WantedTiles.count(key) != 0) { return false; }
+			m_PendingTiles.erase(key);
+			return true;
+		});
+	m_DecodedTiles.erase(unwanted, m_DecodedTiles.end());
+	for (uint32_t i = 0; i < TERRAIN_TILE_UPLOADS_PER_FRAME && !m_DecodedTiles.empty(); i++)
+	{
+		auto& decoded = m_DecodedTiles.front();
+		const vk::DeviceSize size =
+			decoded.m_Heights.size() * sizeof(uint16_t) + decoded.m_BlendMap.size();
+		TerrainTile* tile = AcquireTile(size);
+		if (tile == nullptr) { break; }
+		UploadTile(*tile, decoded);
+		tile->m_Size = size;
+		m_ResidentSize += size;
+		m_PendingTiles.erase(GetTileKey(decoded.m_Coordinate));
+		m_DecodedTiles.pop_front();
+	}
+}
+
+Neon::TerrainTile* Neon::StreamedTerrainRenderer::AcquireTile(vk::DeviceSize size)
+{
+	// Frames that drew a tile are finished after MAX_SWAP_CHAIN_IMAGES more frames
+	auto isInUse = [&](const TerrainTile& tile) {
+		return tile.m_LastUsedFrame + MAX_SWAP_CHAIN_IMAGES > m_Frame;
+	};
+	while (m_ResidentSize > 0 && m_ResidentSize + size > m_Settings.m_MemoryBudget)
+	{
+		TerrainTile* leastRecent = nullptr;
+		for (auto& tile : m_Tiles)
+		{
+			if (!tile.m_Resident || isInUse(tile)) { continue; }
+			if (leastRecent == nullptr || tile.m_LastUsedFrame < leastRecent->m_LastUsedFrame)
+			{ leastRecent = &tile; }
+		}
+		if (leastRecent == nullptr) { return nullptr; }
+		ReleaseTile(*leastRecent);
+	}
+
+	for (auto& tile : m_Tiles)
+	{
+		if (!tile.m_Resident && !isInUse(tile)) { return &tile; }
+	}
+	return &m_Tiles.emplace_back();
+}
+
+void Neon::StreamedTerrainRenderer::ReleaseTile(TerrainTile& tile)
+{
+	m_ResidentSize -= tile.m_Size;
+	tile.m_Resident = false;
+	tile.m_Size = 0;
+	tile.m_Nodes.clear();
+	// Moved out to destroy the images and their views and samplers
+	TextureImage heightMap = std::move(tile.m_HeightMap);
+	TextureImage blendMap = std::move(tile.m_BlendMap);
+}
+
+void Neon::StreamedTerrainRenderer::UploadTile(TerrainTile& tile, TerrainTileData& data)
+{
+	tile.m_Coordinate = data.m_Coordinate;
+	tile.m_Resident = true;
+	tile.m_LastUsedFrame = m_Frame;
+	tile.m_Nodes = std::move(data.m_Nodes);
+	// Tiles without a heightmap are only remembered so that they are not requested again
+	if (data.m_Heights.empty()) { return; }
+
+	for (auto& node : tile.m_Nodes)
+	{
+		node.m_Mesh.m_StaticGeometry.m_VertexBuffer = m_Mesh.GetVertexBuffer();
+		node.m_Mesh.m_StaticGeometry.m_IndexBuffer = m_Mesh.GetIndexBuffer();
+	}
+
+	CreateTerrainHeightMap(data.m_Heights, m_Settings.m_TileResolution,
+						   m_Settings.m_TileResolution, tile.m_HeightMap);
+	tile.m_BlendMap.m_TextureAllocation = Allocator::CreateTextureImage(
+		data.m_BlendMap.data(), data.m_BlendMap.size(), data.m_BlendMapWidth,
+		data.m_BlendMapHeight, vk::Format::eR8G8B8A8Srgb);
+	vk::ImageView blendMapImageView = VulkanRenderer::CreateImageView(
+		tile.m_BlendMap.m_TextureAllocation->m_Image, vk::Format::eR8G8B8A8Srgb,
+		vk::ImageAspectFlagBits::eColor);
+	vk::SamplerCreateInfo samplerInfo = {
+		{}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eNearest,
+		vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+		vk::SamplerAddressMode::eClampToEdge};
+	tile.m_BlendMap.m_Descriptor = {VulkanRenderer::CreateSampler(samplerInfo), blendMapImageView,
+									vk::ImageLayout::eShaderReadOnlyOptimal};
+	Allocator::FlushStaging();
+
+	const auto& device = Context::GetInstance().GetLogicalDevice().GetHandle();
+	if (tile.m_DescriptorSets.empty())
+	{
+		tile.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
+		for (auto& descriptorSet : tile.m_DescriptorSets)
+		{
+			descriptorSet.Init(device);
+			descriptorSet.Create(VulkanRenderer::GetDescriptorPool(), m_Bindings);
+		}
+	}
+	// The slot was not drawn by any frame still in flight, so its sets can be rewritten
+	vk::DescriptorBufferInfo materialBufferInfo{m_MaterialBuffer->m_Buffer, 0, VK_WHOLE_SIZE};
+	vk::DescriptorBufferInfo parametersBufferInfo{m_ParametersBuffer->m_Buffer, 0, VK_WHOLE_SIZE};
+	for (auto& descriptorSet : tile.m_DescriptorSets)
+	{
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(0, &materialBufferInfo, 0),
+			descriptorSet.CreateWrite(1, &tile.m_BlendMap.m_Descriptor, 0),
+			descriptorSet.CreateWrite(2, &m_BackgroundTexture.m_Descriptor, 0),
+			descriptorSet.CreateWrite(3, &m_RTexture.m_Descriptor, 0),
+			descriptorSet.CreateWrite(4, &m_GTexture.m_Descriptor, 0),
+			descriptorSet.CreateWrite(5, &m_BTexture.m_Descriptor, 0),
+			descriptorSet.CreateWrite(7, &parametersBufferInfo, 0),
+			descriptorSet.CreateWrite(8, &tile.m_HeightMap.m_Descriptor, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
 }
@@ -10,9 +10,14 @@
 #include "DescriptorSet.h"
 #include "Entity.h"
 #include "GraphicsPipeline.h"
+#include "OceanSimulation.h"
+#include "StaticGeometryArena.h"
+#include "TerrainHeightfield.h"
+#include "TerrainVirtualTexture.h"
 #include <Core/Allocator.h>
 #include <Renderer/DescriptorSet.h>
 #include <Renderer/GraphicsPipeline.h>
+#include <deque>
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
@@ -22,8 +27,24 @@
 #include <assimp/anim.h>
 #include <assimp/postprocess.h>
 
+// Every terrain quadtree node is drawn as a grid of TERRAIN_CHUNK_SIZE x TERRAIN_CHUNK_SIZE quads
+#define TERRAIN_CHUNK_SIZE 64
+// Fraction of a LOD range after which vertices morph towards the next coarser level
+#define TERRAIN_MORPH_START 0.8f
+// Finished streamed terrain tiles uploaded per frame, each upload waits for the graphics queue
+#define TERRAIN_TILE_UPLOADS_PER_FRAME 1
+// The ocean is drawn as a grid of OCEAN_GRID_SIZE x OCEAN_GRID_SIZE quads reaching
+// OCEAN_GRID_RADIUS from the camera. Vertex spacing grows with the cube of the distance from its
+// center, where OCEAN_GRID_INNER_EXTENT would be covered by an even grid.
+#define OCEAN_GRID_SIZE 256
+#define OCEAN_GRID_RADIUS 4000.0f
+#define OCEAN_GRID_INNER_EXTENT 64.0f
+
 namespace Neon
 {
+struct Frustum;
+class TerrainTileLoader;
+
 struct TagComponent
 {
 	std::string Tag;
@@ -54,6 +75,21 @@ struct Mesh
 	uint32_t m_IndicesCount{0};
 	std::unique_ptr<BufferAllocation> m_VertexBuffer{};
 	std::unique_ptr<BufferAllocation> m_IndexBuffer{};
+	// Used instead of the owned buffers for meshes batched into a StaticGeometryArena and for
+	// the per frame output of compute skinning
+	StaticGeometryRange m_StaticGeometry{};
+	// Object space bounding sphere used for culling, negative radius means never culled
+	glm::vec4 m_BoundingSphere{0.0f, 0.0f, 0.0f, -1.0f};
+
+	[[nodiscard]] vk::Buffer GetVertexBuffer() const
+	{
+		return m_VertexBuffer ? vk::Buffer(m_VertexBuffer->m_Buffer)
+							  : m_StaticGeometry.m_VertexBuffer;
+	}
+	[[nodiscard]] vk::Buffer GetIndexBuffer() const
+	{
+		return m_IndexBuffer ? vk::Buffer(m_IndexBuffer->m_Buffer) : m_StaticGeometry.m_IndexBuffer;
+	}
 };
 
 struct SkyDomeRenderer
@@ -77,15 +113,50 @@ struct Relationship
 	}
 };
 
-struct SkinnedMeshRenderer
+// Frames per second at which clips are baked for crowd rendering
+#define CROWD_ANIMATION_SAMPLE_RATE 30.0f
+
+// Frames of one clip in the animation texture of a crowd
+struct CrowdClip
 {
+	uint32_t m_FirstFrame = 0;
+	uint32_t m_FrameCount = 0;
+	float m_FramesPerTick = 0;
+};
+
+// Draw state of the instances of a SkinnedMesh that are far enough to be rendered as a crowd.
+// The clips are baked into the animation texture once, the vertex shader skins the bind pose by
+// sampling it at the frame each instance passes in its model matrix, so every crowd instance of
+// the mesh is part of one instanced draw.
+struct SkinnedMeshCrowd
+{
+	// Bind pose vertices and indices of the owning SkinnedMesh
 	Mesh m_Mesh;
 
-	Bone m_RootBone;
-	uint32_t m_BoneSize;
-	std::unique_ptr<BufferAllocation> m_BoneBuffer{};
+	GraphicsPipeline m_GraphicsPipeline;
+	std::vector<DescriptorSet> m_DescriptorSets;
 
-	std::unique_ptr<Animation> m_Animation = nullptr;
+	// RGBA32F, one row per frame holding the three rows of the affine skinning matrix per bone.
+	// The frames of the clips of the SkinnedMesh follow each other.
+	TextureImage m_AnimationTexture;
+	// One per clip of the owning SkinnedMesh
+	std::vector<CrowdClip> m_Clips;
+};
+
+// Immutable resources of one imported animated model, shared by every instance spawned from it
+struct SkinnedMesh
+{
+	std::string m_Name;
+	std::shared_ptr<const Skeleton> m_Skeleton;
+	// One per animation of the file, the first plays by default. All are baked for the crowd.
+	std::vector<std::shared_ptr<const AnimationClip>> m_Clips;
+
+	uint32_t m_VerticesCount{0};
+	uint32_t m_IndicesCount{0};
+	// Object space bounding sphere containing every pose of every clip
+	glm::vec4 m_BoundingSphere{0.0f, 0.0f, 0.0f, -1.0f};
+	std::unique_ptr<BufferAllocation> m_BindPoseVertexBuffer{};
+	std::unique_ptr<BufferAllocation> m_IndexBuffer{};
 
 	GraphicsPipeline m_GraphicsPipeline;
 	std::vector<DescriptorSet> m_DescriptorSets;
@@ -93,84 +164,80 @@ struct SkinnedMeshRenderer
 	std::shared_ptr<BufferAllocation> m_MaterialBuffer{};
 	std::vector<TextureImage> m_TextureImages;
 
-	SkinnedMeshRenderer(const aiScene* scene, int index,
-						std::unordered_map<std::string, uint32_t>& boneMap,
-						const std::vector<glm::mat4>& offsetMatrices)
-		: m_BoneSize(offsetMatrices.size())
-	{
-		CreateBoneTree(scene, scene->mRootNode, m_RootBone, glm::mat4(1.0), index, boneMap,
-					   offsetMatrices, m_BoneSize);
-		assert(m_RootBone.GetID() >= 0);
-		m_Animation = std::make_unique<Animation>(scene, index, boneMap, m_BoneSize);
-	}
+	SkinnedMeshCrowd m_Crowd;
 
-	void Update(float seconds)
-	{
-		std::vector<glm::mat4> transforms(m_BoneSize);
-		m_Animation->Update(seconds, transforms, m_RootBone);
-		Allocator::UpdateAllocation(m_BoneBuffer->m_Allocation, transforms);
-	}
+	SkinnedMesh() = default;
+};
 
-	void CreateBoneTree(const aiScene* scene, const aiNode* node, Bone& parentBone,
-						glm::mat4 parentTransform, int animationIndex,
-						std::unordered_map<std::string, uint32_t>& boneMap,
-						const std::vector<glm::mat4>& offsetMatrices, uint32_t& bonesCount)
-	{
-		std::string nodeName = node->mName.data;
+// One animated instance of a SkinnedMesh, owning only its playback state and skinning output
+struct SkinnedMeshRenderer
+{
+	// Instances projected smaller than this are drawn from the baked animation texture, the
+	// projected size is the radius of the bounds relative to half the viewport height
+	static constexpr float CROWD_SCREEN_SIZE = 0.06f;
 
-		const aiAnimation* animation = scene->mAnimations[animationIndex];
+	std::shared_ptr<SkinnedMesh> m_SkinnedMesh;
+	// Skinned vertices of the current frame together with the shared index buffer
+	Mesh m_Mesh;
 
-		const aiNodeAnim* nodeAnim = nullptr;
-		for (int i = 0; i < animation->mNumChannels; i++)
-		{
-			const aiNodeAnim* nodeAnimTemp = animation->mChannels[i];
-			if (std::string(nodeAnimTemp->mNodeName.data) == nodeName)
-			{
-				nodeAnim = nodeAnimTemp;
-				break;
-			}
-		}
+	std::unique_ptr<Animation> m_Animation = nullptr;
+	// First matrix of this instance's palette in the frame's bone buffer, assigned every frame
+	uint32_t m_BoneOffset = 0;
 
-		glm::mat4 localTransform = glm::transpose(*(glm::mat4*)&node->mTransformation);
-		glm::mat4 newParentTransform = parentTransform * localTransform;
+	// Bind pose vertices are skinned by compute once per frame into one region per swap chain
+	// image of the skinned vertex buffer, which every scene pass then draws as plain geometry
+	std::unique_ptr<BufferAllocation> m_SkinnedVertexBuffer{};
+	DescriptorSet m_SkinningDescriptorSet;
 
-		Bone* newParentBone = &parentBone;
-		if (nodeAnim || boneMap.find(nodeName) != boneMap.end())
-		{
-			newParentTransform = glm::mat4(1.0);
-			Bone newBone;
-			if (boneMap.find(nodeName) == boneMap.end())
-			{
-				newBone = Bone(bonesCount, glm::mat4(1.0), parentTransform, localTransform);
-				boneMap[nodeName] = bonesCount++;
-			}
-			else
-			{
-				newBone = Bone(boneMap[nodeName], offsetMatrices[boneMap[nodeName]],
-							   parentTransform, localTransform);
-			}
-			newBone.m_Animated = nodeAnim;
-			if (parentBone.GetID() == -1)
-			{
-				parentBone = newBone;
-				newParentBone = &parentBone;
-			}
-			else
-			{
-				parentBone.GetChildren().push_back(newBone);
-				newParentBone = &parentBone.GetChildren().back();
-			}
-		}
+	// Chosen every frame by UpdateLod. Culled and crowd instances only advance their time,
+	// they are neither posed nor skinned and are drawn as part of the crowd. m_Culled is relative
+	// to the main camera only.
+	uint32_t m_Lod = 0;
+	bool m_Crowd = false;
+	bool m_Culled = false;
+
+	explicit SkinnedMeshRenderer(std::shared_ptr<SkinnedMesh> skinnedMesh);
+
+	// Selects the animation LOD from the projected size of the bounds of the instance placed at
+	// model, projectionScale is the vertical focal length of the camera projection
+	void UpdateLod(const glm::mat4& model, const glm::vec3& cameraPosition, const Frustum& frustum,
+				   float projectionScale);
+
+	[[nodiscard]] bool IsPosed() const
+	{
+		return !m_Crowd && !m_Culled;
+	}
 
-		for (int i = 0; i < node->mNumChildren; i++)
+	// Writes the skinning matrices of posed instances to palette, which holds one matrix per
+	// bone. Instances are independent and may be updated concurrently.
+	void Update(float seconds, glm::mat4* palette)
+	{
+		if (!IsPosed())
 		{
-			CreateBoneTree(scene, node->mChildren[i], *newParentBone, newParentTransform,
-						   animationIndex, boneMap, offsetMatrices, bonesCount);
+			m_Animation->Advance(seconds);
+			return;
 		}
+		m_Animation->Update(seconds, palette, *m_SkinnedMesh->m_Skeleton, m_Lod);
+	}
+
+	// Model matrix of the crowd draw. Its unused fourth row carries the frame within the clip
+	// playing on the base layer, the first frame of that clip and its frame count.
+	[[nodiscard]] Transform GetCrowdTransform(const Transform& transform) const
+	{
+		const auto& clips = m_SkinnedMesh->m_Clips;
+		const auto clip = std::find(clips.begin(), clips.end(), m_Animation->GetClip());
+		const CrowdClip& crowdClip =
+			m_SkinnedMesh->m_Crowd.m_Clips[clip == clips.end() ? 0 : clip - clips.begin()];
+		Transform crowdTransform = transform;
+		crowdTransform.m_Global[0][3] = m_Animation->GetTime() * crowdClip.m_FramesPerTick;
+		crowdTransform.m_Global[1][3] = static_cast<float>(crowdClip.m_FirstFrame);
+		crowdTransform.m_Global[2][3] = static_cast<float>(crowdClip.m_FrameCount);
+		return crowdTransform;
 	}
 };
 
-struct MeshRenderer
+// Immutable GPU resources of one imported mesh, shared by every entity placed from the same model
+struct StaticMesh
 {
 	Mesh m_Mesh;
 
@@ -180,12 +247,100 @@ struct MeshRenderer
 	std::shared_ptr<BufferAllocation> m_MaterialBuffer{};
 	std::vector<TextureImage> m_TextureImages;
 
+	StaticMesh() = default;
+};
+
+struct MeshRenderer
+{
+	std::shared_ptr<StaticMesh> m_StaticMesh;
+
 	MeshRenderer() = default;
+	explicit MeshRenderer(std::shared_ptr<StaticMesh> staticMesh)
+		: m_StaticMesh(std::move(staticMesh))
+	{
+	}
+};
+
+// Quadtree node of a chunked terrain. Every node covers a (TERRAIN_CHUNK_SIZE + 1)^2 vertex grid
+// sampled at the stride of its level, so all nodes draw the same chunk index buffer. Mesh
+// terrains give every node its own vertices, displaced terrains share one grid between all nodes.
+struct TerrainNode
+{
+	Mesh m_Mesh;
+	uint32_t m_Level = 0;
+	// Heightmap texel of the first grid vertex
+	glm::ivec2 m_Origin{0};
+	// Indices into TerrainRenderer::m_Nodes, 0 for children outside of the heightmap
+	std::array<uint32_t, 4> m_Children{};
+
+	// Model matrix of the node drawn from a shared grid, its unused fourth row carries the origin
+	// texel and level of the node
+	[[nodiscard]] Transform GetDisplacedTransform(const Transform& transform) const
+	{
+		Transform nodeTransform = transform;
+		nodeTransform.m_Global[0][3] = static_cast<float>(m_Origin.x);
+		nodeTransform.m_Global[1][3] = static_cast<float>(m_Origin.y);
+		nodeTransform.m_Global[2][3] = static_cast<float>(m_Level);
+		return nodeTransform;
+	}
+};
+
+// 16 bit height of an RGBA heightmap texel, the sum of its RGB channels rescaled to the full range
+inline uint16_t GetTerrainTexelHeight(const unsigned char* texel)
+{
+	const uint32_t value = texel[0] + texel[1] + texel[2];
+	return static_cast<uint16_t>((value * UINT16_MAX + 765 / 2) / 765);
+}
+
+// Builds the quadtree over a texWidth x texHeight heightmap of 16 bit heights, whose texel 0 lies
+// at origin, for a terrain displaced on the GPU. Nodes are bounded by the heights they cover,
+// which map to [-maxHeight, maxHeight].
+std::vector<TerrainNode> CreateDisplacedTerrainNodes(const std::vector<uint16_t>& heights,
+													 int texWidth, int texHeight,
+													 const glm::vec2& origin,
+													 const glm::vec2& texelSize, float maxHeight);
+
+// Appends the nodes of a quadtree to draw for a camera at cameraPosition, culled against frustum.
+// lodRange is the range of level 0 and model places the quadtree in the world.
+void SelectTerrainChunks(const std::vector<TerrainNode>& nodes, float lodRange,
+						 const glm::mat4& model, const glm::vec3& cameraPosition,
+						 const Frustum& frustum, std::vector<const TerrainNode*>& chunks);
+
+// R16 texture of heights sampled by the displacing vertex shader
+void CreateTerrainHeightMap(const std::vector<uint16_t>& heights, uint32_t width, uint32_t height,
+							TextureImage& heightMap);
+
+// Heightmap placement read by the displacing vertex shader, scalar layout
+struct TerrainParameters
+{
+	// Object space position of texel 0 and distance between texels
+	glm::vec2 m_Origin;
+	glm::vec2 m_TexelSize;
+	glm::ivec2 m_HeightMapSize;
+	// Heights are m_MinHeight + m_HeightRange * sampled value
+	float m_MinHeight;
+	float m_HeightRange;
+	float m_LodRange;
+	float m_MorphStart;
 };
 
+// Continuous distance LOD terrain: nodes are selected per camera so that every level covers a
+// ring twice as wide as the previous one, and the vertex shader morphs odd vertices onto the
+// grid of the next level towards the end of each range, so neighbouring levels meet without
+// cracks.
 struct TerrainRenderer
 {
+	// Vertices of every node, node after node, or the shared grid when displaced, and the index
+	// buffer of one chunk
 	Mesh m_Mesh;
+	// m_Nodes[0] is the root
+	std::vector<TerrainNode> m_Nodes;
+	// Distance up to which level 0 is drawn, each following level doubles it
+	float m_LodRange = 0;
+	// Vertices are displaced by m_HeightMap in the vertex shader, which also derives the normals
+	bool m_GpuDisplacement = false;
+	TextureImage m_HeightMap;
+	std::unique_ptr<BufferAllocation> m_ParametersBuffer{};
 
 	GraphicsPipeline m_GraphicsPipeline;
 	std::vector<DescriptorSet> m_DescriptorSets;
@@ -196,11 +351,191 @@ struct TerrainRenderer
 	TextureImage m_RTexture;
 	TextureImage m_GTexture;
 	TextureImage m_BTexture;
+	// Clipmap of the blended ground textures sampled instead of them when set
+	std::unique_ptr<TerrainVirtualTexture> m_VirtualTexture{};
+
+	// Heights for gameplay queries, in the object space of the terrain
+	TerrainHeightfield m_Heightfield;
 
 	TerrainRenderer() = default;
+
+	[[nodiscard]] float GetLodRange(uint32_t level) const
+	{
+		return m_LodRange * static_cast<float>(1u << level);
+	}
+
+	// Appends the nodes to draw for a camera at cameraPosition, culled against frustum, model
+	// places the terrain in the world
+	void SelectChunks(const glm::mat4& model, const glm::vec3& cameraPosition,
+					  const Frustum& frustum, std::vector<const TerrainNode*>& chunks) const;
+
+	// Model matrix of a chunk, its unused fourth row carries the morph range of the chunk level,
+	// or the origin texel and level of the chunk when displaced
+	[[nodiscard]] Transform GetChunkTransform(const Transform& transform,
+											  const TerrainNode& node) const
+	{
+		if (m_GpuDisplacement) { return node.GetDisplacedTransform(transform); }
+		Transform chunkTransform = transform;
+		chunkTransform.m_Global[0][3] = TERRAIN_MORPH_START * GetLodRange(node.m_Level);
+		chunkTransform.m_Global[1][3] = GetLodRange(node.m_Level);
+		return chunkTransform;
+	}
 };
 
-const vk::Extent2D refractionReflectionResolution{1920, 1080};
+// Tiles of a streamed terrain are read from m_Directory as height_<x>_<y>.png and
+// blend_<x>_<y>.png. Heightmaps are m_TileResolution texels wide, TERRAIN_CHUNK_SIZE * 2^n + 1,
+// and neighbouring tiles share their border texels.
+struct TerrainStreamingSettings
+{
+	std::string m_Directory = "textures/terrain";
+	uint32_t m_TileResolution = 1025;
+	// World distance between texels
+	float m_TexelSize = 1.0f;
+	float m_MaxHeight = 100.0f;
+	// Tiles closer to the camera than this are loaded and drawn
+	float m_LoadDistance = 3000.0f;
+	// GPU memory of the heightmaps and blend maps of resident tiles
+	vk::DeviceSize m_MemoryBudget = 256ull << 20;
+	uint32_t m_ThreadCount = 2;
+};
+
+// Tile of a streamed terrain as decoded by a TerrainTileLoader thread
+struct TerrainTileData
+{
+	glm::ivec2 m_Coordinate{0};
+	// Empty when the tile has no heightmap
+	std::vector<uint16_t> m_Heights;
+	std::vector<unsigned char> m_BlendMap;
+	uint32_t m_BlendMapWidth = 0;
+	uint32_t m_BlendMapHeight = 0;
+	std::vector<TerrainNode> m_Nodes;
+};
+
+// Slot of a streamed terrain holding one tile. Slots are reused for other tiles once evicted,
+// keeping their descriptor sets, since sets are not returned to the pool.
+struct TerrainTile
+{
+	glm::ivec2 m_Coordinate{0};
+	bool m_Resident = false;
+	// Last frame the tile was within the load distance, only tiles of the current frame are drawn
+	uint64_t m_LastUsedFrame = 0;
+	vk::DeviceSize m_Size = 0;
+	std::vector<TerrainNode> m_Nodes;
+	TextureImage m_HeightMap;
+	TextureImage m_BlendMap;
+	std::vector<DescriptorSet> m_DescriptorSets;
+};
+
+// Displaced terrain made of tiles that are decoded around the camera on background threads and
+// uploaded on the main thread. Tiles that leave the load distance stay resident until the memory
+// budget needs their slot, least recently used first. Since all tiles lie on one texel grid and
+// share one LOD range, chunks of neighbouring tiles morph the same way and meet without cracks,
+// like chunks within a tile.
+struct StreamedTerrainRenderer
+{
+	TerrainStreamingSettings m_Settings;
+	// Grid and index buffer of one chunk, shared by every node of every tile
+	Mesh m_Mesh;
+	float m_LodRange = 0;
+
+	GraphicsPipeline m_GraphicsPipeline;
+	// Layout of the descriptor sets of every tile, the sets are allocated with equal layouts
+	std::vector<vk::DescriptorSetLayoutBinding> m_Bindings;
+	vk::UniqueDescriptorSetLayout m_DescriptorSetLayout;
+
+	std::unique_ptr<BufferAllocation> m_MaterialBuffer{};
+	std::unique_ptr<BufferAllocation> m_ParametersBuffer{};
+	TextureImage m_BackgroundTexture;
+	TextureImage m_RTexture;
+	TextureImage m_GTexture;
+	TextureImage m_BTexture;
+
+	std::vector<TerrainTile> m_Tiles;
+	std::unique_ptr<TerrainTileLoader> m_Loader;
+	// Tiles requested from the loader or decoded and waiting for a slot, and tiles within the
+	// load distance this frame, by GetTileKey
+	std::unordered_set<uint64_t> m_PendingTiles;
+	std::unordered_set<uint64_t> m_WantedTiles;
+	// Decoded tiles in the order they finished, uploaded once the budget frees a slot
+	std::deque<TerrainTileData> m_DecodedTiles;
+	std::vector<std::pair<float, glm::ivec2>> m_Requests;
+	vk::DeviceSize m_ResidentSize = 0;
+	uint64_t m_Frame = 0;
+
+	StreamedTerrainRenderer();
+	~StreamedTerrainRenderer();
+	StreamedTerrainRenderer(StreamedTerrainRenderer&& other) noexcept;
+	StreamedTerrainRenderer& operator=(StreamedTerrainRenderer&& other) noexcept;
+
+	static uint64_t GetTileKey(const glm::ivec2& coordinate)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(coordinate.x)) << 32) |
+			   static_cast<uint32_t>(coordinate.y);
+	}
+
+	[[nodiscard]] float GetTileSize() const
+	{
+		return static_cast<float>(m_Settings.m_TileResolution - 1) * m_Settings.m_TexelSize;
+	}
+
+	// Model matrix of a tile of the terrain placed by model
+	[[nodiscard]] glm::mat4 GetTileModel(const glm::mat4& model, const TerrainTile& tile) const
+	{
+		const glm::vec2 offset = glm::vec2(tile.m_Coordinate) * GetTileSize();
+		glm::mat4 tileModel = model;
+		tileModel[3] = model * glm::vec4(offset.x, 0.0f, offset.y, 1.0f);
+		return tileModel;
+	}
+
+	[[nodiscard]] bool IsDrawn(const TerrainTile& tile) const
+	{
+		return tile.m_Resident && tile.m_LastUsedFrame == m_Frame && !tile.m_Nodes.empty();
+	}
+
+	// Requests the tiles within the load distance of cameraPosition nearest first, cancels the
+	// requests of tiles that left it and uploads finished tiles as the budget allows
+	void Update(const glm::mat4& model, const glm::vec3& cameraPosition);
+
+private:
+	// Frees resident tiles, least recently used first, until size fits into the budget, and
+	// returns a free slot or nullptr when the tiles over the budget are still in use
+	TerrainTile* AcquireTile(vk::DeviceSize size);
+	void ReleaseTile(TerrainTile& tile);
+	void UploadTile(TerrainTile& tile, TerrainTileData& data);
+};
+
+enum class WaterReflectionMode
+{
+	// Refraction and reflection passes of their own
+	Planar,
+	// Traced through the opaque main pass of the frame, no passes of their own
+	ScreenSpace
+};
+
+// Quality of the refraction and reflection passes of a water surface
+struct WaterRenderingSettings
+{
+	WaterReflectionMode m_ReflectionMode = WaterReflectionMode::Planar;
+	// Size of the refraction and reflection targets relative to the window
+	float m_ResolutionScale = 0.5f;
+	vk::SampleCountFlagBits m_Samples = vk::SampleCountFlagBits::e1;
+	vk::Format m_ColorFormat = vk::Format::eR16G16B16A16Sfloat;
+	// The passes are rendered every m_UpdateInterval frames, the frames in between reproject the
+	// last ones
+	uint32_t m_UpdateInterval = 2;
+	// Skips the passes while the water is outside of the view or occluded
+	bool m_SkipHidden = true;
+	// Renders refraction and reflection together in one multiview pass
+	bool m_Multiview = true;
+};
+
+// Cameras the refraction and reflection targets were last rendered with, read by the water
+// fragment shader to project its fragments into them
+struct WaterCapture
+{
+	glm::mat4 m_RefractionViewProjection{1.0f};
+	glm::mat4 m_ReflectionViewProjection{1.0f};
+};
 
 struct WaterRenderer
 {
@@ -211,12 +546,17 @@ struct WaterRenderer
 	float m_MoveFactor = 0;
 
 	GraphicsPipeline m_GraphicsPipeline;
+	// Same layout as m_GraphicsPipeline, tracing the reflection in screen space
+	GraphicsPipeline m_ScreenSpacePipeline;
 	std::vector<DescriptorSet> m_DescriptorSets;
 
 	std::unique_ptr<BufferAllocation> m_MaterialBuffer{};
 
 	vk::UniqueRenderPass m_RenderPass{};
 
+	WaterRenderingSettings m_Settings;
+	vk::Extent2D m_TargetExtent{};
+
 	TextureImage m_RefractionSampledColorTextureImage;
 	TextureImage m_RefractionSampledDepthTextureImage;
 	TextureImage m_RefractionColorTextureImage;
@@ -229,16 +569,78 @@ struct WaterRenderer
 	TextureImage m_ReflectionDepthTextureImage;
 	std::vector<vk::UniqueFramebuffer> m_ReflectionFrameBuffers;
 
+	// Two layer targets of the multiview pass, refraction in the first layer and reflection in
+	// the second. The refraction and reflection textures then only hold views of their layer.
+	TextureImage m_MultiviewSampledColorTextureImage;
+	TextureImage m_MultiviewSampledDepthTextureImage;
+	TextureImage m_MultiviewColorTextureImage;
+	TextureImage m_MultiviewDepthTextureImage;
+	std::vector<vk::UniqueFramebuffer> m_MultiviewFrameBuffers;
+
 	TextureImage m_DuDvMapTextureImage;
 	TextureImage m_NormalMapTextureImage;
 
-	WaterRenderer();
+	// Per swap chain image copies of m_Capture
+	std::vector<std::unique_ptr<BufferAllocation>> m_CaptureBuffers;
+	WaterCapture m_Capture;
+	bool m_Captured = false;
+	// Side of the water the camera was on when the targets were rendered
+	bool m_CapturedAbove = true;
+	uint32_t m_FramesSinceCapture = 0;
+	// Frames the water has been inside of the view, occlusion results are only trusted once they
+	// were all produced while it was
+	uint32_t m_FramesInView = 0;
+	uint32_t m_VisibilityQuery = 0;
+
+	explicit WaterRenderer(const WaterRenderingSettings& settings = {});
+
+	// Recreates the targets for settings, waiting for the device to be idle
+	void SetSettings(const WaterRenderingSettings& settings);
+	// Whether the refraction and reflection passes have to be rendered this frame, in which case
+	// the caller renders them and stores their cameras in m_Capture. cameraAbove tells the side of
+	// the water the camera is on and inView whether the water is inside of the view frustum.
+	bool UpdateCapture(bool cameraAbove, bool inView);
+	// Writes the targets, or the opaque scene textures in screen space mode, and the capture
+	// buffers to bindings 1, 2, 5 and 6 of the descriptor sets
+	void WriteDescriptors();
+	// Copies m_Capture into the buffer read by the frame of imageIndex
+	void UploadCapture(uint32_t imageIndex) const;
+
+	// Size of the targets for the current window, the window size in screen space mode
+	[[nodiscard]] vk::Extent2D GetTargetExtent() const;
+	[[nodiscard]] const GraphicsPipeline& GetPipeline() const
+	{
+		return m_Settings.m_ReflectionMode == WaterReflectionMode::ScreenSpace
+				   ? m_ScreenSpacePipeline
+				   : m_GraphicsPipeline;
+	}
 
 	void Update(float seconds)
 	{
 		m_MoveFactor += WAVE_SPEED * seconds;
 		m_MoveFactor = m_MoveFactor - std::floor(m_MoveFactor);
 	}
+
+private:
+	void CreateTargets();
+};
+
+// Ocean simulated by m_Simulation. The grid follows the camera in steps of m_GridSpacing, so that
+// its inner vertices do not slide over the waves, and the transform of the entity sets its height.
+// Outer vertices, spaced wider than the step, still slide by up to a step. This is accepted, as
+// they sample the displacement from a mip level that averages it over their spacing.
+struct OceanRenderer
+{
+	Mesh m_Mesh;
+	// Distance between the vertices at the center of the grid
+	float m_GridSpacing = 1.0f;
+
+	GraphicsPipeline m_GraphicsPipeline;
+	std::vector<DescriptorSet> m_DescriptorSets;
+
+	std::unique_ptr<OceanSimulation> m_Simulation{};
+	// Seconds simulated so far, wrapped to OCEAN_REPEAT_PERIOD to keep their precision
+	float m_Time = 0;
 };
 } // namespace Neon
 
@@ -0,0 +1,254 @@
+#include "neopch.h"
+
+#include "OceanSimulation.h"
+#include "VulkanRenderer.h"
+#include <Renderer/Context.h>
+
+// A cascade hands its waves over to the next smaller one at this many of the longest waves of
+// the next one, which the larger patch still resolves with enough texels
+#define OCEAN_CASCADE_OVERLAP 6.0f
+
+void Neon::OceanSimulation::Init(const OceanSettings& settings)
+{
+	m_Settings = settings;
+	m_LevelCount = static_cast<uint32_t>(std::log2(OCEAN_FFT_SIZE)) + 1;
+
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	CreateCascadeImage(m_SpectrumImage, vk::Format::eR32G32B32A32Sfloat, 1,
+					   vk::ImageUsageFlagBits::eStorage);
+	for (auto& fourierImage : m_FourierImages)
+	{
+		CreateCascadeImage(fourierImage, vk::Format::eR32G32B32A32Sfloat, 1,
+						   vk::ImageUsageFlagBits::eStorage);
+	}
+	// Mipmaps are downsampled by blits
+	const vk::ImageUsageFlags surfaceUsage =
+		vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled |
+		vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+	CreateCascadeImage(m_DisplacementImage, vk::Format::eR16G16B16A16Sfloat, m_LevelCount,
+					   surfaceUsage);
+	CreateCascadeImage(m_DerivativesImage, vk::Format::eR16G16B16A16Sfloat, m_LevelCount,
+					   surfaceUsage);
+
+	// The patches tile the surface
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear;
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	samplerInfo.maxLod = static_cast<float>(m_LevelCount);
+	m_Sampler = device.createSamplerUnique(samplerInfo);
+	m_DisplacementDescriptor = {m_Sampler.get(), m_DisplacementImage.m_View.get(),
+								vk::ImageLayout::eGeneral};
+	m_DerivativesDescriptor = {m_Sampler.get(), m_DerivativesImage.m_View.get(),
+							   vk::ImageLayout::eGeneral};
+
+	m_ParametersBuffer = Allocator::CreateMappedBuffer(sizeof(OceanParameters),
+													   vk::BufferUsageFlagBits::eStorageBuffer,
+													   VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	for (uint32_t binding = 0; binding < 5; binding++)
+	{
+		bindings.emplace_back(binding, vk::DescriptorType::eStorageImage, 1,
+							  vk::ShaderStageFlagBits::eCompute);
+	}
+	bindings.emplace_back(5, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	m_DescriptorSet.Init(device);
+	m_DescriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
+	const CascadeImage* storageImages[] = {&m_SpectrumImage, &m_FourierImages[0],
+										   &m_FourierImages[1], &m_DisplacementImage,
+										   &m_DerivativesImage};
+	std::vector<vk::DescriptorImageInfo> imageInfos;
+	for (const auto* storageImage : storageImages)
+	{
+		imageInfos.emplace_back(nullptr, storageImage->m_StorageView.get(),
+								vk::ImageLayout::eGeneral);
+	}
+	vk::DescriptorBufferInfo parametersInfo = GetParametersDescriptor();
+	std::vector<vk::WriteDescriptorSet> descriptorWrites;
+	for (uint32_t binding = 0; binding < 5; binding++)
+	{ descriptorWrites.push_back(m_DescriptorSet.CreateWrite(binding, &imageInfos[binding], 0)); }
+	descriptorWrites.push_back(m_DescriptorSet.CreateWrite(5, &parametersInfo, 0));
+	m_DescriptorSet.Update(descriptorWrites);
+
+	vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0,
+											sizeof(PushConstant)};
+	const std::pair<ComputePipeline*, const char*> pipelines[] = {
+		{&m_SpectrumPipeline, "src/Shaders/build/comp_ocean_spectrum.spv"},
+		{&m_TimePipeline, "src/Shaders/build/comp_ocean_time.spv"},
+		{&m_FftPipeline, "src/Shaders/build/comp_ocean_fft.spv"},
+		{&m_ResolvePipeline, "src/Shaders/build/comp_ocean_resolve.spv"}};
+	for (const auto& [pipeline, shader] : pipelines)
+	{
+		pipeline->Init(device);
+		pipeline->LoadComputeShader(shader);
+		pipeline->CreatePipelineLayout({m_DescriptorSet.GetLayout()}, {pushConstantRange});
+		pipeline->CreatePipeline();
+	}
+
+	WriteParameters();
+	GenerateSpectrum();
+}
+
+void Neon::OceanSimulation::CreateCascadeImage(CascadeImage& cascadeImage, vk::Format format,
+											   uint32_t levelCount,
+											   vk::ImageUsageFlags usage) const
+{
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	cascadeImage.m_Image = Allocator::CreateImage(
+		OCEAN_FFT_SIZE, OCEAN_FFT_SIZE, vk::SampleCountFlagBits::e1, format,
+		vk::ImageTiling::eOptimal, usage, VMA_MEMORY_USAGE_GPU_ONLY, levelCount,
+		OCEAN_CASCADE_COUNT);
+	Allocator::TransitionImageLayout(cascadeImage.m_Image->m_Image,
+									 vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined,
+									 vk::ImageLayout::eGeneral, levelCount, OCEAN_CASCADE_COUNT);
+	vk::ImageViewCreateInfo viewInfo{
+		{},
+		cascadeImage.m_Image->m_Image,
+		vk::ImageViewType::e2DArray,
+		format,
+		{},
+		{vk::ImageAspectFlagBits::eColor, 0, levelCount, 0, OCEAN_CASCADE_COUNT}};
+	cascadeImage.m_View = device.createImageViewUnique(viewInfo);
+	viewInfo.subresourceRange.levelCount = 1;
+	cascadeImage.m_StorageView = device.createImageViewUnique(viewInfo);
+}
+
+void Neon::OceanSimulation::SetSettings(const OceanSettings& settings)
+{
+	Context::GetInstance().GetLogicalDevice().GetHandle().waitIdle();
+	m_Settings = settings;
+	WriteParameters();
+	GenerateSpectrum();
+}
+
+void Neon::OceanSimulation::WriteParameters() const
+{
+	OceanParameters parameters{};
+	for (uint32_t i = 0; i < OCEAN_CASCADE_COUNT; i++)
+	{
+		parameters.m_PatchSizes[i] = m_Settings.m_PatchSizes[i];
+		parameters.m_CutoffLow[i] = i == 0 ? 0.0f : parameters.m_CutoffHigh[i - 1];
+		parameters.m_CutoffHigh[i] =
+			i + 1 == OCEAN_CASCADE_COUNT
+				? std::numeric_limits<float>::max()
+				: OCEAN_CASCADE_OVERLAP * 2.0f * glm::pi<float>() / m_Settings.m_PatchSizes[i + 1];
+	}
+	parameters.m_WindDirection = glm::normalize(m_Settings.m_WindDirection);
+	parameters.m_WindSpeed = m_Settings.m_WindSpeed;
+	parameters.m_Fetch = m_Settings.m_Fetch;
+	parameters.m_Amplitude = m_Settings.m_Amplitude;
+	parameters.m_Choppiness = m_Settings.m_Choppiness;
+	parameters.m_Spectrum = static_cast<int32_t>(m_Settings.m_Spectrum);
+	parameters.m_Seed = m_Settings.m_Seed;
+	memcpy(m_ParametersBuffer->m_MappedData, &parameters, sizeof(parameters));
+}
+
+void Neon::OceanSimulation::GenerateSpectrum()
+{
+	constexpr uint32_t groupCount = OCEAN_FFT_SIZE / OCEAN_WORKGROUP_SIZE;
+	auto commandBuffer = VulkanRenderer::BeginSingleTimeCommands();
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_SpectrumPipeline));
+	const vk::DescriptorSet descriptorSet = m_DescriptorSet.Get();
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+									 m_SpectrumPipeline.GetLayout(), 0, 1, &descriptorSet, 0,
+									 nullptr);
+	commandBuffer.dispatch(groupCount, groupCount, OCEAN_CASCADE_COUNT);
+	VulkanRenderer::EndSingleTimeCommands(commandBuffer);
+}
+
+void Neon::OceanSimulation::Update(vk::CommandBuffer commandBuffer, float time)
+{
+	constexpr uint32_t groupCount = OCEAN_FFT_SIZE / OCEAN_WORKGROUP_SIZE;
+	const vk::MemoryBarrier computeBarrier{vk::AccessFlagBits::eShaderWrite,
+										   vk::AccessFlagBits::eShaderRead |
+											   vk::AccessFlagBits::eShaderWrite};
+
+	// Earlier frames must be done sampling and blitting the cascades that are overwritten
+	const vk::MemoryBarrier previousBarrier{vk::AccessFlagBits::eTransferWrite,
+											vk::AccessFlagBits::eShaderWrite};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexShader |
+									  vk::PipelineStageFlagBits::eFragmentShader |
+									  vk::PipelineStageFlagBits::eTransfer,
+								  vk::PipelineStageFlagBits::eComputeShader, {}, previousBarrier,
+								  nullptr, nullptr);
+	const vk::DescriptorSet descriptorSet = m_DescriptorSet.Get();
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_TimePipeline.GetLayout(),
+									 0, 1, &descriptorSet, 0, nullptr);
+
+	PushConstant pushConstant{time, 0};
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_TimePipeline));
+	commandBuffer.pushConstants(m_TimePipeline.GetLayout(), vk::ShaderStageFlagBits::eCompute, 0,
+								sizeof(PushConstant), &pushConstant);
+	commandBuffer.dispatch(groupCount, groupCount, OCEAN_CASCADE_COUNT);
+
+	// Rows first, then columns, a workgroup per row or column of every cascade
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_FftPipeline));
+	for (int32_t vertical = 0; vertical < 2; vertical++)
+	{
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+									  vk::PipelineStageFlagBits::eComputeShader, {},
+									  computeBarrier, nullptr, nullptr);
+		pushConstant.vertical = vertical;
+		commandBuffer.pushConstants(m_FftPipeline.GetLayout(), vk::ShaderStageFlagBits::eCompute,
+									0, sizeof(PushConstant), &pushConstant);
+		commandBuffer.dispatch(1, OCEAN_FFT_SIZE, OCEAN_CASCADE_COUNT);
+	}
+
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+								  vk::PipelineStageFlagBits::eComputeShader, {}, computeBarrier,
+								  nullptr, nullptr);
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+							   static_cast<vk::Pipeline>(m_ResolvePipeline));
+	commandBuffer.dispatch(groupCount, groupCount, OCEAN_CASCADE_COUNT);
+
+	GenerateMipmaps(commandBuffer);
+}
+
+void Neon::OceanSimulation::GenerateMipmaps(vk::CommandBuffer commandBuffer) const
+{
+	vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+								  vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr,
+								  nullptr);
+
+	auto size = static_cast<int32_t>(OCEAN_FFT_SIZE);
+	for (uint32_t level = 1; level < m_LevelCount; level++)
+	{
+		vk::ImageBlit blit{};
+		blit.srcSubresource = {vk::ImageAspectFlagBits::eColor, level - 1, 0, OCEAN_CASCADE_COUNT};
+		blit.srcOffsets[1] = vk::Offset3D{size, size, 1};
+		size = std::max(size / 2, 1);
+		blit.dstSubresource = {vk::ImageAspectFlagBits::eColor, level, 0, OCEAN_CASCADE_COUNT};
+		blit.dstOffsets[1] = vk::Offset3D{size, size, 1};
+		for (const auto* cascadeImage : {&m_DisplacementImage, &m_DerivativesImage})
+		{
+			commandBuffer.blitImage(cascadeImage->m_Image->m_Image, vk::ImageLayout::eGeneral,
+									cascadeImage->m_Image->m_Image, vk::ImageLayout::eGeneral,
+									blit, vk::Filter::eLinear);
+		}
+
+		vk::MemoryBarrier levelBarrier{vk::AccessFlagBits::eTransferWrite,
+									   vk::AccessFlagBits::eTransferRead};
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+									  vk::PipelineStageFlagBits::eTransfer, {}, levelBarrier,
+									  nullptr, nullptr);
+	}
+
+	// Level 0 was written by the resolve shader, the others by the blits
+	vk::MemoryBarrier readBarrier{vk::AccessFlagBits::eShaderWrite |
+									  vk::AccessFlagBits::eTransferWrite,
+								  vk::AccessFlagBits::eShaderRead};
+	commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader |
+									  vk::PipelineStageFlagBits::eTransfer,
+								  vk::PipelineStageFlagBits::eVertexShader |
+									  vk::PipelineStageFlagBits::eFragmentShader,
+								  {}, readBarrier, nullptr, nullptr);
+}
@@ -0,0 +1,146 @@
+#ifndef NEON_OCEANSIMULATION_H
+#define NEON_OCEANSIMULATION_H
+
+#include "Allocator.h"
+#include "ComputePipeline.h"
+#include "DescriptorSet.h"
+#include <glm/glm.hpp>
+
+// Texels per side of every cascade, a power of two. The FFT shader transforms a whole row in one
+// workgroup of OCEAN_FFT_SIZE / 2 invocations.
+#define OCEAN_FFT_SIZE 256
+#define OCEAN_CASCADE_COUNT 3
+#define OCEAN_WORKGROUP_SIZE 8
+// Seconds after which every wave repeats. Wave frequencies are rounded to multiples of
+// 2 pi / OCEAN_REPEAT_PERIOD, so that the simulated time wraps around without a jump.
+#define OCEAN_REPEAT_PERIOD 200.0f
+
+namespace Neon
+{
+enum class OceanSpectrum : int32_t
+{
+	Phillips = 0,
+	Jonswap = 1
+};
+
+// Waves of an ocean. Every cascade tiles a square patch of the surface and keeps the band of
+// wavelengths between its own patch and the next smaller one, so that the cascades add up to the
+// whole spectrum without repeating visibly.
+struct OceanSettings
+{
+	OceanSpectrum m_Spectrum = OceanSpectrum::Jonswap;
+	// Wind 10 m above the surface in meters per second, blowing along m_WindDirection on the
+	// xz plane
+	float m_WindSpeed = 12.0f;
+	glm::vec2 m_WindDirection{1.0f, 0.0f};
+	// Distance the wind has blown over in meters, shaping the JONSWAP spectrum
+	float m_Fetch = 100000.0f;
+	// Scales the heights of the waves
+	float m_Amplitude = 1.0f;
+	// Horizontal displacement relative to the height, sharpening the crests
+	float m_Choppiness = 1.0f;
+	// Side of the patch of every cascade in world units, largest first
+	float m_PatchSizes[OCEAN_CASCADE_COUNT] = {250.0f, 37.0f, 7.0f};
+	uint32_t m_Seed = 1;
+};
+
+// Settings as read by the ocean compute and surface shaders with scalar layout, with the band
+// of wave numbers kept by every cascade
+struct OceanParameters
+{
+	float m_PatchSizes[OCEAN_CASCADE_COUNT];
+	float m_CutoffLow[OCEAN_CASCADE_COUNT];
+	float m_CutoffHigh[OCEAN_CASCADE_COUNT];
+	glm::vec2 m_WindDirection;
+	float m_WindSpeed;
+	float m_Fetch;
+	float m_Amplitude;
+	float m_Choppiness;
+	int32_t m_Spectrum;
+	uint32_t m_Seed;
+};
+
+// FFT ocean simulated by compute. The initial spectrum of every cascade is generated once, each
+// frame advances it to the current time, transforms it to the surface with an inverse FFT and
+// resolves the displacement and the derivatives of every cascade into mipmapped arrays, one
+// layer per cascade, sampled by the ocean surface shaders. Nothing is read back by the CPU.
+class OceanSimulation
+{
+public:
+	OceanSimulation() = default;
+
+	void Init(const OceanSettings& settings);
+	// Regenerates the initial spectrum, waiting for the device to be idle
+	void SetSettings(const OceanSettings& settings);
+	// Records the simulation of the surface at time seconds, visible to the scene passes
+	// recorded after it
+	void Update(vk::CommandBuffer commandBuffer, float time);
+
+	[[nodiscard]] const OceanSettings& GetSettings() const
+	{
+		return m_Settings;
+	}
+	// Displacement in xyz and the Jacobian of the horizontal displacement in w
+	[[nodiscard]] const vk::DescriptorImageInfo& GetDisplacementDescriptor() const
+	{
+		return m_DisplacementDescriptor;
+	}
+	// Slopes of the height along x and z in xy, derivatives of the horizontal displacement
+	// along its own axis in zw
+	[[nodiscard]] const vk::DescriptorImageInfo& GetDerivativesDescriptor() const
+	{
+		return m_DerivativesDescriptor;
+	}
+	[[nodiscard]] vk::DescriptorBufferInfo GetParametersDescriptor() const
+	{
+		return {m_ParametersBuffer->m_Buffer, 0, VK_WHOLE_SIZE};
+	}
+
+private:
+	struct PushConstant
+	{
+		float time;
+		// Rows or columns transformed by the FFT
+		int32_t vertical;
+	};
+
+	// Array with a layer per cascade, viewed whole for sampling and at level 0 for storage
+	struct CascadeImage
+	{
+		std::unique_ptr<ImageAllocation> m_Image;
+		vk::UniqueImageView m_View;
+		vk::UniqueImageView m_StorageView;
+	};
+
+	void CreateCascadeImage(CascadeImage& cascadeImage, vk::Format format, uint32_t levelCount,
+							vk::ImageUsageFlags usage) const;
+	void WriteParameters() const;
+	void GenerateSpectrum();
+	// Downsamples level 0 of the displacement and derivatives into their other levels
+	void GenerateMipmaps(vk::CommandBuffer commandBuffer) const;
+
+private:
+	OceanSettings m_Settings;
+	uint32_t m_LevelCount = 1;
+
+	ComputePipeline m_SpectrumPipeline;
+	ComputePipeline m_TimePipeline;
+	ComputePipeline m_FftPipeline;
+	ComputePipeline m_ResolvePipeline;
+	// Shared by the pipelines, which have the same layout
+	DescriptorSet m_DescriptorSet;
+
+	// Initial amplitudes h0(k) in xy and conj(h0(-k)) in zw
+	CascadeImage m_SpectrumImage;
+	// Two complex fields per texel in each, advanced in time and transformed in place
+	CascadeImage m_FourierImages[2];
+	CascadeImage m_DisplacementImage;
+	CascadeImage m_DerivativesImage;
+	vk::UniqueSampler m_Sampler;
+	vk::DescriptorImageInfo m_DisplacementDescriptor;
+	vk::DescriptorImageInfo m_DerivativesDescriptor;
+	std::unique_ptr<BufferAllocation> m_ParametersBuffer;
+};
+} // namespace Neon
+
+#endif //NEON_OCEANSIMULATION_H
@@ -2,10 +2,14 @@
 
 #include "Scene.h"
 #include "VulkanRenderer.h"
+#include <Core/JobSystem.h>
 #include <Renderer/Context.h>
+#include <Renderer/Frustum.h>
+#include <emmintrin.h>
 
 #include "Allocator.h"
 #include "PerspectiveCameraController.h"
+#include "TerrainTileLoader.h"
 
 static inline std::string GetFileName(const std::string& path)
 {
@@ -19,6 +23,81 @@ static inline std::string GetFileName(const std::string& path)
 	return path.substr(lastDelimiter + 1);
 }
 
+// Bounding sphere centered on the vertex AABB, enclosing every vertex position
+template<typename T>
+static glm::vec4 CalculateBoundingSphere(const T* vertices, size_t count)
+{
+	if (count == 0) { return {0.0f, 0.0f, 0.0f, -1.0f}; }
+	glm::vec3 min = vertices[0].pos;
+	glm::vec3 max = vertices[0].pos;
+	for (size_t i = 0; i < count; i++)
+	{
+		min = glm::min(min, vertices[i].pos);
+		max = glm::max(max, vertices[i].pos);
+	}
+	glm::vec3 center = (min + max) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset = vertices[i].pos - center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	return {center, std::sqrt(radiusSquared)};
+}
+
+template<typename T>
+static glm::vec4 CalculateBoundingSphere(const std::vector<T>& vertices)
+{
+	return CalculateBoundingSphere(vertices.data(), vertices.size());
+}
+
+// Bounds every baked frame of a clip, rows hold the skinning matrices as written by
+// AnimationClip::BakeSkinningMatrices. A skinned vertex is a weighted average of its position
+// transformed by each influencing bone, so it lies within the union of the bind pose bounds of
+// each bone's vertices transformed by that bone.
+static glm::vec4 CalculateAnimatedBoundingSphere(const std::vector<Neon::Vertex>& vertices,
+												 const std::vector<glm::vec4>& rows,
+												 uint32_t bonesCount, uint32_t frameCount)
+{
+	std::vector<glm::vec3> boneMin(bonesCount, glm::vec3(FLT_MAX));
+	std::vector<glm::vec3> boneMax(bonesCount, glm::vec3(-FLT_MAX));
+	for (const auto& vertex : vertices)
+	{
+		for (uint32_t i = 0; i < MAX_BONES_PER_VERTEX; i++)
+		{
+			if (vertex.boneWeights[i] <= 0.0f) { continue; }
+			boneMin[vertex.boneIDs[i]] = glm::min(boneMin[vertex.boneIDs[i]], vertex.pos);
+			boneMax[vertex.boneIDs[i]] = glm::max(boneMax[vertex.boneIDs[i]], vertex.pos);
+		}
+	}
+
+	glm::vec3 min(FLT_MAX);
+	glm::vec3 max(-FLT_MAX);
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		for (uint32_t id = 0; id < bonesCount; id++)
+		{
+			if (boneMin[id].x > boneMax[id].x) { continue; }
+			const glm::vec4 center((boneMin[id] + boneMax[id]) * 0.5f, 1.0f);
+			const glm::vec4* row = &rows[(static_cast<size_t>(frame) * bonesCount + id) * 3];
+			const glm::vec3 transformed{glm::dot(row[0], center), glm::dot(row[1], center),
+										glm::dot(row[2], center)};
+			float maxScale = 0.0f;
+			for (int c = 0; c < 3; c++)
+			{
+				maxScale = std::max(maxScale,
+									glm::length(glm::vec3(row[0][c], row[1][c], row[2][c])));
+			}
+			const float radius = glm::length(boneMax[id] - glm::vec3(center)) * maxScale;
+			min = glm::min(min, transformed - radius);
+			max = glm::max(max, transformed + radius);
+		}
+	}
+	if (min.x > max.x) { return {0.0f, 0.0f, 0.0f, -1.0f}; }
+	const glm::vec3 center = (min + max) * 0.5f;
+	return {center, glm::length(max - center)};
+}
+
 Neon::Entity Neon::Scene::CreateEntity(const std::string& name)
 {
 	Entity entity = {m_Registry.create(), this};
@@ -27,6 +106,12 @@ Neon::Entity Neon::Scene::CreateEntity(const std::string& name)
 	return entity;
 }
 
+// Sky domes are drawn below their transform, which sinks the horizon of the unit dome
+static glm::mat4 GetSkyDomeTransform(const Neon::Transform& transform)
+{
+	return glm::translate(glm::mat4(1.0), {0, -1000, 0}) * transform.m_Global;
+}
+
 Neon::Entity Neon::Scene::LoadSkyDome()
 {
 	Assimp::Importer importer;
@@ -63,11 +148,15 @@ Neon::Entity Neon::Scene::LoadSkyDome()
 	pipeline.Init(device);
 	pipeline.LoadVertexShader("src/Shaders/build/vert_skydome.spv");
 	pipeline.LoadFragmentShader("src/Shaders/build/frag_skydome.spv");
+	pipeline.LoadMultiviewShaders("src/Shaders/build/vert_skydome_mv.spv",
+								  "src/Shaders/build/frag_skydome.spv");
 
 	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
 												   vk::ShaderStageFlagBits::eFragment,
 											   0, sizeof(PushConstant)};
-	pipeline.CreatePipelineLayout({}, {pushConstantRange});
+	pipeline.CreatePipelineLayout({VulkanRenderer::GetEmptyDescriptorSetLayout(),
+								   VulkanRenderer::GetInstanceDescriptorSetLayout()},
+								  {pushConstantRange});
 	pipeline.CreatePipeline(VulkanRenderer::GetOffscreenRenderPass(),
 							VulkanRenderer::GetMsaaSamples(), VulkanRenderer::GetExtent2D(),
 							{Vertex::getBindingDescription()}, {Vertex::getAttributeDescriptions()},
@@ -85,11 +174,96 @@ Neon::Entity Neon::Scene::LoadModel(const std::string& filename)
 	assert(scene && !(scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) && scene->mRootNode);
 	Entity rootEntity = CreateEntity(scene->mRootNode->mName.C_Str());
 	rootEntity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
-	ProcessNode(scene, scene->mRootNode, rootEntity);
+	ProcessNode(scene, scene->mRootNode, filename, rootEntity);
 	return rootEntity;
 }
 
 Neon::Entity Neon::Scene::LoadAnimatedModel(const std::string& filename)
+{
+	auto it = m_SkinnedMeshes.find(filename);
+	if (it == m_SkinnedMeshes.end())
+	{ it = m_SkinnedMeshes.emplace(filename, CreateSkinnedMesh(filename)).first; }
+
+	Entity entity = CreateEntity(it->second->m_Name);
+	entity.AddComponent<SkinnedMeshRenderer>(it->second);
+	entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+	return entity;
+}
+
+// Uploads the baked clips of skinnedMesh into its animation texture and creates the instanced
+// crowd pipeline, which shares the material bindings of the compute skinned pipeline. The crowd
+// clips must be set already.
+static void CreateSkinnedMeshCrowd(Neon::SkinnedMesh& skinnedMesh,
+								   std::vector<vk::DescriptorSetLayoutBinding> bindings,
+								   const vk::DescriptorBufferInfo& materialBufferInfo,
+								   const std::vector<vk::DescriptorImageInfo>& texturesBufferInfo,
+								   const std::vector<glm::vec4>& rows, uint32_t frameCount)
+{
+	auto& crowd = skinnedMesh.m_Crowd;
+
+	const uint32_t width = skinnedMesh.m_Skeleton->GetBonesCount() * 3;
+	crowd.m_AnimationTexture.m_TextureAllocation =
+		Neon::Allocator::CreateFloatTextureImage(rows, width, frameCount);
+	Neon::Allocator::FlushStaging();
+	vk::ImageView animationImageView = Neon::VulkanRenderer::CreateImageView(
+		crowd.m_AnimationTexture.m_TextureAllocation->m_Image, vk::Format::eR32G32B32A32Sfloat,
+		vk::ImageAspectFlagBits::eColor);
+	vk::SamplerCreateInfo samplerInfo = {
+		{}, vk::Filter::eNearest, vk::Filter::eNearest, vk::SamplerMipmapMode::eNearest};
+	crowd.m_AnimationTexture.m_Descriptor = {Neon::VulkanRenderer::CreateSampler(samplerInfo),
+											 animationImageView,
+											 vk::ImageLayout::eShaderReadOnlyOptimal};
+
+	crowd.m_Mesh.m_VerticesCount = skinnedMesh.m_VerticesCount;
+	crowd.m_Mesh.m_IndicesCount = skinnedMesh.m_IndicesCount;
+	crowd.m_Mesh.m_BoundingSphere = skinnedMesh.m_BoundingSphere;
+	crowd.m_Mesh.m_StaticGeometry.m_VertexBuffer = skinnedMesh.m_BindPoseVertexBuffer->m_Buffer;
+	crowd.m_Mesh.m_StaticGeometry.m_IndexBuffer = skinnedMesh.m_IndexBuffer->m_Buffer;
+
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eVertex);
+	bindings.emplace_back(3, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eVertex);
+	vk::DescriptorBufferInfo bindPoseBufferInfo{skinnedMesh.m_BindPoseVertexBuffer->m_Buffer, 0,
+												VK_WHOLE_SIZE};
+	crowd.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
+	for (auto& descriptorSet : crowd.m_DescriptorSets)
+	{
+		descriptorSet.Init(device);
+		descriptorSet.Create(Neon::VulkanRenderer::GetDescriptorPool(), bindings);
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(0, &materialBufferInfo, 0),
+			descriptorSet.CreateWrite(1, texturesBufferInfo.data(), 0),
+			descriptorSet.CreateWrite(2, &bindPoseBufferInfo, 0),
+			descriptorSet.CreateWrite(3, &crowd.m_AnimationTexture.m_Descriptor, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
+
+	auto& pipeline = crowd.m_GraphicsPipeline;
+	pipeline.Init(device);
+	pipeline.LoadVertexShader("src/Shaders/build/vert_crowd.spv");
+	pipeline.LoadFragmentShader("src/Shaders/build/frag.spv");
+	pipeline.LoadMultiviewShaders("src/Shaders/build/vert_crowd_mv.spv",
+								  "src/Shaders/build/frag_mv.spv");
+
+	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
+												   vk::ShaderStageFlagBits::eFragment,
+											   0, sizeof(Neon::PushConstant)};
+	pipeline.CreatePipelineLayout({crowd.m_DescriptorSets[0].GetLayout(),
+								   Neon::VulkanRenderer::GetInstanceDescriptorSetLayout()},
+								  {pushConstantRange});
+	// Only the leading attributes are fetched as vertex input, bone influences are read from the
+	// bind pose storage buffer
+	auto attributeDescriptions = Neon::Vertex::getAttributeDescriptions();
+	attributeDescriptions.resize(5);
+	pipeline.CreatePipeline(
+		Neon::VulkanRenderer::GetOffscreenRenderPass(), Neon::VulkanRenderer::GetMsaaSamples(),
+		Neon::VulkanRenderer::GetExtent2D(), {Neon::Vertex::getBindingDescription()},
+		attributeDescriptions, vk::CullModeFlagBits::eBack);
+}
+
+std::shared_ptr<Neon::SkinnedMesh> Neon::Scene::CreateSkinnedMesh(const std::string& filename)
 {
 	Assimp::Importer importer;
 	const aiScene* scene =
@@ -107,28 +281,49 @@ Neon::Entity Neon::Scene::LoadAnimatedModel(const std::string& filename)
 	ProcessNode(scene, scene->mRootNode, vertices, indices, materials, textureImages, boneMap,
 				boneOffsets);
 
-	Entity entity = CreateEntity(scene->mRootNode->mName.C_Str());
-	auto& skinnedMeshRenderer =
-		entity.AddComponent<SkinnedMeshRenderer>(scene, 0, boneMap, boneOffsets);
-	skinnedMeshRenderer.m_TextureImages = std::move(textureImages);
-	auto& transformComponent = entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+	// The bone map is only needed while importing, instances share skeleton and clips
+	auto skinnedMesh = std::make_shared<SkinnedMesh>();
+	skinnedMesh->m_Name = scene->mRootNode->mName.C_Str();
+	auto skeleton = std::make_shared<Skeleton>(scene, boneMap, boneOffsets);
+	for (uint32_t i = 0; i < scene->mNumAnimations; i++)
+	{
+		skinnedMesh->m_Clips.push_back(
+			std::make_shared<AnimationClip>(scene, i, boneMap, skeleton->GetBonesCount()));
+	}
+	skinnedMesh->m_Skeleton = std::move(skeleton);
+	skinnedMesh->m_TextureImages = std::move(textureImages);
+
+	// Every clip is baked for the crowd path, one after another. Together the frames also bound
+	// every pose for culling and LOD selection.
+	std::vector<glm::vec4> bakedRows;
+	std::vector<glm::vec4> clipRows;
+	uint32_t bakedFrameCount = 0;
+	for (const auto& clip : skinnedMesh->m_Clips)
+	{
+		CrowdClip crowdClip;
+		crowdClip.m_FirstFrame = bakedFrameCount;
+		crowdClip.m_FrameCount = clip->BakeSkinningMatrices(
+			*skinnedMesh->m_Skeleton, CROWD_ANIMATION_SAMPLE_RATE, clipRows);
+		crowdClip.m_FramesPerTick = CROWD_ANIMATION_SAMPLE_RATE / clip->GetTicksPerSecond();
+		skinnedMesh->m_Crowd.m_Clips.push_back(crowdClip);
+		bakedRows.insert(bakedRows.end(), clipRows.begin(), clipRows.end());
+		bakedFrameCount += crowdClip.m_FrameCount;
+	}
+	skinnedMesh->m_BoundingSphere = CalculateAnimatedBoundingSphere(
+		vertices, bakedRows, skinnedMesh->m_Skeleton->GetBonesCount(), bakedFrameCount);
 
 	auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
 
-	skinnedMeshRenderer.m_BoneBuffer = Neon::Allocator::CreateBuffer(
-		sizeof(boneOffsets[0]) * skinnedMeshRenderer.m_BoneSize,
-		vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-	skinnedMeshRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
-	skinnedMeshRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
-	skinnedMeshRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
+	skinnedMesh->m_VerticesCount = (uint32_t)vertices.size();
+	skinnedMesh->m_IndicesCount = (uint32_t)indices.size();
+	skinnedMesh->m_BindPoseVertexBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, vertices,
-		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
-	skinnedMeshRenderer.m_Mesh.m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer);
+	skinnedMesh->m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, indices,
 		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
 
-	skinnedMeshRenderer.m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
+	skinnedMesh->m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, materials, vk::BufferUsageFlagBits::eStorageBuffer);
 
 	Neon::VulkanRenderer::EndSingleTimeCommands(cmdBuff);
@@ -141,72 +336,54 @@ Neon::Entity Neon::Scene::LoadAnimatedModel(const std::string& filename)
 	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
 						  vk::ShaderStageFlagBits::eFragment);
 	bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler,
-						  static_cast<uint32_t>(skinnedMeshRenderer.m_TextureImages.size()),
+						  static_cast<uint32_t>(skinnedMesh->m_TextureImages.size()),
 						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1,
-						  vk::ShaderStageFlagBits::eVertex);
 
-	vk::DescriptorBufferInfo materialBufferInfo{skinnedMeshRenderer.m_MaterialBuffer->m_Buffer, 0,
+	vk::DescriptorBufferInfo materialBufferInfo{skinnedMesh->m_MaterialBuffer->m_Buffer, 0,
 												VK_WHOLE_SIZE};
 
 	std::vector<vk::DescriptorImageInfo> texturesBufferInfo;
-	texturesBufferInfo.reserve(skinnedMeshRenderer.m_TextureImages.size());
-	for (auto& textureImage : skinnedMeshRenderer.m_TextureImages)
+	texturesBufferInfo.reserve(skinnedMesh->m_TextureImages.size());
+	for (auto& textureImage : skinnedMesh->m_TextureImages)
 	{
 		texturesBufferInfo.push_back(textureImage.m_Descriptor);
 	}
 
-	skinnedMeshRenderer.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
-	vk::DescriptorBufferInfo boneBufferInfo{skinnedMeshRenderer.m_BoneBuffer->m_Buffer, 0,
-											VK_WHOLE_SIZE};
+	skinnedMesh->m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
 	for (int i = 0; i < MAX_SWAP_CHAIN_IMAGES; i++)
 	{
-		auto& wavefrontDescriptorSet = skinnedMeshRenderer.m_DescriptorSets[i];
+		auto& wavefrontDescriptorSet = skinnedMesh->m_DescriptorSets[i];
 		wavefrontDescriptorSet.Init(device);
 		wavefrontDescriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
 		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
 			wavefrontDescriptorSet.CreateWrite(0, &materialBufferInfo, 0),
-			wavefrontDescriptorSet.CreateWrite(1, texturesBufferInfo.data(), 0),
-			wavefrontDescriptorSet.CreateWrite(2, &boneBufferInfo, 0)};
+			wavefrontDescriptorSet.CreateWrite(1, texturesBufferInfo.data(), 0)};
 		wavefrontDescriptorSet.Update(descriptorWrites);
 	}
-	auto& pipeline = skinnedMeshRenderer.m_GraphicsPipeline;
+
+	// Skinned by compute, drawn like static geometry
+	auto& pipeline = skinnedMesh->m_GraphicsPipeline;
 	pipeline.Init(device);
-	pipeline.LoadVertexShader("src/Shaders/build/animation_vert.spv");
+	pipeline.LoadVertexShader("src/Shaders/build/vert.spv");
 	pipeline.LoadFragmentShader("src/Shaders/build/frag.spv");
+	pipeline.LoadMultiviewShaders("src/Shaders/build/vert_mv.spv", "src/Shaders/build/frag_mv.spv");
 
 	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
 												   vk::ShaderStageFlagBits::eFragment,
 											   0, sizeof(PushConstant)};
-	pipeline.CreatePipelineLayout({skinnedMeshRenderer.m_DescriptorSets[0].GetLayout()},
+	pipeline.CreatePipelineLayout({skinnedMesh->m_DescriptorSets[0].GetLayout(),
+								   VulkanRenderer::GetInstanceDescriptorSetLayout()},
 								  {pushConstantRange});
 	pipeline.CreatePipeline(VulkanRenderer::GetOffscreenRenderPass(),
 							VulkanRenderer::GetMsaaSamples(), VulkanRenderer::GetExtent2D(),
-							{Vertex::getBindingDescription()}, {Vertex::getAttributeDescriptions()},
+							{SkinnedVertex::getBindingDescription()},
+							{SkinnedVertex::getAttributeDescriptions()},
 							vk::CullModeFlagBits::eBack);
 
-	return entity;
-}
+	CreateSkinnedMeshCrowd(*skinnedMesh, bindings, materialBufferInfo, texturesBufferInfo,
+						   bakedRows, bakedFrameCount);
 
-float GetHeight(unsigned char* pixels, int texWidth, int texHeight, int texX, int texY,
-				float maxHeight)
-{
-	if (texX < 0 || texY < 0 || texX >= texWidth || texY >= texHeight) { return 0.0f; }
-	unsigned char* valuePtr = pixels + static_cast<int>((texY * texWidth + texX) * 4);
-	uint32_t value =
-		(uint32_t)*valuePtr + (uint32_t) * (valuePtr + 1) + (uint32_t) * (valuePtr + 2);
-	return static_cast<float>(value) / 765.0f * (maxHeight * 2) - maxHeight;
-}
-
-glm::vec3 CalculateNormal(unsigned char* pixels, int texWidth, int texHeight, int texX, int texY,
-						  float maxHeight)
-{
-	float heightL = GetHeight(pixels, texWidth, texHeight, texX + 1, texY, maxHeight);
-	float heightR = GetHeight(pixels, texWidth, texHeight, texX - 1, texY, maxHeight);
-	float heightD = GetHeight(pixels, texWidth, texHeight, texX, texY - 1, maxHeight);
-	float heightU = GetHeight(pixels, texWidth, texHeight, texX, texY + 1, maxHeight);
-	glm::vec3 normal = {heightR - heightL, 2.0f, heightD - heightU};
-	return glm::normalize(normal);
+	return skinnedMesh;
 }
 
 void CreateTextureImage(const std::string& filename, Neon::TextureImage& textureImage)
@@ -260,87 +437,389 @@ struct VertexTerrain
 	}
 };
 
-Neon::Entity Neon::Scene::LoadTerrain(float width, float height, float maxHeight)
+// Grid position of a displaced terrain vertex, in vertices from the chunk origin
+struct VertexTerrainGrid
 {
-	std::vector<VertexTerrain> vertices;
-	std::vector<uint32_t> indices;
+	glm::vec2 grid;
 
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels =
-		stbi_load("textures/heightmap.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	static vk::VertexInputBindingDescription getBindingDescription()
+	{
+		return {0, sizeof(VertexTerrainGrid)};
+	}
 
-	assert(pixels);
+	static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions()
+	{
+		std::vector<vk::VertexInputAttributeDescription> result = {
+			{0, 0, vk::Format::eR32G32Sfloat,
+			 static_cast<uint32_t>(offsetof(VertexTerrainGrid, grid))}};
+		return result;
+	}
+};
+
+// Heightmap and placement shared by the nodes of a terrain being built, the heightmap spans
+// [-width, width] x [-height, height]
+struct TerrainSource
+{
+	unsigned char* m_Pixels;
+	int m_TexWidth;
+	int m_TexHeight;
+	float m_Width;
+	float m_Height;
+	float m_MaxHeight;
+	float m_WidthIncrement;
+	float m_HeightIncrement;
+	// Decoded heights of a mesh terrain, see DecodeTerrainHeights
+	const float* m_Heights = nullptr;
+};
 
-	float densityX = static_cast<float>(texWidth) / (width * 2.0f + 1);
-	float densityY = static_cast<float>(texHeight) / (height * 2.0f + 1);
-
-	int widthCount = static_cast<int>(densityX * (width * 2.0f + 1));
-	int heightCount = static_cast<int>(densityY * (height * 2.0f + 1));
-	float widthIncrement = 1.0f / (densityX);
-	float heightIncrement = 1.0f / (densityY);
-	float xValue = -width;
-	float zValue = -height;
-
-	float mapTexCoordXIncrement = 1.0f / static_cast<float>(widthCount);
-	float mapTexCoordYIncrement = 1.0f / static_cast<float>(heightCount);
-	float mapTexCoordX = 0;
-	float mapTexCoordY = 0;
-	float tileTexCoordX = 0;
-	float tileTexCoordY = 0;
-	for (int i = 0; i < heightCount; i++)
-	{
-		for (int j = 0; j < widthCount; j++)
+// Decodes the heights of source into rows of m_TexWidth + 2 floats surrounded by a border of
+// zero height, like texels outside of the heightmap always had, so that normals can read the
+// neighbours of any texel without bounds checks
+static void DecodeTerrainHeights(const TerrainSource& source, std::vector<float>& heights)
+{
+	const auto rowLength = static_cast<size_t>(source.m_TexWidth) + 2;
+	heights.assign(rowLength * (source.m_TexHeight + 2), 0.0f);
+	const float scale = source.m_MaxHeight * 2 / 765.0f;
+
+	auto decodeRows = [&](uint32_t begin, uint32_t end) {
+		const __m128 scales = _mm_set1_ps(scale);
+		const __m128 offsets = _mm_set1_ps(-source.m_MaxHeight);
+		const __m128i channelMask = _mm_set1_epi32(0xFF);
+		for (uint32_t y = begin; y < end; y++)
 		{
-			VertexTerrain vertex{};
-			int texX = static_cast<int>(static_cast<float>(j) / static_cast<float>(widthCount) *
-										static_cast<float>(texWidth));
-			int texY = static_cast<int>(static_cast<float>(i) / static_cast<float>(heightCount) *
-										static_cast<float>(texHeight));
-			vertex.pos = {xValue, GetHeight(pixels, texWidth, texHeight, texX, texY, maxHeight),
-						  zValue};
-			vertex.norm = CalculateNormal(pixels, texWidth, texHeight, texX, texY, maxHeight);
-			vertex.mapTexCoord = {mapTexCoordX, mapTexCoordY};
-			vertex.tileTexCoord = {tileTexCoordX, tileTexCoordY};
-			vertices.push_back(vertex);
-			xValue += widthIncrement;
-			mapTexCoordX += mapTexCoordXIncrement;
-			tileTexCoordX += 0.5;
+			const unsigned char* pixels = source.m_Pixels + size_t(y) * source.m_TexWidth * 4;
+			float* row = &heights[(y + 1) * rowLength + 1];
+			int x = 0;
+			for (; x + 4 <= source.m_TexWidth; x += 4)
+			{
+				// Four RGBA texels, the RGB sum of each is accumulated in its 32 bit lane
+				const __m128i texels =
+					_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + x * 4));
+				__m128i sum = _mm_and_si128(texels, channelMask);
+				sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(texels, 8), channelMask));
+				sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(texels, 16), channelMask));
+				const __m128 values = _mm_cvtepi32_ps(sum);
+				_mm_storeu_ps(row + x, _mm_add_ps(_mm_mul_ps(values, scales), offsets));
+			}
+			for (; x < source.m_TexWidth; x++)
+			{
+				const unsigned char* texel = pixels + x * 4;
+				row[x] = static_cast<float>(texel[0] + texel[1] + texel[2]) * scale -
+						 source.m_MaxHeight;
+			}
 		}
-		xValue = -width;
-		zValue += heightIncrement;
-		mapTexCoordX = 0;
-		mapTexCoordY += mapTexCoordYIncrement;
-		tileTexCoordX = 0;
-		tileTexCoordY += 0.5f;
-	}
+	};
+	JobSystem::ParallelFor(static_cast<uint32_t>(source.m_TexHeight),
+						   TERRAIN_GENERATION_BATCH_SIZE, decodeRows);
+}
 
-	uint32_t index = 0;
-	for (int i = 0; i < heightCount - 1; i++)
+// Appends the node at level whose grid starts at texel (originX, originY) and its subtree,
+// returns its index or 0 when it lies outside of the heightmap. Vertices are assigned in node
+// order and written later by WriteTerrainRow.
+static uint32_t CreateTerrainNode(const TerrainSource& source, uint32_t level, int originX,
+								  int originY, std::vector<Neon::TerrainNode>& nodes)
+{
+	if (originX >= source.m_TexWidth - 1 || originY >= source.m_TexHeight - 1) { return 0; }
+
+	const auto index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+	auto& node = nodes[index];
+	node.m_Level = level;
+	node.m_Origin = {originX, originY};
+	node.m_Mesh.m_VerticesCount = (TERRAIN_CHUNK_SIZE + 1) * (TERRAIN_CHUNK_SIZE + 1);
+	node.m_Mesh.m_IndicesCount = TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * 6;
+	node.m_Mesh.m_StaticGeometry.m_BaseVertex = index * node.m_Mesh.m_VerticesCount;
+
+	if (level > 0)
 	{
-		for (int j = 0; j < widthCount - 1; j++)
+		const int half = TERRAIN_CHUNK_SIZE << (level - 1);
+		for (uint32_t child = 0; child < 4; child++)
 		{
-			indices.push_back(index);
-			indices.push_back(index + widthCount);
-			indices.push_back(index + 1);
-			indices.push_back(index + 1);
-			indices.push_back(index + widthCount);
-			indices.push_back(index + widthCount + 1);
-			index++;
+			const uint32_t childIndex =
+				CreateTerrainNode(source, level - 1, originX + static_cast<int>(child & 1) * half,
+								  originY + static_cast<int>(child >> 1) * half, nodes);
+			nodes[index].m_Children[child] = childIndex;
 		}
-		index++;
 	}
+	return index;
+}
 
-	Entity entity = CreateEntity("terrain");
-	auto& terrainRenderer = entity.AddComponent<TerrainRenderer>();
-	auto& transform = entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+// Writes grid row j of node, four vertices at a time
+static void WriteTerrainRow(const TerrainSource& source, const Neon::TerrainNode& node, int j,
+							VertexTerrain* vertices)
+{
+	constexpr int rowLength = TERRAIN_CHUNK_SIZE + 1;
+	// Rounded up to whole groups of four, the texels of the padding lanes repeat the last one
+	constexpr int paddedLength = (rowLength + 3) / 4 * 4;
+	const auto heightsRowLength = static_cast<size_t>(source.m_TexWidth) + 2;
+	const int stride = 1 << node.m_Level;
+
+	// Grids reaching past the heightmap are clamped to its border
+	const int texY = std::min(node.m_Origin.y + j * stride, source.m_TexHeight - 1);
+	const float* row = source.m_Heights + (texY + 1) * heightsRowLength + 1;
+	const float* previousRow = row - heightsRowLength;
+	const float* nextRow = row + heightsRowLength;
+	alignas(16) float heights[paddedLength], normalX[paddedLength], normalY[paddedLength],
+		normalZ[paddedLength];
+	int texX[paddedLength];
+	for (int i = 0; i < paddedLength; i++)
+	{
+		const int column = std::min(i, rowLength - 1);
+		texX[i] = std::min(node.m_Origin.x + column * stride, source.m_TexWidth - 1);
+	}
 
-	std::vector<Material> materials;
-	Material material{};
+	const __m128 two = _mm_set1_ps(2.0f);
+	for (int i = 0; i < paddedLength; i += 4)
+	{
+		const int* x = texX + i;
+		const __m128 left =
+			_mm_setr_ps(row[x[0] - 1], row[x[1] - 1], row[x[2] - 1], row[x[3] - 1]);
+		const __m128 right =
+			_mm_setr_ps(row[x[0] + 1], row[x[1] + 1], row[x[2] + 1], row[x[3] + 1]);
+		const __m128 down = _mm_setr_ps(previousRow[x[0]], previousRow[x[1]], previousRow[x[2]],
+										previousRow[x[3]]);
+		const __m128 up =
+			_mm_setr_ps(nextRow[x[0]], nextRow[x[1]], nextRow[x[2]], nextRow[x[3]]);
+		_mm_store_ps(heights + i, _mm_setr_ps(row[x[0]], row[x[1]], row[x[2]], row[x[3]]));
+
+		// Central differences in texels, (left - right, 2, down - up) normalized
+		const __m128 dx = _mm_sub_ps(left, right);
+		const __m128 dz = _mm_sub_ps(down, up);
+		const __m128 lengthSquared =
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), _mm_set1_ps(4.0f));
+		const __m128 inverseLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+		_mm_store_ps(normalX + i, _mm_mul_ps(dx, inverseLength));
+		_mm_store_ps(normalY + i, _mm_mul_ps(two, inverseLength));
+		_mm_store_ps(normalZ + i, _mm_mul_ps(dz, inverseLength));
+	}
+
+	const float z = -source.m_Height + static_cast<float>(texY) * source.m_HeightIncrement;
+	const float mapV = static_cast<float>(texY) / static_cast<float>(source.m_TexHeight);
+	for (int i = 0; i < rowLength; i++)
+	{
+		auto& vertex = vertices[i];
+		const auto u = static_cast<float>(texX[i]);
+		vertex.pos = {-source.m_Width + u * source.m_WidthIncrement, heights[i], z};
+		vertex.norm = {normalX[i], normalY[i], normalZ[i]};
+		vertex.color = glm::vec3(0.0f);
+		vertex.mapTexCoord = {u / static_cast<float>(source.m_TexWidth), mapV};
+		vertex.tileTexCoord = {u * 0.5f, static_cast<float>(texY) * 0.5f};
+	}
+}
+
+// Index buffer of one chunk grid, shared by every node and level
+static std::vector<uint32_t> CreateTerrainChunkIndices()
+{
+	constexpr uint32_t rowLength = TERRAIN_CHUNK_SIZE + 1;
+	std::vector<uint32_t> indices(TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE * 6);
+	for (uint32_t quad = 0; quad < TERRAIN_CHUNK_SIZE * TERRAIN_CHUNK_SIZE; quad++)
+	{
+		const uint32_t index = quad / TERRAIN_CHUNK_SIZE * rowLength + quad % TERRAIN_CHUNK_SIZE;
+		uint32_t* triangles = &indices[quad * 6];
+		triangles[0] = index;
+		triangles[1] = index + rowLength;
+		triangles[2] = index + 1;
+		triangles[3] = index + 1;
+		triangles[4] = index + rowLength;
+		triangles[5] = index + rowLength + 1;
+	}
+	return indices;
+}
+
+// Vertices of one chunk grid, displaced by the vertex shader
+static std::vector<VertexTerrainGrid> CreateTerrainGrid()
+{
+	std::vector<VertexTerrainGrid> gridVertices;
+	gridVertices.reserve((TERRAIN_CHUNK_SIZE + 1) * (TERRAIN_CHUNK_SIZE + 1));
+	for (int j = 0; j <= TERRAIN_CHUNK_SIZE; j++)
+	{
+		for (int i = 0; i <= TERRAIN_CHUNK_SIZE; i++)
+		{ gridVertices.push_back({{static_cast<float>(i), static_cast<float>(j)}}); }
+	}
+	return gridVertices;
+}
+
+static std::vector<Neon::Material> CreateTerrainMaterials()
+{
+	std::vector<Neon::Material> materials;
+	Neon::Material material{};
 	material.ambient = {0.1, 0.1, 0.1};
 	material.diffuse = {0.8, 0.8, 0.8};
 	material.specular = {0.0, 0.0, 0.0};
 	material.textureID = 0;
 	materials.push_back(material);
+	return materials;
+}
+
+// Material, blend map and ground textures are read by the fragment shader, the vertex shader of
+// displaced terrains reads the TerrainParameters and the heightmap, the one of mesh terrains the
+// vertex buffer. Virtually textured terrains read the clipmap and its parameters instead of the
+// ground textures.
+static std::vector<vk::DescriptorSetLayoutBinding> CreateTerrainBindings(bool gpuDisplacement,
+																		 bool virtualTexture)
+{
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(2, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(3, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(4, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(5, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	if (gpuDisplacement)
+	{
+		bindings.emplace_back(7, vk::DescriptorType::eStorageBuffer, 1,
+							  vk::ShaderStageFlagBits::eVertex);
+		bindings.emplace_back(8, vk::DescriptorType::eCombinedImageSampler, 1,
+							  vk::ShaderStageFlagBits::eVertex);
+	}
+	else
+	{
+		// Morph targets are read from the vertex buffer
+		bindings.emplace_back(6, vk::DescriptorType::eStorageBuffer, 1,
+							  vk::ShaderStageFlagBits::eVertex);
+	}
+	if (virtualTexture)
+	{
+		bindings.emplace_back(9, vk::DescriptorType::eCombinedImageSampler, 1,
+							  vk::ShaderStageFlagBits::eFragment);
+		bindings.emplace_back(10, vk::DescriptorType::eStorageBuffer, 1,
+							  vk::ShaderStageFlagBits::eFragment);
+	}
+	return bindings;
+}
+
+static void CreateTerrainPipeline(Neon::GraphicsPipeline& pipeline,
+								  vk::DescriptorSetLayout descriptorSetLayout,
+								  bool gpuDisplacement, bool virtualTexture)
+{
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	pipeline.Init(device);
+	pipeline.LoadVertexShader(gpuDisplacement ? "src/Shaders/build/vert_terrain.spv"
+											  : "src/Shaders/build/vert_terrain_mesh.spv");
+	pipeline.LoadFragmentShader(virtualTexture ? "src/Shaders/build/frag_terrain_vt.spv"
+											   : "src/Shaders/build/frag_terrain.spv");
+	pipeline.LoadMultiviewShaders(gpuDisplacement ? "src/Shaders/build/vert_terrain_mv.spv"
+												  : "src/Shaders/build/vert_terrain_mesh_mv.spv",
+								  virtualTexture ? "src/Shaders/build/frag_terrain_vt_mv.spv"
+												 : "src/Shaders/build/frag_terrain_mv.spv");
+
+	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
+												   vk::ShaderStageFlagBits::eFragment,
+											   0, sizeof(Neon::PushConstant)};
+	pipeline.CreatePipelineLayout(
+		{descriptorSetLayout, Neon::VulkanRenderer::GetInstanceDescriptorSetLayout()},
+		{pushConstantRange});
+	if (gpuDisplacement)
+	{
+		pipeline.CreatePipeline(Neon::VulkanRenderer::GetOffscreenRenderPass(),
+								Neon::VulkanRenderer::GetMsaaSamples(),
+								Neon::VulkanRenderer::GetExtent2D(),
+								{VertexTerrainGrid::getBindingDescription()},
+								{VertexTerrainGrid::getAttributeDescriptions()},
+								vk::CullModeFlagBits::eBack);
+	}
+	else
+	{
+		pipeline.CreatePipeline(Neon::VulkanRenderer::GetOffscreenRenderPass(),
+								Neon::VulkanRenderer::GetMsaaSamples(),
+								Neon::VulkanRenderer::GetExtent2D(),
+								{VertexTerrain::getBindingDescription()},
+								{VertexTerrain::getAttributeDescriptions()},
+								vk::CullModeFlagBits::eBack);
+	}
+}
+
+Neon::Entity Neon::Scene::LoadTerrain(float width, float height, float maxHeight,
+									  bool gpuDisplacement, bool virtualTexture)
+{
+	std::vector<VertexTerrain> vertices;
+	std::vector<VertexTerrainGrid> gridVertices;
+	std::vector<uint16_t> heights;
+
+	int texWidth, texHeight, texChannels;
+	stbi_uc* pixels =
+		stbi_load("textures/heightmap.png", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+	assert(pixels);
+	assert(texWidth > 1 && texHeight > 1);
+
+	TerrainSource source{pixels, texWidth, texHeight, width, height, maxHeight};
+	source.m_WidthIncrement = (width * 2.0f + 1) / static_cast<float>(texWidth);
+	source.m_HeightIncrement = (height * 2.0f + 1) / static_cast<float>(texHeight);
+	const glm::vec2 origin = {-width, -height};
+	const glm::vec2 texelSize = {source.m_WidthIncrement, source.m_HeightIncrement};
+
+	// Both kinds keep the 16 bit heights for the heightfield, displaced ones also upload them
+	heights.resize(static_cast<size_t>(texWidth) * texHeight);
+	auto decodeRows = [&](uint32_t begin, uint32_t end) {
+		for (size_t i = size_t(begin) * texWidth; i < size_t(end) * texWidth; i++)
+		{ heights[i] = GetTerrainTexelHeight(pixels + i * 4); }
+	};
+	JobSystem::ParallelFor(static_cast<uint32_t>(texHeight), TERRAIN_GENERATION_BATCH_SIZE,
+						   decodeRows);
+
+	std::vector<TerrainNode> nodes;
+	if (gpuDisplacement)
+	{
+		nodes = CreateDisplacedTerrainNodes(heights, texWidth, texHeight, origin, texelSize,
+											maxHeight);
+		gridVertices = CreateTerrainGrid();
+	}
+	else
+	{
+		// Levels until the root chunk covers the whole heightmap
+		uint32_t levelCount = 1;
+		while ((TERRAIN_CHUNK_SIZE << (levelCount - 1)) < std::max(texWidth, texHeight) - 1)
+		{ levelCount++; }
+
+		std::vector<float> decodedHeights;
+		DecodeTerrainHeights(source, decodedHeights);
+		source.m_Heights = decodedHeights.data();
+		CreateTerrainNode(source, levelCount - 1, 0, 0, nodes);
+
+		// Every node row is written independently into its preassigned vertices
+		constexpr uint32_t rowLength = TERRAIN_CHUNK_SIZE + 1;
+		vertices.resize(nodes.size() * rowLength * rowLength);
+		auto writeRows = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t row = begin; row < end; row++)
+			{
+				const auto& node = nodes[row / rowLength];
+				const uint32_t j = row % rowLength;
+				const uint32_t firstVertex = node.m_Mesh.m_StaticGeometry.m_BaseVertex;
+				WriteTerrainRow(source, node, static_cast<int>(j),
+								&vertices[firstVertex + j * rowLength]);
+			}
+		};
+		JobSystem::ParallelFor(static_cast<uint32_t>(nodes.size()) * rowLength,
+							   TERRAIN_GENERATION_BATCH_SIZE, writeRows);
+		auto boundNodes = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++)
+			{
+				auto& mesh = nodes[i].m_Mesh;
+				mesh.m_BoundingSphere = CalculateBoundingSphere(
+					vertices.data() + mesh.m_StaticGeometry.m_BaseVertex, mesh.m_VerticesCount);
+			}
+		};
+		JobSystem::ParallelFor(static_cast<uint32_t>(nodes.size()), 1, boundNodes);
+	}
+	stbi_image_free(pixels);
+	const std::vector<uint32_t> indices = CreateTerrainChunkIndices();
+
+	Entity entity = CreateEntity("terrain");
+	auto& terrainRenderer = entity.AddComponent<TerrainRenderer>();
+	entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+	terrainRenderer.m_Nodes = std::move(nodes);
+	// A node is refined while its bounds reach into the finer range, so a node can extend about
+	// two chunk widths of its level past that range. Six chunk widths keep those parts in the
+	// unmorphed start of the next range, where the finer neighbour is already fully morphed.
+	terrainRenderer.m_LodRange =
+		6.0f * TERRAIN_CHUNK_SIZE * std::max(source.m_WidthIncrement, source.m_HeightIncrement);
 
 	CreateTextureImage("textures/blendMap.png", terrainRenderer.m_BlendMap);
 	CreateTextureImage("textures/grassy2.png", terrainRenderer.m_BackgroundTexture);
@@ -348,41 +827,82 @@ Neon::Entity Neon::Scene::LoadTerrain(float width, float height, float maxHeight
 	CreateTextureImage("textures/grassFlowers.png", terrainRenderer.m_GTexture);
 	CreateTextureImage("textures/path.png", terrainRenderer.m_BTexture);
 
+	if (virtualTexture)
+	{
+		terrainRenderer.m_VirtualTexture = std::make_unique<TerrainVirtualTexture>();
+		terrainRenderer.m_VirtualTexture->Init(
+			{texWidth, texHeight}, origin, texelSize, terrainRenderer.m_BlendMap,
+			terrainRenderer.m_BackgroundTexture, terrainRenderer.m_RTexture,
+			terrainRenderer.m_GTexture, terrainRenderer.m_BTexture);
+	}
+
+	terrainRenderer.m_GpuDisplacement = gpuDisplacement;
+	if (gpuDisplacement)
+	{
+		CreateTerrainHeightMap(heights, static_cast<uint32_t>(texWidth),
+							   static_cast<uint32_t>(texHeight), terrainRenderer.m_HeightMap);
+	}
+	terrainRenderer.m_Heightfield =
+		TerrainHeightfield(std::move(heights), static_cast<uint32_t>(texWidth),
+						   static_cast<uint32_t>(texHeight), origin, texelSize, maxHeight);
+
 	auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
 
-	terrainRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
 	terrainRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
-	terrainRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
-		cmdBuff, vertices,
-		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	terrainRenderer.m_Mesh.m_BoundingSphere = terrainRenderer.m_Nodes[0].m_Mesh.m_BoundingSphere;
+	if (gpuDisplacement)
+	{
+		terrainRenderer.m_Mesh.m_VerticesCount = (uint32_t)gridVertices.size();
+		terrainRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
+			cmdBuff, gridVertices, vk::BufferUsageFlagBits::eVertexBuffer);
+
+		TerrainParameters parameters{};
+		parameters.m_Origin = origin;
+		parameters.m_TexelSize = texelSize;
+		parameters.m_HeightMapSize = {texWidth, texHeight};
+		parameters.m_MinHeight = -maxHeight;
+		parameters.m_HeightRange = maxHeight * 2;
+		parameters.m_LodRange = terrainRenderer.m_LodRange;
+		parameters.m_MorphStart = TERRAIN_MORPH_START;
+		terrainRenderer.m_ParametersBuffer = Allocator::CreateDeviceLocalBuffer(
+			cmdBuff, std::vector<TerrainParameters>{parameters},
+			vk::BufferUsageFlagBits::eStorageBuffer);
+	}
+	else
+	{
+		terrainRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
+		terrainRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
+			cmdBuff, vertices,
+			vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	}
 	terrainRenderer.m_Mesh.m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, indices,
 		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
 	terrainRenderer.m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
-		cmdBuff, materials, vk::BufferUsageFlagBits::eStorageBuffer);
+		cmdBuff, CreateTerrainMaterials(), vk::BufferUsageFlagBits::eStorageBuffer);
 
 	VulkanRenderer::EndSingleTimeCommands(cmdBuff);
 
 	Allocator::FlushStaging();
 
-	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	for (auto& node : terrainRenderer.m_Nodes)
+	{
+		node.m_Mesh.m_StaticGeometry.m_VertexBuffer = terrainRenderer.m_Mesh.GetVertexBuffer();
+		node.m_Mesh.m_StaticGeometry.m_IndexBuffer = terrainRenderer.m_Mesh.GetIndexBuffer();
+	}
 
-	std::vector<vk::DescriptorSetLayoutBinding> bindings;
-	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
-						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler, 1,
-						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(2, vk::DescriptorType::eCombinedImageSampler, 1,
-						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(3, vk::DescriptorType::eCombinedImageSampler, 1,
-						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(4, vk::DescriptorType::eCombinedImageSampler, 1,
-						  vk::ShaderStageFlagBits::eFragment);
-	bindings.emplace_back(5, vk::DescriptorType::eCombinedImageSampler, 1,
-						  vk::ShaderStageFlagBits::eFragment);
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	const auto bindings = CreateTerrainBindings(gpuDisplacement, virtualTexture);
 
 	vk::DescriptorBufferInfo materialBufferInfo{terrainRenderer.m_MaterialBuffer->m_Buffer, 0,
 												VK_WHOLE_SIZE};
+	vk::DescriptorBufferInfo vertexBufferInfo{terrainRenderer.m_Mesh.GetVertexBuffer(), 0,
+											  VK_WHOLE_SIZE};
+	vk::DescriptorBufferInfo parametersBufferInfo{};
+	if (gpuDisplacement)
+	{
+		parametersBufferInfo = {terrainRenderer.m_ParametersBuffer->m_Buffer, 0, VK_WHOLE_SIZE};
+	}
 
 	terrainRenderer.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
 	for (int i = 0; i < MAX_SWAP_CHAIN_IMAGES; i++)
@@ -398,24 +918,88 @@ Neon::Entity Neon::Scene::LoadTerrain(float width, float height, float maxHeight
 			wavefrontDescriptorSet.CreateWrite(3, &terrainRenderer.m_RTexture.m_Descriptor, 0),
 			wavefrontDescriptorSet.CreateWrite(4, &terrainRenderer.m_GTexture.m_Descriptor, 0),
 			wavefrontDescriptorSet.CreateWrite(5, &terrainRenderer.m_BTexture.m_Descriptor, 0)};
+		if (gpuDisplacement)
+		{
+			descriptorWrites.push_back(
+				wavefrontDescriptorSet.CreateWrite(7, &parametersBufferInfo, 0));
+			descriptorWrites.push_back(wavefrontDescriptorSet.CreateWrite(
+				8, &terrainRenderer.m_HeightMap.m_Descriptor, 0));
+		}
+		else
+		{
+			descriptorWrites.push_back(wavefrontDescriptorSet.CreateWrite(6, &vertexBufferInfo, 0));
+		}
+		vk::DescriptorBufferInfo clipmapParametersInfo{};
+		if (virtualTexture)
+		{
+			clipmapParametersInfo = terrainRenderer.m_VirtualTexture->GetParametersDescriptor(i);
+			descriptorWrites.push_back(wavefrontDescriptorSet.CreateWrite(
+				9, &terrainRenderer.m_VirtualTexture->GetDescriptor(), 0));
+			descriptorWrites.push_back(
+				wavefrontDescriptorSet.CreateWrite(10, &clipmapParametersInfo, 0));
+		}
 		wavefrontDescriptorSet.Update(descriptorWrites);
 	}
 
-	auto& pipeline = terrainRenderer.m_GraphicsPipeline;
-	pipeline.Init(device);
-	pipeline.LoadVertexShader("src/Shaders/build/vert_terrain.spv");
-	pipeline.LoadFragmentShader("src/Shaders/build/frag_terrain.spv");
+	CreateTerrainPipeline(terrainRenderer.m_GraphicsPipeline,
+						  terrainRenderer.m_DescriptorSets[0].GetLayout(), gpuDisplacement,
+						  virtualTexture);
 
-	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
-												   vk::ShaderStageFlagBits::eFragment,
-											   0, sizeof(PushConstant)};
-	pipeline.CreatePipelineLayout({terrainRenderer.m_DescriptorSets[0].GetLayout()},
-								  {pushConstantRange});
-	pipeline.CreatePipeline(
-		VulkanRenderer::GetOffscreenRenderPass(), VulkanRenderer::GetMsaaSamples(),
-		VulkanRenderer::GetExtent2D(), {VertexTerrain::getBindingDescription()},
-		{VertexTerrain::getAttributeDescriptions()}, vk::CullModeFlagBits::eBack);
+	return entity;
+}
+
+Neon::Entity Neon::Scene::LoadStreamedTerrain(const TerrainStreamingSettings& settings)
+{
+	assert((settings.m_TileResolution - 1) % TERRAIN_CHUNK_SIZE == 0);
+
+	Entity entity = CreateEntity("streamedTerrain");
+	auto& terrainRenderer = entity.AddComponent<StreamedTerrainRenderer>();
+	entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+	terrainRenderer.m_Settings = settings;
+	// Same ranges as LoadTerrain
+	terrainRenderer.m_LodRange = 6.0f * TERRAIN_CHUNK_SIZE * settings.m_TexelSize;
+
+	CreateTextureImage("textures/grassy2.png", terrainRenderer.m_BackgroundTexture);
+	CreateTextureImage("textures/mud.png", terrainRenderer.m_RTexture);
+	CreateTextureImage("textures/grassFlowers.png", terrainRenderer.m_GTexture);
+	CreateTextureImage("textures/path.png", terrainRenderer.m_BTexture);
 
+	const auto gridVertices = CreateTerrainGrid();
+	const auto indices = CreateTerrainChunkIndices();
+	// Tiles are placed by their model matrix, so they share their placement in the heightmap
+	TerrainParameters parameters{};
+	parameters.m_Origin = glm::vec2(0.0f);
+	parameters.m_TexelSize = glm::vec2(settings.m_TexelSize);
+	parameters.m_HeightMapSize = glm::ivec2(static_cast<int>(settings.m_TileResolution));
+	parameters.m_MinHeight = -settings.m_MaxHeight;
+	parameters.m_HeightRange = settings.m_MaxHeight * 2;
+	parameters.m_LodRange = terrainRenderer.m_LodRange;
+	parameters.m_MorphStart = TERRAIN_MORPH_START;
+
+	auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
+	terrainRenderer.m_Mesh.m_VerticesCount = (uint32_t)gridVertices.size();
+	terrainRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
+	terrainRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, gridVertices, vk::BufferUsageFlagBits::eVertexBuffer);
+	terrainRenderer.m_Mesh.m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, indices, vk::BufferUsageFlagBits::eIndexBuffer);
+	terrainRenderer.m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, CreateTerrainMaterials(), vk::BufferUsageFlagBits::eStorageBuffer);
+	terrainRenderer.m_ParametersBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, std::vector<TerrainParameters>{parameters},
+		vk::BufferUsageFlagBits::eStorageBuffer);
+	VulkanRenderer::EndSingleTimeCommands(cmdBuff);
+	Allocator::FlushStaging();
+
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	terrainRenderer.m_Bindings = CreateTerrainBindings(true, false);
+	terrainRenderer.m_DescriptorSetLayout = device.createDescriptorSetLayoutUnique(
+		{{}, static_cast<uint32_t>(terrainRenderer.m_Bindings.size()),
+		 terrainRenderer.m_Bindings.data()});
+	CreateTerrainPipeline(terrainRenderer.m_GraphicsPipeline,
+						  terrainRenderer.m_DescriptorSetLayout.get(), true, false);
+
+	terrainRenderer.m_Loader = std::make_unique<TerrainTileLoader>(settings);
 	return entity;
 }
 
@@ -447,7 +1031,7 @@ struct VertexWater
 };
 } // namespace Neon
 
-Neon::Entity Neon::Scene::LoadWater()
+Neon::Entity Neon::Scene::LoadWater(const WaterRenderingSettings& settings)
 {
 	VertexWater topLeft = {{1, 0, 1}, {0, 1, 0}};
 	VertexWater bottomLeft = {{1, 0, -1}, {0, 1, 0}};
@@ -458,7 +1042,7 @@ Neon::Entity Neon::Scene::LoadWater()
 	std::vector<uint32_t> indices = {0, 1, 2, 2, 1, 3};
 
 	Entity entity = CreateEntity("Water");
-	auto& waterRenderer = entity.AddComponent<WaterRenderer>();
+	auto& waterRenderer = entity.AddComponent<WaterRenderer>(settings);
 	auto& transform = entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
 
 	Material material{};
@@ -471,6 +1055,7 @@ Neon::Entity Neon::Scene::LoadWater()
 
 	waterRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
 	waterRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
+	waterRenderer.m_Mesh.m_BoundingSphere = CalculateBoundingSphere(vertices);
 	waterRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, vertices,
 		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
@@ -501,6 +1086,8 @@ Neon::Entity Neon::Scene::LoadWater()
 						  vk::ShaderStageFlagBits::eFragment);
 	bindings.emplace_back(5, vk::DescriptorType::eCombinedImageSampler, 1,
 						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(6, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eFragment);
 
 	vk::DescriptorBufferInfo materialBufferInfo{waterRenderer.m_MaterialBuffer->m_Buffer, 0,
 												VK_WHOLE_SIZE};
@@ -516,33 +1103,131 @@ Neon::Entity Neon::Scene::LoadWater()
 		wavefrontDescriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
 		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
 			wavefrontDescriptorSet.CreateWrite(0, &materialBufferInfo, 0),
-			wavefrontDescriptorSet.CreateWrite(
-				1, &waterRenderer.m_RefractionColorTextureImage.m_Descriptor, 0),
-			wavefrontDescriptorSet.CreateWrite(
-				2, &waterRenderer.m_ReflectionColorTextureImage.m_Descriptor, 0),
 			wavefrontDescriptorSet.CreateWrite(3, &waterRenderer.m_DuDvMapTextureImage.m_Descriptor,
 											   0),
 			wavefrontDescriptorSet.CreateWrite(4, &waterRenderer.m_NormalMapTextureImage.m_Descriptor,
-											   0),
-			wavefrontDescriptorSet.CreateWrite(5, &waterRenderer.m_RefractionDepthTextureImage.m_Descriptor,
 											   0)};
 		wavefrontDescriptorSet.Update(descriptorWrites);
 	}
+	// Targets are rewritten whenever they are recreated
+	waterRenderer.WriteDescriptors();
 
-	auto& pipeline = waterRenderer.m_GraphicsPipeline;
-	pipeline.Init(device);
-	pipeline.LoadVertexShader("src/Shaders/build/vert_water.spv");
-	pipeline.LoadFragmentShader("src/Shaders/build/frag_water.spv");
+	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
+												   vk::ShaderStageFlagBits::eFragment,
+											   0, sizeof(PushConstant)};
+	const std::pair<GraphicsPipeline*, const char*> pipelines[] = {
+		{&waterRenderer.m_GraphicsPipeline, "src/Shaders/build/frag_water.spv"},
+		{&waterRenderer.m_ScreenSpacePipeline, "src/Shaders/build/frag_water_ssr.spv"}};
+	for (const auto& [pipeline, fragmentShader] : pipelines)
+	{
+		pipeline->Init(device);
+		pipeline->LoadVertexShader("src/Shaders/build/vert_water.spv");
+		pipeline->LoadFragmentShader(fragmentShader);
+		pipeline->CreatePipelineLayout({waterRenderer.m_DescriptorSets[0].GetLayout(),
+										VulkanRenderer::GetInstanceDescriptorSetLayout()},
+									   {pushConstantRange});
+		pipeline->CreatePipeline(VulkanRenderer::GetOffscreenRenderPass(),
+								 VulkanRenderer::GetMsaaSamples(), VulkanRenderer::GetExtent2D(),
+								 {VertexWater::getBindingDescription()},
+								 {VertexWater::getAttributeDescriptions()},
+								 vk::CullModeFlagBits::eNone);
+	}
+
+	return entity;
+}
+
+Neon::Entity Neon::Scene::LoadOcean(const OceanSettings& settings)
+{
+	// Positions along each axis go from the even inner grid to a cubic growth toward the edge
+	auto gridPosition = [](uint32_t index) {
+		const float u = 2.0f * static_cast<float>(index) / OCEAN_GRID_SIZE - 1.0f;
+		return OCEAN_GRID_INNER_EXTENT * u +
+			   (OCEAN_GRID_RADIUS - OCEAN_GRID_INNER_EXTENT) * u * u * u;
+	};
+	std::vector<VertexWater> vertices;
+	vertices.reserve((OCEAN_GRID_SIZE + 1) * (OCEAN_GRID_SIZE + 1));
+	for (uint32_t z = 0; z <= OCEAN_GRID_SIZE; z++)
+	{
+		for (uint32_t x = 0; x <= OCEAN_GRID_SIZE; x++)
+		{ vertices.push_back({{gridPosition(x), 0, gridPosition(z)}, {0, 1, 0}}); }
+	}
+	std::vector<uint32_t> indices;
+	indices.reserve(OCEAN_GRID_SIZE * OCEAN_GRID_SIZE * 6);
+	for (uint32_t z = 0; z < OCEAN_GRID_SIZE; z++)
+	{
+		for (uint32_t x = 0; x < OCEAN_GRID_SIZE; x++)
+		{
+			const uint32_t topLeft = z * (OCEAN_GRID_SIZE + 1) + x;
+			const uint32_t bottomLeft = topLeft + OCEAN_GRID_SIZE + 1;
+			indices.insert(indices.end(), {topLeft, bottomLeft, topLeft + 1, topLeft + 1,
+										   bottomLeft, bottomLeft + 1});
+		}
+	}
+
+	Entity entity = CreateEntity("Ocean");
+	auto& oceanRenderer = entity.AddComponent<OceanRenderer>();
+	entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+
+	auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
+
+	// The grid follows the camera and is never culled
+	oceanRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
+	oceanRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
+	oceanRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, vertices,
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	oceanRenderer.m_Mesh.m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
+		cmdBuff, indices,
+		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	oceanRenderer.m_GridSpacing = 2.0f * OCEAN_GRID_INNER_EXTENT / OCEAN_GRID_SIZE;
+
+	VulkanRenderer::EndSingleTimeCommands(cmdBuff);
+
+	Allocator::FlushStaging();
+
+	oceanRenderer.m_Simulation = std::make_unique<OceanSimulation>();
+	oceanRenderer.m_Simulation->Init(settings);
+
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	bindings.emplace_back(0, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler, 1,
+						  vk::ShaderStageFlagBits::eFragment);
+	bindings.emplace_back(2, vk::DescriptorType::eStorageBuffer, 1,
+						  vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
+
+	const vk::DescriptorBufferInfo parametersInfo =
+		oceanRenderer.m_Simulation->GetParametersDescriptor();
+	oceanRenderer.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
+	for (auto& descriptorSet : oceanRenderer.m_DescriptorSets)
+	{
+		descriptorSet.Init(device);
+		descriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
+		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+			descriptorSet.CreateWrite(
+				0, &oceanRenderer.m_Simulation->GetDisplacementDescriptor(), 0),
+			descriptorSet.CreateWrite(
+				1, &oceanRenderer.m_Simulation->GetDerivativesDescriptor(), 0),
+			descriptorSet.CreateWrite(2, &parametersInfo, 0)};
+		descriptorSet.Update(descriptorWrites);
+	}
 
 	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
 												   vk::ShaderStageFlagBits::eFragment,
 											   0, sizeof(PushConstant)};
-	pipeline.CreatePipelineLayout({waterRenderer.m_DescriptorSets[0].GetLayout()},
-								  {pushConstantRange});
-	pipeline.CreatePipeline(VulkanRenderer::GetOffscreenRenderPass(),
-							VulkanRenderer::GetMsaaSamples(), VulkanRenderer::GetExtent2D(),
-							{VertexWater::getBindingDescription()},
-							{VertexWater::getAttributeDescriptions()}, vk::CullModeFlagBits::eNone);
+	oceanRenderer.m_GraphicsPipeline.Init(device);
+	oceanRenderer.m_GraphicsPipeline.LoadVertexShader("src/Shaders/build/vert_ocean.spv");
+	oceanRenderer.m_GraphicsPipeline.LoadFragmentShader("src/Shaders/build/frag_ocean.spv");
+	oceanRenderer.m_GraphicsPipeline.CreatePipelineLayout(
+		{oceanRenderer.m_DescriptorSets[0].GetLayout(),
+		 VulkanRenderer::GetInstanceDescriptorSetLayout()},
+		{pushConstantRange});
+	oceanRenderer.m_GraphicsPipeline.CreatePipeline(
+		VulkanRenderer::GetOffscreenRenderPass(), VulkanRenderer::GetMsaaSamples(),
+		VulkanRenderer::GetExtent2D(), {VertexWater::getBindingDescription()},
+		{VertexWater::getAttributeDescriptions()}, vk::CullModeFlagBits::eNone);
 
 	return entity;
 }
@@ -563,22 +1248,131 @@ void Neon::Scene::OnUpdate(float ts, Neon::PerspectiveCameraController controlle
 		childTransform.m_Global = parentTransform.m_Global * childTransform.m_Local;
 	}
 
-	auto animationView = m_Registry.view<SkinnedMeshRenderer>();
+	// Animation LODs follow the main camera, characters outside of its frustum are not posed
+	const auto& lodCamera = controller.GetCamera();
+	const Frustum lodFrustum(lodCamera.GetProjectionMatrix() * lodCamera.GetViewMatrix());
+	const float projectionScale = std::abs(lodCamera.GetProjectionMatrix()[1][1]);
+	const float seconds = ts / 1000.0f;
+	uint32_t boneCount = 0;
+	m_PosedRenderers.clear();
+	auto animationView = m_Registry.view<SkinnedMeshRenderer, Transform>();
 	for (auto entity : animationView)
 	{
 		auto& skinnedMeshRenderer = animationView.get<SkinnedMeshRenderer>(entity);
-		skinnedMeshRenderer.Update(ts / 1000.0f);
+		const auto& transform = animationView.get<Transform>(entity);
+		skinnedMeshRenderer.UpdateLod(transform.m_Global, lodCamera.GetPosition(), lodFrustum,
+									  projectionScale);
+		// Instances whose palettes no longer fit into the bone buffer of the frame join the crowd
+		const uint32_t bonesCount = skinnedMeshRenderer.m_SkinnedMesh->m_Skeleton->GetBonesCount();
+		if (skinnedMeshRenderer.IsPosed() && boneCount + bonesCount > MAX_BONE_MATRICES_PER_FRAME)
+		{ skinnedMeshRenderer.m_Crowd = true; }
+		if (!skinnedMeshRenderer.IsPosed())
+		{
+			skinnedMeshRenderer.Update(seconds, nullptr);
+			continue;
+		}
+		skinnedMeshRenderer.m_BoneOffset = boneCount;
+		boneCount += bonesCount;
+		m_PosedRenderers.push_back(&skinnedMeshRenderer);
+	}
+
+	// Instances are posed in parallel into their slice of the palettes, which are then uploaded
+	// with one copy and skinned
+	if (m_BoneMatrices.size() < boneCount) { m_BoneMatrices.resize(boneCount); }
+	auto poseRenderers = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			auto& renderer = *m_PosedRenderers[i];
+			renderer.Update(seconds, &m_BoneMatrices[renderer.m_BoneOffset]);
+		}
+	};
+	JobSystem::ParallelFor(static_cast<uint32_t>(m_PosedRenderers.size()),
+						   ANIMATION_UPDATE_BATCH_SIZE, poseRenderers);
+	VulkanRenderer::UploadBoneMatrices(m_BoneMatrices, boneCount);
+	for (auto* skinnedMeshRenderer : m_PosedRenderers)
+	{ VulkanRenderer::DispatchSkinning(*skinnedMeshRenderer); }
+
+	// Terrain tiles are streamed around the main camera
+	auto streamedTerrainView = m_Registry.view<StreamedTerrainRenderer, Transform>();
+	for (auto entity : streamedTerrainView)
+	{
+		auto& terrainRenderer = streamedTerrainView.get<StreamedTerrainRenderer>(entity);
+		const auto& transform = streamedTerrainView.get<Transform>(entity);
+		terrainRenderer.Update(transform.m_Global, lodCamera.GetPosition());
+	}
+	// Ground texture clipmaps are baked around the main camera
+	auto terrainView = m_Registry.view<TerrainRenderer, Transform>();
+	for (auto entity : terrainView)
+	{
+		auto& terrainRenderer = terrainView.get<TerrainRenderer>(entity);
+		if (!terrainRenderer.m_VirtualTexture) { continue; }
+		const auto& transform = terrainView.get<Transform>(entity);
+		const glm::vec4 cameraPosition =
+			glm::inverse(transform.m_Global) * glm::vec4(lodCamera.GetPosition(), 1.0f);
+		terrainRenderer.m_VirtualTexture->Update(
+			VulkanRenderer::GetCommandBuffer(), VulkanRenderer::GetImageIndex(),
+			{cameraPosition.x, cameraPosition.z}, TERRAIN_CLIPMAP_PAGES_PER_FRAME);
 	}
 
+	// Oceans are simulated before the passes that draw them
+	auto oceanView = m_Registry.view<OceanRenderer>();
+	for (auto entity : oceanView)
+	{
+		auto& oceanRenderer = oceanView.get<OceanRenderer>(entity);
+		oceanRenderer.m_Time =
+			std::fmod(oceanRenderer.m_Time + ts / 1000.0f, OCEAN_REPEAT_PERIOD);
+		oceanRenderer.m_Simulation->Update(VulkanRenderer::GetCommandBuffer(),
+										   oceanRenderer.m_Time);
+	}
+
+	// Reflections that miss the scene trace rays to the sky dome
+	auto skyDomeView = m_Registry.view<SkyDomeRenderer, Transform>();
+	for (auto entity : skyDomeView)
+	{
+		const glm::mat4 transform = GetSkyDomeTransform(skyDomeView.get<Transform>(entity));
+		VulkanRenderer::SetSkyDome(
+			{glm::vec3(transform[3]), glm::length(glm::vec3(transform[0]))});
+	}
+
+	// Refraction and reflection passes are skipped while the water is hidden and rendered every
+	// few frames otherwise, the water reprojects the last ones in between
 	auto waterGroup = m_Registry.group<WaterRenderer>(entt::get<Transform>);
 	for (auto entity : waterGroup)
 	{
 		auto camera = controller.GetCamera();
 		const auto& [waterRenderer, transform] = waterGroup.get<WaterRenderer, Transform>(entity);
+		const WaterRenderingSettings& settings = waterRenderer.m_Settings;
+		// Targets, or the opaque scene textures read in screen space mode, follow the size of the
+		// window
+		if (waterRenderer.m_TargetExtent != waterRenderer.GetTargetExtent())
+		{ waterRenderer.SetSettings(settings); }
+
+		if (settings.m_ReflectionMode == WaterReflectionMode::ScreenSpace)
+		{
+			waterRenderer.m_Capture.m_RefractionViewProjection =
+				camera.GetProjectionMatrix() * camera.GetViewMatrix();
+			waterRenderer.m_Capture.m_ReflectionViewProjection =
+				waterRenderer.m_Capture.m_RefractionViewProjection;
+			waterRenderer.UploadCapture(VulkanRenderer::GetImageIndex());
+			VulkanRenderer::RequestOpaqueScene();
+			continue;
+		}
 
 		float waterHeight = transform.m_Global[3][1];
+		const bool cameraAbove = camera.GetPosition().y >= waterHeight;
+		const glm::vec4& boundingSphere = waterRenderer.m_Mesh.m_BoundingSphere;
+		const glm::vec3 center = transform.m_Global * glm::vec4(glm::vec3(boundingSphere), 1.0f);
+		const float maxScale = std::max(glm::length(glm::vec3(transform.m_Global[0])),
+										glm::length(glm::vec3(transform.m_Global[2])));
+		const bool inView = lodFrustum.IsSphereVisible(center, boundingSphere.w * maxScale);
+		if (!waterRenderer.UpdateCapture(cameraAbove, inView))
+		{
+			waterRenderer.UploadCapture(VulkanRenderer::GetImageIndex());
+			continue;
+		}
+
 		float yNormal = -1;
-		if (camera.GetPosition().y < waterHeight)
+		if (!cameraAbove)
 		{
 			yNormal *= -1;
 			waterHeight -= 0.1;
@@ -587,74 +1381,152 @@ void Neon::Scene::OnUpdate(float ts, Neon::PerspectiveCameraController controlle
 		{
 			waterHeight += 0.1;
 		}
+		auto reflectionCamera = camera;
+		float translation = -((camera.GetPosition().y - waterHeight) * 2);
+		reflectionCamera.Translate({0, translation, 0});
+		reflectionCamera.InvertPitch();
+		waterRenderer.m_Capture.m_RefractionViewProjection =
+			camera.GetProjectionMatrix() * camera.GetViewMatrix();
+		waterRenderer.m_Capture.m_ReflectionViewProjection =
+			reflectionCamera.GetProjectionMatrix() * reflectionCamera.GetViewMatrix();
+
+		Frustum frustum(waterRenderer.m_Capture.m_RefractionViewProjection);
+		if (settings.m_Multiview)
+		{
+			// The second view of the pass is the reflection camera, mirrored in the shaders
+			frustum.m_Mirrored = true;
+			frustum.m_MirrorHeight = waterHeight;
+			VulkanRenderer::BeginScene(waterRenderer.m_MultiviewFrameBuffers,
+									   waterRenderer.m_TargetExtent, clearColor, camera,
+									   {0, yNormal, 0, waterHeight}, pointLight, lightIntensity,
+									   lightDirection, lightPosition, false,
+									   settings.m_ColorFormat, settings.m_Samples, true,
+									   waterHeight);
+			Render(camera, frustum);
+			VulkanRenderer::EndScene();
+			waterRenderer.UploadCapture(VulkanRenderer::GetImageIndex());
+			continue;
+		}
+
 		VulkanRenderer::BeginScene(waterRenderer.m_RefractionFrameBuffers,
-								   refractionReflectionResolution, clearColor, camera,
+								   waterRenderer.m_TargetExtent, clearColor, camera,
 								   {0, yNormal, 0, waterHeight}, pointLight, lightIntensity,
-								   lightDirection, lightPosition);
-		Render(camera, refractionReflectionResolution);
+								   lightDirection, lightPosition, false, settings.m_ColorFormat,
+								   settings.m_Samples);
+		Render(camera, frustum);
 		VulkanRenderer::EndScene();
 
-		float translation = -((camera.GetPosition().y - waterHeight) * 2);
-		camera.Translate({0, translation, 0});
-		camera.InvertPitch();
-
 		VulkanRenderer::BeginScene(waterRenderer.m_ReflectionFrameBuffers,
-								   refractionReflectionResolution, clearColor, camera,
+								   waterRenderer.m_TargetExtent, clearColor, reflectionCamera,
 								   {0, -yNormal, 0, -waterHeight}, pointLight, lightIntensity,
-								   lightDirection, lightPosition);
-		Render(camera, refractionReflectionResolution);
+								   lightDirection, lightPosition, false, settings.m_ColorFormat,
+								   settings.m_Samples);
+		Render(reflectionCamera, Frustum(waterRenderer.m_Capture.m_ReflectionViewProjection));
 		VulkanRenderer::EndScene();
+		waterRenderer.UploadCapture(VulkanRenderer::GetImageIndex());
 	}
 
 	auto camera = controller.GetCamera();
 	VulkanRenderer::BeginScene(VulkanRenderer::GetOffscreenFramebuffers(),
 							   VulkanRenderer::GetExtent2D(), clearColor, camera, {0, 1, 0, 100000},
-							   pointLight, lightIntensity, lightDirection, lightPosition);
-	Render(camera, VulkanRenderer::GetExtent2D());
+							   pointLight, lightIntensity, lightDirection, lightPosition, true);
+	Render(camera, lodFrustum);
+	// Oceans follow the camera in steps of their grid
+	auto oceanGroup = m_Registry.group<OceanRenderer>(entt::get<Transform>);
+	for (auto entity : oceanGroup)
+	{
+		const auto& [ocean, transform] = oceanGroup.get<OceanRenderer, Transform>(entity);
+		const glm::vec3 cameraPosition = camera.GetPosition();
+		const glm::vec3 gridOrigin = {
+			std::floor(cameraPosition.x / ocean.m_GridSpacing) * ocean.m_GridSpacing, 0.0f,
+			std::floor(cameraPosition.z / ocean.m_GridSpacing) * ocean.m_GridSpacing};
+		Transform gridTransform(glm::translate(glm::mat4(1.0), gridOrigin) * transform.m_Global,
+								glm::mat4(1.0));
+		VulkanRenderer::Render(gridTransform, ocean, 0);
+	}
 	for (auto entity : waterGroup)
 	{
 		const auto& [water, transform] = waterGroup.get<WaterRenderer, Transform>(entity);
 		water.Update(ts / 1000.0f);
-		VulkanRenderer::Render(transform, water, VulkanRenderer::GetExtent2D(), water.m_MoveFactor);
+		VulkanRenderer::Render(transform, water.GetPipeline(), water.m_DescriptorSets,
+							   water.m_Mesh, water.m_MoveFactor, RenderLayer::Transparent,
+							   water.m_VisibilityQuery);
 	}
 	VulkanRenderer::EndScene();
 }
 
-void Neon::Scene::Render(Neon::PerspectiveCamera camera, vk::Extent2D extent)
+void Neon::Scene::Render(const Neon::PerspectiveCamera& camera, const Frustum& frustum)
 {
 	auto skyDomeGroup = m_Registry.group<SkyDomeRenderer>(entt::get<Transform>);
 	for (auto entity : skyDomeGroup)
 	{
 		auto [skyDomeRenderer, transform] = skyDomeGroup.get<SkyDomeRenderer, Transform>(entity);
-		glm::mat4 transformMatrix = transform.m_Global;
-		transformMatrix = glm::translate(glm::mat4(1.0), camera.GetPosition()) * transform.m_Global;
-		transformMatrix = glm::translate(glm::mat4(1.0), {0, -1000, 0}) * transform.m_Global;
-		Transform newTransform(transformMatrix, glm::mat4(1.0));
-		VulkanRenderer::Render(newTransform, skyDomeRenderer, extent, 0);
+		Transform newTransform(GetSkyDomeTransform(transform), glm::mat4(1.0));
+		VulkanRenderer::Render(newTransform, skyDomeRenderer, 0, RenderLayer::Background);
 	}
+	// Terrain LODs follow the camera of each pass
 	auto terrainGroup = m_Registry.group<TerrainRenderer>(entt::get<Transform>);
 	for (auto entity : terrainGroup)
 	{
 		const auto& [terrainRenderer, transform] =
 			terrainGroup.get<TerrainRenderer, Transform>(entity);
-		VulkanRenderer::Render(transform, terrainRenderer, extent, 0);
+		m_TerrainChunks.clear();
+		terrainRenderer.SelectChunks(transform.m_Global, camera.GetPosition(), frustum,
+									 m_TerrainChunks);
+		for (const auto* chunk : m_TerrainChunks)
+		{
+			VulkanRenderer::Render(terrainRenderer.GetChunkTransform(transform, *chunk),
+								   terrainRenderer, chunk->m_Mesh, 0);
+		}
+	}
+	auto streamedTerrainGroup = m_Registry.group<StreamedTerrainRenderer>(entt::get<Transform>);
+	for (auto entity : streamedTerrainGroup)
+	{
+		const auto& [terrainRenderer, transform] =
+			streamedTerrainGroup.get<StreamedTerrainRenderer, Transform>(entity);
+		for (const auto& tile : terrainRenderer.m_Tiles)
+		{
+			if (!terrainRenderer.IsDrawn(tile)) { continue; }
+			const Transform tileTransform(terrainRenderer.GetTileModel(transform.m_Global, tile),
+										  glm::mat4(1.0));
+			m_TerrainChunks.clear();
+			SelectTerrainChunks(tile.m_Nodes, terrainRenderer.m_LodRange, tileTransform.m_Global,
+								camera.GetPosition(), frustum, m_TerrainChunks);
+			for (const auto* chunk : m_TerrainChunks)
+			{
+				VulkanRenderer::Render(chunk->GetDisplacedTransform(tileTransform),
+									   terrainRenderer.m_GraphicsPipeline, tile.m_DescriptorSets,
+									   chunk->m_Mesh, 0);
+			}
+		}
 	}
 	auto meshGroup = m_Registry.group<MeshRenderer>(entt::get<Transform>);
 	for (auto entity : meshGroup)
 	{
 		const auto& [meshRenderer, transform] = meshGroup.get<MeshRenderer, Transform>(entity);
-		VulkanRenderer::Render(transform, meshRenderer, extent, 0);
+		VulkanRenderer::Render(transform, *meshRenderer.m_StaticMesh, 0);
 	}
 	auto animationGroup = m_Registry.group<SkinnedMeshRenderer>(entt::get<Transform>);
 	for (auto entity : animationGroup)
 	{
 		const auto& [skinnedMeshRenderer, transform] =
 			animationGroup.get<SkinnedMeshRenderer, Transform>(entity);
-		VulkanRenderer::Render(transform, skinnedMeshRenderer, extent, 0);
+		// Instances outside of the main view are not skinned, passes that still see them, such
+		// as the water reflections, draw them from the baked animation
+		if (skinnedMeshRenderer.m_Crowd || skinnedMeshRenderer.m_Culled)
+		{
+			const auto& crowd = skinnedMeshRenderer.m_SkinnedMesh->m_Crowd;
+			VulkanRenderer::Render(skinnedMeshRenderer.GetCrowdTransform(transform), crowd,
+								   crowd.m_Mesh, 0);
+			continue;
+		}
+		VulkanRenderer::Render(transform, *skinnedMeshRenderer.m_SkinnedMesh,
+							   skinnedMeshRenderer.m_Mesh, 0);
 	}
 }
 
-void Neon::Scene::ProcessNode(const aiScene* scene, aiNode* node, Neon::Entity parent)
+void Neon::Scene::ProcessNode(const aiScene* scene, aiNode* node, const std::string& filename,
+							  Neon::Entity parent)
 {
 	auto newParent = CreateEntity(node->mName.C_Str());
 	newParent.AddComponent<Transform>(glm::mat4(1.0),
@@ -663,11 +1535,11 @@ void Neon::Scene::ProcessNode(const aiScene* scene, aiNode* node, Neon::Entity p
 	for (int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		ProcessMesh(scene, mesh, newParent);
+		ProcessMesh(scene, mesh, filename + ":" + std::to_string(node->mMeshes[i]), newParent);
 	}
 	for (int i = 0; i < node->mNumChildren; i++)
 	{
-		ProcessNode(scene, node->mChildren[i], newParent);
+		ProcessNode(scene, node->mChildren[i], filename, newParent);
 	}
 }
 
@@ -730,10 +1602,24 @@ void Neon::Scene::ProcessMesh(aiMesh* mesh, std::vector<Vertex>& vertices,
 	}
 }
 
-void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
+void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, const std::string& meshKey,
+							  Entity parent)
 {
 	assert(parent.HasComponent<Transform>());
 
+	auto it = m_StaticMeshes.find(meshKey);
+	if (it == m_StaticMeshes.end())
+	{ it = m_StaticMeshes.emplace(meshKey, CreateStaticMesh(scene, mesh)).first; }
+	if (!it->second) { return; }
+
+	Entity entity = CreateEntity(mesh->mName.C_Str());
+	entity.AddComponent<MeshRenderer>(it->second);
+	entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
+	entity.AddComponent<Relationship>(parent);
+}
+
+std::shared_ptr<Neon::StaticMesh> Neon::Scene::CreateStaticMesh(const aiScene* scene, aiMesh* mesh)
+{
 	std::vector<uint32_t> indices;
 	for (int i = 0; i < mesh->mNumFaces; i++)
 	{
@@ -746,7 +1632,7 @@ void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
 		}
 	}
 
-	if (indices.empty()) { return; }
+	if (indices.empty()) { return nullptr; }
 
 	std::vector<Vertex> vertices;
 	for (int i = 0; i < mesh->mNumVertices; i++)
@@ -765,10 +1651,7 @@ void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
 		vertices.push_back(vertex);
 	}
 
-	Entity entity = CreateEntity(mesh->mName.C_Str());
-	auto& meshRenderer = entity.AddComponent<MeshRenderer>();
-	auto& transform = entity.AddComponent<Transform>(glm::mat4(1.0), glm::mat4(1.0));
-	entity.AddComponent<Relationship>(parent);
+	auto staticMesh = std::make_shared<StaticMesh>();
 
 	std::vector<Material> materials;
 	aiMaterial* aiMaterial = scene->mMaterials[mesh->mMaterialIndex];
@@ -815,20 +1698,16 @@ void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
 	vk::DescriptorImageInfo desc{sampler, textureImageView,
 								 vk::ImageLayout::eShaderReadOnlyOptimal};
 
-	meshRenderer.m_TextureImages.emplace_back(desc, imageAllocation);
+	staticMesh->m_TextureImages.emplace_back(desc, imageAllocation);
 
 	auto cmdBuff = VulkanRenderer::BeginSingleTimeCommands();
 
-	meshRenderer.m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
-	meshRenderer.m_Mesh.m_IndicesCount = (uint32_t)indices.size();
-	meshRenderer.m_Mesh.m_VertexBuffer = Allocator::CreateDeviceLocalBuffer(
-		cmdBuff, vertices,
-		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
-	meshRenderer.m_Mesh.m_IndexBuffer = Allocator::CreateDeviceLocalBuffer(
-		cmdBuff, indices,
-		vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer);
+	staticMesh->m_Mesh.m_VerticesCount = (uint32_t)vertices.size();
+	staticMesh->m_Mesh.m_IndicesCount = (uint32_t)indices.size();
+	staticMesh->m_Mesh.m_BoundingSphere = CalculateBoundingSphere(vertices);
+	staticMesh->m_Mesh.m_StaticGeometry = m_StaticGeometry.Add(cmdBuff, vertices, indices);
 
-	meshRenderer.m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
+	staticMesh->m_MaterialBuffer = Allocator::CreateDeviceLocalBuffer(
 		cmdBuff, materials, vk::BufferUsageFlagBits::eStorageBuffer);
 
 	VulkanRenderer::EndSingleTimeCommands(cmdBuff);
@@ -841,23 +1720,23 @@ void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
 	bindings.emplace_back(0, vk::DescriptorType::eStorageBuffer, 1,
 						  vk::ShaderStageFlagBits::eFragment);
 	bindings.emplace_back(1, vk::DescriptorType::eCombinedImageSampler,
-						  static_cast<uint32_t>(meshRenderer.m_TextureImages.size()),
+						  static_cast<uint32_t>(staticMesh->m_TextureImages.size()),
 						  vk::ShaderStageFlagBits::eFragment);
 
-	vk::DescriptorBufferInfo materialBufferInfo{meshRenderer.m_MaterialBuffer->m_Buffer, 0,
+	vk::DescriptorBufferInfo materialBufferInfo{staticMesh->m_MaterialBuffer->m_Buffer, 0,
 												VK_WHOLE_SIZE};
 
 	std::vector<vk::DescriptorImageInfo> texturesBufferInfo;
-	texturesBufferInfo.reserve(meshRenderer.m_TextureImages.size());
-	for (auto& texture : meshRenderer.m_TextureImages)
+	texturesBufferInfo.reserve(staticMesh->m_TextureImages.size());
+	for (auto& texture : staticMesh->m_TextureImages)
 	{
 		texturesBufferInfo.push_back(texture.m_Descriptor);
 	}
 
-	meshRenderer.m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
+	staticMesh->m_DescriptorSets.resize(MAX_SWAP_CHAIN_IMAGES);
 	for (int i = 0; i < MAX_SWAP_CHAIN_IMAGES; i++)
 	{
-		auto& wavefrontDescriptorSet = meshRenderer.m_DescriptorSets[i];
+		auto& wavefrontDescriptorSet = staticMesh->m_DescriptorSets[i];
 		wavefrontDescriptorSet.Init(device);
 		wavefrontDescriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
 		std::vector<vk::WriteDescriptorSet> descriptorWrites = {
@@ -865,20 +1744,24 @@ void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent)
 			wavefrontDescriptorSet.CreateWrite(1, texturesBufferInfo.data(), 0)};
 		wavefrontDescriptorSet.Update(descriptorWrites);
 	}
-	auto& pipeline = meshRenderer.m_GraphicsPipeline;
+	auto& pipeline = staticMesh->m_GraphicsPipeline;
 	pipeline.Init(device);
 	pipeline.LoadVertexShader("src/Shaders/build/vert.spv");
 	pipeline.LoadFragmentShader("src/Shaders/build/frag.spv");
+	pipeline.LoadMultiviewShaders("src/Shaders/build/vert_mv.spv", "src/Shaders/build/frag_mv.spv");
 
 	vk::PushConstantRange pushConstantRange = {vk::ShaderStageFlagBits::eVertex |
 												   vk::ShaderStageFlagBits::eFragment,
 											   0, sizeof(PushConstant)};
-	pipeline.CreatePipelineLayout({meshRenderer.m_DescriptorSets[0].GetLayout()},
+	pipeline.CreatePipelineLayout({staticMesh->m_DescriptorSets[0].GetLayout(),
+								   VulkanRenderer::GetInstanceDescriptorSetLayout()},
 								  {pushConstantRange});
 	pipeline.CreatePipeline(VulkanRenderer::GetOffscreenRenderPass(),
 							VulkanRenderer::GetMsaaSamples(), VulkanRenderer::GetExtent2D(),
 							{Vertex::getBindingDescription()}, {Vertex::getAttributeDescriptions()},
 							vk::CullModeFlagBits::eBack);
+
+	return staticMesh;
 }
 
 void Neon::Scene::ProcessMesh(const aiScene* scene, aiMesh* mesh, std::vector<Vertex>& vertices,
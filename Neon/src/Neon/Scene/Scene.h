@@ -10,13 +10,24 @@
 #include <assimp/scene.h>
 
 #include "PerspectiveCameraController.h"
+#include "StaticGeometryArena.h"
 #include "entt.h"
 
 #define MAX_BONES_PER_VERTEX 10
+// Skinned instances posed by one task of the parallel animation update
+#define ANIMATION_UPDATE_BATCH_SIZE 4
+// Heightmap or chunk grid rows generated by one task of the parallel terrain generation
+#define TERRAIN_GENERATION_BATCH_SIZE 16
 
 namespace Neon
 {
 class Entity;
+struct StaticMesh;
+struct SkinnedMesh;
+struct SkinnedMeshRenderer;
+struct TerrainNode;
+struct TerrainStreamingSettings;
+struct Frustum;
 
 struct Vertex
 {
@@ -62,6 +73,35 @@ struct Vertex
 	}
 };
 
+// Output of shader_comp_skinning.comp, same layout as the leading attributes of Vertex
+struct SkinnedVertex
+{
+	glm::vec3 pos;
+	glm::vec3 norm;
+	glm::vec3 color;
+	glm::vec2 texCoord;
+	uint32_t matID;
+
+	static vk::VertexInputBindingDescription getBindingDescription()
+	{
+		return {0, sizeof(SkinnedVertex)};
+	}
+
+	static std::vector<vk::VertexInputAttributeDescription> getAttributeDescriptions()
+	{
+		return {
+			{0, 0, vk::Format::eR32G32B32Sfloat,
+			 static_cast<uint32_t>(offsetof(SkinnedVertex, pos))},
+			{1, 0, vk::Format::eR32G32B32Sfloat,
+			 static_cast<uint32_t>(offsetof(SkinnedVertex, norm))},
+			{2, 0, vk::Format::eR32G32B32Sfloat,
+			 static_cast<uint32_t>(offsetof(SkinnedVertex, color))},
+			{3, 0, vk::Format::eR32G32Sfloat,
+			 static_cast<uint32_t>(offsetof(SkinnedVertex, texCoord))},
+			{4, 0, vk::Format::eR32Sint, static_cast<uint32_t>(offsetof(SkinnedVertex, matID))}};
+	}
+};
+
 struct Material
 {
 	glm::vec3 ambient = glm::vec3(0.1f, 0.1f, 0.1f);
@@ -90,16 +130,29 @@ public:
 
 	Entity LoadAnimatedModel(const std::string& filename);
 
-	Entity LoadTerrain(float width, float height, float maxHeight);
+	// Chunked LOD terrain from textures/heightmap.png. With gpuDisplacement only the heightmap and
+	// one chunk grid are uploaded and the vertex shader displaces the grid, otherwise every node
+	// gets its own vertices computed on the CPU. With virtualTexture the ground textures are baked
+	// into a clipmap around the camera instead of being blended by every fragment.
+	Entity LoadTerrain(float width, float height, float maxHeight, bool gpuDisplacement = true,
+					   bool virtualTexture = true);
+
+	// Terrain whose tiles are streamed in and out around the camera, see StreamedTerrainRenderer
+	Entity LoadStreamedTerrain(const TerrainStreamingSettings& settings);
+
+	// Water plane reflecting and refracting the scene, rendered twice more per frame at most
+	Entity LoadWater(const WaterRenderingSettings& settings = {});
 
-	Entity LoadWater();
+	// Open ocean simulated by compute, see OceanSimulation. The transform of the entity sets the
+	// height of the surface, which spreads around the camera.
+	Entity LoadOcean(const OceanSettings& settings = {});
 
 	void OnUpdate(float ts, Neon::PerspectiveCameraController controller, glm::vec4 clearColor,
 				  bool pointLight, float lightIntensity, glm::vec3 lightDirection,
 				  glm::vec3 lightPosition);
 
 private:
-	void ProcessNode(const aiScene* scene, aiNode* node, Entity parent);
+	void ProcessNode(const aiScene* scene, aiNode* node, const std::string& filename, Entity parent);
 	void ProcessNode(const aiScene* scene, aiNode* node, std::vector<Vertex>& vertices,
 					 std::vector<uint32_t>& indices);
 	void ProcessNode(const aiScene* scene, aiNode* node, std::vector<Vertex>& vertices,
@@ -109,16 +162,29 @@ private:
 					 std::vector<glm::mat4>& boneOffsets);
 	static void ProcessMesh(aiMesh* mesh, std::vector<Vertex>& vertices,
 							std::vector<uint32_t>& indices);
-	void ProcessMesh(const aiScene* scene, aiMesh* mesh, Entity parent);
+	void ProcessMesh(const aiScene* scene, aiMesh* mesh, const std::string& meshKey, Entity parent);
+	std::shared_ptr<StaticMesh> CreateStaticMesh(const aiScene* scene, aiMesh* mesh);
+	std::shared_ptr<SkinnedMesh> CreateSkinnedMesh(const std::string& filename);
 	static void ProcessMesh(const aiScene* scene, aiMesh* mesh, std::vector<Vertex>& vertices,
 							std::vector<uint32_t>& indices, std::vector<Material>& materials,
 							std::vector<TextureImage>& textureImages,
 							std::unordered_map<std::string, uint32_t>& boneMap,
 							std::vector<glm::mat4>& boneOffsets);
-	void Render(Neon::PerspectiveCamera camera, vk::Extent2D extent);
+	// Draws the scene seen by camera, or by both views of a multiview pass, culled by frustum
+	void Render(const Neon::PerspectiveCamera& camera, const Frustum& frustum);
 
 private:
 	entt::registry m_Registry;
+	std::unordered_map<std::string, std::shared_ptr<StaticMesh>> m_StaticMeshes;
+	std::unordered_map<std::string, std::shared_ptr<SkinnedMesh>> m_SkinnedMeshes;
+	// Per frame animation scratch, kept to reuse its capacity: instances posed this frame and the
+	// bone palettes they are posed into, uploaded together
+	std::vector<SkinnedMeshRenderer*> m_PosedRenderers;
+	std::vector<glm::mat4> m_BoneMatrices;
+	// Terrain chunks selected for the pass being rendered
+	std::vector<const TerrainNode*> m_TerrainChunks;
+	// Shared vertex/index buffers of all static meshes loaded by LoadModel
+	StaticGeometryArena m_StaticGeometry{sizeof(Vertex)};
 	friend class Entity;
 };
 } // namespace Neon
@@ -0,0 +1,413 @@
+#include "neopch.h"
+
+#include "Skeleton.h"
+#include <assimp/scene.h>
+#include <glm/gtc/quaternion.hpp>
+#include <xmmintrin.h>
+
+// Column-major 4x4 product, result must not alias a or b
+static void MultiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+{
+	const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+	const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+	const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+	const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+	for (int i = 0; i < 4; i++)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+		_mm_storeu_ps(&result[i][0], column);
+	}
+}
+
+static __m128 Lerp(__m128 from, __m128 to, __m128 factor)
+{
+	return _mm_add_ps(from, _mm_mul_ps(factor, _mm_sub_ps(to, from)));
+}
+
+void Neon::LocalPose::Resize(uint32_t jointCount)
+{
+	const uint32_t paddedCount = PadJointCount(jointCount);
+	for (auto& component : m_Translation) { component.resize(paddedCount, 0.0f); }
+	for (auto& component : m_Rotation) { component.resize(paddedCount, 0.0f); }
+	for (auto& component : m_Scale) { component.resize(paddedCount, 1.0f); }
+	m_Rotation[3].assign(paddedCount, 1.0f);
+}
+
+// Interpolates the SKELETON_SIMD_WIDTH joints starting at i
+static void InterpolateJoints(const Neon::LocalPose& from, const Neon::LocalPose& to,
+							  Neon::LocalPose& result, size_t i, __m128 translationFactor,
+							  __m128 rotationFactor, __m128 scaleFactor)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	for (int c = 0; c < 3; c++)
+	{
+		_mm_storeu_ps(&result.m_Translation[c][i],
+					  Lerp(_mm_loadu_ps(&from.m_Translation[c][i]),
+						   _mm_loadu_ps(&to.m_Translation[c][i]), translationFactor));
+		_mm_storeu_ps(&result.m_Scale[c][i], Lerp(_mm_loadu_ps(&from.m_Scale[c][i]),
+												  _mm_loadu_ps(&to.m_Scale[c][i]), scaleFactor));
+	}
+
+	__m128 fromRotation[4];
+	__m128 toRotation[4];
+	__m128 dot = _mm_setzero_ps();
+	for (int c = 0; c < 4; c++)
+	{
+		fromRotation[c] = _mm_loadu_ps(&from.m_Rotation[c][i]);
+		toRotation[c] = _mm_loadu_ps(&to.m_Rotation[c][i]);
+		dot = _mm_add_ps(dot, _mm_mul_ps(fromRotation[c], toRotation[c]));
+	}
+	// Flip the target into the same hemisphere so the shortest arc is taken
+	const __m128 flip = _mm_and_ps(dot, signMask);
+	__m128 rotation[4];
+	__m128 lengthSquared = _mm_setzero_ps();
+	for (int c = 0; c < 4; c++)
+	{
+		rotation[c] = Lerp(fromRotation[c], _mm_xor_ps(toRotation[c], flip), rotationFactor);
+		lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(rotation[c], rotation[c]));
+	}
+	const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+	for (int c = 0; c < 4; c++)
+	{ _mm_storeu_ps(&result.m_Rotation[c][i], _mm_mul_ps(rotation[c], inverseLength)); }
+}
+
+void Neon::LocalPose::Interpolate(const LocalPose& from, const LocalPose& to,
+								  const std::vector<float> factors[3], uint32_t jointCount)
+{
+	const size_t count = PadJointCount(jointCount);
+	assert(count <= m_Rotation[0].size());
+	assert(from.m_Rotation[0].size() >= count && to.m_Rotation[0].size() >= count);
+	for (size_t i = 0; i < count; i += SKELETON_SIMD_WIDTH)
+	{
+		InterpolateJoints(from, to, *this, i, _mm_loadu_ps(&factors[0][i]),
+						  _mm_loadu_ps(&factors[1][i]), _mm_loadu_ps(&factors[2][i]));
+	}
+}
+
+void Neon::LocalPose::Interpolate(const LocalPose& from, const LocalPose& to, float factor,
+								  uint32_t jointCount)
+{
+	const size_t count = PadJointCount(jointCount);
+	assert(count <= m_Rotation[0].size());
+	assert(from.m_Rotation[0].size() >= count && to.m_Rotation[0].size() >= count);
+	const __m128 factors = _mm_set1_ps(factor);
+	for (size_t i = 0; i < count; i += SKELETON_SIMD_WIDTH)
+	{ InterpolateJoints(from, to, *this, i, factors, factors, factors); }
+}
+
+// Per joint blend factors of the SKELETON_SIMD_WIDTH joints starting at i
+static __m128 LoadMaskedWeight(float weight, const std::vector<float>& mask, size_t i)
+{
+	const __m128 weights = _mm_set1_ps(weight);
+	return mask.empty() ? weights : _mm_mul_ps(weights, _mm_loadu_ps(&mask[i]));
+}
+
+void Neon::LocalPose::Blend(const LocalPose& pose, float weight, const std::vector<float>& mask,
+							uint32_t jointCount)
+{
+	const size_t count = PadJointCount(jointCount);
+	assert(count <= m_Rotation[0].size() && pose.m_Rotation[0].size() >= count);
+	assert(mask.empty() || mask.size() >= count);
+	for (size_t i = 0; i < count; i += SKELETON_SIMD_WIDTH)
+	{
+		const __m128 factors = LoadMaskedWeight(weight, mask, i);
+		InterpolateJoints(*this, pose, *this, i, factors, factors, factors);
+	}
+}
+
+// Hamilton product of quaternions stored as x, y, z, w component vectors
+static void MultiplyQuaternions(const __m128 a[4], const __m128 b[4], __m128 result[4])
+{
+	result[0] = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[3], b[0]), _mm_mul_ps(a[0], b[3])),
+									  _mm_mul_ps(a[1], b[2])),
+						   _mm_mul_ps(a[2], b[1]));
+	result[1] = _mm_add_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(a[3], b[1]), _mm_mul_ps(a[0], b[2])),
+									  _mm_mul_ps(a[1], b[3])),
+						   _mm_mul_ps(a[2], b[0]));
+	result[2] = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(a[3], b[2]), _mm_mul_ps(a[0], b[1])),
+									  _mm_mul_ps(a[1], b[0])),
+						   _mm_mul_ps(a[2], b[3]));
+	result[3] = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_mul_ps(a[3], b[3]), _mm_mul_ps(a[0], b[0])),
+									  _mm_mul_ps(a[1], b[1])),
+						   _mm_mul_ps(a[2], b[2]));
+}
+
+void Neon::LocalPose::Add(const LocalPose& pose, const LocalPose& reference, float weight,
+						  const std::vector<float>& mask, uint32_t jointCount)
+{
+	const size_t count = PadJointCount(jointCount);
+	assert(count <= m_Rotation[0].size() && pose.m_Rotation[0].size() >= count);
+	assert(reference.m_Rotation[0].size() >= count);
+	assert(mask.empty() || mask.size() >= count);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	for (size_t i = 0; i < count; i += SKELETON_SIMD_WIDTH)
+	{
+		const __m128 factor = LoadMaskedWeight(weight, mask, i);
+		for (int c = 0; c < 3; c++)
+		{
+			const __m128 offset = _mm_sub_ps(_mm_loadu_ps(&pose.m_Translation[c][i]),
+											 _mm_loadu_ps(&reference.m_Translation[c][i]));
+			_mm_storeu_ps(&m_Translation[c][i], _mm_add_ps(_mm_loadu_ps(&m_Translation[c][i]),
+														   _mm_mul_ps(factor, offset)));
+			const __m128 ratio = _mm_div_ps(_mm_loadu_ps(&pose.m_Scale[c][i]),
+											_mm_loadu_ps(&reference.m_Scale[c][i]));
+			_mm_storeu_ps(&m_Scale[c][i],
+						  _mm_mul_ps(_mm_loadu_ps(&m_Scale[c][i]), Lerp(one, ratio, factor)));
+		}
+
+		// delta = pose * conjugate(reference), scaled by normalized lerp from identity
+		__m128 rotation[4];
+		__m128 conjugate[4];
+		for (int c = 0; c < 4; c++)
+		{
+			rotation[c] = _mm_loadu_ps(&pose.m_Rotation[c][i]);
+			conjugate[c] = _mm_loadu_ps(&reference.m_Rotation[c][i]);
+			if (c < 3) { conjugate[c] = _mm_xor_ps(conjugate[c], signMask); }
+		}
+		__m128 delta[4];
+		MultiplyQuaternions(rotation, conjugate, delta);
+		const __m128 flip = _mm_and_ps(delta[3], signMask);
+		for (int c = 0; c < 4; c++)
+		{
+			const __m128 identity = c == 3 ? one : _mm_setzero_ps();
+			delta[c] = Lerp(identity, _mm_xor_ps(delta[c], flip), factor);
+			rotation[c] = _mm_loadu_ps(&m_Rotation[c][i]);
+		}
+		__m128 result[4];
+		MultiplyQuaternions(delta, rotation, result);
+		__m128 lengthSquared = _mm_setzero_ps();
+		for (const __m128& component : result)
+		{ lengthSquared = _mm_add_ps(lengthSquared, _mm_mul_ps(component, component)); }
+		const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+		for (int c = 0; c < 4; c++)
+		{ _mm_storeu_ps(&m_Rotation[c][i], _mm_mul_ps(result[c], inverseLength)); }
+	}
+}
+
+// Builds the Bone tree of every node that is animated or skins vertices, registering animated
+// nodes without skinned vertices in boneMap
+static void CreateBoneTree(const aiScene* scene, const aiNode* node, Neon::Bone& parentBone,
+						   glm::mat4 parentTransform,
+						   std::unordered_map<std::string, uint32_t>& boneMap,
+						   const std::vector<glm::mat4>& offsetMatrices, uint32_t& bonesCount)
+{
+	std::string nodeName = node->mName.data;
+
+	// Every clip of the scene shares the skeleton, a node is animated if any clip has a channel
+	const aiNodeAnim* nodeAnim = nullptr;
+	for (int a = 0; a < scene->mNumAnimations && !nodeAnim; a++)
+	{
+		const aiAnimation* animation = scene->mAnimations[a];
+		for (int i = 0; i < animation->mNumChannels; i++)
+		{
+			const aiNodeAnim* nodeAnimTemp = animation->mChannels[i];
+			if (std::string(nodeAnimTemp->mNodeName.data) == nodeName)
+			{
+				nodeAnim = nodeAnimTemp;
+				break;
+			}
+		}
+	}
+
+	glm::mat4 localTransform = glm::transpose(*(glm::mat4*)&node->mTransformation);
+	glm::mat4 newParentTransform = parentTransform * localTransform;
+
+	Neon::Bone* newParentBone = &parentBone;
+	if (nodeAnim || boneMap.find(nodeName) != boneMap.end())
+	{
+		newParentTransform = glm::mat4(1.0);
+		Neon::Bone newBone;
+		if (boneMap.find(nodeName) == boneMap.end())
+		{
+			newBone = Neon::Bone(bonesCount, glm::mat4(1.0), parentTransform, localTransform);
+			boneMap[nodeName] = bonesCount++;
+		}
+		else
+		{
+			newBone = Neon::Bone(boneMap[nodeName], offsetMatrices[boneMap[nodeName]],
+								 parentTransform, localTransform);
+		}
+		newBone.m_Animated = nodeAnim;
+		newBone.m_Name = nodeName;
+		if (parentBone.GetID() == -1)
+		{
+			parentBone = newBone;
+			newParentBone = &parentBone;
+		}
+		else
+		{
+			parentBone.GetChildren().push_back(newBone);
+			newParentBone = &parentBone.GetChildren().back();
+		}
+	}
+
+	for (int i = 0; i < node->mNumChildren; i++)
+	{
+		CreateBoneTree(scene, node->mChildren[i], *newParentBone, newParentTransform, boneMap,
+					   offsetMatrices, bonesCount);
+	}
+}
+
+Neon::Skeleton::Skeleton(const aiScene* scene,
+						 std::unordered_map<std::string, uint32_t>& boneMap,
+						 const std::vector<glm::mat4>& offsetMatrices)
+	: m_BonesCount(static_cast<uint32_t>(offsetMatrices.size()))
+{
+	Bone rootBone;
+	CreateBoneTree(scene, scene->mRootNode, rootBone, glm::mat4(1.0), boneMap, offsetMatrices,
+				   m_BonesCount);
+	assert(rootBone.GetID() != -1);
+	AddJoints(rootBone);
+}
+
+void Neon::Skeleton::AddJoints(Bone& root)
+{
+	// The queue position of a bone is its joint index
+	std::vector<Bone*> queue{&root};
+	std::vector<uint32_t> depths;
+	m_ParentIndices.push_back(-1);
+	for (size_t index = 0; index < queue.size(); index++)
+	{
+		Bone& bone = *queue[index];
+		m_BoneIDs.push_back(bone.GetID());
+		m_Animated.push_back(bone.m_Animated);
+		m_ParentTransforms.push_back(bone.GetParentTransform());
+		m_BindLocalTransforms.push_back(bone.GetLocalTransform());
+		m_OffsetMatrices.push_back(bone.GetOffsetMatrix());
+		m_JointNames.push_back(bone.m_Name);
+		const int32_t parentIndex = m_ParentIndices[index];
+		depths.push_back(parentIndex < 0 ? 0 : depths[parentIndex] + 1);
+
+		for (auto& child : bone.GetChildren())
+		{
+			queue.push_back(&child);
+			m_ParentIndices.push_back(static_cast<int32_t>(index));
+		}
+	}
+
+	// Depths are ascending, every LOD drops the deepest level that is left, typically fingers,
+	// toes and facial joints first
+	for (uint32_t lod = 0; lod < ANIMATION_LOD_COUNT; lod++)
+	{
+		const uint32_t maxDepth = depths.back() > lod ? depths.back() - lod : 0;
+		m_LodJointCounts[lod] = static_cast<uint32_t>(
+			std::upper_bound(depths.begin(), depths.end(), maxDepth) - depths.begin());
+	}
+
+	m_BindPose.Resize(GetJointCount());
+	for (uint32_t i = 0; i < GetJointCount(); i++)
+	{
+		const glm::mat4& local = m_BindLocalTransforms[i];
+		const glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])),
+							  glm::length(glm::vec3(local[2])));
+		const glm::quat rotation = glm::quat_cast(glm::mat3(
+			glm::vec3(local[0]) / scale.x, glm::vec3(local[1]) / scale.y,
+			glm::vec3(local[2]) / scale.z));
+		for (int c = 0; c < 3; c++)
+		{
+			m_BindPose.m_Translation[c][i] = local[3][c];
+			m_BindPose.m_Scale[c][i] = scale[c];
+		}
+		m_BindPose.m_Rotation[0][i] = rotation.x;
+		m_BindPose.m_Rotation[1][i] = rotation.y;
+		m_BindPose.m_Rotation[2][i] = rotation.z;
+		m_BindPose.m_Rotation[3][i] = rotation.w;
+	}
+}
+
+std::vector<float> Neon::Skeleton::CreateMask(const std::string& jointName, float weight) const
+{
+	assert(weight > 0.0f);
+	const auto root = std::find(m_JointNames.begin(), m_JointNames.end(), jointName);
+	assert(root != m_JointNames.end());
+	const auto rootIndex = static_cast<uint32_t>(root - m_JointNames.begin());
+
+	// Parents precede their children, so one pass reaches the whole subtree
+	std::vector<float> mask(GetPaddedJointCount(), 0.0f);
+	mask[rootIndex] = weight;
+	for (uint32_t i = rootIndex + 1; i < GetJointCount(); i++)
+	{
+		if (mask[m_ParentIndices[i]] > 0.0f) { mask[i] = weight; }
+	}
+	return mask;
+}
+
+void Neon::Skeleton::ComputeSkinningMatrices(const LocalPose& pose,
+											 std::vector<glm::mat4>& localTransforms,
+											 std::vector<glm::mat4>& modelTransforms,
+											 glm::mat4* transforms, uint32_t jointCount) const
+{
+	jointCount = std::min(jointCount, GetJointCount());
+	const uint32_t paddedCount = PadJointCount(jointCount);
+	assert(localTransforms.size() >= GetPaddedJointCount());
+	assert(modelTransforms.size() >= GetPaddedJointCount());
+	assert(pose.m_Rotation[0].size() >= paddedCount);
+
+	// Translation * rotation * scale of four joints at a time
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	for (uint32_t i = 0; i < paddedCount; i += SKELETON_SIMD_WIDTH)
+	{
+		const __m128 x = _mm_loadu_ps(&pose.m_Rotation[0][i]);
+		const __m128 y = _mm_loadu_ps(&pose.m_Rotation[1][i]);
+		const __m128 z = _mm_loadu_ps(&pose.m_Rotation[2][i]);
+		const __m128 w = _mm_loadu_ps(&pose.m_Rotation[3][i]);
+		const __m128 scaleX = _mm_loadu_ps(&pose.m_Scale[0][i]);
+		const __m128 scaleY = _mm_loadu_ps(&pose.m_Scale[1][i]);
+		const __m128 scaleZ = _mm_loadu_ps(&pose.m_Scale[2][i]);
+
+		const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 columns[4][4];
+		columns[0][0] =
+			_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+		columns[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+		columns[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+		columns[0][3] = _mm_setzero_ps();
+		columns[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+		columns[1][1] =
+			_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+		columns[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+		columns[1][3] = _mm_setzero_ps();
+		columns[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+		columns[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+		columns[2][2] =
+			_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+		columns[2][3] = _mm_setzero_ps();
+		columns[3][0] = _mm_loadu_ps(&pose.m_Translation[0][i]);
+		columns[3][1] = _mm_loadu_ps(&pose.m_Translation[1][i]);
+		columns[3][2] = _mm_loadu_ps(&pose.m_Translation[2][i]);
+		columns[3][3] = one;
+
+		// Each column group holds one component per joint, transpose to one column per joint
+		for (int c = 0; c < 4; c++)
+		{
+			_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+			for (int j = 0; j < SKELETON_SIMD_WIDTH; j++)
+			{ _mm_storeu_ps(&localTransforms[i + j][c][0], columns[c][j]); }
+		}
+	}
+
+	glm::mat4 parentModel;
+	for (uint32_t i = 0; i < GetJointCount(); i++)
+	{
+		const bool posed = m_Animated[i] && i < jointCount;
+		const glm::mat4& local = posed ? localTransforms[i] : m_BindLocalTransforms[i];
+		if (m_ParentIndices[i] < 0)
+		{ MultiplyMatrices(m_ParentTransforms[i], local, modelTransforms[i]); }
+		else
+		{
+			MultiplyMatrices(modelTransforms[m_ParentIndices[i]], m_ParentTransforms[i],
+							 parentModel);
+			MultiplyMatrices(parentModel, local, modelTransforms[i]);
+		}
+		MultiplyMatrices(modelTransforms[i], m_OffsetMatrices[i], transforms[m_BoneIDs[i]]);
+	}
+}
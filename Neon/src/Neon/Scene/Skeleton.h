@@ -0,0 +1,121 @@
+#ifndef NEON_SKELETON_H
+#define NEON_SKELETON_H
+
+#include "Bone.h"
+#include <glm/glm.hpp>
+
+struct aiScene;
+
+// Number of joints processed together by the SSE pose code
+#define SKELETON_SIMD_WIDTH 4
+// Number of animation LODs, each drops the deepest level of the joints animated by the previous
+#define ANIMATION_LOD_COUNT 4
+
+namespace Neon
+{
+inline uint32_t PadJointCount(uint32_t jointCount)
+{
+	return (jointCount + SKELETON_SIMD_WIDTH - 1) / SKELETON_SIMD_WIDTH * SKELETON_SIMD_WIDTH;
+}
+
+// Local joint transforms in structure-of-arrays form, one array per component. Arrays are padded
+// to a multiple of SKELETON_SIMD_WIDTH with identity transforms.
+struct LocalPose
+{
+	std::vector<float> m_Translation[3];
+	std::vector<float> m_Rotation[4];
+	std::vector<float> m_Scale[3];
+
+	void Resize(uint32_t jointCount);
+	// Per joint lerp of translation and scale and normalized lerp of rotation of the first
+	// jointCount joints, factors hold one array per channel (translation, rotation, scale)
+	void Interpolate(const LocalPose& from, const LocalPose& to,
+					 const std::vector<float> factors[3], uint32_t jointCount);
+	// Same as above with one factor for every joint and channel
+	void Interpolate(const LocalPose& from, const LocalPose& to, float factor,
+					 uint32_t jointCount);
+	// Blends the first jointCount joints towards pose by weight, scaled per joint by mask unless
+	// it is empty
+	void Blend(const LocalPose& pose, float weight, const std::vector<float>& mask,
+			   uint32_t jointCount);
+	// Applies the difference between pose and reference scaled by weight and mask: translations
+	// are offset, rotations premultiplied by the delta rotation and scales multiplied by the ratio
+	void Add(const LocalPose& pose, const LocalPose& reference, float weight,
+			 const std::vector<float>& mask, uint32_t jointCount);
+};
+
+// Bone hierarchy flattened breadth first into arrays, so every parent precedes its children,
+// which lets local to model conversion run as a single linear pass, and the joints animated by
+// each LOD form a prefix of the arrays
+class Skeleton
+{
+public:
+	Skeleton() = default;
+	// Flattens the nodes of scene that are animated by any of its animations or skin vertices,
+	// adding bones for animated nodes missing from boneMap
+	Skeleton(const aiScene* scene, std::unordered_map<std::string, uint32_t>& boneMap,
+			 const std::vector<glm::mat4>& offsetMatrices);
+
+	[[nodiscard]] uint32_t GetJointCount() const
+	{
+		return static_cast<uint32_t>(m_ParentIndices.size());
+	}
+	[[nodiscard]] uint32_t GetPaddedJointCount() const
+	{
+		return PadJointCount(GetJointCount());
+	}
+	// Joints animated at lod, the remaining ones keep their bind pose relative to their parent
+	[[nodiscard]] uint32_t GetLodJointCount(uint32_t lod) const
+	{
+		return m_LodJointCounts[lod];
+	}
+	// Size of the bone palette, joints map into it through their bone ID
+	[[nodiscard]] uint32_t GetBonesCount() const
+	{
+		return m_BonesCount;
+	}
+	[[nodiscard]] uint32_t GetBoneID(uint32_t joint) const
+	{
+		return m_BoneIDs[joint];
+	}
+	[[nodiscard]] bool IsAnimated(uint32_t joint) const
+	{
+		return m_Animated[joint];
+	}
+	// Local transforms of the bind pose, held by joints a clip has no channel for
+	[[nodiscard]] const LocalPose& GetBindPose() const
+	{
+		return m_BindPose;
+	}
+
+	// Per joint layer weights selecting the subtree rooted at the joint named jointName
+	[[nodiscard]] std::vector<float> CreateMask(const std::string& jointName,
+												float weight = 1.0f) const;
+
+	// Writes the skinning matrix of every joint to transforms, indexed by bone ID. Only the first
+	// jointCount joints are posed, localTransforms and modelTransforms are scratch storage of at
+	// least GetPaddedJointCount() matrices.
+	void ComputeSkinningMatrices(const LocalPose& pose, std::vector<glm::mat4>& localTransforms,
+								 std::vector<glm::mat4>& modelTransforms, glm::mat4* transforms,
+								 uint32_t jointCount) const;
+
+private:
+	void AddJoints(Bone& root);
+
+private:
+	std::vector<int32_t> m_ParentIndices;
+	std::vector<uint32_t> m_BoneIDs;
+	std::vector<uint8_t> m_Animated;
+	// Static node transforms between the parent joint and the joint
+	std::vector<glm::mat4> m_ParentTransforms;
+	// Local transforms used for joints without an animation channel
+	std::vector<glm::mat4> m_BindLocalTransforms;
+	LocalPose m_BindPose;
+	std::vector<std::string> m_JointNames;
+	std::vector<glm::mat4> m_OffsetMatrices;
+	uint32_t m_BonesCount = 0;
+	std::array<uint32_t, ANIMATION_LOD_COUNT> m_LodJointCounts{};
+};
+} // namespace Neon
+
+#endif //NEON_SKELETON_H
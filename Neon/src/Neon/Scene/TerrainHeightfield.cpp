@@ -0,0 +1,299 @@
+#include "neopch.h"
+
+#include "TerrainHeightfield.h"
+#include <cmath>
+#include <emmintrin.h>
+
+Neon::TerrainHeightfield::TerrainHeightfield(std::vector<uint16_t> heights, uint32_t width,
+											 uint32_t height, const glm::vec2& origin,
+											 const glm::vec2& texelSize, float maxHeight)
+	: m_Heights(std::move(heights)), m_Width(width), m_Height(height), m_Origin(origin),
+	  m_TexelSize(texelSize), m_Scale(maxHeight * 2 / UINT16_MAX), m_Offset(-maxHeight)
+{
+	assert(width > 1 && height > 1);
+	assert(m_Heights.size() == static_cast<size_t>(width) * height);
+	BuildPyramid();
+}
+
+void Neon::TerrainHeightfield::BuildPyramid()
+{
+	glm::uvec2 size = {m_Width - 1, m_Height - 1};
+	std::vector<HeightRange> cells(static_cast<size_t>(size.x) * size.y);
+	for (uint32_t y = 0; y < size.y; y++)
+	{
+		const uint16_t* row = &m_Heights[y * m_Width];
+		const uint16_t* nextRow = row + m_Width;
+		for (uint32_t x = 0; x < size.x; x++)
+		{
+			const uint16_t a = std::min(row[x], row[x + 1]);
+			const uint16_t b = std::min(nextRow[x], nextRow[x + 1]);
+			const uint16_t c = std::max(row[x], row[x + 1]);
+			const uint16_t d = std::max(nextRow[x], nextRow[x + 1]);
+			cells[y * size.x + x] = {std::min(a, b), std::max(c, d)};
+		}
+	}
+	m_Pyramid.push_back(std::move(cells));
+	m_LevelSizes.push_back(size);
+
+	while (size.x > 1 || size.y > 1)
+	{
+		const auto& previous = m_Pyramid.back();
+		const glm::uvec2 previousSize = size;
+		size = (size + 1u) / 2u;
+		std::vector<HeightRange> level(static_cast<size_t>(size.x) * size.y);
+		for (uint32_t y = 0; y < size.y; y++)
+		{
+			for (uint32_t x = 0; x < size.x; x++)
+			{
+				// Children past the border of an odd sized level repeat the last one
+				const uint32_t x0 = x * 2, x1 = std::min(x * 2 + 1, previousSize.x - 1);
+				const uint32_t y0 = y * 2, y1 = std::min(y * 2 + 1, previousSize.y - 1);
+				const HeightRange children[4] = {
+					previous[y0 * previousSize.x + x0], previous[y0 * previousSize.x + x1],
+					previous[y1 * previousSize.x + x0], previous[y1 * previousSize.x + x1]};
+				HeightRange range = children[0];
+				for (const auto& child : children)
+				{
+					range.m_Min = std::min(range.m_Min, child.m_Min);
+					range.m_Max = std::max(range.m_Max, child.m_Max);
+				}
+				level[y * size.x + x] = range;
+			}
+		}
+		m_Pyramid.push_back(std::move(level));
+		m_LevelSizes.push_back(size);
+	}
+}
+
+void Neon::TerrainHeightfield::Locate(float x, float z, uint32_t& cellX, uint32_t& cellY,
+									  float& fractionX, float& fractionY) const
+{
+	const float texelX = std::clamp((x - m_Origin.x) / m_TexelSize.x, 0.0f,
+									static_cast<float>(m_Width - 1));
+	const float texelY = std::clamp((z - m_Origin.y) / m_TexelSize.y, 0.0f,
+									static_cast<float>(m_Height - 1));
+	// The last row and column are sampled from the cell before them
+	cellX = std::min(static_cast<uint32_t>(texelX), m_Width - 2);
+	cellY = std::min(static_cast<uint32_t>(texelY), m_Height - 2);
+	fractionX = texelX - static_cast<float>(cellX);
+	fractionY = texelY - static_cast<float>(cellY);
+}
+
+float Neon::TerrainHeightfield::GetHeightAt(float x, float z) const
+{
+	uint32_t cellX, cellY;
+	float fractionX, fractionY;
+	Locate(x, z, cellX, cellY, fractionX, fractionY);
+	const float h00 = GetTexel(cellX, cellY), h10 = GetTexel(cellX + 1, cellY);
+	const float h01 = GetTexel(cellX, cellY + 1), h11 = GetTexel(cellX + 1, cellY + 1);
+	const float top = h00 + (h10 - h00) * fractionX;
+	const float bottom = h01 + (h11 - h01) * fractionX;
+	return top + (bottom - top) * fractionY;
+}
+
+glm::vec3 Neon::TerrainHeightfield::GetNormal(float x, float z) const
+{
+	uint32_t cellX, cellY;
+	float fractionX, fractionY;
+	Locate(x, z, cellX, cellY, fractionX, fractionY);
+	const float h00 = GetTexel(cellX, cellY), h10 = GetTexel(cellX + 1, cellY);
+	const float h01 = GetTexel(cellX, cellY + 1), h11 = GetTexel(cellX + 1, cellY + 1);
+	// Partial derivatives of the bilinear patch, per texel and then per object unit
+	const float dx = (h10 - h00 + (h11 - h01 - h10 + h00) * fractionY) / m_TexelSize.x;
+	const float dz = (h01 - h00 + (h11 - h10 - h01 + h00) * fractionX) / m_TexelSize.y;
+	return glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+}
+
+void Neon::TerrainHeightfield::SampleHeights(const float* texelX, const float* texelY,
+											 float* heights) const
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 u = _mm_loadu_ps(texelX);
+	__m128 v = _mm_loadu_ps(texelY);
+	u = _mm_min_ps(_mm_max_ps(u, zero), _mm_set1_ps(static_cast<float>(m_Width - 1)));
+	v = _mm_min_ps(_mm_max_ps(v, zero), _mm_set1_ps(static_cast<float>(m_Height - 1)));
+	// Coordinates are positive, so truncation floors them
+	const __m128i cellX =
+		_mm_cvttps_epi32(_mm_min_ps(u, _mm_set1_ps(static_cast<float>(m_Width - 2))));
+	const __m128i cellY =
+		_mm_cvttps_epi32(_mm_min_ps(v, _mm_set1_ps(static_cast<float>(m_Height - 2))));
+	const __m128 fractionX = _mm_sub_ps(u, _mm_cvtepi32_ps(cellX));
+	const __m128 fractionY = _mm_sub_ps(v, _mm_cvtepi32_ps(cellY));
+
+	alignas(16) int32_t x[4], y[4];
+	_mm_store_si128(reinterpret_cast<__m128i*>(x), cellX);
+	_mm_store_si128(reinterpret_cast<__m128i*>(y), cellY);
+	alignas(16) float h00[4], h10[4], h01[4], h11[4];
+	for (int i = 0; i < 4; i++)
+	{
+		const uint16_t* texel = &m_Heights[static_cast<size_t>(y[i]) * m_Width + x[i]];
+		h00[i] = texel[0];
+		h10[i] = texel[1];
+		h01[i] = texel[m_Width];
+		h11[i] = texel[m_Width + 1];
+	}
+
+	// Interpolated in the encoded range, the scale and offset are applied once
+	const __m128 a = _mm_load_ps(h00), b = _mm_load_ps(h10);
+	const __m128 c = _mm_load_ps(h01), d = _mm_load_ps(h11);
+	const __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fractionX));
+	const __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fractionX));
+	const __m128 value = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fractionY));
+	_mm_storeu_ps(heights, _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(m_Scale)),
+									  _mm_set1_ps(m_Offset)));
+}
+
+void Neon::TerrainHeightfield::GetHeights(const glm::vec2* positions, float* heights,
+										  size_t count) const
+{
+	const glm::vec2 inverseTexelSize = 1.0f / m_TexelSize;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float texelX[4], texelY[4];
+		for (int j = 0; j < 4; j++)
+		{
+			texelX[j] = (positions[i + j].x - m_Origin.x) * inverseTexelSize.x;
+			texelY[j] = (positions[i + j].y - m_Origin.y) * inverseTexelSize.y;
+		}
+		SampleHeights(texelX, texelY, heights + i);
+	}
+	for (; i < count; i++) { heights[i] = GetHeightAt(positions[i].x, positions[i].y); }
+}
+
+void Neon::TerrainHeightfield::GetNormals(const glm::vec2* positions, glm::vec3* normals,
+										  size_t count) const
+{
+	for (size_t i = 0; i < count; i++) { normals[i] = GetNormal(positions[i].x, positions[i].y); }
+}
+
+void Neon::TerrainHeightfield::ClampToGround(glm::vec3* positions, size_t count,
+											 float offset) const
+{
+	const glm::vec2 inverseTexelSize = 1.0f / m_TexelSize;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float texelX[4], texelY[4], heights[4];
+		for (int j = 0; j < 4; j++)
+		{
+			texelX[j] = (positions[i + j].x - m_Origin.x) * inverseTexelSize.x;
+			texelY[j] = (positions[i + j].z - m_Origin.y) * inverseTexelSize.y;
+		}
+		SampleHeights(texelX, texelY, heights);
+		for (int j = 0; j < 4; j++) { positions[i + j].y = heights[j] + offset; }
+	}
+	for (; i < count; i++)
+	{ positions[i].y = GetHeightAt(positions[i].x, positions[i].z) + offset; }
+}
+
+// Entry and exit parameters of the ray through the box [low, high], clipped to [0, distance]
+static bool IntersectBox(const glm::vec3& origin, const glm::vec3& inverseDirection,
+						 const glm::vec3& low, const glm::vec3& high, float distance, float& entry,
+						 float& exit)
+{
+	entry = 0.0f;
+	exit = distance;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// A ray parallel to a slab is inside of it everywhere or nowhere. Its infinite inverse
+		// direction would give NaN for an origin on one of the planes.
+		if (std::isinf(inverseDirection[axis]))
+		{
+			if (origin[axis] < low[axis] || origin[axis] > high[axis]) { return false; }
+			continue;
+		}
+		const float t0 = (low[axis] - origin[axis]) * inverseDirection[axis];
+		const float t1 = (high[axis] - origin[axis]) * inverseDirection[axis];
+		entry = std::max(entry, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+	return entry <= exit;
+}
+
+// Möller-Trumbore intersection, distance is the closest hit so far and is updated on a closer one
+static bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+							  const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+							  float& distance)
+{
+	const glm::vec3 edge1 = b - a;
+	const glm::vec3 edge2 = c - a;
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (std::abs(determinant) < 1e-8f) { return false; }
+	const float inverseDeterminant = 1.0f / determinant;
+	const glm::vec3 s = origin - a;
+	const float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f) { return false; }
+	const glm::vec3 q = glm::cross(s, edge1);
+	const float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f) { return false; }
+	const float t = glm::dot(edge2, q) * inverseDeterminant;
+	if (t < 0.0f || t > distance) { return false; }
+	distance = t;
+	return true;
+}
+
+bool Neon::TerrainHeightfield::Raycast(const glm::vec3& origin, const glm::vec3& direction,
+									   float maxDistance, float& distance) const
+{
+	if (IsEmpty()) { return false; }
+	// Scaling x and z into texels keeps the ray parameter, so distances need no conversion
+	TexelRay ray;
+	ray.m_Origin = {(origin.x - m_Origin.x) / m_TexelSize.x, origin.y,
+					(origin.z - m_Origin.y) / m_TexelSize.y};
+	ray.m_Direction = {direction.x / m_TexelSize.x, direction.y, direction.z / m_TexelSize.y};
+	ray.m_InverseDirection = 1.0f / ray.m_Direction;
+
+	distance = maxDistance;
+	const auto top = static_cast<uint32_t>(m_Pyramid.size() - 1);
+	return RaycastCell(top, 0, 0, ray, distance);
+}
+
+bool Neon::TerrainHeightfield::RaycastCell(uint32_t level, uint32_t x, uint32_t y,
+										   const TexelRay& ray, float& distance) const
+{
+	const glm::uvec2& size = m_LevelSizes[level];
+	const HeightRange& range = m_Pyramid[level][y * size.x + x];
+	const uint32_t cellSize = 1u << level;
+	const glm::vec3 low = {static_cast<float>(x * cellSize), Decode(range.m_Min),
+						   static_cast<float>(y * cellSize)};
+	const glm::vec3 high = {static_cast<float>(std::min((x + 1) * cellSize, m_Width - 1)),
+							Decode(range.m_Max),
+							static_cast<float>(std::min((y + 1) * cellSize, m_Height - 1))};
+	float entry, exit;
+	if (!IntersectBox(ray.m_Origin, ray.m_InverseDirection, low, high, distance, entry, exit))
+	{ return false; }
+	if (level == 0) { return RaycastTexelCell(x, y, ray, distance); }
+
+	// Every child may hold the closest hit, but each hit found shortens the ray, which culls the
+	// boxes behind it. Starting with the child the ray enters first makes that likely.
+	const glm::uvec2& childSize = m_LevelSizes[level - 1];
+	const uint32_t first =
+		(ray.m_Direction.x < 0.0f ? 1u : 0u) | (ray.m_Direction.z < 0.0f ? 2u : 0u);
+	bool hit = false;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		const uint32_t child = i ^ first;
+		const uint32_t childX = x * 2 + (child & 1);
+		const uint32_t childY = y * 2 + (child >> 1);
+		if (childX >= childSize.x || childY >= childSize.y) { continue; }
+		hit |= RaycastCell(level - 1, childX, childY, ray, distance);
+	}
+	return hit;
+}
+
+bool Neon::TerrainHeightfield::RaycastTexelCell(uint32_t x, uint32_t y, const TexelRay& ray,
+												float& distance) const
+{
+	const auto left = static_cast<float>(x), right = static_cast<float>(x + 1);
+	const auto top = static_cast<float>(y), bottom = static_cast<float>(y + 1);
+	const glm::vec3 p00 = {left, GetTexel(x, y), top};
+	const glm::vec3 p10 = {right, GetTexel(x + 1, y), top};
+	const glm::vec3 p01 = {left, GetTexel(x, y + 1), bottom};
+	const glm::vec3 p11 = {right, GetTexel(x + 1, y + 1), bottom};
+	// Same split as the chunk index buffer
+	bool hit = IntersectTriangle(ray.m_Origin, ray.m_Direction, p00, p01, p10, distance);
+	hit |= IntersectTriangle(ray.m_Origin, ray.m_Direction, p10, p01, p11, distance);
+	return hit;
+}
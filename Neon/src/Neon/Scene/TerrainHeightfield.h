@@ -0,0 +1,98 @@
+#ifndef NEON_TERRAINHEIGHTFIELD_H
+#define NEON_TERRAINHEIGHTFIELD_H
+
+#include <glm/glm.hpp>
+
+namespace Neon
+{
+// CPU copy of a terrain heightmap for gameplay queries, in the object space of the terrain.
+// Heights are kept as 16 bit values together with a pyramid of their minimum and maximum over
+// cells of 2^level texels, which bounds the terrain for ray traversal. Queries outside of the
+// heightmap are clamped to its border.
+class TerrainHeightfield
+{
+public:
+	TerrainHeightfield() = default;
+	// width x height texels whose texel 0 lies at origin, texelSize apart, and whose values map
+	// to [-maxHeight, maxHeight]
+	TerrainHeightfield(std::vector<uint16_t> heights, uint32_t width, uint32_t height,
+					   const glm::vec2& origin, const glm::vec2& texelSize, float maxHeight);
+
+	[[nodiscard]] bool IsEmpty() const
+	{
+		return m_Heights.empty();
+	}
+	[[nodiscard]] uint32_t GetWidth() const
+	{
+		return m_Width;
+	}
+	[[nodiscard]] uint32_t GetHeight() const
+	{
+		return m_Height;
+	}
+
+	// Bilinear height at (x, z)
+	[[nodiscard]] float GetHeightAt(float x, float z) const;
+	// Normal of the bilinear surface at (x, z)
+	[[nodiscard]] glm::vec3 GetNormal(float x, float z) const;
+
+	// Heights at count positions (x, z), four at a time
+	void GetHeights(const glm::vec2* positions, float* heights, size_t count) const;
+	void GetNormals(const glm::vec2* positions, glm::vec3* normals, size_t count) const;
+	// Places count positions offset above the terrain, keeping their x and z
+	void ClampToGround(glm::vec3* positions, size_t count, float offset = 0.0f) const;
+
+	// Distance along the normalized direction to the first intersection of the ray with the
+	// triangles of the full resolution grid, if one lies within maxDistance
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+				 float& distance) const;
+
+private:
+	struct HeightRange
+	{
+		uint16_t m_Min;
+		uint16_t m_Max;
+	};
+
+	// Ray in texel space, x and z in texels and y in object units, which keeps the ray parameter
+	struct TexelRay
+	{
+		glm::vec3 m_Origin;
+		glm::vec3 m_Direction;
+		glm::vec3 m_InverseDirection;
+	};
+
+	[[nodiscard]] float Decode(uint16_t value) const
+	{
+		return static_cast<float>(value) * m_Scale + m_Offset;
+	}
+	[[nodiscard]] float GetTexel(uint32_t x, uint32_t y) const
+	{
+		return Decode(m_Heights[y * m_Width + x]);
+	}
+	// Texel coordinates of (x, z) clamped to the heightmap, split into cell and fraction
+	void Locate(float x, float z, uint32_t& cellX, uint32_t& cellY, float& fractionX,
+				float& fractionY) const;
+	// Bilinear heights of four positions given as texel coordinates
+	void SampleHeights(const float* texelX, const float* texelY, float* heights) const;
+	void BuildPyramid();
+	bool RaycastCell(uint32_t level, uint32_t x, uint32_t y, const TexelRay& ray, float& distance)
+		const;
+	bool RaycastTexelCell(uint32_t x, uint32_t y, const TexelRay& ray, float& distance) const;
+
+private:
+	std::vector<uint16_t> m_Heights;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	glm::vec2 m_Origin{0.0f};
+	glm::vec2 m_TexelSize{1.0f};
+	float m_Scale = 0.0f;
+	float m_Offset = 0.0f;
+	// Level 0 holds one range per cell between four texels, every following level one per two
+	// by two cells of the previous one, up to a single cell
+	std::vector<std::vector<HeightRange>> m_Pyramid;
+	std::vector<glm::uvec2> m_LevelSizes;
+};
+} // namespace Neon
+
+#endif //NEON_TERRAINHEIGHTFIELD_H
@@ -0,0 +1,115 @@
+#include "neopch.h"
+
+#include "TerrainTileLoader.h"
+
+Neon::TerrainTileLoader::TerrainTileLoader(const TerrainStreamingSettings& settings)
+	: m_Settings(settings)
+{
+	const uint32_t threadCount = std::max(m_Settings.m_ThreadCount, 1u);
+	m_Workers.reserve(threadCount);
+	for (uint32_t i = 0; i < threadCount; i++)
+	{ m_Workers.emplace_back(&TerrainTileLoader::WorkerLoop, this); }
+}
+
+Neon::TerrainTileLoader::~TerrainTileLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stop = true;
+	}
+	m_RequestCondition.notify_all();
+	for (auto& worker : m_Workers) { worker.join(); }
+}
+
+void Neon::TerrainTileLoader::Request(const glm::ivec2& coordinate)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Requests.push_back(coordinate);
+	}
+	m_RequestCondition.notify_one();
+}
+
+bool Neon::TerrainTileLoader::Cancel(const glm::ivec2& coordinate)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto request = std::find(m_Requests.begin(), m_Requests.end(), coordinate);
+	if (request == m_Requests.end()) { return false; }
+	m_Requests.erase(request);
+	return true;
+}
+
+bool Neon::TerrainTileLoader::Poll(TerrainTileData& tile)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_Finished.empty()) { return false; }
+	tile = std::move(m_Finished.front());
+	m_Finished.pop_front();
+	return true;
+}
+
+void Neon::TerrainTileLoader::WorkerLoop()
+{
+	while (true)
+	{
+		glm::ivec2 coordinate;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_RequestCondition.wait(lock, [&] { return m_Stop || !m_Requests.empty(); });
+			if (m_Stop) { return; }
+			coordinate = m_Requests.front();
+			m_Requests.pop_front();
+		}
+
+		TerrainTileData tile = Load(coordinate);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Finished.push_back(std::move(tile));
+	}
+}
+
+Neon::TerrainTileData Neon::TerrainTileLoader::Load(const glm::ivec2& coordinate) const
+{
+	TerrainTileData tile;
+	tile.m_Coordinate = coordinate;
+	const std::string suffix =
+		"_" + std::to_string(coordinate.x) + "_" + std::to_string(coordinate.y) + ".png";
+
+	int texWidth, texHeight, texChannels;
+	stbi_uc* pixels = stbi_load((m_Settings.m_Directory + "/height" + suffix).c_str(), &texWidth,
+								&texHeight, &texChannels, STBI_rgb_alpha);
+	if (pixels == nullptr) { return tile; }
+	// Tiles of another size would not fit the chunk grid, they are treated as missing
+	const auto resolution = static_cast<int>(m_Settings.m_TileResolution);
+	if (texWidth != resolution || texHeight != resolution)
+	{
+		NEO_CORE_ERROR("Terrain tile {0}, {1} is {2}x{3} texels instead of {4}x{4}", coordinate.x,
+					   coordinate.y, texWidth, texHeight, resolution);
+		stbi_image_free(pixels);
+		return tile;
+	}
+
+	tile.m_Heights.resize(static_cast<size_t>(texWidth) * texHeight);
+	for (size_t i = 0; i < tile.m_Heights.size(); i++)
+	{ tile.m_Heights[i] = GetTerrainTexelHeight(pixels + i * 4); }
+	stbi_image_free(pixels);
+	tile.m_Nodes = CreateDisplacedTerrainNodes(tile.m_Heights, texWidth, texHeight, glm::vec2(0.0f),
+											   glm::vec2(m_Settings.m_TexelSize),
+											   m_Settings.m_MaxHeight);
+
+	// Tiles without a blend map show the background texture only
+	pixels = stbi_load((m_Settings.m_Directory + "/blend" + suffix).c_str(), &texWidth, &texHeight,
+					   &texChannels, STBI_rgb_alpha);
+	if (pixels == nullptr)
+	{
+		tile.m_BlendMap = {0, 0, 0, 255};
+		tile.m_BlendMapWidth = 1;
+		tile.m_BlendMapHeight = 1;
+		return tile;
+	}
+	tile.m_BlendMap.assign(pixels, pixels + static_cast<size_t>(texWidth) * texHeight * 4);
+	tile.m_BlendMapWidth = static_cast<uint32_t>(texWidth);
+	tile.m_BlendMapHeight = static_cast<uint32_t>(texHeight);
+	stbi_image_free(pixels);
+	return tile;
+}
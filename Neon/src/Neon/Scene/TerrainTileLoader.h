@@ -0,0 +1,47 @@
+#ifndef NEON_TERRAINTILELOADER_H
+#define NEON_TERRAINTILELOADER_H
+
+#include "Components.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace Neon
+{
+// Decodes the tiles of a streamed terrain on its own threads, so that reading and decoding files
+// never stalls a frame. Requests are served in order and finished tiles are collected on the main
+// thread, which uploads them.
+class TerrainTileLoader
+{
+public:
+	explicit TerrainTileLoader(const TerrainStreamingSettings& settings);
+	~TerrainTileLoader();
+	TerrainTileLoader(const TerrainTileLoader& other) = delete;
+	TerrainTileLoader(TerrainTileLoader&& other) = delete;
+	TerrainTileLoader& operator=(const TerrainTileLoader& other) = delete;
+	TerrainTileLoader& operator=(TerrainTileLoader&& other) = delete;
+
+	void Request(const glm::ivec2& coordinate);
+	// Drops the request of a tile no thread started yet, returns false when the tile is being
+	// or was already decoded
+	bool Cancel(const glm::ivec2& coordinate);
+	// Moves a finished tile into tile, returns false when none is finished
+	bool Poll(TerrainTileData& tile);
+
+private:
+	void WorkerLoop();
+	[[nodiscard]] TerrainTileData Load(const glm::ivec2& coordinate) const;
+
+private:
+	TerrainStreamingSettings m_Settings;
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_RequestCondition;
+	std::deque<glm::ivec2> m_Requests;
+	std::deque<TerrainTileData> m_Finished;
+	bool m_Stop = false;
+};
+} // namespace Neon
+
+#endif //NEON_TERRAINTILELOADER_H
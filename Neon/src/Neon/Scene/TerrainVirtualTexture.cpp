@@ -0,0 +1,242 @@
+#include "neopch.h"
+
+#include "TerrainVirtualTexture.h"
+#include "VulkanRenderer.h"
+#include <Renderer/Context.h>
+
+#define TERRAIN_CLIPMAP_PAGES_PER_SIDE (TERRAIN_CLIPMAP_RESOLUTION / TERRAIN_CLIPMAP_PAGE_SIZE)
+
+// Heightmap texels covered by one texel of level
+static float GetLevelTexelSize(uint32_t level)
+{
+	return static_cast<float>(1u << level) / TERRAIN_CLIPMAP_TEXEL_DENSITY;
+}
+
+// Slot of page in the toroidally addressed level
+static glm::ivec2 GetPageSlot(const glm::ivec2& page)
+{
+	constexpr int pagesPerSide = TERRAIN_CLIPMAP_PAGES_PER_SIDE;
+	return {(page.x % pagesPerSide + pagesPerSide) % pagesPerSide,
+			(page.y % pagesPerSide + pagesPerSide) % pagesPerSide};
+}
+
+void Neon::TerrainVirtualTexture::Init(const glm::ivec2& heightMapSize, const glm::vec2& origin,
+									   const glm::vec2& texelSize, const TextureImage& blendMap,
+									   const TextureImage& backgroundTexture,
+									   const TextureImage& rTexture, const TextureImage& gTexture,
+									   const TextureImage& bTexture)
+{
+	m_HeightMapSize = heightMapSize;
+	m_Origin = origin;
+	m_TexelSize = texelSize;
+
+	// Levels until the coarsest one holds the heightmap with a page of margin on every side
+	const auto mapSize = static_cast<float>(std::max(heightMapSize.x, heightMapSize.y));
+	uint32_t levelCount = 1;
+	while (levelCount < TERRAIN_CLIPMAP_MAX_LEVELS &&
+		   (TERRAIN_CLIPMAP_RESOLUTION - 2 * TERRAIN_CLIPMAP_PAGE_SIZE) *
+				   GetLevelTexelSize(levelCount - 1) <
+			   mapSize)
+	{ levelCount++; }
+	m_Levels.resize(levelCount);
+	for (auto& level : m_Levels)
+	{
+		level.m_SlotPages.assign(TERRAIN_CLIPMAP_PAGES_PER_SIDE * TERRAIN_CLIPMAP_PAGES_PER_SIDE,
+								 glm::ivec2(INT32_MIN));
+	}
+
+	const auto& device = Neon::Context::GetInstance().GetLogicalDevice().GetHandle();
+	m_Image = Allocator::CreateImage(
+		TERRAIN_CLIPMAP_RESOLUTION, TERRAIN_CLIPMAP_RESOLUTION, vk::SampleCountFlagBits::e1,
+		vk::Format::eR8G8B8A8Unorm, vk::ImageTiling::eOptimal,
+		vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+		VMA_MEMORY_USAGE_GPU_ONLY, 1, levelCount);
+	Allocator::TransitionImageLayout(m_Image->m_Image, vk::ImageAspectFlagBits::eColor,
+									 vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, 1,
+									 levelCount);
+	vk::ImageViewCreateInfo viewInfo{{},
+									 m_Image->m_Image,
+									 vk::ImageViewType::e2DArray,
+									 vk::Format::eR8G8B8A8Unorm,
+									 {},
+									 {vk::ImageAspectFlagBits::eColor, 0, 1, 0, levelCount}};
+	m_ImageView = device.createImageViewUnique(viewInfo);
+
+	// Repeating addresses wrap filtering around the toroidal levels
+	vk::SamplerCreateInfo samplerInfo{};
+	samplerInfo.magFilter = vk::Filter::eLinear;
+	samplerInfo.minFilter = vk::Filter::eLinear;
+	samplerInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+	samplerInfo.addressModeU = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeV = vk::SamplerAddressMode::eRepeat;
+	samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+	m_Sampler = device.createSamplerUnique(samplerInfo);
+	m_Descriptor = {m_Sampler.get(), m_ImageView.get(), vk::ImageLayout::eGeneral};
+
+	std::vector<vk::DescriptorSetLayoutBinding> bindings;
+	for (uint32_t binding = 0; binding < 5; binding++)
+	{
+		bindings.emplace_back(binding, vk::DescriptorType::eCombinedImageSampler, 1,
+							  vk::ShaderStageFlagBits::eCompute);
+	}
+	bindings.emplace_back(5, vk::DescriptorType::eStorageImage, 1,
+						  vk::ShaderStageFlagBits::eCompute);
+	m_BakeDescriptorSet.Init(device);
+	m_BakeDescriptorSet.Create(VulkanRenderer::GetDescriptorPool(), bindings);
+	vk::DescriptorImageInfo clipmapInfo{nullptr, m_ImageView.get(), vk::ImageLayout::eGeneral};
+	std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+		m_BakeDescriptorSet.CreateWrite(0, &blendMap.m_Descriptor, 0),
+		m_BakeDescriptorSet.CreateWrite(1, &backgroundTexture.m_Descriptor, 0),
+		m_BakeDescriptorSet.CreateWrite(2, &rTexture.m_Descriptor, 0),
+		m_BakeDescriptorSet.CreateWrite(3, &gTexture.m_Descriptor, 0),
+		m_BakeDescriptorSet.CreateWrite(4, &bTexture.m_Descriptor, 0),
+		m_BakeDescriptorSet.CreateWrite(5, &clipmapInfo, 0)};
+	m_BakeDescriptorSet.Update(descriptorWrites);
+
+	m_BakePipeline.Init(device);
+	m_BakePipeline.LoadComputeShader("src/Shaders/build/comp_terrain_bake.spv");
+	vk::PushConstantRange pushConstantRange{vk::ShaderStageFlagBits::eCompute, 0,
+											sizeof(BakePushConstant)};
+	m_BakePipeline.CreatePipelineLayout({m_BakeDescriptorSet.GetLayout()}, {pushConstantRange});
+	m_BakePipeline.CreatePipeline();
+
+	m_ParametersBuffers.resize(MAX_SWAP_CHAIN_IMAGES);
+	for (auto& parametersBuffer : m_ParametersBuffers)
+	{
+		parametersBuffer =
+			Allocator::CreateMappedBuffer(sizeof(TerrainClipmapParameters),
+										  vk::BufferUsageFlagBits::eStorageBuffer,
+										  VMA_MEMORY_USAGE_CPU_TO_GPU);
+	}
+
+	// Every level starts out baked around the center of the terrain
+	const glm::vec2 center = origin + glm::vec2(heightMapSize - 1) * texelSize * 0.5f;
+	auto commandBuffer = VulkanRenderer::BeginSingleTimeCommands();
+	Update(commandBuffer, 0, center, UINT32_MAX);
+	VulkanRenderer::EndSingleTimeCommands(commandBuffer);
+	for (uint32_t i = 0; i < MAX_SWAP_CHAIN_IMAGES; i++) { WriteParameters(i); }
+}
+
+glm::ivec2 Neon::TerrainVirtualTexture::GetTargetPage(uint32_t level,
+													  const glm::vec2& cameraTexel) const
+{
+	constexpr int pagesPerSide = TERRAIN_CLIPMAP_PAGES_PER_SIDE;
+	const float pageSize = GetLevelTexelSize(level) * TERRAIN_CLIPMAP_PAGE_SIZE;
+	glm::ivec2 target = glm::ivec2(glm::floor(cameraTexel / pageSize + 0.5f)) - pagesPerSide / 2;
+	// Regions reach at most a page past the heightmap, or center it when it is smaller
+	const glm::ivec2 mapPages(glm::ceil(glm::vec2(m_HeightMapSize) / pageSize));
+	for (int axis = 0; axis < 2; axis++)
+	{
+		const int highest = mapPages[axis] + 1 - pagesPerSide;
+		if (highest >= -1) { target[axis] = std::clamp(target[axis], -1, highest); }
+		else
+		{
+			target[axis] = (mapPages[axis] - pagesPerSide) / 2;
+		}
+	}
+	return target;
+}
+
+void Neon::TerrainVirtualTexture::Update(vk::CommandBuffer commandBuffer, uint32_t imageIndex,
+										 const glm::vec2& cameraPosition, uint32_t pageBudget)
+{
+	constexpr int pagesPerSide = TERRAIN_CLIPMAP_PAGES_PER_SIDE;
+	const glm::vec2 cameraTexel = (cameraPosition - m_Origin) / m_TexelSize;
+	bool baking = false;
+	std::vector<std::pair<float, glm::ivec2>> missingPages;
+	for (auto levelIndex = static_cast<uint32_t>(m_Levels.size()); levelIndex-- > 0;)
+	{
+		auto& level = m_Levels[levelIndex];
+		level.m_Target = GetTargetPage(levelIndex, cameraTexel);
+		// Pages of the new region replace the ones outside of it, so only the part of the
+		// previous valid region that remains in the region stays valid until it is baked
+		const glm::ivec2 targetEnd = level.m_Target + pagesPerSide;
+		level.m_ValidMin = glm::max(level.m_ValidMin, level.m_Target);
+		level.m_ValidMax = glm::max(glm::min(level.m_ValidMax, targetEnd), level.m_ValidMin);
+
+		// Pages closest to the camera first
+		const float pageSize = GetLevelTexelSize(levelIndex) * TERRAIN_CLIPMAP_PAGE_SIZE;
+		const glm::vec2 cameraPage = cameraTexel / pageSize - 0.5f;
+		missingPages.clear();
+		for (int y = level.m_Target.y; y < targetEnd.y; y++)
+		{
+			for (int x = level.m_Target.x; x < targetEnd.x; x++)
+			{
+				const glm::ivec2 page = {x, y};
+				const glm::ivec2 slot = GetPageSlot(page);
+				if (level.m_SlotPages[slot.y * pagesPerSide + slot.x] == page) { continue; }
+				const glm::vec2 offset = glm::vec2(page) - cameraPage;
+				missingPages.emplace_back(glm::dot(offset, offset), page);
+			}
+		}
+		std::sort(missingPages.begin(), missingPages.end(),
+				  [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		const auto bakeCount =
+			static_cast<uint32_t>(std::min<size_t>(missingPages.size(), pageBudget));
+		if (bakeCount > 0 && !baking)
+		{
+			// Earlier frames must be done sampling the slots that are overwritten
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader,
+										  vk::PipelineStageFlagBits::eComputeShader, {}, nullptr,
+										  nullptr, nullptr);
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute,
+									   static_cast<vk::Pipeline>(m_BakePipeline));
+			const vk::DescriptorSet descriptorSet = m_BakeDescriptorSet.Get();
+			commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+											 m_BakePipeline.GetLayout(), 0, 1, &descriptorSet, 0,
+											 nullptr);
+			baking = true;
+		}
+		for (uint32_t i = 0; i < bakeCount; i++)
+		{
+			const glm::ivec2& page = missingPages[i].second;
+			const glm::ivec2 slot = GetPageSlot(page);
+			BakePushConstant pushConstant{page * TERRAIN_CLIPMAP_PAGE_SIZE,
+										  slot * TERRAIN_CLIPMAP_PAGE_SIZE,
+										  glm::vec2(m_HeightMapSize),
+										  GetLevelTexelSize(levelIndex),
+										  static_cast<int32_t>(levelIndex)};
+			commandBuffer.pushConstants(m_BakePipeline.GetLayout(),
+										vk::ShaderStageFlagBits::eCompute, 0,
+										sizeof(BakePushConstant), &pushConstant);
+			constexpr uint32_t groupCount =
+				TERRAIN_CLIPMAP_PAGE_SIZE / TERRAIN_CLIPMAP_WORKGROUP_SIZE;
+			commandBuffer.dispatch(groupCount, groupCount, 1);
+			level.m_SlotPages[slot.y * pagesPerSide + slot.x] = page;
+		}
+		pageBudget -= bakeCount;
+		if (bakeCount == missingPages.size())
+		{
+			level.m_ValidMin = level.m_Target;
+			level.m_ValidMax = targetEnd;
+		}
+	}
+
+	if (baking)
+	{
+		vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite,
+								  vk::AccessFlagBits::eShaderRead};
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+									  vk::PipelineStageFlagBits::eFragmentShader, {}, barrier,
+									  nullptr, nullptr);
+	}
+	WriteParameters(imageIndex);
+}
+
+void Neon::TerrainVirtualTexture::WriteParameters(uint32_t imageIndex) const
+{
+	TerrainClipmapParameters parameters{};
+	parameters.m_HeightMapSize = glm::vec2(m_HeightMapSize);
+	parameters.m_TexelDensity = TERRAIN_CLIPMAP_TEXEL_DENSITY;
+	parameters.m_LevelCount = static_cast<int32_t>(m_Levels.size());
+	for (size_t i = 0; i < m_Levels.size(); i++)
+	{
+		// Shrunk by a texel, so that filtering stays within the baked pages
+		const auto& level = m_Levels[i];
+		if (glm::any(glm::greaterThanEqual(level.m_ValidMin, level.m_ValidMax))) { continue; }
+		parameters.m_Levels[i] = {level.m_ValidMin * TERRAIN_CLIPMAP_PAGE_SIZE + 1,
+								  level.m_ValidMax * TERRAIN_CLIPMAP_PAGE_SIZE - 1};
+	}
+	memcpy(m_ParametersBuffers[imageIndex]->m_MappedData, &parameters, sizeof(parameters));
+}
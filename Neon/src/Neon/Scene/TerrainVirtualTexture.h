@@ -0,0 +1,113 @@
+#ifndef NEON_TERRAINVIRTUALTEXTURE_H
+#define NEON_TERRAINVIRTUALTEXTURE_H
+
+#include "Allocator.h"
+#include "ComputePipeline.h"
+#include "DescriptorSet.h"
+#include <glm/glm.hpp>
+
+// Texels per side of every clipmap level, a multiple of TERRAIN_CLIPMAP_PAGE_SIZE
+#define TERRAIN_CLIPMAP_RESOLUTION 1024
+// Texels per side of a page, the unit in which levels are baked
+#define TERRAIN_CLIPMAP_PAGE_SIZE 128
+#define TERRAIN_CLIPMAP_MAX_LEVELS 8
+// Clipmap texels per heightmap texel at the finest level
+#define TERRAIN_CLIPMAP_TEXEL_DENSITY 16
+// Pages baked per frame once the initial clipmap is baked
+#define TERRAIN_CLIPMAP_PAGES_PER_FRAME 8
+#define TERRAIN_CLIPMAP_WORKGROUP_SIZE 8
+
+namespace Neon
+{
+// Region of a level whose pages are baked, in texels of the level, read by the terrain fragment
+// shader with scalar layout
+struct TerrainClipmapLevel
+{
+	glm::ivec2 m_ValidMin;
+	glm::ivec2 m_ValidMax;
+};
+
+struct TerrainClipmapParameters
+{
+	glm::vec2 m_HeightMapSize;
+	float m_TexelDensity;
+	int32_t m_LevelCount;
+	TerrainClipmapLevel m_Levels[TERRAIN_CLIPMAP_MAX_LEVELS];
+};
+
+// Blend of the ground textures of a terrain baked by compute into a clipmap around the camera,
+// so that terrain fragments take a single lookup. Level l holds TERRAIN_CLIPMAP_RESOLUTION texels
+// per side, each covering 2^l / TERRAIN_CLIPMAP_TEXEL_DENSITY heightmap texels, and is addressed
+// toroidally: the page of level texel t lives at t mod TERRAIN_CLIPMAP_RESOLUTION, so pages that
+// enter the region as the camera moves replace the ones leaving it on the other side. The
+// coarsest level covers the whole heightmap and is always valid.
+class TerrainVirtualTexture
+{
+public:
+	TerrainVirtualTexture() = default;
+
+	// Terrain textures must outlive the clipmap. heightMapSize texels, the first at origin and
+	// texelSize apart in the object space of the terrain.
+	void Init(const glm::ivec2& heightMapSize, const glm::vec2& origin, const glm::vec2& texelSize,
+			  const TextureImage& blendMap, const TextureImage& backgroundTexture,
+			  const TextureImage& rTexture, const TextureImage& gTexture,
+			  const TextureImage& bTexture);
+
+	// Records the bake of at most pageBudget missing pages around cameraPosition, the x and z of
+	// the camera in the object space of the terrain, coarse levels first, and publishes the
+	// valid regions to the parameters buffer of imageIndex
+	void Update(vk::CommandBuffer commandBuffer, uint32_t imageIndex,
+				const glm::vec2& cameraPosition, uint32_t pageBudget);
+
+	[[nodiscard]] const vk::DescriptorImageInfo& GetDescriptor() const
+	{
+		return m_Descriptor;
+	}
+	[[nodiscard]] vk::DescriptorBufferInfo GetParametersDescriptor(uint32_t imageIndex) const
+	{
+		return {m_ParametersBuffers[imageIndex]->m_Buffer, 0, VK_WHOLE_SIZE};
+	}
+
+private:
+	struct BakePushConstant
+	{
+		glm::ivec2 pageOrigin;
+		glm::ivec2 slotOrigin;
+		glm::vec2 heightMapSize;
+		float texelSize;
+		int32_t level;
+	};
+
+	struct Level
+	{
+		// First page of the region around the camera, in pages of the level
+		glm::ivec2 m_Target{0};
+		// Baked pages of the region, maximum exclusive
+		glm::ivec2 m_ValidMin{0};
+		glm::ivec2 m_ValidMax{0};
+		// Page held by every slot
+		std::vector<glm::ivec2> m_SlotPages;
+	};
+
+	// First page of the region of level centered on cameraTexel and kept on the heightmap
+	[[nodiscard]] glm::ivec2 GetTargetPage(uint32_t level, const glm::vec2& cameraTexel) const;
+	void WriteParameters(uint32_t imageIndex) const;
+
+private:
+	glm::ivec2 m_HeightMapSize{0};
+	glm::vec2 m_Origin{0.0f};
+	glm::vec2 m_TexelSize{1.0f};
+	std::vector<Level> m_Levels;
+
+	ComputePipeline m_BakePipeline;
+	DescriptorSet m_BakeDescriptorSet;
+	std::unique_ptr<ImageAllocation> m_Image;
+	vk::UniqueImageView m_ImageView;
+	vk::UniqueSampler m_Sampler;
+	vk::DescriptorImageInfo m_Descriptor;
+	// Valid regions seen by the frames of every swap chain image
+	std::vector<std::unique_ptr<BufferAllocation>> m_ParametersBuffers;
+};
+} // namespace Neon
+
+#endif //NEON_TERRAINVIRTUALTEXTURE_H
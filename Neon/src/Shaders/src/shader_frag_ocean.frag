@@ -0,0 +1,64 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+
+#include "scene_view.glsl"
+#include "ocean.glsl"
+#include "sky.glsl"
+
+layout(location = 0) in vec3 fragWorldPos;
+layout(location = 1) in vec2 fragSurfacePos;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform sampler2DArray displacementMap;
+layout(set = 0, binding = 1) uniform sampler2DArray derivativesMap;
+layout(set = 0, binding = 2, scalar) readonly buffer OceanParametersBuffer
+{
+    OceanParameters ocean;
+};
+
+const vec3 WATER_COLOR = vec3(0.0, 0.1, 0.18);
+const vec3 FOAM_COLOR = vec3(0.85, 0.9, 0.9);
+// Reflectance of water seen head on
+const float WATER_REFLECTANCE = 0.02;
+const float SPECULAR_POWER = 512.0;
+
+void main()
+{
+    vec4 derivatives = vec4(0.0);
+    // Compression of the surface summed over the cascades, positive where crests fold over
+    float compression = 0.0;
+    for (int cascade = 0; cascade < OCEAN_CASCADE_COUNT; cascade++)
+    {
+        vec3 coords = vec3(fragSurfacePos / ocean.patchSizes[cascade], cascade);
+        derivatives += texture(derivativesMap, coords);
+        compression += 1.0 - texture(displacementMap, coords).w;
+    }
+    // Slopes of the displaced surface, whose horizontal displacement stretches the height
+    vec2 slope = derivatives.xy / max(vec2(1.0) + derivatives.zw, vec2(0.1));
+    vec3 normal = normalize(vec3(-slope.x, 1.0, -slope.y));
+
+    vec3 lightDir = normalize(-pushConstant.lightDirection);
+    float lightIntensity = pushConstant.lightIntensity;
+    if (pushConstant.pointLight == 1)
+    {
+        lightDir = pushConstant.lightPosition - fragWorldPos;
+        lightIntensity /= length(lightDir);
+        lightDir = normalize(lightDir);
+    }
+    vec3 viewDir = normalize(GetViewCameraPosition() - fragWorldPos);
+
+    float cosine = max(dot(normal, viewDir), 0.0);
+    float fresnel = WATER_REFLECTANCE + (1.0 - WATER_REFLECTANCE) * pow(1.0 - cosine, 5.0);
+    vec3 reflection = SkyColorAlong(pushConstant.skyDome, fragWorldPos, reflect(-viewDir, normal));
+    float diffuse = max(dot(normal, lightDir), 0.0) * 0.5 + 0.5;
+    vec3 color = mix(WATER_COLOR * diffuse * lightIntensity, reflection, fresnel);
+    float specular = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), SPECULAR_POWER);
+    color += specular * lightIntensity;
+
+    float foam = smoothstep(0.4, 1.0, compression);
+    color = mix(color, FOAM_COLOR * diffuse * lightIntensity, foam);
+    outColor = vec4(color, 1.0);
+}
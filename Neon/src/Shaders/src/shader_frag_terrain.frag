@@ -5,6 +5,7 @@
 #extension GL_GOOGLE_include_directive : enable
 #extension GL_EXT_scalar_block_layout : enable
 
+#include "scene_view.glsl"
 #include "material.glsl"
 
 layout(location = 0) in vec3 fragColor;
@@ -20,35 +21,67 @@ layout(set = 0, binding = 0, scalar) readonly buffer MaterialBufferObject
     Material material;
 };
 
-layout(set = 0, binding = 1) uniform sampler2D blendMap;
-layout(set = 0, binding = 2) uniform sampler2D backgroundTexture;
-layout(set = 0, binding = 2) uniform sampler2D rTexture;
-layout(set = 0, binding = 3) uniform sampler2D gTexture;
-layout(set = 0, binding = 4) uniform sampler2D bTexture;
+#ifdef VIRTUAL_TEXTURE
+#define CLIPMAP_RESOLUTION 1024
+#define CLIPMAP_MAX_LEVELS 8
 
-layout(push_constant, scalar) uniform PushConstant
+struct ClipmapLevel
 {
-    vec3 cameraPos;
-    mat4 view;
-    mat4 projection;
-
-    vec4 clippingPlane;
+    ivec2 validMin;
+    ivec2 validMax;
+};
 
-    mat4 model;
+layout(set = 0, binding = 9) uniform sampler2DArray clipmap;
+layout(set = 0, binding = 10, scalar) readonly buffer ClipmapParameters
+{
+    vec2 heightMapSize;
+    float texelDensity;
+    int levelCount;
+    ClipmapLevel levels[CLIPMAP_MAX_LEVELS];
+}
+clipmapParameters;
+#else
+layout(set = 0, binding = 1) uniform sampler2D blendMap;
+layout(set = 0, binding = 2) uniform sampler2D backgroundTexture;
+layout(set = 0, binding = 3) uniform sampler2D rTexture;
+layout(set = 0, binding = 4) uniform sampler2D gTexture;
+layout(set = 0, binding = 5) uniform sampler2D bTexture;
+#endif
 
-    int pointLight;
-    float lightIntensity;
-    vec3 lightDirection;
-    vec3 lightPosition;
+#ifdef VIRTUAL_TEXTURE
+// Baked ground color from the finest clipmap level that is not minified and whose baked region
+// holds the fragment, the coarsest level holds the whole terrain
+vec4 sampleClipmap()
+{
+    vec2 texel = fragMapTexCoord * clipmapParameters.heightMapSize * clipmapParameters.texelDensity;
+    float footprint = max(length(dFdx(texel)), length(dFdy(texel)));
+    int level = clamp(int(log2(max(footprint, 1.0))), 0, clipmapParameters.levelCount - 1);
+    for (; level < clipmapParameters.levelCount - 1; level++)
+    {
+        vec2 levelTexel = texel / float(1 << level);
+        ClipmapLevel clipmapLevel = clipmapParameters.levels[level];
+        if (all(greaterThanEqual(levelTexel, vec2(clipmapLevel.validMin))) &&
+            all(lessThan(levelTexel, vec2(clipmapLevel.validMax))))
+        {
+            break;
+        }
+    }
+    vec2 levelTexel = texel / float(1 << level);
+    vec4 color = textureLod(clipmap, vec3(levelTexel / CLIPMAP_RESOLUTION, level), 0.0);
+    return vec4(pow(color.rgb, vec3(2.2)), color.a);
 }
-pushConstant;
+#endif
 
 void main()
 {
+#ifdef VIRTUAL_TEXTURE
+    vec4 finalTextureColor = sampleClipmap();
+#else
     vec3 blendColor = texture(blendMap, fragMapTexCoord).rgb;
     float background = 1.0 - (blendColor.r + blendColor.g + blendColor.b);
     vec4 finalTextureColor = background * texture(backgroundTexture, fragTileTexCoord) + blendColor.r * texture(rTexture, fragTileTexCoord) +
     blendColor.g * texture(gTexture, fragTileTexCoord) + blendColor.b * texture(bTexture, fragTileTexCoord);
+#endif
 
     vec3 lightDir = normalize(-pushConstant.lightDirection);
     float lightIntensity = pushConstant.lightIntensity;
@@ -61,7 +94,7 @@ void main()
 
     vec3 diffuse = computeDiffuse(material, lightDir, fragNorm) * finalTextureColor.rgb;
 
-    vec3 viewDir = normalize(pushConstant.cameraPos - fragWorldPos);
+    vec3 viewDir = normalize(GetViewCameraPosition() - fragWorldPos);
     vec3 specular = computeSpecular(material, viewDir, lightDir, fragNorm);
 
     float gamma = 1. / 2.2;
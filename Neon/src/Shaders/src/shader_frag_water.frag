@@ -7,8 +7,7 @@
 
 layout(location = 0) in vec3 fragWorldPos;
 layout(location = 1) in vec3 fragNorm;
-layout(location = 2) in vec4 fragClipSpace;
-layout(location = 3) in vec2 fragTextureCoords;
+layout(location = 2) in vec2 fragTextureCoords;
 
 layout(location = 0) out vec4 outColor;
 
@@ -16,11 +15,26 @@ layout(set = 0, binding = 0, scalar) readonly buffer MaterialBufferObject
 {
     Material material;
 };
+#ifdef SCREEN_SPACE_REFLECTION
+// Opaque main pass of the current frame and its depth pyramid, farthest depth in r and closest
+// in g with level 0 at half resolution. Binding 2 is left unused.
+layout(set = 0, binding = 1) uniform sampler2D sceneColor;
+layout(set = 0, binding = 5) uniform sampler2D hiZ;
+#else
 layout(set = 0, binding = 1) uniform sampler2D textureSamplerRefraction;
 layout(set = 0, binding = 2) uniform sampler2D textureSamplerReflection;
+layout(set = 0, binding = 5) uniform sampler2D depthMap;
+#endif
 layout(set = 0, binding = 3) uniform sampler2D dudvMap;
 layout(set = 0, binding = 4) uniform sampler2D normalMap;
-layout(set = 0, binding = 5) uniform sampler2D depthMap;
+// Cameras the refraction and reflection maps were last rendered with, which may be a few frames
+// behind the current one. Screen space reflection uses the current camera for both.
+layout(set = 0, binding = 6, scalar) readonly buffer WaterCapture
+{
+    mat4 refractionViewProjection;
+    mat4 reflectionViewProjection;
+}
+capture;
 
 layout(push_constant, scalar) uniform PushConstant
 {
@@ -30,19 +44,141 @@ layout(push_constant, scalar) uniform PushConstant
 
     vec4 clippingPlane;
 
-    mat4 model;
-
     int pointLight;
     float lightIntensity;
     vec3 lightDirection;
     vec3 lightPosition;
 
     float moveFactor;
+    float mirrorHeight;
+    vec4 skyDome;
 }
 pushConstant;
 
 float waveStrength = 0.15;
 
+// Coordinates of the fragment in a map rendered with viewProjection
+vec2 projectToMap(mat4 viewProjection)
+{
+    vec4 clipSpace = viewProjection * vec4(fragWorldPos, 1.0);
+    return clipSpace.xy / clipSpace.w / 2 + 0.5;
+}
+
+#ifdef SCREEN_SPACE_REFLECTION
+#include "sky.glsl"
+
+const float SSR_NEAR = 0.1;
+const float SSR_FAR = 10000.0;
+// World distance the reflected ray is traced for
+const float SSR_MAX_DISTANCE = 2000.0;
+const int SSR_MAX_STEPS = 64;
+// Depth in world units behind a surface below which the ray counts as hitting it, deeper rays
+// pass behind it
+const float SSR_THICKNESS = 2.0;
+
+float linearDepth(float depth)
+{
+    return SSR_NEAR * SSR_FAR / (SSR_FAR - depth * (SSR_FAR - SSR_NEAR));
+}
+
+vec3 projectToScreen(vec4 clipSpace)
+{
+    return vec3(clipSpace.xy / clipSpace.w * 0.5 + 0.5, clipSpace.z / clipSpace.w);
+}
+
+// Marches the reflected ray in screen space, as (uv, depth), through the closest depths of the
+// depth pyramid. Cells the ray stays in front of are crossed whole and the next one is tested on
+// a coarser level, a cell the ray goes behind is refined until level 0 tells the surface hit.
+// Returns the fraction of the traced distance at the hit, or -1 when the ray leaves the screen,
+// passes behind everything or runs out of steps.
+float traceScreenSpace(vec3 origin, vec3 direction, out vec2 hitCoords)
+{
+    mat4 viewProjection = capture.refractionViewProjection;
+    vec4 clipStart = viewProjection * vec4(origin, 1.0);
+    vec4 clipDirection = viewProjection * vec4(direction, 0.0);
+    // Rays toward the camera end in front of the near plane
+    float rayLength = SSR_MAX_DISTANCE;
+    if (clipDirection.w < 0.0)
+    {
+        rayLength = min(rayLength, (clipStart.w - 2.0 * SSR_NEAR) / -clipDirection.w);
+    }
+    vec3 start = projectToScreen(clipStart);
+    vec3 ray = projectToScreen(clipStart + clipDirection * rayLength) - start;
+    vec2 safeRay = vec2(abs(ray.x) < 1e-6 ? 1e-6 : ray.x, abs(ray.y) < 1e-6 ? 1e-6 : ray.y);
+
+    int levelCount = textureQueryLevels(hiZ);
+    int level = 0;
+    float t = 0.0;
+    for (int i = 0; i < SSR_MAX_STEPS; i++)
+    {
+        vec3 position = start + ray * t;
+        if (t > 1.0 || any(lessThan(position.xy, vec2(0.0))) ||
+            any(greaterThan(position.xy, vec2(1.0))))
+        {
+            return -1.0;
+        }
+
+        vec2 cellCount = vec2(textureSize(hiZ, level));
+        vec2 cell = min(floor(position.xy * cellCount), cellCount - 1.0);
+        float closest = texelFetch(hiZ, ivec2(cell), level).g;
+        // Where the ray leaves the cell, nudged into the next one, and where it goes behind the
+        // closest depth of the cell
+        vec2 boundary = (cell + step(0.0, ray.xy) + sign(ray.xy) * 0.001) / cellCount;
+        vec2 exits = (boundary - start.xy) / safeRay;
+        float exitT = min(exits.x, exits.y);
+        float behindT = 2.0;
+        if (position.z >= closest)
+        {
+            behindT = t;
+        }
+        else if (ray.z > 0.0)
+        {
+            behindT = (closest - start.z) / ray.z;
+        }
+
+        if (behindT >= exitT)
+        {
+            t = exitT;
+            level = min(level + 1, levelCount - 1);
+        }
+        else if (level > 0)
+        {
+            t = max(t, behindT);
+            level--;
+        }
+        else
+        {
+            vec3 hit = start + ray * max(t, behindT);
+            if (linearDepth(hit.z) - linearDepth(closest) < SSR_THICKNESS)
+            {
+                hitCoords = hit.xy;
+                return max(t, behindT);
+            }
+            t = exitT;
+        }
+    }
+    return -1.0;
+}
+
+// Opaque scene along the reflected ray, faded into the sky toward the screen edges and the end
+// of the ray where the screen runs out of information
+vec3 traceReflection(vec3 viewDir, vec3 normal)
+{
+    vec3 direction = reflect(-viewDir, normal);
+    vec3 sky = SkyColorAlong(pushConstant.skyDome, fragWorldPos, direction);
+    vec2 hitCoords;
+    float hitT = traceScreenSpace(fragWorldPos, direction, hitCoords);
+    if (hitT < 0.0)
+    {
+        return sky;
+    }
+    vec2 edge = abs(hitCoords * 2.0 - 1.0);
+    float fade = (1.0 - smoothstep(0.8, 1.0, max(edge.x, edge.y))) *
+                 (1.0 - smoothstep(0.7, 1.0, hitT));
+    return mix(sky, texture(sceneColor, hitCoords).rgb, fade);
+}
+#endif
+
 void main()
 {
     vec3 lightDir = normalize(-pushConstant.lightDirection);
@@ -58,11 +194,14 @@ void main()
 
     float near = 0.1;
     float far = 10000.0;
-    vec2 textureCoords = fragClipSpace.xy / fragClipSpace.w;
-    textureCoords = textureCoords / 2 + 0.5;
-    vec2 refractTextureCoords = vec2(textureCoords.x, textureCoords.y);
-    vec2 reflectTextureCoords = vec2(textureCoords.x, -textureCoords.y);
+#ifdef SCREEN_SPACE_REFLECTION
+    vec2 refractTextureCoords = gl_FragCoord.xy / vec2(textureSize(sceneColor, 0));
+    float depth = texelFetch(hiZ, ivec2(refractTextureCoords * vec2(textureSize(hiZ, 0))), 0).g;
+#else
+    vec2 refractTextureCoords = projectToMap(capture.refractionViewProjection);
+    vec2 reflectTextureCoords = projectToMap(capture.reflectionViewProjection);
     float depth = texture(depthMap, refractTextureCoords).r;
+#endif
     float floorDist = 2.0 * near * far / (far + near - depth * (far - near));
     depth = gl_FragCoord.z;
     float waterDist = 2.0 * near * far / (far + near - depth * (far - near));
@@ -75,15 +214,23 @@ void main()
     refractTextureCoords += distortion;
     refractTextureCoords = clamp(refractTextureCoords, 0.001, 0.999);
 
+#ifndef SCREEN_SPACE_REFLECTION
     reflectTextureCoords += distortion;
-    reflectTextureCoords.x = clamp(reflectTextureCoords.x, 0.001, 0.999);
-    reflectTextureCoords.y = clamp(reflectTextureCoords.y, -0.999, -0.001);
+    reflectTextureCoords = clamp(reflectTextureCoords, 0.001, 0.999);
+#endif
 
     vec4 normalMapColor = texture(normalMap, distortedTexCoords);
     vec3 normal = normalize(vec3(normalMapColor.r * 2.0 - 1.0, normalMapColor.b * 3, normalMapColor.g * 2.0 - 1.0));
 
     float refractiveFactor = pow(abs(dot(viewDir, normal)), 0.5);
-    vec4 textureValue = mix(texture(textureSamplerReflection, reflectTextureCoords), texture(textureSamplerRefraction, refractTextureCoords), refractiveFactor);
+#ifdef SCREEN_SPACE_REFLECTION
+    vec4 reflection = vec4(traceReflection(viewDir, normal), 1.0);
+    vec4 refraction = texture(sceneColor, refractTextureCoords);
+#else
+    vec4 reflection = texture(textureSamplerReflection, reflectTextureCoords);
+    vec4 refraction = texture(textureSamplerRefraction, refractTextureCoords);
+#endif
+    vec4 textureValue = mix(reflection, refraction, refractiveFactor);
 
     vec3 specular = computeSpecular(material, viewDir, lightDir, normal) * clamp(waterDepth / 5.0, 0.0, 1.0);
 
@@ -0,0 +1,102 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+
+#include "scene_view.glsl"
+#include "material.glsl"
+
+#define MAX_BONES_PER_VERTEX 10
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec3 color;
+layout(location = 3) in vec2 texCoord;
+layout(location = 4) in int matID;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNorm;
+layout(location = 2) out vec3 fragWorldPos;
+layout(location = 3) out vec2 fragTexCoord;
+layout(location = 4) flat out int fragMatID;
+layout(location = 5) out vec4 clipSpace;
+
+struct Vertex
+{
+    vec3 pos;
+    vec3 norm;
+    vec3 color;
+    vec2 texCoord;
+    int matID;
+    uint boneIDs[MAX_BONES_PER_VERTEX];
+    float boneWeights[MAX_BONES_PER_VERTEX];
+};
+
+layout(set = 0, binding = 2, scalar) readonly buffer BindPoseBuffer
+{
+    Vertex vertices[];
+};
+
+// One row per frame, three texels per bone holding the rows of its affine skinning matrix. The
+// frames of the clips follow each other.
+layout(set = 0, binding = 3) uniform sampler2D animationTexture;
+
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
+{
+    mat4 instanceTransforms[];
+};
+
+mat4 LoadBoneTransform(uint boneID, int frame)
+{
+    int column = int(boneID) * 3;
+    vec4 row0 = texelFetch(animationTexture, ivec2(column, frame), 0);
+    vec4 row1 = texelFetch(animationTexture, ivec2(column + 1, frame), 0);
+    vec4 row2 = texelFetch(animationTexture, ivec2(column + 2, frame), 0);
+    return mat4(vec4(row0.x, row1.x, row2.x, 0.0),
+                vec4(row0.y, row1.y, row2.y, 0.0),
+                vec4(row0.z, row1.z, row2.z, 0.0),
+                vec4(row0.w, row1.w, row2.w, 1.0));
+}
+
+void main()
+{
+    // The unused fourth row of the model matrix carries the frame of the instance within its
+    // clip, the first frame of the clip and its frame count
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    float frame = model[0][3];
+    int firstFrame = int(model[1][3]);
+    int frameCount = max(int(model[2][3]), 1);
+    model[0][3] = 0.0;
+    model[1][3] = 0.0;
+    model[2][3] = 0.0;
+
+    int frame0 = firstFrame + int(frame) % frameCount;
+    int frame1 = firstFrame + (int(frame) + 1) % frameCount;
+    float factor = fract(frame);
+
+    Vertex vertex = vertices[gl_VertexIndex];
+    mat4 boneTransform = mat4(0.0);
+    for (int i = 0; i < MAX_BONES_PER_VERTEX; i++)
+    {
+        if (vertex.boneWeights[i] > 0.0)
+        {
+            uint boneID = vertex.boneIDs[i];
+            mat4 bone = LoadBoneTransform(boneID, frame0) * (1.0 - factor) +
+                        LoadBoneTransform(boneID, frame1) * factor;
+            boneTransform += bone * vertex.boneWeights[i];
+        }
+    }
+
+    fragColor = color;
+    fragNorm = normalize((model * boneTransform * vec4(norm, 0)).xyz);
+    vec4 worldPos = model * boneTransform * vec4(pos, 1);
+    fragWorldPos = worldPos.xyz;
+    fragTexCoord = texCoord;
+    fragMatID = matID;
+
+    clipSpace = GetViewClipPosition(worldPos);
+
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
+
+    gl_Position = GetViewClipPosition(worldPos);
+}
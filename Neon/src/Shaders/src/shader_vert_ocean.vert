@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+
+#include "scene_view.glsl"
+#include "ocean.glsl"
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+
+layout(location = 0) out vec3 fragWorldPos;
+// Position on the surface before displacement, where the cascades are looked up
+layout(location = 1) out vec2 fragSurfacePos;
+
+layout(set = 0, binding = 0) uniform sampler2DArray displacementMap;
+layout(set = 0, binding = 2, scalar) readonly buffer OceanParametersBuffer
+{
+    OceanParameters ocean;
+};
+
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
+{
+    mat4 instanceTransforms[];
+};
+
+// Surface covered by a vertex per unit of distance to the camera. The grid is finer near its
+// center, which follows the camera, so distant vertices average the cascades over coarser levels.
+const float OCEAN_LOD_SCALE = 0.005;
+
+void main()
+{
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    vec4 worldPos = model * vec4(pos, 1.0);
+    fragSurfacePos = worldPos.xz;
+
+    float footprint = distance(worldPos.xyz, pushConstant.cameraPos) * OCEAN_LOD_SCALE;
+    vec3 displacement = vec3(0.0);
+    for (int cascade = 0; cascade < OCEAN_CASCADE_COUNT; cascade++)
+    {
+        float patchSize = ocean.patchSizes[cascade];
+        float lod = log2(max(footprint * OCEAN_FFT_SIZE / patchSize, 1.0));
+        vec3 coords = vec3(worldPos.xz / patchSize, cascade);
+        displacement += textureLod(displacementMap, coords, lod).xyz;
+    }
+    worldPos.xyz += displacement;
+    fragWorldPos = worldPos.xyz;
+
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
+
+    gl_Position = GetViewClipPosition(worldPos);
+}
@@ -3,28 +3,24 @@
 #extension GL_GOOGLE_include_directive : enable
 #extension GL_EXT_scalar_block_layout : enable
 
+#include "scene_view.glsl"
+
 layout(location = 0) in vec3 pos;
 
 layout(location = 0) out vec3 fragWorldPos;
 
-layout(push_constant, scalar) uniform PushConstant
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
 {
-    vec3 cameraPos;
-    mat4 view;
-    mat4 projection;
-
-    vec4 clippingPlane;
-
-    mat4 model;
-}
-pushConstant;
+    mat4 instanceTransforms[];
+};
 
 void main()
 {
-    vec4 worldPos = pushConstant.model * vec4(pos, 1.0);
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    vec4 worldPos = model * vec4(pos, 1.0);
     fragWorldPos = (worldPos).xyz;
 
-    gl_ClipDistance[0] = dot(worldPos, pushConstant.clippingPlane);
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
 
-    gl_Position = pushConstant.projection * pushConstant.view * worldPos;
+    gl_Position = GetViewClipPosition(worldPos);
 }
\ No newline at end of file
@@ -9,11 +9,15 @@ layout(location = 1) in vec3 norm;
 
 layout(location = 0) out vec3 fragWorldPos;
 layout(location = 1) out vec3 fragNorm;
-layout(location = 2) out vec4 fragClipSpace;
-layout(location = 3) out vec2 fragTextureCoords;
+layout(location = 2) out vec2 fragTextureCoords;
 
 const float tiling = 10;
 
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
+{
+    mat4 instanceTransforms[];
+};
+
 layout(push_constant, scalar) uniform PushConstant
 {
     vec3 cameraPos;
@@ -21,20 +25,17 @@ layout(push_constant, scalar) uniform PushConstant
     mat4 projection;
 
     vec4 clippingPlane;
-
-    mat4 model;
 }
 pushConstant;
 
 void main()
 {
-    vec4 worldPos = pushConstant.model * vec4(pos, 1);
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    vec4 worldPos = model * vec4(pos, 1);
     fragWorldPos = worldPos.xyz;
-    fragNorm = normalize((pushConstant.model * vec4(norm, 0)).xyz);
-    vec4 clipSpace = pushConstant.projection * pushConstant.view * worldPos;
-    fragClipSpace = clipSpace;
+    fragNorm = normalize((model * vec4(norm, 0)).xyz);
     fragTextureCoords = vec2(pos.x / 2 + 0.5, pos.z / 2 + 0.5) * tiling;
 
     gl_ClipDistance[0] = dot(worldPos, pushConstant.clippingPlane);
-    gl_Position = clipSpace;
+    gl_Position = pushConstant.projection * pushConstant.view * worldPos;
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+// Color of the sky dome at a world height, shared by the dome and by the reflections that miss
+// the scene
+vec3 SkyColor(float height)
+{
+    float red = -0.00022 * (abs(height) - 2800) + 0.18;
+    float green = -0.00025 * (abs(height) - 2800) + 0.27;
+    float blue = -0.00019 * (abs(height) - 2800) + 0.5;
+    return vec3(red, green, blue);
+}
+
+// Color of the dome (xyz center, w radius), as set by VulkanRenderer::SetSkyDome, seen along
+// direction from a position inside of it
+vec3 SkyColorAlong(vec4 dome, vec3 position, vec3 direction)
+{
+    vec3 offset = position - dome.xyz;
+    float b = dot(offset, direction);
+    float c = dot(offset, offset) - dome.w * dome.w;
+    float t = -b + sqrt(max(b * b - c, 0.0));
+    return SkyColor(position.y + direction.y * t);
+}
@@ -1,9 +1,30 @@
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert.vert -o build/vert.spv
-"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_animation.vert -o build/animation_vert.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert.vert -DMULTIVIEW -o build/vert_mv.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag.frag -o build/frag.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag.frag -DMULTIVIEW -o build/frag_mv.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_skydome.frag -o build/frag_skydome.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_skydome.vert -o build/vert_skydome.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_skydome.vert -DMULTIVIEW -o build/vert_skydome_mv.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_terrain.vert -o build/vert_terrain.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_terrain.vert -DMULTIVIEW -o build/vert_terrain_mv.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_terrain_mesh.vert -o build/vert_terrain_mesh.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_terrain_mesh.vert -DMULTIVIEW -o build/vert_terrain_mesh_mv.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_terrain.frag -o build/frag_terrain.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_terrain.frag -DMULTIVIEW -o build/frag_terrain_mv.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_terrain.frag -DVIRTUAL_TEXTURE -o build/frag_terrain_vt.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_terrain.frag -DVIRTUAL_TEXTURE -DMULTIVIEW -o build/frag_terrain_vt_mv.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_terrain_bake.comp -o build/comp_terrain_bake.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_water.vert -o build/vert_water.spv
 "C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_water.frag -o build/frag_water.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_water.frag -DSCREEN_SPACE_REFLECTION -o build/frag_water_ssr.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_ocean.vert -o build/vert_ocean.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_frag_ocean.frag -o build/frag_ocean.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_ocean_spectrum.comp -o build/comp_ocean_spectrum.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_ocean_time.comp -o build/comp_ocean_time.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_ocean_fft.comp -o build/comp_ocean_fft.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_ocean_resolve.comp -o build/comp_ocean_resolve.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_cull.comp -o build/comp_cull.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_hiz.comp -o build/comp_hiz.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_comp_skinning.comp -o build/comp_skinning.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_crowd.vert -o build/vert_crowd.spv
+"C:/VulkanSDK/1.2.131.2/Bin32/glslc.exe" src/shader_vert_crowd.vert -DMULTIVIEW -o build/vert_crowd_mv.spv
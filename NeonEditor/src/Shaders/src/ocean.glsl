@@ -0,0 +1,36 @@
+// Shared by the ocean shaders, mirrors OceanSimulation.h
+#define OCEAN_FFT_SIZE 256
+#define OCEAN_CASCADE_COUNT 3
+#define OCEAN_REPEAT_PERIOD 200.0
+
+#define OCEAN_SPECTRUM_PHILLIPS 0
+#define OCEAN_SPECTRUM_JONSWAP 1
+
+const float GRAVITY = 9.81;
+const float PI = 3.14159265359;
+
+struct OceanParameters
+{
+    float patchSizes[OCEAN_CASCADE_COUNT];
+    // Band of wave numbers kept by every cascade
+    float cutoffLow[OCEAN_CASCADE_COUNT];
+    float cutoffHigh[OCEAN_CASCADE_COUNT];
+    vec2 windDirection;
+    float windSpeed;
+    float fetch;
+    float amplitude;
+    float choppiness;
+    int spectrum;
+    uint seed;
+};
+
+// Wave vector of a texel of the spectrum of a cascade, the zero frequency is in the middle
+vec2 WaveVector(ivec2 texel, float patchSize)
+{
+    return vec2(texel - OCEAN_FFT_SIZE / 2) * 2.0 * PI / patchSize;
+}
+
+vec2 ComplexMultiply(vec2 a, vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
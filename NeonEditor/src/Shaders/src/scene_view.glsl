@@ -0,0 +1,66 @@
+// Push constant of the scene passes and the view a scene shader draws. Shaders compiled with
+// MULTIVIEW run in multiview passes, whose second view mirrors the camera across the plane
+// y = mirrorHeight. Level of detail follows pushConstant.cameraPos in both views, so they draw the
+// same geometry. Include before any declaration.
+#ifdef MULTIVIEW
+#extension GL_EXT_multiview : enable
+#endif
+
+layout(push_constant, scalar) uniform PushConstant
+{
+    vec3 cameraPos;
+    mat4 view;
+    mat4 projection;
+
+    vec4 clippingPlane;
+
+    int pointLight;
+    float lightIntensity;
+    vec3 lightDirection;
+    vec3 lightPosition;
+
+    float moveFactor;
+    float mirrorHeight;
+    vec4 skyDome;
+}
+pushConstant;
+
+bool IsMirrorView()
+{
+#ifdef MULTIVIEW
+    return gl_ViewIndex == 1;
+#else
+    return false;
+#endif
+}
+
+vec3 MirrorPosition(vec3 position)
+{
+    return vec3(position.x, 2.0 * pushConstant.mirrorHeight - position.y, position.z);
+}
+
+vec3 GetViewCameraPosition()
+{
+    return IsMirrorView() ? MirrorPosition(pushConstant.cameraPos) : pushConstant.cameraPos;
+}
+
+// The mirror view sees the reflection of the scene through the camera, upside down, so its image
+// is flipped back, which also restores the winding of the mirrored triangles
+vec4 GetViewClipPosition(vec4 worldPos)
+{
+    if (!IsMirrorView())
+    {
+        return pushConstant.projection * pushConstant.view * worldPos;
+    }
+    vec4 position = pushConstant.projection * pushConstant.view *
+                    vec4(MirrorPosition(worldPos.xyz), worldPos.w);
+    position.y = -position.y;
+    return position;
+}
+
+// The mirror view keeps the other side of the clipping plane
+float GetViewClipDistance(vec4 worldPos)
+{
+    float distance = dot(worldPos, pushConstant.clippingPlane);
+    return IsMirrorView() ? -distance : distance;
+}
@@ -5,6 +5,7 @@
 #extension GL_GOOGLE_include_directive : enable
 #extension GL_EXT_scalar_block_layout : enable
 
+#include "scene_view.glsl"
 #include "material.glsl"
 
 layout(location = 0) in vec3 fragColor;
@@ -22,23 +23,6 @@ layout(set = 0, binding = 0, scalar) readonly buffer MaterialBufferObject
 };
 layout(set = 0, binding = 1) uniform sampler2D textureSamplers[];
 
-layout(push_constant, scalar) uniform PushConstant
-{
-    vec3 cameraPos;
-    mat4 view;
-    mat4 projection;
-
-    vec4 clippingPlane;
-
-    mat4 model;
-
-    int pointLight;
-    float lightIntensity;
-    vec3 lightDirection;
-    vec3 lightPosition;
-}
-pushConstant;
-
 void main()
 {
     Material mat = materials[fragMatID];
@@ -62,7 +46,7 @@ void main()
         diffuse *= diffuseTxt;
     }
 
-    vec3 viewDir = normalize(pushConstant.cameraPos - fragWorldPos);
+    vec3 viewDir = normalize(GetViewCameraPosition() - fragWorldPos);
     vec3 specular = computeSpecular(mat, viewDir, lightDir, fragNorm);
 
     float gamma = 1. / 2.2;
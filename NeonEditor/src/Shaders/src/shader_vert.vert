@@ -3,6 +3,7 @@
 #extension GL_GOOGLE_include_directive : enable
 #extension GL_EXT_scalar_block_layout : enable
 
+#include "scene_view.glsl"
 #include "material.glsl"
 
 layout(location = 0) in vec3 pos;
@@ -18,30 +19,24 @@ layout(location = 3) out vec2 fragTexCoord;
 layout(location = 4) flat out int fragMatID;
 layout(location = 5) out vec4 clipSpace;
 
-layout(push_constant, scalar) uniform PushConstant
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
 {
-    vec3 cameraPos;
-    mat4 view;
-    mat4 projection;
-
-    vec4 clippingPlane;
-
-    mat4 model;
-}
-pushConstant;
+    mat4 instanceTransforms[];
+};
 
 void main()
 {
+    mat4 model = instanceTransforms[gl_InstanceIndex];
     fragColor = color;
-    fragNorm = normalize((pushConstant.model * vec4(norm, 0)).xyz);
-    vec4 worldPos = pushConstant.model * vec4(pos, 1);
+    fragNorm = normalize((model * vec4(norm, 0)).xyz);
+    vec4 worldPos = model * vec4(pos, 1);
     fragWorldPos = worldPos.xyz;
     fragTexCoord = texCoord;
     fragMatID = matID;
 
-    clipSpace = pushConstant.projection * pushConstant.view * worldPos;
+    clipSpace = GetViewClipPosition(worldPos);
 
-    gl_ClipDistance[0] = dot(worldPos, pushConstant.clippingPlane);
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
 
-    gl_Position = pushConstant.projection * pushConstant.view * worldPos;
+    gl_Position = GetViewClipPosition(worldPos);
 }
\ No newline at end of file
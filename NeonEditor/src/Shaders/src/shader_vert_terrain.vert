@@ -3,13 +3,11 @@
 #extension GL_GOOGLE_include_directive : enable
 #extension GL_EXT_scalar_block_layout : enable
 
+#include "scene_view.glsl"
 #include "material.glsl"
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec3 color;
-layout(location = 3) in vec2 mapTexCoord;
-layout(location = 4) in vec2 tileTexCoord;
+// Position in the chunk grid, in vertices from the chunk origin
+layout(location = 0) in vec2 grid;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 fragNorm;
@@ -17,28 +15,79 @@ layout(location = 2) out vec3 fragWorldPos;
 layout(location = 3) out vec2 fragMapTexCoord;
 layout(location = 4) out vec2 fragTileTexCoord;
 
-layout(push_constant, scalar) uniform PushConstant
+layout(set = 0, binding = 7, scalar) readonly buffer TerrainParameters
 {
-    vec3 cameraPos;
-    mat4 view;
-    mat4 projection;
+    vec2 origin;
+    vec2 texelSize;
+    ivec2 heightMapSize;
+    float minHeight;
+    float heightRange;
+    float lodRange;
+    float morphStart;
+}
+terrain;
+
+layout(set = 0, binding = 8) uniform sampler2D heightMap;
 
-    vec4 clippingPlane;
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
+{
+    mat4 instanceTransforms[];
+};
 
-    mat4 model;
+float SampleHeight(vec2 texel)
+{
+    vec2 uv = (texel + 0.5) / vec2(terrain.heightMapSize);
+    return terrain.minHeight + terrain.heightRange * textureLod(heightMap, uv, 0.0).r;
+}
+
+vec3 GetPosition(vec2 texel)
+{
+    vec2 position = terrain.origin + texel * terrain.texelSize;
+    return vec3(position.x, SampleHeight(texel), position.y);
 }
-pushConstant;
 
 void main()
 {
-    fragColor = color;
-    fragNorm = normalize((pushConstant.model * vec4(norm, 0)).xyz);
-    vec4 worldPos = pushConstant.model * vec4(pos, 1);
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    // The fourth row carries the heightmap texel of the chunk origin and the chunk level
+    vec2 chunkOrigin = vec2(model[0][3], model[1][3]);
+    float level = model[2][3];
+    model[0][3] = 0.0;
+    model[1][3] = 0.0;
+    model[2][3] = 0.0;
+
+    // Grids reaching past the heightmap are clamped to its border
+    float stride = exp2(level);
+    vec2 lastTexel = vec2(terrain.heightMapSize - 1);
+    vec2 texel = min(chunkOrigin + grid * stride, lastTexel);
+
+    float range = terrain.lodRange * stride;
+    float morphStart = terrain.morphStart * range;
+    float distance = length((model * vec4(GetPosition(texel), 1)).xyz - pushConstant.cameraPos);
+    float morph = clamp((distance - morphStart) / (range - morphStart), 0.0, 1.0);
+
+    // Odd vertices of the chunk grid slide onto their even neighbour, which turns the grid into
+    // the one of the next coarser level
+    vec2 morphedGrid = grid - fract(grid * 0.5) * 2.0 * morph;
+    texel = min(chunkOrigin + morphedGrid * stride, lastTexel);
+    vec3 position = GetPosition(texel);
+
+    // Central differences of the neighbouring texels
+    float left = SampleHeight(texel - vec2(1, 0));
+    float right = SampleHeight(texel + vec2(1, 0));
+    float down = SampleHeight(texel - vec2(0, 1));
+    float up = SampleHeight(texel + vec2(0, 1));
+    vec3 normal = vec3((left - right) / (2.0 * terrain.texelSize.x), 1.0,
+                       (down - up) / (2.0 * terrain.texelSize.y));
+
+    fragColor = vec3(0.0);
+    fragNorm = normalize((model * vec4(normal, 0)).xyz);
+    vec4 worldPos = model * vec4(position, 1);
     fragWorldPos = worldPos.xyz;
-    fragMapTexCoord = mapTexCoord;
-    fragTileTexCoord = tileTexCoord;
+    fragMapTexCoord = texel / vec2(terrain.heightMapSize);
+    fragTileTexCoord = texel * 0.5;
 
-    gl_ClipDistance[0] = dot(worldPos, pushConstant.clippingPlane);
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
 
-    gl_Position = pushConstant.projection * pushConstant.view * worldPos;
-}
\ No newline at end of file
+    gl_Position = GetViewClipPosition(worldPos);
+}
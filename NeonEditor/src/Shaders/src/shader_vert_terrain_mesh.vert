@@ -0,0 +1,76 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+
+#include "scene_view.glsl"
+#include "material.glsl"
+
+// Quads per side of a terrain chunk, matches TERRAIN_CHUNK_SIZE
+#define CHUNK_SIZE 64
+#define CHUNK_ROW_LENGTH (CHUNK_SIZE + 1)
+
+struct TerrainVertex
+{
+    vec3 pos;
+    vec3 norm;
+    vec3 color;
+    vec2 mapTexCoord;
+    vec2 tileTexCoord;
+};
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec3 color;
+layout(location = 3) in vec2 mapTexCoord;
+layout(location = 4) in vec2 tileTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNorm;
+layout(location = 2) out vec3 fragWorldPos;
+layout(location = 3) out vec2 fragMapTexCoord;
+layout(location = 4) out vec2 fragTileTexCoord;
+
+// Vertices of every chunk, each chunk starts at a multiple of CHUNK_ROW_LENGTH^2
+layout(set = 0, binding = 6, scalar) readonly buffer VertexBuffer
+{
+    TerrainVertex vertices[];
+};
+
+layout(set = 1, binding = 0, scalar) readonly buffer InstanceBuffer
+{
+    mat4 instanceTransforms[];
+};
+
+void main()
+{
+    mat4 model = instanceTransforms[gl_InstanceIndex];
+    // The fourth row carries the distances over which the chunk morphs to the next level
+    vec2 morphRange = vec2(model[0][3], model[1][3]);
+    model[0][3] = 0.0;
+    model[1][3] = 0.0;
+
+    // Odd vertices of the chunk grid slide onto their even neighbour, which turns the grid into
+    // the one of the next coarser level
+    int chunkVertex = gl_VertexIndex % (CHUNK_ROW_LENGTH * CHUNK_ROW_LENGTH);
+    int column = chunkVertex % CHUNK_ROW_LENGTH;
+    int row = chunkVertex / CHUNK_ROW_LENGTH;
+    TerrainVertex target = vertices[gl_VertexIndex - (column & 1) - (row & 1) * CHUNK_ROW_LENGTH];
+    float morph = 0.0;
+    if (morphRange.y > morphRange.x)
+    {
+        float distance = length((model * vec4(pos, 1)).xyz - pushConstant.cameraPos);
+        morph = clamp((distance - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    }
+
+    fragColor = color;
+    fragNorm = normalize((model * vec4(mix(norm, target.norm, morph), 0)).xyz);
+    vec4 worldPos = model * vec4(mix(pos, target.pos, morph), 1);
+    fragWorldPos = worldPos.xyz;
+    fragMapTexCoord = mix(mapTexCoord, target.mapTexCoord, morph);
+    fragTileTexCoord = mix(tileTexCoord, target.tileTexCoord, morph);
+
+    gl_ClipDistance[0] = GetViewClipDistance(worldPos);
+
+    gl_Position = GetViewClipPosition(worldPos);
+}
\ No newline at end of file
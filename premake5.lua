@@ -85,6 +85,13 @@ project "Neon"
 			"NEO_PLATFORM_WINDOWS",
 		}
 
+		-- SPIR-V is rebuilt from the shader sources with the library, so that every application
+		-- linking it loads binaries matching them
+		prebuildcommands
+		{
+			'cd "%{prj.location}src/Shaders" && call compile.bat'
+		}
+
 	filter "configurations:Debug"
 		defines "NEO_DEBUG"
 		symbols "On"
@@ -133,6 +140,12 @@ project "NeonEditor"
 		{ 
 			"NEO_PLATFORM_WINDOWS"
 		}
+
+		-- The editor runs from its own copy of the shaders, rebuilt like the library's
+		prebuildcommands
+		{
+			'cd "%{prj.location}src/Shaders" && call compile.bat'
+		}
 	
 	filter "configurations:Debug"
 		defines "NEO_DEBUG"